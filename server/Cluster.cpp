@@ -0,0 +1,412 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <sys/stat.h>
+#include <cstring>
+#include <atomic>
+#include <fstream>
+#include <unordered_map>
+#include "Util/util.h"
+#include "Util/logger.h"
+#include "Util/onceToken.h"
+#include "Util/TimeTicker.h"
+#include "Common/config.h"
+#include "Rtsp/Rtsp.h"
+#include "Cluster.h"
+#include "WebHook.h"
+#include "WebApi.h"
+
+using namespace std;
+using namespace Json;
+using namespace toolkit;
+using namespace mediakit;
+
+namespace Cluster {
+#define CLUSTER_FIELD "cluster."
+const string kOriginUrl = CLUSTER_FIELD "origin_url";
+const string kTimeoutSec = CLUSTER_FIELD "timeout_sec";
+const string kRetryCount = CLUSTER_FIELD "retry_count";
+const string kOriginDirectory = CLUSTER_FIELD "origin_directory";
+const string kDirectoryCacheSec = CLUSTER_FIELD "directory_cache_sec";
+const string kMaxHops = CLUSTER_FIELD "max_hops";
+
+static onceToken token([]() {
+    mINI::Instance()[kOriginUrl] = "";
+    mINI::Instance()[kTimeoutSec] = 15;
+    mINI::Instance()[kRetryCount] = 3;
+    mINI::Instance()[kOriginDirectory] = "";
+    mINI::Instance()[kDirectoryCacheSec] = 5;
+    mINI::Instance()[kMaxHops] = 4;
+});
+
+}//namespace Cluster
+
+static const string kEdgeServerParam = "edge=1";
+static const string kEdgeHopParam = "cluster_hop";
+
+static vector<string> splitOriginUrls(const string &str) {
+    vector<string> ret;
+    for (auto &url : split(str, ";")) {
+        trim(url);
+        if (!url.empty()) {
+            ret.emplace_back(url);
+        }
+    }
+    return ret;
+}
+
+static string getStreamKey(const MediaInfo &info) {
+    return info._vhost + "/" + info._app + "/" + info._streamid;
+}
+
+// 获取本请求所在的溯源级数，播放器直接请求时为0
+static int getHop(const MediaInfo &info) {
+    auto params = Parser::parseArgs(info._param_strs);
+    auto it = params.find(kEdgeHopParam);
+    if (it == params.end()) {
+        return ClusterRelay::isEdgeRequest(info) ? 1 : 0;
+    }
+    return atoi(it->second.data());
+}
+
+// 获取源站url
+static string getPullUrl(const string &origin_fmt, const MediaInfo &info) {
+    char url[1024] = { 0 };
+    if ((ssize_t)origin_fmt.size() > snprintf(url, sizeof(url), origin_fmt.data(), info._app.data(), info._streamid.data())) {
+        WarnL << "get origin url failed, origin_fmt:" << origin_fmt;
+        return "";
+    }
+    //去除下一级边沿站附带的集群参数，防止多级溯源时参数不断累加
+    string params;
+    for (auto &item : split(info._param_strs, "&")) {
+        auto key = FindField(item.data(), nullptr, "=");
+        if (item.empty() || item == kEdgeServerParam || key == kEdgeHopParam || key == VHOST_KEY) {
+            continue;
+        }
+        params.append(item).push_back('&');
+    }
+    if (!params.empty()) {
+        params.pop_back();
+    }
+    //告知源站这是来自边沿站的拉流请求，如果未找到流请立即返回拉流失败
+    return string(url) + '?' + kEdgeServerParam + '&' + kEdgeHopParam + '=' + to_string(getHop(info) + 1) + '&' + VHOST_KEY + '='
+        + info._vhost + '&' + params;
+}
+
+static void pullStreamFromOrigin(const vector<string> &urls, size_t index, size_t failed_cnt, const MediaInfo &args,
+                                 const function<void(bool success)> &cb) {
+    GET_CONFIG(float, cluster_timeout_sec, Cluster::kTimeoutSec);
+    GET_CONFIG(int, retry_count, Cluster::kRetryCount);
+
+    auto url = getPullUrl(urls[index % urls.size()], args);
+    auto timeout_sec = cluster_timeout_sec / urls.size();
+    InfoL << "pull stream from origin, failed_cnt: " << failed_cnt << ", timeout_sec: " << timeout_sec << ", url: " << url;
+
+    ProtocolOption option;
+    option.enable_hls =  option.enable_hls || (args._schema == HLS_SCHEMA);
+    option.enable_mp4 = false;
+
+    addStreamProxy(args._vhost, args._app, args._streamid, url, retry_count, option, Rtsp::RTP_TCP, timeout_sec,
+                  [=](const SockException &ex, const string &key) mutable {
+        if (!ex) { // pull ok
+            cb(true);
+            return;
+        }
+        //拉流失败
+        if (++failed_cnt == urls.size()) {
+            //已经重试所有源站了
+            WarnL << "pull stream from origin final failed: " << url;
+            cb(false);
+        }
+        else { // try next
+           pullStreamFromOrigin(urls, index + 1, failed_cnt, args, cb);
+        }
+    });
+}
+
+/////////////////////////////////////////StaticOriginDirectory/////////////////////////////////////////
+
+/**
+ * 固定源站，即cluster.origin_url配置，多个源站轮询
+ */
+class StaticOriginDirectory : public OriginDirectory {
+public:
+    StaticOriginDirectory(vector<string> urls) : _urls(std::move(urls)) {}
+
+    void lookup(const MediaInfo &info, const onLookup &cb) override {
+        //每次从不同的源站开始尝试
+        auto index = _index++ % _urls.size();
+        vector<string> ret;
+        for (size_t i = 0; i < _urls.size(); ++i) {
+            ret.emplace_back(_urls[(index + i) % _urls.size()]);
+        }
+        cb(ret, "");
+    }
+
+private:
+    atomic<size_t> _index { 0 };
+    vector<string> _urls;
+};
+
+/////////////////////////////////////////FileOriginDirectory/////////////////////////////////////////
+
+/**
+ * 文件源站目录，每行格式为: app/stream 源站url模板(多个以分号分隔)
+ * app和stream可以为*，匹配优先级为app/stream > app/* > * /*，#开头的行为注释
+ * 文件修改后自动重新加载
+ */
+class FileOriginDirectory : public OriginDirectory {
+public:
+    FileOriginDirectory(string path) : _path(std::move(path)) {}
+
+    void lookup(const MediaInfo &info, const onLookup &cb) override {
+        vector<string> ret;
+        {
+            lock_guard<mutex> lck(_mtx);
+            reload();
+            for (auto key : { info._app + "/" + info._streamid, info._app + "/*", string("*/*") }) {
+                auto it = _origins.find(key);
+                if (it != _origins.end()) {
+                    ret = it->second;
+                    break;
+                }
+            }
+        }
+        cb(ret, ret.empty() ? "origin not found in directory file: " + _path : "");
+    }
+
+private:
+    void reload() {
+        struct stat st;
+        if (stat(_path.data(), &st) != 0) {
+            WarnL << "stat origin directory file failed: " << _path << " " << strerror(errno);
+            return;
+        }
+        if (st.st_mtime == _mtime) {
+            return;
+        }
+        _mtime = st.st_mtime;
+        _origins.clear();
+
+        ifstream file(_path);
+        string line;
+        while (getline(file, line)) {
+            trim(line);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            auto pos = line.find_first_of(" \t");
+            if (pos == string::npos) {
+                WarnL << "invalid origin directory line: " << line;
+                continue;
+            }
+            auto urls = splitOriginUrls(line.substr(pos + 1));
+            if (!urls.empty()) {
+                _origins[line.substr(0, pos)] = std::move(urls);
+            }
+        }
+        InfoL << "origin directory file loaded: " << _path << ", rules: " << _origins.size();
+    }
+
+private:
+    string _path;
+    time_t _mtime = 0;
+    mutex _mtx;
+    unordered_map<string, vector<string> > _origins;
+};
+
+/////////////////////////////////////////HttpOriginDirectory/////////////////////////////////////////
+
+//http源站目录缓存个数达到该值后开始清理过期项
+static constexpr size_t kMinSweepSize = 1024;
+//http源站目录最多缓存的流个数
+static constexpr size_t kMaxCacheSize = 100 * 1024;
+
+/**
+ * http源站目录，post json请求{"vhost","app","stream","schema"}，
+ * 回复{"code":0,"origins":["rtmp://127.0.0.1:1935/%s/%s"]}，查询结果缓存cluster.directory_cache_sec秒
+ */
+class HttpOriginDirectory : public OriginDirectory {
+public:
+    HttpOriginDirectory(string url) : _url(std::move(url)) {}
+
+    void lookup(const MediaInfo &info, const onLookup &cb) override {
+        GET_CONFIG(float, cache_sec, Cluster::kDirectoryCacheSec);
+        auto key = getStreamKey(info);
+        vector<string> cached;
+        {
+            lock_guard<mutex> lck(_mtx);
+            auto it = _cache.find(key);
+            if (it != _cache.end()) {
+                if (it->second.first.elapsedTime() < cache_sec * 1000) {
+                    cached = it->second.second;
+                } else {
+                    _cache.erase(it);
+                }
+            }
+        }
+        if (!cached.empty()) {
+            cb(cached, "");
+            return;
+        }
+
+        ArgsType body;
+        body["schema"] = info._schema;
+        body[VHOST_KEY] = info._vhost;
+        body["app"] = info._app;
+        body["stream"] = info._streamid;
+        weak_ptr<HttpOriginDirectory> weak_self = static_pointer_cast<HttpOriginDirectory>(shared_from_this());
+        do_http_hook(_url, body, [weak_self, key, cb](const Value &obj, const string &err) {
+            if (!err.empty()) {
+                cb({}, err);
+                return;
+            }
+            vector<string> urls;
+            for (auto &url : obj["origins"]) {
+                urls.emplace_back(url.asString());
+            }
+            if (urls.empty()) {
+                cb(urls, "origin not found in directory");
+                return;
+            }
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->addCache(key, urls);
+            }
+            cb(urls, "");
+        });
+    }
+
+private:
+    void addCache(const string &key, const vector<string> &urls) {
+        GET_CONFIG(float, cache_sec, Cluster::kDirectoryCacheSec);
+        if (cache_sec <= 0) {
+            return;
+        }
+        lock_guard<mutex> lck(_mtx);
+        if (_cache.size() >= _sweep_size) {
+            //过期的流只有再次查询时才会被删除，缓存个数翻倍时清理一次过期项，均摊开销为常数
+            for (auto it = _cache.begin(); it != _cache.end();) {
+                if (it->second.first.elapsedTime() >= cache_sec * 1000) {
+                    it = _cache.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            _sweep_size = MAX(kMinSweepSize, 2 * _cache.size());
+        }
+        if (_cache.size() >= kMaxCacheSize && !_cache.count(key)) {
+            //未过期的流也太多了，不再缓存
+            return;
+        }
+        _cache[key] = make_pair(Ticker(), urls);
+    }
+
+private:
+    string _url;
+    mutex _mtx;
+    size_t _sweep_size = kMinSweepSize;
+    unordered_map<string, pair<Ticker, vector<string> > > _cache;
+};
+
+OriginDirectory::Ptr OriginDirectory::create(const string &directory, const vector<string> &origin_urls) {
+    if (start_with(directory, "http://") || start_with(directory, "https://")) {
+        return std::make_shared<HttpOriginDirectory>(directory);
+    }
+    if (!directory.empty()) {
+        return std::make_shared<FileOriginDirectory>(directory);
+    }
+    if (!origin_urls.empty()) {
+        return std::make_shared<StaticOriginDirectory>(origin_urls);
+    }
+    return nullptr;
+}
+
+/////////////////////////////////////////ClusterRelay/////////////////////////////////////////
+
+INSTANCE_IMP(ClusterRelay)
+
+bool ClusterRelay::isEdgeRequest(const MediaInfo &args) {
+    return start_with(args._param_strs, kEdgeServerParam);
+}
+
+OriginDirectory::Ptr ClusterRelay::getDirectory() {
+    GET_CONFIG(string, directory, Cluster::kOriginDirectory);
+    GET_CONFIG(string, origin_url, Cluster::kOriginUrl);
+    lock_guard<recursive_mutex> lck(_mtx);
+    if (!_directory || directory != _directory_conf || origin_url != _origin_url_conf) {
+        //配置发生变更，重新创建目录
+        _directory_conf = directory;
+        _origin_url_conf = origin_url;
+        _directory = OriginDirectory::create(directory, splitOriginUrls(origin_url));
+    }
+    return _directory;
+}
+
+bool ClusterRelay::enabled() {
+    return getDirectory() != nullptr;
+}
+
+void ClusterRelay::pull(const MediaInfo &args, const function<void()> &close_player) {
+    auto directory = getDirectory();
+    if (!directory) {
+        close_player();
+        return;
+    }
+
+    GET_CONFIG(int, max_hops, Cluster::kMaxHops);
+    auto hop = getHop(args);
+    if (hop >= max_hops) {
+        WarnL << "cluster relay exceed max hops(" << hop << "), stop pulling: " << args.getUrl();
+        close_player();
+        return;
+    }
+
+    auto key = getStreamKey(args);
+    {
+        lock_guard<recursive_mutex> lck(_mtx);
+        auto &waiters = _pending[key];
+        waiters.emplace_back(close_player);
+        if (waiters.size() > 1) {
+            //该流正在溯源，合并请求，等待同一结果
+            DebugL << "cluster relay in progress, waiters: " << waiters.size() << ", " << key;
+            return;
+        }
+    }
+
+    directory->lookup(args, [this, args, key](const vector<string> &urls, const string &err) {
+        if (!err.empty() || urls.empty()) {
+            WarnL << "lookup origin failed: " << key << ", " << err;
+            onResult(key, false);
+            return;
+        }
+        pullStreamFromOrigin(urls, 0, 0, args, [this, key](bool success) { onResult(key, success); });
+    });
+}
+
+void ClusterRelay::onResult(const string &key, bool success) {
+    list<function<void()> > waiters;
+    {
+        lock_guard<recursive_mutex> lck(_mtx);
+        auto it = _pending.find(key);
+        if (it == _pending.end()) {
+            return;
+        }
+        waiters.swap(it->second);
+        _pending.erase(it);
+    }
+    if (success) {
+        //拉流成功，播放器监听到媒体注册事件后会自行回复
+        return;
+    }
+    for (auto &close_player : waiters) {
+        close_player();
+    }
+}
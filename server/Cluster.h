@@ -0,0 +1,109 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_CLUSTER_H
+#define ZLMEDIAKIT_CLUSTER_H
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "Common/MediaSource.h"
+
+namespace Cluster {
+//源站拉流url模板，多个以分号分隔
+extern const std::string kOriginUrl;
+//溯源总超时时长
+extern const std::string kTimeoutSec;
+//溯源失败尝试次数
+extern const std::string kRetryCount;
+//源站目录，为文件路径或http地址，设置后优先于kOriginUrl
+extern const std::string kOriginDirectory;
+//http源站目录查询结果缓存时长
+extern const std::string kDirectoryCacheSec;
+//多级溯源最大级数，防止配置错误导致溯源环路
+extern const std::string kMaxHops;
+}//namespace Cluster
+
+/**
+ * 源站目录，查找某个流归属的源站(或上一级边沿站)
+ */
+class OriginDirectory : public std::enable_shared_from_this<OriginDirectory> {
+public:
+    using Ptr = std::shared_ptr<OriginDirectory>;
+    /**
+     * 查找结果回调
+     * @param urls 源站拉流url模板列表，格式同cluster.origin_url，按优先级排列
+     * @param err 错误描述，为空代表成功
+     */
+    using onLookup = std::function<void(const std::vector<std::string> &urls, const std::string &err)>;
+
+    virtual ~OriginDirectory() = default;
+
+    /**
+     * 查找流归属的源站，cb可能在任意线程回调
+     */
+    virtual void lookup(const mediakit::MediaInfo &info, const onLookup &cb) = 0;
+
+    /**
+     * 根据配置创建源站目录
+     * @param directory 以http://或https://开头时为http目录，否则为文件目录
+     * @param origin_urls 未配置目录时使用的固定源站
+     * @return 未配置任何源站时返回nullptr
+     */
+    static Ptr create(const std::string &directory, const std::vector<std::string> &origin_urls);
+};
+
+/**
+ * 集群溯源
+ * 边沿站播放的流不存在时，通过源站目录找到源站并拉流(复用PlayerProxy)；
+ * 同一个流的并发播放请求只会触发一次目录查询和一次拉流，其他请求等待同一结果；
+ * 上一级也可以是边沿站，从而组成多级分发树，减少源站出口带宽。
+ */
+class ClusterRelay {
+public:
+    static ClusterRelay &Instance();
+
+    /**
+     * 是否开启了集群模式
+     */
+    bool enabled();
+
+    /**
+     * 播放的流不存在，开始溯源
+     * @param args 播放url信息
+     * @param close_player 溯源失败时调用，立即断开播放器
+     */
+    void pull(const mediakit::MediaInfo &args, const std::function<void()> &close_player);
+
+    /**
+     * 判断是否为来自下一级边沿站的溯源请求
+     */
+    static bool isEdgeRequest(const mediakit::MediaInfo &args);
+
+private:
+    ClusterRelay() = default;
+
+    OriginDirectory::Ptr getDirectory();
+    void onResult(const std::string &key, bool success);
+
+private:
+    std::recursive_mutex _mtx;
+    std::string _directory_conf;
+    std::string _origin_url_conf;
+    OriginDirectory::Ptr _directory;
+    //正在溯源的流及其等待中的播放器
+    std::map<std::string, std::list<std::function<void()> > > _pending;
+};
+
+#endif //ZLMEDIAKIT_CLUSTER_H
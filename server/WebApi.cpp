@@ -23,6 +23,12 @@
 #endif //ENABLE_MYSQL
 #include "Common/config.h"
 #include "Common/MediaSource.h"
+#include "Common/SendBatchStatistic.h"
+#include "Common/PacketPool.h"
+#include "Common/Metrics.h"
+#include "Record/DiskWriter.h"
+#include "Record/RecordIndex.h"
+#include "Common/FileChunkCache.h"
 #include "Http/HttpRequester.h"
 #include "Http/HttpSession.h"
 #include "Network/TcpServer.h"
@@ -38,6 +44,12 @@
 #if defined(ENABLE_RTPPROXY)
 #include "Rtp/RtpServer.h"
 #endif
+#if defined(ENABLE_FFMPEG)
+#include "Codec/Transcoder.h"
+#endif
+#if defined(ENABLE_MP4)
+#include "Record/MP4Reader.h"
+#endif
 #ifdef ENABLE_WEBRTC
 #include "../webrtc/WebRtcPlayer.h"
 #include "../webrtc/WebRtcPusher.h"
@@ -439,6 +451,23 @@ void getStatisticJson(const function<void(Value &val)> &cb) {
     val["MediaSource"] = (Json::UInt64)(ObjectStatistic<MediaSource>::count());
     val["MultiMediaSourceMuxer"] = (Json::UInt64)(ObjectStatistic<MultiMediaSourceMuxer>::count());
 
+    {
+        //按需拉流请求合并统计
+        auto stat = MediaSource::getFindAsyncStatistic();
+        Value find_async;
+        find_async["flights"] = (Json::UInt64) stat.flights;
+        find_async["waiters"] = (Json::UInt64) stat.waiters;
+        find_async["coalesced"] = (Json::UInt64) stat.coalesced;
+        find_async["resolved"] = (Json::UInt64) stat.resolved;
+        find_async["timeout"] = (Json::UInt64) stat.timeout;
+        find_async["closed"] = (Json::UInt64) stat.closed;
+        find_async["pendingFlights"] = (Json::UInt64) stat.pending_flights;
+        find_async["pendingWaiters"] = (Json::UInt64) stat.pending_waiters;
+        find_async["latencyAvgMS"] = (Json::UInt64) (stat.latency_count ? stat.latency_total_ms / stat.latency_count : 0);
+        find_async["latencyMaxMS"] = (Json::UInt64) stat.latency_max_ms;
+        val["FindAsync"] = find_async;
+    }
+
     val["TcpServer"] = (Json::UInt64)(ObjectStatistic<TcpServer>::count());
     val["TcpSession"] = (Json::UInt64)(ObjectStatistic<TcpSession>::count());
     val["UdpServer"] = (Json::UInt64)(ObjectStatistic<UdpServer>::count());
@@ -456,6 +485,16 @@ void getStatisticJson(const function<void(Value &val)> &cb) {
 
     val["RtpPacket"] = (Json::UInt64)(ObjectStatistic<RtpPacket>::count());
     val["RtmpPacket"] = (Json::UInt64)(ObjectStatistic<RtmpPacket>::count());
+
+    PacketPoolRegistry::for_each([&](const string &name, const PacketPoolStatistic &stat) {
+        Value pool;
+        pool["hit"] = (Json::UInt64) stat.hit;
+        pool["miss"] = (Json::UInt64) stat.miss;
+        pool["recycle"] = (Json::UInt64) stat.recycle;
+        pool["drop"] = (Json::UInt64) stat.drop;
+        pool["cached"] = (Json::UInt64) stat.cached;
+        val["PacketPool"][name] = pool;
+    });
 #ifdef ENABLE_MEM_DEBUG
     auto bytes = getTotalMemUsage();
     val["totalMemUsage"] = (Json::UInt64) bytes;
@@ -571,6 +610,7 @@ static void getArgsValue(const HttpAllArgs<ApiArgsType> &allArgs, const string &
  */
 void installWebApi() {
     addHttpListener();
+    Metrics::Instance().startSampler();
     GET_CONFIG(string, api_secret, API::kSecret);
 
     //获取线程负载
@@ -1290,6 +1330,139 @@ void installWebApi() {
 
 #endif//ENABLE_RTPPROXY
 
+#if defined(ENABLE_FFMPEG)
+    // 开始转码，转码后的流以新的流id注册
+    api_regist("/index/api/startTranscode", [](API_ARGS_MAP_ASYNC) {
+        CHECK_SECRET();
+        CHECK_ARGS("vhost", "app", "stream");
+
+        auto src = MediaSource::find(allArgs["vhost"], allArgs["app"], allArgs["stream"]);
+        if (!src) {
+            throw ApiRetException("can not find the source stream", API::NotFound);
+        }
+
+        auto get_codec = [](const string &str, CodecId def) -> CodecId {
+            if (str.empty()) {
+                return def;
+            }
+            if (str == "none") {
+                //不输出该类型track
+                return CodecInvalid;
+            }
+            if (strcasecmp(str.data(), "aac") == 0) {
+                return CodecAAC;
+            }
+            auto ret = getCodecId(str);
+            if (ret == CodecInvalid) {
+                throw InvalidArgsException("invalid codec:" + str);
+            }
+            return ret;
+        };
+
+        MediaSourceEvent::TranscodeArgs args;
+        args.stream_id = allArgs["dst_stream"];
+        args.video_codec = get_codec(allArgs["video_codec"], CodecH264);
+        args.audio_codec = get_codec(allArgs["audio_codec"], CodecAAC);
+        args.width = allArgs["width"];
+        args.height = allArgs["height"];
+        args.video_bitrate = allArgs["video_bitrate"];
+        args.audio_bitrate = allArgs["audio_bitrate"];
+        args.thread_num = allArgs["thread_num"].empty() ? 2 : allArgs["thread_num"].as<int>();
+        // 多码率格式: 宽x高[@码率],...，宽或高为0时等比缩放，也可以简写为720p[@码率]
+        // 例如: renditions=1920x1080@4000000,720p@2000000,360p@800000
+        for (auto &item : split(allArgs["renditions"], ",")) {
+            trim(item);
+            if (item.empty()) {
+                continue;
+            }
+            MediaSourceEvent::TranscodeArgs::Rendition rendition;
+            auto pos = item.find('@');
+            if (pos != string::npos) {
+                rendition.video_bitrate = atoi(item.data() + pos + 1);
+                item = item.substr(0, pos);
+            }
+            if (end_with(item, "p")) {
+                rendition.height = atoi(item.data());
+            } else if ((pos = item.find('x')) != string::npos) {
+                rendition.width = atoi(item.data());
+                rendition.height = atoi(item.data() + pos + 1);
+            }
+            if (!rendition.width && !rendition.height) {
+                throw InvalidArgsException("invalid rendition:" + item);
+            }
+            args.renditions.emplace_back(std::move(rendition));
+        }
+
+        src->getOwnerPoller()->async([=]() mutable {
+            src->startTranscode(args, [val, headerOut, invoker, args, src](const SockException &ex) mutable {
+                if (ex) {
+                    val["code"] = API::OtherFailed;
+                    val["msg"] = ex.what();
+                } else {
+                    val["stream"] = args.stream_id.empty() ? src->getId() + "_transcoded" : args.stream_id;
+                }
+                invoker(200, headerOut, val.toStyledString());
+            });
+        });
+    });
+
+    api_regist("/index/api/stopTranscode", [](API_ARGS_MAP_ASYNC) {
+        CHECK_SECRET();
+        CHECK_ARGS("vhost", "app", "stream");
+
+        auto src = MediaSource::find(allArgs["vhost"], allArgs["app"], allArgs["stream"]);
+        if (!src) {
+            throw ApiRetException("can not find the stream", API::NotFound);
+        }
+
+        src->getOwnerPoller()->async([=]() mutable {
+            // dst_stream如果为空，关闭全部
+            if (!src->stopTranscode(allArgs["dst_stream"])) {
+                val["code"] = API::OtherFailed;
+                val["msg"] = "stopTranscode failed";
+            }
+            invoker(200, headerOut, val.toStyledString());
+        });
+    });
+
+    // 获取所有转码任务及其负载
+    api_regist("/index/api/getTranscodeList", [](API_ARGS_MAP) {
+        CHECK_SECRET();
+        val["data"] = Value(arrayValue);
+        Transcoder::for_each([&](const Transcoder &transcoder) {
+            Value obj;
+            obj["src_url"] = transcoder.getSourceUrl();
+            obj["stream"] = transcoder.getStreamId();
+            obj["duration"] = (Json::UInt64) transcoder.getDuration();
+            for (auto &info : transcoder.getStatistic()) {
+                Value track;
+                track["codec_type"] = info.type;
+                track["src_codec"] = getCodecName(info.src_codec);
+                track["frames_in"] = (Json::UInt64) info.frames_in;
+                track["frames_decoded"] = (Json::UInt64) info.frames_decoded;
+                track["decode_queue"] = (Json::UInt64) info.decode_queue;
+                track["decode_drop"] = (Json::UInt64) info.decode_drop;
+                track["decode_cpu_ms"] = (Json::UInt64) (info.decode_cpu_us / 1000);
+                track["encoders"] = Value(arrayValue);
+                for (auto &enc : info.encoders) {
+                    Value encoder;
+                    encoder["stream"] = enc.stream_id;
+                    encoder["codec"] = getCodecName(enc.codec);
+                    encoder["width"] = enc.width;
+                    encoder["height"] = enc.height;
+                    encoder["frames_encoded"] = (Json::UInt64) enc.frames_encoded;
+                    encoder["queue"] = (Json::UInt64) enc.queue;
+                    encoder["drop"] = (Json::UInt64) enc.drop;
+                    encoder["cpu_ms"] = (Json::UInt64) (enc.cpu_us / 1000);
+                    track["encoders"].append(encoder);
+                }
+                obj["tracks"].append(track);
+            }
+            val["data"].append(obj);
+        });
+    });
+#endif//ENABLE_FFMPEG
+
     // 开始录制hls或MP4
     api_regist("/index/api/startRecord",[](API_ARGS_MAP_ASYNC){
         CHECK_SECRET();
@@ -1344,11 +1517,13 @@ void installWebApi() {
 
         auto stamp = allArgs["stamp"].as<size_t>();
         src->getOwnerPoller()->async([=]() mutable {
-            bool flag = src->seekTo(stamp);
-            val["result"] = flag ? 0 : -1;
-            val["msg"] = flag ? "success" : "seek failed";
-            val["code"] = flag ? API::Success : API::OtherFailed;
-            invoker(200, headerOut, val.toStyledString());
+            //点播文件可能在读文件线程中seek，完成后再回复
+            src->seekToAsync(stamp, [=](bool flag) mutable {
+                val["result"] = flag ? 0 : -1;
+                val["msg"] = flag ? "success" : "seek failed";
+                val["code"] = flag ? API::Success : API::OtherFailed;
+                invoker(200, headerOut, val.toStyledString());
+            });
         });
     });
 
@@ -1443,6 +1618,74 @@ void installWebApi() {
         val["data"]["paths"] = paths;
     });
 
+    static auto getRecordTimeRange = [](const HttpAllArgs<ApiArgsType> &allArgs, uint64_t &start_ms, uint64_t &end_ms) {
+        //unix时间戳，单位秒，可以带小数
+        start_ms = allArgs["start_time"].empty() ? 0 : (uint64_t)(allArgs["start_time"].as<double>() * 1000);
+        end_ms = allArgs["end_time"].empty() ? UINT64_MAX : (uint64_t)(allArgs["end_time"].as<double>() * 1000);
+        if (start_ms >= end_ms) {
+            throw InvalidArgsException("end_time must be greater than start_time");
+        }
+    };
+
+    // 按时间查询录制索引，不需要扫描录像目录
+    // 测试url http://127.0.0.1/index/api/getRecordIndex?vhost=__defaultVhost__&app=live&stream=obs&type=mp4&start_time=1700000000&end_time=1700003600
+    api_regist("/index/api/getRecordIndex", [](API_ARGS_MAP) {
+        CHECK_SECRET();
+        CHECK_ARGS("vhost", "app", "stream");
+        string type = allArgs["type"];
+        if (!type.empty() && type != "mp4" && type != "hls") {
+            throw InvalidArgsException("type must be mp4 or hls");
+        }
+        auto record_path = Recorder::getRecordPath(type == "hls" ? Recorder::type_hls : Recorder::type_mp4, allArgs["vhost"], allArgs["app"], allArgs["stream"], allArgs["customized_path"]);
+        //hls返回的是m3u8文件路径，切片在其所在目录下
+        auto folder = record_path.substr(0, record_path.rfind('/') + 1);
+        uint64_t start_ms, end_ms;
+        getRecordTimeRange(allArgs, start_ms, end_ms);
+        val["data"] = Value(arrayValue);
+        for (auto &segment : RecordIndex::Instance().getSegments(folder, start_ms, end_ms)) {
+            Value obj;
+            obj["start_time_ms"] = (Json::UInt64) segment.start_ms;
+            obj["duration_ms"] = (Json::UInt64) segment.duration_ms;
+            obj["file_path"] = segment.path;
+            val["data"].append(obj);
+        }
+    });
+
+#if defined(ENABLE_MP4)
+    // 从任意时间点开始跨mp4录像文件连续点播，生成的流在无人观看时自动关闭
+    // 测试url http://127.0.0.1/index/api/loadRecordTimeline?vhost=__defaultVhost__&app=live&stream=obs&start_time=1700000000
+    api_regist("/index/api/loadRecordTimeline", [](API_ARGS_MAP) {
+        CHECK_SECRET();
+        CHECK_ARGS("vhost", "app", "stream", "start_time");
+        GET_CONFIG(string, record_app, Record::kAppName);
+        auto folder = Recorder::getRecordPath(Recorder::type_mp4, allArgs["vhost"], allArgs["app"], allArgs["stream"], allArgs["customized_path"]);
+        uint64_t start_ms, end_ms;
+        getRecordTimeRange(allArgs, start_ms, end_ms);
+        auto segments = RecordIndex::Instance().getSegments(folder, start_ms, end_ms);
+        if (segments.empty()) {
+            throw ApiRetException("can not find any record in this time range", API::NotFound);
+        }
+        //开始时间落在录制中断期间时，从下一个切片开始播放
+        uint32_t start_stamp = start_ms > segments.front().start_ms ? (uint32_t)(start_ms - segments.front().start_ms) : 0;
+        uint64_t duration_ms = 0;
+        for (auto &segment : segments) {
+            duration_ms += segment.duration_ms;
+        }
+        string dst_stream = allArgs["dst_stream"];
+        if (dst_stream.empty()) {
+            dst_stream = allArgs["app"] + "/" + allArgs["stream"] + "/" + to_string(start_ms);
+        }
+        if (!MediaSource::find(allArgs["vhost"], record_app, dst_stream)) {
+            auto reader = std::make_shared<MP4Reader>(allArgs["vhost"], record_app, dst_stream, std::move(segments), start_stamp);
+            reader->startReadMP4();
+        }
+        val["data"]["app"] = record_app;
+        val["data"]["stream"] = dst_stream;
+        val["data"]["start_stamp"] = start_stamp;
+        val["data"]["duration_ms"] = (Json::UInt64) duration_ms;
+    });
+#endif
+
     static auto responseSnap = [](const string &snap_path,
                                   const HttpSession::KeyValue &headerIn,
                                   const HttpSession::HttpResponseInvoker &invoker,
@@ -1542,6 +1785,70 @@ void installWebApi() {
         });
     });
 
+    // prometheus文本格式导出流级别与热点路径统计
+    //测试url http://127.0.0.1/metrics?secret=035c73f7-bb6b-4889-a715-d9eb2d1925cc
+    api_regist("/metrics", [](API_ARGS_MAP_ASYNC) {
+        CHECK_SECRET();
+        headerOut["Content-Type"] = "text/plain; version=0.0.4; charset=utf-8";
+        invoker(200, headerOut, Metrics::Instance().dump());
+    });
+
+    // 获取批量发送统计(udp为sendmmsg)，用于验证每次flush合并的包数，transport字段区分udp与tcp
+    api_regist("/index/api/getSendBatchStatistic", [](API_ARGS_MAP) {
+        CHECK_SECRET();
+        val["data"] = Value(arrayValue);
+        SendBatchStatistic::for_each([&](const SendBatchStatistic &stat) {
+            Value obj;
+            obj["type"] = stat.getType();
+            obj["id"] = stat.getIdentifier();
+            obj["transport"] = stat.getTransport();
+            auto packets = stat.getPacketCount();
+            auto flushes = stat.getFlushCount();
+            obj["packets"] = (Json::UInt64) packets;
+            obj["flushes"] = (Json::UInt64) flushes;
+            obj["avg_batch"] = flushes ? (double) packets / flushes : 0.0;
+            auto histogram = stat.getHistogram();
+            for (size_t i = 0; i < histogram.size(); ++i) {
+                obj["histogram"][SendBatchStatistic::getBucketName(i)] = (Json::UInt64) histogram[i];
+            }
+            val["data"].append(obj);
+        });
+    });
+
+    // 获取录制磁盘写入器统计，用于观察每路录制的写入延时与排队深度
+    api_regist("/index/api/getDiskWriterStatistic", [](API_ARGS_MAP) {
+        CHECK_SECRET();
+        val["data"] = Value(arrayValue);
+        DiskWriter::for_each([&](const DiskWriter &writer) {
+            Value obj;
+            obj["tag"] = writer.getTag();
+            obj["path"] = writer.getPath();
+            obj["queue_size"] = (Json::UInt64) writer.getQueueSize();
+            obj["queue_bytes"] = (Json::UInt64) writer.getQueueBytes();
+            obj["write_bytes"] = (Json::UInt64) writer.getWriteBytes();
+            obj["drop_bytes"] = (Json::UInt64) writer.getDropBytes();
+            obj["avg_latency_ms"] = (Json::UInt64) writer.getAvgLatencyMS();
+            obj["max_latency_ms"] = (Json::UInt64) writer.getMaxLatencyMS();
+            val["data"].append(obj);
+        });
+    });
+
+    // 获取点播文件内容缓存统计(http/hls/mp4点播共享)
+    // 测试url http://127.0.0.1/index/api/getFileCacheStatistic
+    api_regist("/index/api/getFileCacheStatistic", [](API_ARGS_MAP) {
+        CHECK_SECRET();
+        auto statistic = FileChunkCache::Instance().getStatistic();
+        auto total = statistic.hits + statistic.misses;
+        val["data"]["enabled"] = FileChunkCache::enabled();
+        val["data"]["hits"] = (Json::UInt64) statistic.hits;
+        val["data"]["misses"] = (Json::UInt64) statistic.misses;
+        val["data"]["hit_ratio"] = total ? (double) statistic.hits / total : 0.0;
+        val["data"]["evictions"] = (Json::UInt64) statistic.evictions;
+        val["data"]["chunks"] = (Json::UInt64) statistic.chunks;
+        val["data"]["bytes"] = (Json::UInt64) statistic.bytes;
+        val["data"]["capacity"] = (Json::UInt64) statistic.capacity;
+    });
+
 #ifdef ENABLE_WEBRTC
     class WebRtcArgsImp : public WebRtcArgs {
     public:
@@ -20,6 +20,7 @@
 #include "Http/HttpSession.h"
 #include "WebHook.h"
 #include "WebApi.h"
+#include "Cluster.h"
 
 //using namespace std;
 using std::string;
@@ -80,20 +81,6 @@ onceToken token([](){
 },nullptr);
 }//namespace Hook
 
-namespace Cluster {
-#define CLUSTER_FIELD "cluster."
-const string kOriginUrl = CLUSTER_FIELD "origin_url";
-const string kTimeoutSec = CLUSTER_FIELD "timeout_sec";
-const string kRetryCount = CLUSTER_FIELD "retry_count";
-
-static onceToken token([]() {
-    mINI::Instance()[kOriginUrl] = "";
-    mINI::Instance()[kTimeoutSec] = 15;
-    mINI::Instance()[kRetryCount] = 3;
-});
-
-}//namespace Cluster
-
 static void parse_http_response(const SockException &ex, const Parser &res,
                                 const std::function<void(const Value &,const string &)> &fun){
     std::string errStr;
@@ -261,49 +248,6 @@ static void reportServerKeepalive() {
     }, nullptr);
 }
 
-static const string kEdgeServerParam = "edge=1";
-// 获取源站url
-static string getPullUrl(const string &origin_fmt, const MediaInfo &info) {
-    char url[1024] = { 0 };
-    if ((ssize_t)origin_fmt.size() > snprintf(url, sizeof(url), origin_fmt.data(), info._app.data(), info._streamid.data())) {
-        WarnL << "get origin url failed, origin_fmt:" << origin_fmt;
-        return "";
-    }
-    //告知源站这是来自边沿站的拉流请求，如果未找到流请立即返回拉流失败
-    return string(url) + '?' + kEdgeServerParam + '&' + VHOST_KEY + '=' + info._vhost + '&' + info._param_strs;
-}
-
-static void pullStreamFromOrigin(const std::vector<string>& urls, size_t index, size_t failed_cnt, const MediaInfo &args,
-                                 const std::function<void()> &closePlayer) {
-
-    GET_CONFIG(float, cluster_timeout_sec, Cluster::kTimeoutSec);
-    GET_CONFIG(int, retry_count, Cluster::kRetryCount);
-
-    auto url = getPullUrl(urls[index % urls.size()], args);
-    auto timeout_sec = cluster_timeout_sec / urls.size();
-    InfoL << "pull stream from origin, failed_cnt: " << failed_cnt << ", timeout_sec: " << timeout_sec << ", url: " << url;
-
-    ProtocolOption option;
-    option.enable_hls =  option.enable_hls || (args._schema == HLS_SCHEMA);
-    option.enable_mp4 = false;
-
-    addStreamProxy(args._vhost, args._app, args._streamid, url, retry_count, option, Rtsp::RTP_TCP, timeout_sec,
-                  [=](const SockException &ex, const string &key) mutable {
-        if (!ex) { // pull ok
-            return;
-        }
-        //拉流失败
-        if (++failed_cnt == urls.size()) {
-            //已经重试所有源站了
-            WarnL << "pull stream from origin final failed: " << url;
-            closePlayer();
-        }
-        else { // try next
-           pullStreamFromOrigin(urls, index + 1, failed_cnt, args, closePlayer);
-        }
-    });
-}
-
 static void *web_hook_tag = nullptr;
 
 static mINI jsonToMini(const Value &obj) {
@@ -443,28 +387,15 @@ void installWebHook(){
         do_http_hook(hook_stream_chaned, body, nullptr);
     });
 
-    GET_CONFIG_FUNC(std::vector<string>, origin_urls, Cluster::kOriginUrl, [](const string &str) {
-        std::vector<string> ret;
-        for (auto &url : split(str, ";")) {
-            trim(url);
-            if (!url.empty()) {
-                ret.emplace_back(url);
-            }
-        }
-        return ret;
-    });
-
     //监听播放失败(未找到特定的流)事件
     NoticeCenter::Instance().addListener(&web_hook_tag, Broadcast::kBroadcastNotFoundStream, [](BroadcastNotFoundStreamArgs) {
-        if (!origin_urls.empty()) {
-            //设置了源站，那么尝试溯源
-            static std::atomic<uint8_t> s_index { 0 };
-            pullStreamFromOrigin(origin_urls, s_index.load(), 0, args, closePlayer);
-            ++s_index;
+        if (ClusterRelay::Instance().enabled()) {
+            //设置了源站或源站目录，那么尝试溯源
+            ClusterRelay::Instance().pull(args, closePlayer);
             return;
         }
 
-        if (start_with(args._param_strs, kEdgeServerParam)) {
+        if (ClusterRelay::isEdgeRequest(args)) {
             //源站收到来自边沿站的溯源请求，流不存在时立即返回拉流失败
             closePlayer();
             return;
@@ -542,7 +473,7 @@ void installWebHook(){
     });
 
     NoticeCenter::Instance().addListener(&web_hook_tag, Broadcast::kBroadcastStreamNoneReader, [](BroadcastStreamNoneReaderArgs) {
-        if (!origin_urls.empty()) {
+        if (ClusterRelay::Instance().enabled()) {
             //边沿站无人观看时立即停止溯源
             sender.close(false);
             WarnL << "无人观看主动关闭流:" << sender.getOriginUrl();
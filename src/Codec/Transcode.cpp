@@ -17,6 +17,8 @@
 #include "Common/config.h"
 #include "Transcode.h"
 #include "Extension/AAC.h"
+#include "Extension/H264.h"
+#include "Extension/H265.h"
 #include "Common/config.h"
 #define MAX_DELAY_SECOND 3
 
@@ -120,6 +122,7 @@ bool TaskManager::addEncodeTask(function<void()> task) {
         if (_task.size() > _max_task) {
             WarnL << "encoder thread task is too more, now drop frame!";
             _task.pop_front();
+            ++_drop_count;
         }
     }
     _sem.post();
@@ -132,6 +135,7 @@ bool TaskManager::addDecodeTask(bool key_frame, function<void()> task) {
         if (_decode_drop_start) {
             if (!key_frame) {
                 TraceL << "decode thread drop frame";
+                ++_drop_count;
                 return false;
             }
             _decode_drop_start = false;
@@ -185,6 +189,30 @@ TaskManager::~TaskManager() {
     stopThread(true);
 }
 
+size_t TaskManager::getTaskSize() {
+    lock_guard<mutex> lck(_task_mtx);
+    return _task.size();
+}
+
+uint64_t TaskManager::getDropCount() const {
+    return _drop_count;
+}
+
+uint64_t TaskManager::getCpuTimeUS() const {
+    return _cpu_time_us;
+}
+
+uint64_t TaskManager::getThreadCpuTimeUS() {
+#if !defined(_WIN32)
+    struct timespec ts;
+    if (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+#endif
+    //不支持线程cpu时间，退化为墙上时间
+    return getCurrentMicrosecond();
+}
+
 bool TaskManager::isEnabled() const {
     return _thread.operator bool();
 }
@@ -206,7 +234,9 @@ void TaskManager::onThreadRun(const string &name) {
 
         try {
             TimeTicker2(50, TraceL);
+            auto cpu_start = getThreadCpuTimeUS();
             task();
+            _cpu_time_us += getThreadCpuTimeUS() - cpu_start;
             task = nullptr;
         } catch (ThreadExitException &ex) {
             break;
@@ -526,6 +556,333 @@ void FFmpegDecoder::onDecode(const FFmpegFrame::Ptr &frame) {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+static AVPixelFormat getPixelFormat(const AVCodec *codec) {
+    if (!codec->pix_fmts) {
+        return AV_PIX_FMT_YUV420P;
+    }
+    AVPixelFormat ret = AV_PIX_FMT_NONE;
+    for (auto fmt = codec->pix_fmts; *fmt != AV_PIX_FMT_NONE; ++fmt) {
+        if (*fmt == AV_PIX_FMT_YUV420P) {
+            //优先使用yuv420p，与解码输出一致，可以省去一次格式转换
+            return *fmt;
+        }
+        auto desc = av_pix_fmt_desc_get(*fmt);
+        if (ret == AV_PIX_FMT_NONE && desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            ret = *fmt;
+        }
+    }
+    return ret == AV_PIX_FMT_NONE ? AV_PIX_FMT_YUV420P : ret;
+}
+
+static int getSampleRate(const AVCodec *codec, int sample_rate) {
+    if (!codec->supported_samplerates) {
+        return sample_rate;
+    }
+    int ret = 0;
+    for (auto rate = codec->supported_samplerates; *rate; ++rate) {
+        if (*rate == sample_rate) {
+            return sample_rate;
+        }
+        if (*rate == 48000 || !ret) {
+            ret = *rate;
+        }
+    }
+    return ret;
+}
+
+FFmpegEncoder::FFmpegEncoder(const Track::Ptr &track, CodecId codec_id, int bit_rate, int width, int height, int thread_num) {
+    setupFFmpeg();
+    _codec_id = codec_id;
+    const AVCodec *codec = nullptr;
+    const AVCodec *codec_default = nullptr;
+    switch (codec_id) {
+        case CodecH264:
+            codec_default = getCodec<false>({{AV_CODEC_ID_H264}, {"libx264"}});
+            if (checkIfSupportedNvidia()) {
+                codec = getCodec<false>({{AV_CODEC_ID_H264}, {"libx264"}, {"h264_qsv"}, {"h264_videotoolbox"}, {"h264_nvenc"}});
+            } else {
+                codec = getCodec<false>({{AV_CODEC_ID_H264}, {"libx264"}, {"h264_qsv"}, {"h264_videotoolbox"}});
+            }
+            break;
+        case CodecH265:
+            codec_default = getCodec<false>({{AV_CODEC_ID_HEVC}, {"libx265"}});
+            if (checkIfSupportedNvidia()) {
+                codec = getCodec<false>({{AV_CODEC_ID_HEVC}, {"libx265"}, {"hevc_qsv"}, {"hevc_videotoolbox"}, {"hevc_nvenc"}});
+            } else {
+                codec = getCodec<false>({{AV_CODEC_ID_HEVC}, {"libx265"}, {"hevc_qsv"}, {"hevc_videotoolbox"}});
+            }
+            break;
+        case CodecAAC:
+            codec = getCodec<false>({{AV_CODEC_ID_AAC}, {"libfdk_aac"}});
+            break;
+        case CodecOpus:
+            codec = getCodec<false>({{AV_CODEC_ID_OPUS}, {"libopus"}});
+            break;
+        default:
+            break;
+    }
+
+    if (!codec) {
+        throw std::runtime_error(StrPrinter << "未找到编码器:" << getCodecName(codec_id));
+    }
+    if (getTrackType(codec_id) != track->getTrackType()) {
+        throw std::invalid_argument(StrPrinter << "编码格式与源track类型不匹配:" << getCodecName(codec_id));
+    }
+
+    while (true) {
+        _context.reset(avcodec_alloc_context3(codec), [](AVCodecContext *ctx) {
+            avcodec_free_context(&ctx);
+        });
+
+        if (!_context) {
+            throw std::runtime_error("创建编码器失败");
+        }
+
+        AVDictionary *dict = nullptr;
+        if (track->getTrackType() == TrackVideo) {
+            auto video = static_pointer_cast<VideoTrack>(track);
+            int fps = video->getVideoFps() > 0 ? (int) video->getVideoFps() : 25;
+            _context->width = width ? width : video->getVideoWidth();
+            _context->height = height ? height : video->getVideoHeight();
+            _context->pix_fmt = getPixelFormat(codec);
+            //输入时间戳单位为毫秒
+            _context->time_base = AVRational { 1, 1000 };
+            _context->framerate = AVRational { fps, 1 };
+            _context->gop_size = fps * 2;
+            //直播不需要b帧，避免dts与pts不一致并降低延时
+            _context->max_b_frames = 0;
+            if (bit_rate > 0) {
+                _context->bit_rate = bit_rate;
+            }
+            if (!strcmp(codec->name, "libx264") || !strcmp(codec->name, "libx265")) {
+                //硬件编码器的preset取值不同(例如nvenc没有veryfast)，设置后会导致打开失败
+                av_dict_set(&dict, "preset", "veryfast", 0);
+                av_dict_set(&dict, "tune", "zerolatency", 0);
+            }
+        } else {
+            auto audio = static_pointer_cast<AudioTrack>(track);
+            _context->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+            _context->sample_rate = getSampleRate(codec, audio->getAudioSampleRate());
+            _context->channels = MAX(1, MIN(audio->getAudioChannel(), 2));
+            _context->channel_layout = av_get_default_channel_layout(_context->channels);
+            _context->time_base = AVRational { 1, _context->sample_rate };
+            if (bit_rate > 0) {
+                _context->bit_rate = bit_rate;
+            }
+            //aac config通过extradata获取
+            _context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+
+        if (thread_num <= 0) {
+            av_dict_set(&dict, "threads", "auto", 0);
+        } else {
+            av_dict_set(&dict, "threads", to_string(MIN((unsigned int)thread_num, thread::hardware_concurrency())).data(), 0);
+        }
+        av_dict_set(&dict, "strict", "-2", 0);
+
+        int ret = avcodec_open2(_context.get(), codec, &dict);
+        av_dict_free(&dict);
+        if (ret >= 0) {
+            //成功
+            InfoL << "打开编码器成功:" << codec->name;
+            break;
+        }
+
+        if (codec_default && codec_default != codec) {
+            //硬件编解码器打开失败，尝试软件的
+            WarnL << "打开编码器" << codec->name << "失败，原因是:" << ffmpeg_err(ret) << ", 再尝试打开编码器" << codec_default->name;
+            codec = codec_default;
+            continue;
+        }
+        throw std::runtime_error(StrPrinter << "打开编码器" << codec->name << "失败:" << ffmpeg_err(ret));
+    }
+
+    if (_context->codec_type == AVMEDIA_TYPE_VIDEO) {
+        //分辨率与像素格式一致时不转换
+        _sws = std::make_shared<FFmpegSws>(_context->pix_fmt, _context->width, _context->height);
+    } else {
+        _swr = std::make_shared<FFmpegSwr>(_context->sample_fmt, _context->channels, _context->channel_layout, _context->sample_rate);
+        _fifo.reset(av_audio_fifo_alloc(_context->sample_fmt, _context->channels, 1), [](AVAudioFifo *fifo) {
+            av_audio_fifo_free(fifo);
+        });
+    }
+}
+
+FFmpegEncoder::~FFmpegEncoder() {
+    //直播转码销毁时编码器中残留的几帧已无意义，不再同步flush，防止阻塞poller线程
+    stopThread(true);
+}
+
+void FFmpegEncoder::flush() {
+    if (avcodec_send_frame(_context.get(), nullptr) < 0) {
+        return;
+    }
+    while (true) {
+        auto pkt = alloc_av_packet();
+        auto ret = avcodec_receive_packet(_context.get(), pkt.get());
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            WarnL << "avcodec_receive_packet failed:" << ffmpeg_err(ret);
+            break;
+        }
+        onEncode(pkt.get());
+    }
+}
+
+const AVCodecContext *FFmpegEncoder::getContext() const {
+    return _context.get();
+}
+
+Track::Ptr FFmpegEncoder::getTrack() const {
+    switch (_codec_id) {
+        case CodecH264: return std::make_shared<H264Track>();
+        case CodecH265: return std::make_shared<H265Track>();
+        case CodecAAC: return std::make_shared<AACTrack>(string((char *) _context->extradata, _context->extradata_size));
+        case CodecOpus: return std::make_shared<OpusTrack>();
+        default: return nullptr;
+    }
+}
+
+void FFmpegEncoder::setOnEncode(FFmpegEncoder::onEnc cb) {
+    _cb = std::move(cb);
+}
+
+bool FFmpegEncoder::inputFrame(const FFmpegFrame::Ptr &frame, bool async) {
+    if (async && !TaskManager::isEnabled()) {
+        //开启异步编码，尝试启动异步编码线程
+        startThread("encoder thread");
+    }
+
+    if (!async || !TaskManager::isEnabled()) {
+        return inputFrame_l(frame);
+    }
+
+    return addEncodeTask([this, frame]() {
+        inputFrame_l(frame);
+    });
+}
+
+bool FFmpegEncoder::inputFrame_l(const FFmpegFrame::Ptr &frame) {
+    if (_context->codec_type == AVMEDIA_TYPE_AUDIO) {
+        return inputAudioFrame(frame);
+    }
+    if (frame->get()->pts <= _last_pts) {
+        //编码器要求时间戳递增
+        WarnL << "编码时忽略时间戳回退的帧:" << frame->get()->pts << " <= " << _last_pts;
+        return false;
+    }
+    _last_pts = frame->get()->pts;
+    //在编码线程缩放，多码率输出时各编码器可以并行缩放
+    auto out = _sws->inputFrame(frame);
+    if (!out) {
+        return false;
+    }
+    return encodeFrame(out->get());
+}
+
+bool FFmpegEncoder::inputAudioFrame(const FFmpegFrame::Ptr &frame) {
+    auto pcm = _swr->inputFrame(frame);
+    if (!pcm) {
+        return false;
+    }
+    if (!_audio_samples && !av_audio_fifo_size(_fifo.get())) {
+        _audio_stamp = pcm->get()->pts;
+    }
+    av_audio_fifo_write(_fifo.get(), (void **) pcm->get()->data, pcm->get()->nb_samples);
+
+    //部分编码器(譬如aac)要求每帧采样数固定
+    auto frame_size = _context->frame_size > 0 ? _context->frame_size : pcm->get()->nb_samples;
+    while (av_audio_fifo_size(_fifo.get()) >= frame_size) {
+        auto out = std::make_shared<FFmpegFrame>();
+        out->get()->format = _context->sample_fmt;
+        out->get()->channels = _context->channels;
+        out->get()->channel_layout = _context->channel_layout;
+        out->get()->sample_rate = _context->sample_rate;
+        out->get()->nb_samples = frame_size;
+        auto ret = av_frame_get_buffer(out->get(), 0);
+        if (ret < 0) {
+            WarnL << "av_frame_get_buffer failed:" << ffmpeg_err(ret);
+            return false;
+        }
+        av_audio_fifo_read(_fifo.get(), (void **) out->get()->data, frame_size);
+        out->get()->pts = _audio_samples;
+        _audio_samples += frame_size;
+        encodeFrame(out->get());
+    }
+    return true;
+}
+
+bool FFmpegEncoder::encodeFrame(const AVFrame *frame) {
+    TimeTicker2(30, TraceL);
+    auto ret = avcodec_send_frame(_context.get(), frame);
+    if (ret < 0) {
+        WarnL << "avcodec_send_frame failed:" << ffmpeg_err(ret);
+        return false;
+    }
+
+    while (true) {
+        auto pkt = alloc_av_packet();
+        ret = avcodec_receive_packet(_context.get(), pkt.get());
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            WarnL << "avcodec_receive_packet failed:" << ffmpeg_err(ret);
+            break;
+        }
+        onEncode(pkt.get());
+    }
+    return true;
+}
+
+template <typename FrameType = FrameImp>
+static Frame::Ptr makeFrame(CodecId codec_id, const AVPacket *pkt, uint64_t dts, uint64_t pts) {
+    auto frame = FrameImp::create<FrameType>();
+    frame->_codec_id = codec_id;
+    frame->_dts = dts;
+    frame->_pts = pts;
+    frame->_buffer.assign((char *) pkt->data, pkt->size);
+    return frame;
+}
+
+void FFmpegEncoder::onEncode(const AVPacket *pkt) {
+    if (!_cb) {
+        return;
+    }
+    int64_t dts = pkt->dts;
+    int64_t pts = pkt->pts;
+    if (_context->codec_type == AVMEDIA_TYPE_AUDIO) {
+        //音频时间戳单位为采样数，转换为毫秒
+        dts = (int64_t) _audio_stamp + pkt->dts * 1000 / _context->sample_rate;
+        pts = (int64_t) _audio_stamp + pkt->pts * 1000 / _context->sample_rate;
+    }
+    //aac等编码器的首帧因编码延时(initial padding)时间戳为负，防止无符号回绕
+    dts = MAX(dts, (int64_t) 0);
+    pts = MAX(pts, (int64_t) 0);
+
+    Frame::Ptr frame;
+    switch (_codec_id) {
+        case CodecH264: {
+            auto h264 = makeFrame<H264Frame>(_codec_id, pkt, dts, pts);
+            static_pointer_cast<H264Frame>(h264)->_prefix_size = prefixSize(h264->data(), h264->size());
+            frame = std::move(h264);
+            break;
+        }
+        case CodecH265: {
+            auto h265 = makeFrame<H265Frame>(_codec_id, pkt, dts, pts);
+            static_pointer_cast<H265Frame>(h265)->_prefix_size = prefixSize(h265->data(), h265->size());
+            frame = std::move(h265);
+            break;
+        }
+        default: frame = makeFrame(_codec_id, pkt, dts, pts); break;
+    }
+    _cb(frame);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 FFmpegSwr::FFmpegSwr(AVSampleFormat output, int channel, int channel_layout, int samplerate) {
     _target_format = output;
     _target_channels = channel;
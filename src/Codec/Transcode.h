@@ -13,6 +13,7 @@
 
 #if defined(ENABLE_FFMPEG)
 
+#include <atomic>
 #include "Util/TimeTicker.h"
 #include "Common/MediaSink.h"
 
@@ -71,6 +72,15 @@ public:
     void setMaxTaskSize(size_t size);
     void stopThread(bool drop_task);
 
+    // 获取排队中的任务个数
+    size_t getTaskSize();
+    // 获取因任务堆积而丢弃的帧数
+    uint64_t getDropCount() const;
+    // 获取后台线程执行任务消耗的cpu时间，单位微秒
+    uint64_t getCpuTimeUS() const;
+    // 获取当前线程消耗的cpu时间，单位微秒
+    static uint64_t getThreadCpuTimeUS();
+
 protected:
     void startThread(const std::string &name);
     bool addEncodeTask(std::function<void()> task);
@@ -93,6 +103,8 @@ private:
     bool _decode_drop_start = false;
     bool _exit = false;
     size_t _max_task = 30;
+    std::atomic<uint64_t> _drop_count { 0 };
+    std::atomic<uint64_t> _cpu_time_us { 0 };
     std::mutex _task_mtx;
     toolkit::semaphore _sem;
     toolkit::List<std::function<void()> > _task;
@@ -141,6 +153,56 @@ private:
     AVPixelFormat _target_format;
 };
 
+class FFmpegEncoder : public TaskManager {
+public:
+    using Ptr = std::shared_ptr<FFmpegEncoder>;
+    using onEnc = std::function<void(const Frame::Ptr &)>;
+
+    /**
+     * 构造编码器
+     * @param track 源track，用于获取帧率、采样率、通道数、分辨率等参数
+     * @param codec_id 目标编码格式，支持H264/H265/AAC/Opus
+     * @param bit_rate 目标码率，单位bit/s，为0时由编码器决定
+     * @param width 目标宽度，为0时与源track一致
+     * @param height 目标高度，为0时与源track一致
+     * @param thread_num 编码线程数
+     */
+    FFmpegEncoder(const Track::Ptr &track, CodecId codec_id, int bit_rate = 0, int width = 0, int height = 0, int thread_num = 2);
+    ~FFmpegEncoder() override;
+
+    /**
+     * 输入解码后的帧，视频帧在编码线程内部缩放到目标分辨率与像素格式，音频帧内部会重采样
+     * 同一个解码帧可以同时输入给多个编码器
+     */
+    bool inputFrame(const FFmpegFrame::Ptr &frame, bool async);
+    void setOnEncode(onEnc cb);
+    void flush();
+    const AVCodecContext *getContext() const;
+
+    /**
+     * 获取编码输出对应的track
+     */
+    Track::Ptr getTrack() const;
+
+private:
+    bool inputFrame_l(const FFmpegFrame::Ptr &frame);
+    bool inputAudioFrame(const FFmpegFrame::Ptr &frame);
+    bool encodeFrame(const AVFrame *frame);
+    void onEncode(const AVPacket *pkt);
+
+private:
+    CodecId _codec_id;
+    int64_t _last_pts = -1;
+    // 音频已编码采样数与起始时间戳(毫秒)
+    int64_t _audio_samples = 0;
+    uint64_t _audio_stamp = 0;
+    onEnc _cb;
+    FFmpegSws::Ptr _sws;
+    FFmpegSwr::Ptr _swr;
+    std::shared_ptr<AVAudioFifo> _fifo;
+    std::shared_ptr<AVCodecContext> _context;
+};
+
 }//namespace mediakit
 #endif// ENABLE_FFMPEG
 #endif //ZLMEDIAKIT_TRANSCODE_H
@@ -0,0 +1,397 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#if defined(ENABLE_FFMPEG)
+#include <set>
+#include "Transcoder.h"
+#include "Common/config.h"
+#include "Common/MultiMediaSourceMuxer.h"
+#include "Record/HlsMakerImp.h"
+#include "Thread/WorkThreadPool.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace toolkit {
+StatisticImp(mediakit::Transcoder);
+}
+
+namespace mediakit {
+
+static mutex s_transcoder_mtx;
+static set<const Transcoder *> s_transcoder_set;
+
+void Transcoder::for_each(const function<void(const Transcoder &)> &cb) {
+    lock_guard<mutex> lck(s_transcoder_mtx);
+    for (auto ptr : s_transcoder_set) {
+        cb(*ptr);
+    }
+}
+
+Transcoder::Transcoder(EventPoller::Ptr poller, string vhost, string app, string stream, const MediaSourceEvent::TranscodeArgs &args) {
+    _poller = std::move(poller);
+    _vhost = std::move(vhost);
+    _app = std::move(app);
+    _src_stream = std::move(stream);
+    _args = args;
+    CHECK(!_args.stream_id.empty());
+
+    if (_args.renditions.empty()) {
+        Output output;
+        output.stream_id = _args.stream_id;
+        output.width = _args.width;
+        output.height = _args.height;
+        output.video_bitrate = _args.video_bitrate;
+        _outputs.emplace_back(std::move(output));
+        return;
+    }
+
+    set<string> stream_ids { _args.stream_id, _src_stream };
+    for (size_t i = 0; i < _args.renditions.size(); ++i) {
+        auto &rendition = _args.renditions[i];
+        Output output;
+        output.stream_id = rendition.stream_id;
+        if (output.stream_id.empty()) {
+            output.stream_id = _args.stream_id + "_" + (rendition.height ? to_string(rendition.height) + "p" : to_string(i));
+        }
+        output.width = rendition.width;
+        output.height = rendition.height;
+        output.video_bitrate = rendition.video_bitrate;
+        if (!stream_ids.emplace(output.stream_id).second) {
+            throw std::invalid_argument("多码率流id重复:" + output.stream_id);
+        }
+        _outputs.emplace_back(std::move(output));
+    }
+}
+
+Transcoder::~Transcoder() {
+    {
+        //先从列表中移除，防止其他线程遍历时访问正在析构的对象
+        lock_guard<mutex> lck(s_transcoder_mtx);
+        s_transcoder_set.erase(this);
+    }
+    InfoL << getSourceUrl() << " -> " << _args.stream_id << ", duration(ms):" << getDuration();
+    //停止编解码线程需要等待线程退出(正在编码的帧可能耗时较长)，放到后台线程执行，防止阻塞源流所在poller线程
+    auto video = std::move(_tracks[TrackVideo]);
+    auto audio = std::move(_tracks[TrackAudio]);
+    if (!video && !audio) {
+        return;
+    }
+    WorkThreadPool::Instance().getExecutor()->async([video, audio]() mutable {
+        //先停止所有解码线程，防止其继续往编码线程输入数据
+        if (video) {
+            video->decoder = nullptr;
+        }
+        if (audio) {
+            audio->decoder = nullptr;
+        }
+        video = nullptr;
+        audio = nullptr;
+    });
+}
+
+//宽高只指定一个时，按源分辨率等比缩放，且必须为偶数
+static void getTargetSize(const VideoTrack::Ptr &track, int &width, int &height) {
+    auto src_width = track->getVideoWidth();
+    auto src_height = track->getVideoHeight();
+    if (!width && height && src_height) {
+        width = (int) ((int64_t) src_width * height / src_height);
+    } else if (width && !height && src_width) {
+        height = (int) ((int64_t) src_height * width / src_width);
+    }
+    width &= ~1;
+    height &= ~1;
+}
+
+bool Transcoder::addTrack(const Track::Ptr &track) {
+    auto type = track->getTrackType();
+    if (type != TrackVideo && type != TrackAudio) {
+        return false;
+    }
+    auto codec_id = type == TrackVideo ? _args.video_codec : _args.audio_codec;
+    if (codec_id == CodecInvalid) {
+        //不输出该类型的track
+        return false;
+    }
+
+    auto ctx = std::make_shared<TrackContext>();
+    ctx->src_track = track;
+    try {
+        if (type == TrackVideo) {
+            //每个码率一个编码器，各自在编码线程缩放
+            for (size_t i = 0; i < _outputs.size(); ++i) {
+                auto &output = _outputs[i];
+                getTargetSize(static_pointer_cast<VideoTrack>(track), output.width, output.height);
+                auto enc = std::make_shared<EncoderContext>();
+                enc->index = i;
+                enc->encoder = std::make_shared<FFmpegEncoder>(track, codec_id, output.video_bitrate, output.width, output.height, _args.thread_num);
+                //记录实际分辨率，用于生成hls主索引文件
+                output.width = enc->encoder->getContext()->width;
+                output.height = enc->encoder->getContext()->height;
+                ctx->encoders.emplace_back(std::move(enc));
+            }
+        } else {
+            //音频只编码一次，输出到所有码率
+            auto enc = std::make_shared<EncoderContext>();
+            enc->encoder = std::make_shared<FFmpegEncoder>(track, codec_id, _args.audio_bitrate, 0, 0, _args.thread_num);
+            ctx->encoders.emplace_back(std::move(enc));
+        }
+        ctx->decoder = std::make_shared<FFmpegDecoder>(track, _args.thread_num);
+    } catch (std::exception &ex) {
+        WarnL << "创建" << track->getCodecName() << " -> " << getCodecName(codec_id) << "转码器失败:" << ex.what();
+        return false;
+    }
+
+    //以下回调都在解码或编码线程执行，捕获的裸指针生命周期长于解码线程
+    auto ctx_ptr = ctx.get();
+    ctx->decoder->setOnDecode([ctx_ptr](const FFmpegFrame::Ptr &frame) {
+        ++ctx_ptr->frames_decoded;
+        //解码帧只读，可以同时输入给多个编码线程
+        for (auto &enc : ctx_ptr->encoders) {
+            enc->encoder->inputFrame(frame, true);
+        }
+    });
+
+    weak_ptr<Transcoder> weak_self = shared_from_this();
+    auto poller = _poller;
+    for (auto &enc : ctx->encoders) {
+        auto enc_ptr = enc.get();
+        auto index = enc->index;
+        enc->encoder->setOnEncode([weak_self, poller, enc_ptr, index](const Frame::Ptr &frame) {
+            ++enc_ptr->frames_encoded;
+            //切换到源流所在线程输入到转码后的流，不在编码线程持有强引用，防止在编码线程析构自身
+            poller->async([weak_self, index, frame]() {
+                if (auto strong_self = weak_self.lock()) {
+                    strong_self->onEncode(index, frame);
+                }
+            }, false);
+        });
+    }
+
+    _tracks[type] = std::move(ctx);
+    InfoL << getSourceUrl() << " -> " << _args.stream_id << ", " << track->getCodecName() << " -> " << getCodecName(codec_id)
+          << ", renditions:" << _outputs.size();
+    return true;
+}
+
+void Transcoder::addTrackCompleted() {
+    ProtocolOption option;
+    //转码后的流不重复录制mp4
+    option.enable_mp4 = false;
+    if (!_args.renditions.empty()) {
+        //多码率转码时由hls主索引文件引用各码率流
+        option.enable_hls = true;
+    }
+
+    auto self = shared_from_this();
+    for (size_t i = 0; i < _outputs.size(); ++i) {
+        auto &output = _outputs[i];
+        output.muxer = std::make_shared<MultiMediaSourceMuxer>(_vhost, _app, output.stream_id, 0.0, option);
+        for (auto &ctx : _tracks) {
+            if (!ctx) {
+                continue;
+            }
+            for (auto &enc : ctx->encoders) {
+                if (enc->index == i || enc->index == kAllOutput) {
+                    //每个流使用独立的track对象
+                    output.muxer->addTrack(enc->encoder->getTrack());
+                }
+            }
+        }
+        output.muxer->addTrackCompleted();
+        output.muxer->setMediaListener(self);
+    }
+
+    if (!_args.renditions.empty()) {
+        makeMasterPlaylist();
+    }
+
+    //track添加完毕后才加入列表，之后_tracks不再修改，可以跨线程读取统计信息
+    lock_guard<mutex> lck(s_transcoder_mtx);
+    s_transcoder_set.emplace(this);
+}
+
+void Transcoder::makeMasterPlaylist() {
+#if defined(ENABLE_HLS)
+    GET_CONFIG(bool, enable_vhost, General::kEnableVhost);
+    auto path = Recorder::getRecordPath(Recorder::type_hls, _vhost, _app, _args.stream_id, "");
+    _master = std::make_shared<HlsMasterMakerImp>(path, enable_vhost ? string(VHOST_KEY) + "=" + _vhost : "", _vhost, _app, _args.stream_id);
+
+    int audio_bitrate = 0;
+    if (_tracks[TrackAudio]) {
+        //未指定码率时按128kbps估算
+        audio_bitrate = _args.audio_bitrate ? _args.audio_bitrate : 128 * 1000;
+    }
+    vector<HlsMasterMakerImp::Variant> variants;
+    for (auto &output : _outputs) {
+        if (!output.muxer || output.muxer->getTracks(false).empty()) {
+            //该码率流没有任何track(编码器创建失败)，不会生成hls，不能被主索引引用
+            WarnL << "hls variant has no track, skipped: " << output.stream_id;
+            continue;
+        }
+        HlsMasterMakerImp::Variant variant;
+        variant.stream_id = output.stream_id;
+        variant.width = output.width;
+        variant.height = output.height;
+        //未指定码率时按每像素3bit估算(720p约2.7Mbps)
+        variant.bandwidth = (output.video_bitrate ? output.video_bitrate : output.width * output.height * 3) + audio_bitrate;
+        variants.emplace_back(std::move(variant));
+    }
+    if (!_master->makeIndexFile(variants)) {
+        WarnL << "no valid hls variant, master playlist not created: " << _args.stream_id;
+        _master = nullptr;
+        return;
+    }
+    _master->getMediaSource()->setListener(shared_from_this());
+#else
+    WarnL << "hls相关功能未打开，不生成多码率主索引文件:" << _args.stream_id;
+#endif
+}
+
+bool Transcoder::inputFrame(const Frame::Ptr &frame) {
+    auto type = frame->getTrackType();
+    if (type != TrackVideo && type != TrackAudio) {
+        return false;
+    }
+    auto &ctx = _tracks[type];
+    if (!ctx) {
+        return false;
+    }
+    ++ctx->frames_in;
+    return ctx->decoder->inputFrame(frame, true, true);
+}
+
+void Transcoder::resetTracks() {
+    onError(SockException(Err_other, "源流track已重置"));
+}
+
+void Transcoder::onEncode(size_t index, const Frame::Ptr &frame) {
+    if (index != kAllOutput) {
+        if (index < _outputs.size() && _outputs[index].muxer) {
+            _outputs[index].muxer->inputFrame(frame);
+        }
+        return;
+    }
+    for (auto &output : _outputs) {
+        if (output.muxer) {
+            output.muxer->inputFrame(frame);
+        }
+    }
+}
+
+void Transcoder::setOnClose(onClose cb) {
+    _on_close = std::move(cb);
+}
+
+void Transcoder::onError(const SockException &ex) {
+    if (_closed) {
+        return;
+    }
+    _closed = true;
+    weak_ptr<Transcoder> weak_self = shared_from_this();
+    //异步回调，防止在源流遍历转码器时移除自身
+    _poller->async([weak_self, ex]() {
+        auto strong_self = weak_self.lock();
+        if (strong_self && strong_self->_on_close) {
+            strong_self->_on_close(ex);
+        }
+    }, false);
+}
+
+vector<string> Transcoder::getOutputStreamIds() const {
+    vector<string> ret;
+    for (auto &output : _outputs) {
+        ret.emplace_back(output.stream_id);
+    }
+    if (!_args.renditions.empty()) {
+        //hls主索引文件对应的流
+        ret.emplace_back(_args.stream_id);
+    }
+    return ret;
+}
+
+const string &Transcoder::getStreamId() const {
+    return _args.stream_id;
+}
+
+string Transcoder::getSourceUrl() const {
+    return _vhost + "/" + _app + "/" + _src_stream;
+}
+
+uint64_t Transcoder::getDuration() const {
+    return _ticker.createdTime();
+}
+
+vector<Transcoder::TrackStatistic> Transcoder::getStatistic() const {
+    vector<TrackStatistic> ret;
+    for (auto &ctx : _tracks) {
+        if (!ctx) {
+            continue;
+        }
+        TrackStatistic info;
+        info.type = ctx->src_track->getTrackType();
+        info.src_codec = ctx->src_track->getCodecId();
+        info.frames_in = ctx->frames_in;
+        info.frames_decoded = ctx->frames_decoded;
+        info.decode_queue = ctx->decoder->getTaskSize();
+        info.decode_drop = ctx->decoder->getDropCount();
+        info.decode_cpu_us = ctx->decoder->getCpuTimeUS();
+        for (auto &enc : ctx->encoders) {
+            EncoderStatistic enc_info;
+            if (enc->index != kAllOutput) {
+                enc_info.stream_id = _outputs[enc->index].stream_id;
+            }
+            enc_info.codec = info.type == TrackVideo ? _args.video_codec : _args.audio_codec;
+            enc_info.width = enc->encoder->getContext()->width;
+            enc_info.height = enc->encoder->getContext()->height;
+            enc_info.frames_encoded = enc->frames_encoded;
+            enc_info.queue = enc->encoder->getTaskSize();
+            enc_info.drop = enc->encoder->getDropCount();
+            enc_info.cpu_us = enc->encoder->getCpuTimeUS();
+            info.encoders.emplace_back(std::move(enc_info));
+        }
+        ret.emplace_back(std::move(info));
+    }
+    return ret;
+}
+
+MediaOriginType Transcoder::getOriginType(MediaSource &sender) const {
+    return MediaOriginType::transcode;
+}
+
+string Transcoder::getOriginUrl(MediaSource &sender) const {
+    return getSourceUrl();
+}
+
+bool Transcoder::close(MediaSource &sender) {
+    onError(SockException(Err_shutdown, "closed by user"));
+    return true;
+}
+
+int Transcoder::totalReaderCount(MediaSource &sender) {
+    //所有码率流及hls主索引的观看人数之和，不能调用带sender参数的版本，否则会回调到本函数
+    int ret = 0;
+    for (auto &output : _outputs) {
+        if (output.muxer) {
+            ret += output.muxer->totalReaderCount();
+        }
+    }
+    if (_master) {
+        ret += _master->getMediaSource()->readerCount();
+    }
+    return ret;
+}
+
+EventPoller::Ptr Transcoder::getOwnerPoller(MediaSource &sender) {
+    return _poller;
+}
+
+} // namespace mediakit
+#endif // ENABLE_FFMPEG
@@ -0,0 +1,191 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_TRANSCODER_H
+#define ZLMEDIAKIT_TRANSCODER_H
+
+#if defined(ENABLE_FFMPEG)
+#include "Transcode.h"
+#include "Common/MediaSource.h"
+
+namespace mediakit {
+
+class MultiMediaSourceMuxer;
+class HlsMasterMakerImp;
+
+/**
+ * 转码器，作为源流MultiMediaSourceMuxer的一个消费者(与RtpSender类似)
+ * 源流帧 -> 解码线程 -> 编码线程(缩放+编码) -> 源流所在poller -> 转码后的MultiMediaSourceMuxer
+ * 多码率转码时，每个track只解码一次，解码帧同时输入给各码率的编码器，音频只编码一次并输出到所有码率的流
+ * 转码后的流作为新的流注册，其观看人数计入源流的观看人数
+ */
+class Transcoder : public MediaSinkInterface, public MediaSourceEvent, public std::enable_shared_from_this<Transcoder> {
+public:
+    using Ptr = std::shared_ptr<Transcoder>;
+    using onClose = std::function<void(const toolkit::SockException &ex)>;
+
+    class EncoderStatistic {
+    public:
+        // 输出的流id，为空代表输出到所有码率的流(音频)
+        std::string stream_id;
+        CodecId codec;
+        int width = 0;
+        int height = 0;
+        uint64_t frames_encoded = 0;
+        // 编码线程待处理任务个数、因任务积压丢弃的帧数、累计消耗的cpu时间(微秒)
+        size_t queue = 0;
+        uint64_t drop = 0;
+        uint64_t cpu_us = 0;
+    };
+
+    class TrackStatistic {
+    public:
+        TrackType type;
+        CodecId src_codec;
+        // 输入源流帧数、解码输出帧数
+        uint64_t frames_in = 0;
+        uint64_t frames_decoded = 0;
+        // 解码线程待处理任务个数、因任务积压丢弃的帧数、累计消耗的cpu时间(微秒)
+        size_t decode_queue = 0;
+        uint64_t decode_drop = 0;
+        uint64_t decode_cpu_us = 0;
+        std::vector<EncoderStatistic> encoders;
+    };
+
+    /**
+     * @param poller 源流所在线程
+     * @param vhost 源流vhost
+     * @param app 源流app
+     * @param stream 源流id
+     * @param args 转码参数，args.stream_id不得为空
+     * 多码率流id重复时抛异常
+     */
+    Transcoder(toolkit::EventPoller::Ptr poller, std::string vhost, std::string app, std::string stream, const MediaSourceEvent::TranscodeArgs &args);
+    ~Transcoder() override;
+
+    /**
+     * 添加源流track，创建对应的解码器与编码器，失败时返回false
+     */
+    bool addTrack(const Track::Ptr &track) override;
+
+    /**
+     * 所有track添加完毕，创建并注册转码后的流
+     */
+    void addTrackCompleted() override;
+
+    /**
+     * 输入源流帧，异步解码
+     */
+    bool inputFrame(const Frame::Ptr &frame) override;
+
+    /**
+     * 源流track重置，转码器无法复用编解码器，直接触发关闭
+     */
+    void resetTracks() override;
+
+    /**
+     * 设置关闭回调，由源流MultiMediaSourceMuxer移除本对象
+     */
+    void setOnClose(onClose cb);
+
+    /**
+     * 转码后的流id，多码率转码时为hls主索引文件对应的流id
+     */
+    const std::string &getStreamId() const;
+
+    /**
+     * 转码后将要注册的所有流id(各码率流以及hls主索引文件对应的流)
+     */
+    std::vector<std::string> getOutputStreamIds() const;
+
+    /**
+     * 源流url
+     */
+    std::string getSourceUrl() const;
+
+    /**
+     * 已运行时长，单位毫秒
+     */
+    uint64_t getDuration() const;
+
+    /**
+     * 获取各track转码统计信息
+     */
+    std::vector<TrackStatistic> getStatistic() const;
+
+    /**
+     * 遍历所有转码器，可以跨线程调用
+     */
+    static void for_each(const std::function<void(const Transcoder &)> &cb);
+
+protected:
+    ///////MediaSourceEvent override///////
+    MediaOriginType getOriginType(MediaSource &sender) const override;
+    std::string getOriginUrl(MediaSource &sender) const override;
+    bool close(MediaSource &sender) override;
+    int totalReaderCount(MediaSource &sender) override;
+    toolkit::EventPoller::Ptr getOwnerPoller(MediaSource &sender) override;
+
+private:
+    void onError(const toolkit::SockException &ex);
+    void onEncode(size_t index, const Frame::Ptr &frame);
+    void makeMasterPlaylist();
+
+private:
+    // 输出到所有码率的流
+    static constexpr size_t kAllOutput = (size_t) -1;
+
+    class Output {
+    public:
+        std::string stream_id;
+        int width = 0;
+        int height = 0;
+        int video_bitrate = 0;
+        std::shared_ptr<MultiMediaSourceMuxer> muxer;
+    };
+
+    class EncoderContext {
+    public:
+        using Ptr = std::shared_ptr<EncoderContext>;
+        size_t index = kAllOutput;
+        std::atomic<uint64_t> frames_encoded { 0 };
+        FFmpegEncoder::Ptr encoder;
+    };
+
+    class TrackContext {
+    public:
+        using Ptr = std::shared_ptr<TrackContext>;
+        Track::Ptr src_track;
+        std::atomic<uint64_t> frames_in { 0 };
+        std::atomic<uint64_t> frames_decoded { 0 };
+        // 析构顺序与声明顺序相反，先停止解码线程，再释放其回调中引用的编码器
+        std::vector<EncoderContext::Ptr> encoders;
+        FFmpegDecoder::Ptr decoder;
+    };
+
+    bool _closed = false;
+    std::string _vhost;
+    std::string _app;
+    std::string _src_stream;
+    MediaSourceEvent::TranscodeArgs _args;
+    toolkit::Ticker _ticker;
+    onClose _on_close;
+    TrackContext::Ptr _tracks[2];
+    std::vector<Output> _outputs;
+    std::shared_ptr<HlsMasterMakerImp> _master;
+    toolkit::EventPoller::Ptr _poller;
+
+    //对象个数统计
+    toolkit::ObjectStatistic<Transcoder> _statistic;
+};
+
+} // namespace mediakit
+#endif // ENABLE_FFMPEG
+#endif // ZLMEDIAKIT_TRANSCODER_H
@@ -0,0 +1,265 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <cerrno>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#if defined(ENABLE_IOURING)
+#include <liburing.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "AsyncFileReader.h"
+#include "Common/config.h"
+#include "Common/Metrics.h"
+#include "Util/util.h"
+#include "Util/logger.h"
+#include "Util/uv_errno.h"
+#include "Thread/ThreadPool.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+enum FileIOEngine {
+    engine_sync = 0,
+    engine_thread,
+    engine_io_uring,
+};
+
+static FileIOEngine getConfigEngine() {
+    GET_CONFIG_FUNC(int, engine, General::kFileIOEngine, [](const string &str) {
+#if defined(_WIN32)
+        //windows下没有pread，保持同步读取
+        return (int)engine_sync;
+#else
+        if (str == "sync") {
+            return (int)engine_sync;
+        }
+        if (str == "thread") {
+            return (int)engine_thread;
+        }
+        if (str != "io_uring" && str != "auto") {
+            WarnL << "unknown " << General::kFileIOEngine << ": " << str << ", use auto";
+        }
+        return (int)engine_io_uring;
+#endif
+    });
+    return (FileIOEngine)engine;
+}
+
+static MetricHistogram &getLatencyHistogram(FileIOEngine engine) {
+    static auto &s_thread = Metrics::Instance().getHistogram("zlm_file_read_latency_seconds", "engine=\"thread\"", "Latency of asynchronous file reads",
+                                                             { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000 }, 1e-6);
+    static auto &s_io_uring = Metrics::Instance().getHistogram("zlm_file_read_latency_seconds", "engine=\"io_uring\"", "Latency of asynchronous file reads",
+                                                               { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000 }, 1e-6);
+    return engine == engine_io_uring ? s_io_uring : s_thread;
+}
+
+#if defined(ENABLE_IOURING)
+/**
+ * io_uring上下文，每个poller线程一个实例
+ * 完成队列通过eventfd挂载到poller，读完成后在提交请求的同一线程中回调
+ */
+class IoUringContext {
+public:
+    //poller线程与进程同生命周期，不析构，防止线程退出时poller回调引用已释放的对象
+    static IoUringContext *current() {
+        static thread_local IoUringContext *s_ctx = nullptr;
+        static thread_local bool s_inited = false;
+        if (!s_inited) {
+            s_inited = true;
+            auto poller = EventPoller::getCurrentPoller();
+            if (poller) {
+                s_ctx = new IoUringContext;
+                if (!s_ctx->init(poller)) {
+                    delete s_ctx;
+                    s_ctx = nullptr;
+                }
+            }
+        }
+        return s_ctx;
+    }
+
+    ~IoUringContext() {
+        if (_event_fd != -1) {
+            close(_event_fd);
+        }
+        if (_inited) {
+            io_uring_queue_exit(&_ring);
+        }
+    }
+
+    bool read(const shared_ptr<FILE> &fp, uint64_t offset, size_t size, AsyncFileReader::onRead &cb) {
+        auto sqe = io_uring_get_sqe(&_ring);
+        if (!sqe) {
+            //提交队列已满
+            return false;
+        }
+        auto req = new Request;
+        req->fp = fp;
+        req->cb = std::move(cb);
+        req->stamp = getCurrentMicrosecond();
+        req->buf = BufferRaw::create();
+        req->buf->setCapacity(size + 1);
+        io_uring_prep_read(sqe, fileno(fp.get()), req->buf->data(), size, offset);
+        io_uring_sqe_set_data(sqe, req);
+        auto ret = io_uring_submit(&_ring);
+        if (ret < 0) {
+            //提交失败时sqe未被消耗，清空后交由调用者降级
+            io_uring_prep_nop(sqe);
+            io_uring_sqe_set_data(sqe, nullptr);
+            cb = std::move(req->cb);
+            delete req;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Request {
+        uint64_t stamp;
+        shared_ptr<FILE> fp;
+        BufferRaw::Ptr buf;
+        AsyncFileReader::onRead cb;
+    };
+
+    bool init(const EventPoller::Ptr &poller) {
+        GET_CONFIG(uint32_t, entries, General::kFileIOQueueDepth);
+        auto ret = io_uring_queue_init(MAX(entries, 8u), &_ring, 0);
+        if (ret < 0) {
+            WarnL << "io_uring_queue_init failed: " << uv_strerror(ret) << ", fallback to thread engine";
+            return false;
+        }
+        _inited = true;
+        _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_event_fd == -1 || io_uring_register_eventfd(&_ring, _event_fd) < 0) {
+            WarnL << "register io_uring eventfd failed, fallback to thread engine";
+            return false;
+        }
+        if (poller->addEvent(_event_fd, EventPoller::Event_Read, [this](int event) { onEvent(); }) == -1) {
+            WarnL << "add io_uring eventfd to poller failed, fallback to thread engine";
+            return false;
+        }
+        InfoL << "io_uring file reader started, queue depth: " << entries;
+        return true;
+    }
+
+    void onEvent() {
+        uint64_t value;
+        while (::read(_event_fd, &value, sizeof(value)) > 0);
+
+        auto &latency = getLatencyHistogram(engine_io_uring);
+        io_uring_cqe *cqe;
+        while (io_uring_peek_cqe(&_ring, &cqe) == 0) {
+            unique_ptr<Request> req((Request *)io_uring_cqe_get_data(cqe));
+            auto res = cqe->res;
+            io_uring_cqe_seen(&_ring, cqe);
+            if (!req) {
+                continue;
+            }
+            latency.observe(getCurrentMicrosecond() - req->stamp);
+            if (res > 0) {
+                req->buf->setSize(res);
+                req->cb(std::move(req->buf), 0);
+            } else {
+                req->cb(nullptr, -res);
+            }
+        }
+    }
+
+private:
+    bool _inited = false;
+    int _event_fd = -1;
+    io_uring _ring;
+};
+#endif // defined(ENABLE_IOURING)
+
+//读取文件指定位置的数据，不改变文件读写位置
+static Buffer::Ptr readFile(FILE *fp, uint64_t offset, size_t size, int &err) {
+    err = 0;
+#if defined(_WIN32)
+    err = ENOTSUP;
+    return nullptr;
+#else
+    auto buf = BufferRaw::create();
+    buf->setCapacity(size + 1);
+    ssize_t ret;
+    do {
+        ret = pread(fileno(fp), buf->data(), size, offset);
+    } while (ret == -1 && errno == EINTR);
+    if (ret > 0) {
+        buf->setSize(ret);
+        return buf;
+    }
+    if (ret == -1) {
+        err = errno;
+    }
+    return nullptr;
+#endif
+}
+
+INSTANCE_IMP(AsyncFileReader)
+
+AsyncFileReader::AsyncFileReader() {
+    GET_CONFIG(uint32_t, threads, General::kFileIOThreads);
+    addPoller("file reader", MAX(threads, 1u), ThreadPool::PRIORITY_HIGHEST, false);
+}
+
+bool AsyncFileReader::enabled() {
+    return getConfigEngine() != engine_sync;
+}
+
+const char *AsyncFileReader::getEngineName() {
+    switch (getConfigEngine()) {
+        case engine_sync: return "sync";
+#if defined(ENABLE_IOURING)
+        case engine_io_uring: return IoUringContext::current() ? "io_uring" : "thread";
+#endif
+        default: return "thread";
+    }
+}
+
+EventPoller::Ptr AsyncFileReader::getPoller() {
+    return static_pointer_cast<EventPoller>(getExecutor());
+}
+
+void AsyncFileReader::read(const shared_ptr<FILE> &fp, uint64_t offset, size_t size, onRead cb) {
+    switch (getConfigEngine()) {
+        case engine_sync: {
+            int err;
+            auto buf = readFile(fp.get(), offset, size, err);
+            cb(buf, err);
+            return;
+        }
+#if defined(ENABLE_IOURING)
+        case engine_io_uring: {
+            auto ctx = IoUringContext::current();
+            if (ctx && ctx->read(fp, offset, size, cb)) {
+                return;
+            }
+            //非poller线程或io_uring不可用，降级为线程池
+            break;
+        }
+#endif
+        default: break;
+    }
+    auto stamp = getCurrentMicrosecond();
+    getPoller()->async([fp, offset, size, cb, stamp]() {
+        int err;
+        auto buf = readFile(fp.get(), offset, size, err);
+        getLatencyHistogram(engine_thread).observe(getCurrentMicrosecond() - stamp);
+        cb(buf, err);
+    }, false);
+}
+
+} // namespace mediakit
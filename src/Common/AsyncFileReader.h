@@ -0,0 +1,68 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_ASYNCFILEREADER_H
+#define ZLMEDIAKIT_ASYNCFILEREADER_H
+
+#include <cstdio>
+#include <memory>
+#include <functional>
+#include "Network/Buffer.h"
+#include "Thread/TaskExecutor.h"
+#include "Poller/EventPoller.h"
+
+namespace mediakit {
+
+/**
+ * 异步文件读取引擎，用于http文件下载与mp4点播，防止page cache未命中时阻塞poller线程
+ * 引擎由general.file_io_engine配置:
+ *  io_uring: 在调用者所在的poller线程中提交读请求，完成事件通过eventfd在同一线程回调，无线程切换(需编译时开启ENABLE_IOURING)；
+ *  thread: 在读文件线程池中执行pread，完成后在读文件线程中回调；
+ *  auto: 优先io_uring，不支持时(未编译或内核不支持)使用thread；
+ *  sync: 关闭异步读取，保持在调用线程中同步读取。
+ */
+class AsyncFileReader : public toolkit::TaskExecutorGetterImp {
+public:
+    // 读取结果回调，buf为nullptr代表已读到文件末尾或读取失败(err为错误码)
+    using onRead = std::function<void(const toolkit::Buffer::Ptr &buf, int err)>;
+
+    static AsyncFileReader &Instance();
+    ~AsyncFileReader() override = default;
+
+    /**
+     * 是否开启异步读取
+     */
+    static bool enabled();
+
+    /**
+     * 当前线程实际使用的引擎名，用于日志与统计
+     */
+    static const char *getEngineName();
+
+    /**
+     * 异步读取文件指定位置的数据，不改变文件读写位置
+     * @param fp 文件，读取完成前会一直持有其引用
+     * @param offset 文件偏移量
+     * @param size 读取字节数，返回的数据可能小于该值(文件末尾)
+     * @param cb 完成回调，io_uring引擎下在调用线程回调，thread引擎下在读文件线程回调
+     */
+    void read(const std::shared_ptr<FILE> &fp, uint64_t offset, size_t size, onRead cb);
+
+    /**
+     * 获取一个读文件线程，可以在其中执行阻塞的文件操作(例如mp4解复用)
+     */
+    toolkit::EventPoller::Ptr getPoller();
+
+private:
+    AsyncFileReader();
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_ASYNCFILEREADER_H
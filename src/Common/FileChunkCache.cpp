@@ -0,0 +1,170 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <sys/stat.h>
+#include "FileChunkCache.h"
+#include "Common/config.h"
+#include "Common/Metrics.h"
+#include "Util/util.h"
+#include "Util/File.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+constexpr size_t FileChunkCache::kChunkSize;
+constexpr size_t FileChunkCache::kShardCount;
+
+INSTANCE_IMP(FileChunkCache)
+
+static size_t getCapacity() {
+    GET_CONFIG(size_t, cache_mb, General::kFileCacheMB);
+    return cache_mb * 1024 * 1024;
+}
+
+bool FileChunkCache::enabled() {
+    //每个分片至少能容纳一个chunk，否则所有chunk都无法进入缓存
+    return getCapacity() >= kShardCount * kChunkSize;
+}
+
+string FileChunkCache::makeFileKey(const string &path, uint64_t &file_size) {
+    struct stat st;
+    if (stat(path.data(), &st) != 0) {
+        return "";
+    }
+    file_size = st.st_size;
+#if defined(__linux__) || defined(__linux)
+    //纳秒精度，防止同一秒内被改写(例如直播m3u8)时命中旧缓存
+    uint64_t mtime = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+#else
+    uint64_t mtime = st.st_mtime;
+#endif
+    return path + '?' + to_string(file_size) + '-' + to_string(mtime);
+}
+
+Buffer::Ptr FileChunkCache::readChunk(FILE *fp, uint64_t index, uint64_t file_size) {
+    auto offset = index * kChunkSize;
+    if (!fp || offset >= file_size) {
+        return nullptr;
+    }
+    auto size = (size_t)MIN((uint64_t)kChunkSize, file_size - offset);
+    if (fseek64(fp, offset, SEEK_SET) != 0) {
+        return nullptr;
+    }
+    auto chunk = BufferRaw::create();
+    chunk->setCapacity(size + 1);
+    auto ret = fread(chunk->data(), 1, size, fp);
+    if (!ret) {
+        return nullptr;
+    }
+    chunk->setSize(ret);
+    return chunk;
+}
+
+FileChunkCache::Shard &FileChunkCache::getShard(const string &key) {
+    return _shards[hash<string>()(key) % kShardCount];
+}
+
+static string makeChunkKey(const string &file_key, uint64_t index) {
+    return file_key + '#' + to_string(index);
+}
+
+Buffer::Ptr FileChunkCache::get(const string &file_key, uint64_t index) {
+    static auto &s_hits = Metrics::Instance().getCounter("zlm_file_cache_hits_total", "", "File chunk cache hits for http and mp4 vod");
+    static auto &s_misses = Metrics::Instance().getCounter("zlm_file_cache_misses_total", "", "File chunk cache misses for http and mp4 vod");
+    auto key = makeChunkKey(file_key, index);
+    auto &shard = getShard(key);
+    lock_guard<mutex> lck(shard.mtx);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        ++shard.misses;
+        s_misses.add();
+        return nullptr;
+    }
+    ++shard.hits;
+    s_hits.add();
+    //移至头部
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->second;
+}
+
+void FileChunkCache::put(const string &file_key, uint64_t index, const Buffer::Ptr &chunk) {
+    if (chunk && admit(file_key, index, chunk->size())) {
+        insert(file_key, index, chunk);
+    }
+}
+
+bool FileChunkCache::admit(const string &file_key, uint64_t index, size_t size) {
+    auto capacity = getCapacity() / kShardCount;
+    if (size > capacity) {
+        return false;
+    }
+    auto key = makeChunkKey(file_key, index);
+    auto &shard = getShard(key);
+    lock_guard<mutex> lck(shard.mtx);
+    if (shard.map.find(key) != shard.map.end()) {
+        //并发读取同一chunk
+        return false;
+    }
+    if (shard.ghost.erase(key)) {
+        return true;
+    }
+    //第一次读取，只记录到影子队列，影子队列长度与缓存可容纳的chunk个数相当
+    shard.ghost.emplace(key);
+    shard.ghost_fifo.emplace_back(std::move(key));
+    while (shard.ghost_fifo.size() > capacity / kChunkSize + 1) {
+        shard.ghost.erase(shard.ghost_fifo.front());
+        shard.ghost_fifo.pop_front();
+    }
+    return false;
+}
+
+void FileChunkCache::insert(const string &file_key, uint64_t index, const Buffer::Ptr &chunk) {
+    static auto &s_evictions = Metrics::Instance().getCounter("zlm_file_cache_evictions_total", "", "File chunks evicted from the cache");
+    auto capacity = getCapacity() / kShardCount;
+    if (!chunk || chunk->size() > capacity) {
+        return;
+    }
+    auto key = makeChunkKey(file_key, index);
+    auto &shard = getShard(key);
+    lock_guard<mutex> lck(shard.mtx);
+    if (shard.map.find(key) != shard.map.end()) {
+        return;
+    }
+    //淘汰最久未访问的chunk
+    while (!shard.lru.empty() && shard.bytes + chunk->size() > capacity) {
+        auto &back = shard.lru.back();
+        shard.bytes -= back.second->size();
+        shard.map.erase(back.first);
+        shard.lru.pop_back();
+        ++shard.evictions;
+        s_evictions.add();
+    }
+    shard.lru.emplace_front(key, chunk);
+    shard.map.emplace(std::move(key), shard.lru.begin());
+    shard.bytes += chunk->size();
+}
+
+FileChunkCache::Statistic FileChunkCache::getStatistic() const {
+    Statistic ret;
+    ret.capacity = getCapacity();
+    for (auto &shard : _shards) {
+        lock_guard<mutex> lck(shard.mtx);
+        ret.hits += shard.hits;
+        ret.misses += shard.misses;
+        ret.evictions += shard.evictions;
+        ret.chunks += shard.map.size();
+        ret.bytes += shard.bytes;
+    }
+    return ret;
+}
+
+} // namespace mediakit
@@ -0,0 +1,122 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_FILECHUNKCACHE_H
+#define ZLMEDIAKIT_FILECHUNKCACHE_H
+
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <deque>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "Network/Buffer.h"
+
+namespace mediakit {
+
+/**
+ * 点播文件内容缓存，http文件下载(含hls点播)与mp4点播共用
+ * 文件按固定大小切分为chunk缓存在内存中，总大小不超过general.file_cache_mb；
+ * 按key的hash分片加锁，每个分片独立做lru淘汰；
+ * 准入策略: chunk第一次被读取时只记录在影子队列中，短时间内第二次被读取才进入缓存，
+ * 防止单次下载或顺序扫描大文件把热点录像挤出缓存
+ */
+class FileChunkCache {
+public:
+    static constexpr size_t kChunkSize = 256 * 1024;
+
+    class Statistic {
+    public:
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t chunks = 0;
+        size_t bytes = 0;
+        size_t capacity = 0;
+    };
+
+    static FileChunkCache &Instance();
+
+    /**
+     * 是否开启缓存，general.file_cache_mb小于4(每个分片容纳不了一个chunk)时关闭
+     */
+    static bool enabled();
+
+    /**
+     * 生成文件缓存标识，包含路径、文件大小与修改时间，文件被改写后旧的缓存自然失效
+     * @param path 文件路径
+     * @param file_size 返回文件大小
+     * @return 文件不存在时返回空
+     */
+    static std::string makeFileKey(const std::string &path, uint64_t &file_size);
+
+    /**
+     * 同步读取文件的某个chunk，会改变文件读写位置
+     * @param fp 文件
+     * @param index chunk序号
+     * @param file_size 文件大小
+     */
+    static toolkit::Buffer::Ptr readChunk(FILE *fp, uint64_t index, uint64_t file_size);
+
+    /**
+     * 获取缓存的chunk
+     * @return 未命中时返回nullptr
+     */
+    toolkit::Buffer::Ptr get(const std::string &file_key, uint64_t index);
+
+    /**
+     * 缓存从文件读取的chunk，是否真正缓存由准入策略决定
+     */
+    void put(const std::string &file_key, uint64_t index, const toolkit::Buffer::Ptr &chunk);
+
+    /**
+     * 准入判断，第一次读取只记录，短时间内第二次读取才返回true；
+     * 用于在拷贝数据前判断是否需要缓存(例如mmap内存未准入时直接零拷贝发送)
+     * @param size chunk大小
+     */
+    bool admit(const std::string &file_key, uint64_t index, size_t size);
+
+    /**
+     * 不经准入判断直接缓存chunk，配合admit使用
+     */
+    void insert(const std::string &file_key, uint64_t index, const toolkit::Buffer::Ptr &chunk);
+
+    Statistic getStatistic() const;
+
+private:
+    FileChunkCache() = default;
+
+    class Shard {
+    public:
+        using Entry = std::pair<std::string, toolkit::Buffer::Ptr>;
+        mutable std::mutex mtx;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        //头部为最近访问
+        std::list<Entry> lru;
+        std::unordered_map<std::string, std::list<Entry>::iterator> map;
+        //影子队列，只记录key
+        std::deque<std::string> ghost_fifo;
+        std::unordered_set<std::string> ghost;
+    };
+
+    static constexpr size_t kShardCount = 16;
+    Shard &getShard(const std::string &key);
+
+private:
+    Shard _shards[kShardCount];
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_FILECHUNKCACHE_H
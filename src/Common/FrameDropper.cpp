@@ -0,0 +1,250 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "FrameDropper.h"
+#include "Common/config.h"
+#include "Rtsp/Rtsp.h"
+#include "Rtmp/Rtmp.h"
+#include "Network/Socket.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+FrameDropper::FrameDropper(const string &schema) {
+    auto &metrics = Metrics::Instance();
+    auto non_ref = "schema=\"" + schema + "\",reason=\"non_ref\"";
+    auto skip = "schema=\"" + schema + "\",reason=\"skip_to_key\"";
+    _non_ref_packets = &metrics.getCounter("zlm_viewer_drop_packets_total", non_ref, "Packets dropped for congested viewers");
+    _non_ref_bytes = &metrics.getCounter("zlm_viewer_drop_bytes_total", non_ref, "Bytes dropped for congested viewers");
+    _skip_packets = &metrics.getCounter("zlm_viewer_drop_packets_total", skip, "Packets dropped for congested viewers");
+    _skip_bytes = &metrics.getCounter("zlm_viewer_drop_bytes_total", skip, "Bytes dropped for congested viewers");
+    _skip_events = &metrics.getCounter("zlm_viewer_skip_to_key_total", "schema=\"" + schema + "\"", "Times a congested viewer skipped to the next key frame");
+}
+
+bool FrameDropper::enabled() {
+    GET_CONFIG(size_t, drop_non_ref_bytes, General::kDropNonRefBytes);
+    GET_CONFIG(size_t, skip_to_key_bytes, General::kSkipToKeyBytes);
+    return drop_non_ref_bytes || skip_to_key_bytes;
+}
+
+bool FrameDropper::canSkipToKey(CodecId codec) {
+    //其他编码的rtp包无法判断是否为关键帧，进入跳帧模式后将无法恢复
+    return codec == CodecH264 || codec == CodecH265;
+}
+
+void FrameDropper::setVideoCodec(CodecId codec) {
+    _video_codec = codec;
+    _skip_enabled = canSkipToKey(codec);
+}
+
+bool FrameDropper::checkSkip() {
+    GET_CONFIG(size_t, skip_to_key_bytes, General::kSkipToKeyBytes);
+    if (_skipping || !_skip_enabled || !skip_to_key_bytes || _pending_bytes < skip_to_key_bytes) {
+        return false;
+    }
+    _skipping = true;
+    ++_skip_times;
+    _skip_events->add();
+    return true;
+}
+
+FrameDropper::DropReason FrameDropper::checkFrame(PacketKind kind, bool busy) {
+    GET_CONFIG(size_t, drop_non_ref_bytes, General::kDropNonRefBytes);
+    if (_skipping) {
+        if (kind != kind_key_start || busy) {
+            //积压未清空或不是关键帧的开始，继续丢弃
+            return drop_skip;
+        }
+        //积压已清空，从关键帧开始恢复发送
+        _skipping = false;
+        return drop_none;
+    }
+    if (checkSkip()) {
+        return drop_skip;
+    }
+    if (kind == kind_non_ref && drop_non_ref_bytes && _pending_bytes >= drop_non_ref_bytes) {
+        return drop_non_ref;
+    }
+    return drop_none;
+}
+
+bool FrameDropper::input(PacketKind kind, size_t bytes, bool busy, uint32_t stamp) {
+    if (!busy) {
+        //socket可写，之前的积压已经发送完毕
+        _pending_bytes = 0;
+    }
+
+    auto reason = drop_none;
+    if (kind == kind_audio) {
+        //音频不需要等待关键帧，积压清空后即恢复发送
+        checkSkip();
+        if (_skipping && !busy && !_has_video) {
+            //纯音频流，直接退出跳帧模式
+            _skipping = false;
+        }
+        reason = _skipping && busy ? drop_skip : drop_none;
+    } else {
+        if (!_has_video || stamp != _frame_stamp) {
+            //新的一帧，同一帧的多个包只判断一次，防止只发送了半帧或者丢失了帧头
+            _has_video = true;
+            _frame_stamp = stamp;
+            _frame_drop = checkFrame(kind, busy);
+        }
+        reason = _frame_drop;
+    }
+
+    switch (reason) {
+        case drop_skip:
+            ++_drop_skip;
+            _skip_packets->add();
+            _skip_bytes->add(bytes);
+            return true;
+        case drop_non_ref:
+            ++_drop_non_ref;
+            _non_ref_packets->add();
+            _non_ref_bytes->add(bytes);
+            return true;
+        default:
+            break;
+    }
+
+    if (busy) {
+        _pending_bytes += bytes;
+    }
+    return false;
+}
+
+bool FrameDropper::inputRtp(const RtpPacket::Ptr &rtp, bool busy) {
+    auto kind = kind_audio;
+    if (rtp->type == TrackVideo) {
+        kind = getRtpKind(_video_codec, rtp->getPayload(), rtp->getPayloadSize());
+    }
+    return input(kind, rtp->size(), busy, rtp->getStamp());
+}
+
+bool FrameDropper::inputRtmp(const RtmpPacket::Ptr &rtmp, bool busy) {
+    return input(getRtmpKind(*rtmp), rtmp->size(), busy, rtmp->time_stamp);
+}
+
+static FrameDropper::PacketKind getH264Kind(uint8_t nal_header, bool start) {
+    switch (nal_header & 0x1F) {
+        case 5: return start ? FrameDropper::kind_key_start : FrameDropper::kind_ref;
+        case 7:
+        case 8: return FrameDropper::kind_key_start;
+        case 1: return (nal_header & 0x60) ? FrameDropper::kind_ref : FrameDropper::kind_non_ref;
+        //sei、aud等
+        default: return FrameDropper::kind_ref;
+    }
+}
+
+static FrameDropper::PacketKind getH265Kind(uint8_t nal_header, bool start) {
+    auto type = (nal_header >> 1) & 0x3F;
+    if (type >= 16 && type <= 21) {
+        //IRAP
+        return start ? FrameDropper::kind_key_start : FrameDropper::kind_ref;
+    }
+    if (type >= 32 && type <= 34) {
+        //vps/sps/pps
+        return FrameDropper::kind_key_start;
+    }
+    if (type <= 14 && type % 2 == 0) {
+        //TRAIL_N、TSA_N、STSA_N、RADL_N、RASL_N等子层非参考帧
+        return FrameDropper::kind_non_ref;
+    }
+    return FrameDropper::kind_ref;
+}
+
+FrameDropper::PacketKind FrameDropper::getRtpKind(CodecId codec, const uint8_t *payload, size_t size) {
+    switch (codec) {
+        case CodecH264: {
+            if (size < 2) {
+                return kind_ref;
+            }
+            switch (payload[0] & 0x1F) {
+                //STAP-A，取第一个nalu
+                case 24: return size > 3 ? getH264Kind(payload[3], true) : kind_ref;
+                //FU-A，nri在FU indicator中，nalu类型在FU header中
+                case 28: return getH264Kind((payload[0] & 0x60) | (payload[1] & 0x1F), payload[1] & 0x80);
+                default: return getH264Kind(payload[0], true);
+            }
+        }
+        case CodecH265: {
+            if (size < 3) {
+                return kind_ref;
+            }
+            switch ((payload[0] >> 1) & 0x3F) {
+                //AP，取第一个nalu
+                case 48: return size > 4 ? getH265Kind(payload[4], true) : kind_ref;
+                //FU，nalu类型在FU header中
+                case 49: return getH265Kind((payload[2] & 0x3F) << 1, payload[2] & 0x80);
+                default: return getH265Kind(payload[0], true);
+            }
+        }
+        default: return kind_ref;
+    }
+}
+
+FrameDropper::PacketKind FrameDropper::getRtmpKind(const RtmpPacket &rtmp) {
+    if (rtmp.type_id != MSG_VIDEO) {
+        return kind_audio;
+    }
+    if (rtmp.size() < 5) {
+        return kind_ref;
+    }
+    if (rtmp.isCfgFrame() || (uint8_t)rtmp.buffer[0] >> 4 == FLV_KEY_FRAME) {
+        return kind_key_start;
+    }
+    auto codec = rtmp.getMediaType();
+    if (codec != FLV_CODEC_H264 && codec != FLV_CODEC_H265) {
+        return kind_ref;
+    }
+    //跳过flv video tag头(1字节)、AVCPacketType(1字节)与CompositionTime(3字节)，遍历avcc格式的nalu，以第一个slice为准
+    auto ptr = (const uint8_t *)rtmp.data() + 5;
+    auto end = (const uint8_t *)rtmp.data() + rtmp.size();
+    while (ptr + 5 <= end) {
+        uint32_t nal_size = ((uint32_t)ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
+        auto nal_header = ptr[4];
+        if (codec == FLV_CODEC_H264) {
+            auto type = nal_header & 0x1F;
+            if (type >= 1 && type <= 5) {
+                return getH264Kind(nal_header, true);
+            }
+        } else if (((nal_header >> 1) & 0x3F) < 32) {
+            return getH265Kind(nal_header, true);
+        }
+        if (nal_size > (size_t)(end - ptr - 4)) {
+            break;
+        }
+        ptr += 4 + nal_size;
+    }
+    return kind_ref;
+}
+
+void RtpSeqRewriter::onDrop(const RtpPacket::Ptr &rtp) {
+    ++_seq_offset[rtp->getSSRC()];
+}
+
+RtpPacket::Ptr RtpSeqRewriter::rewrite(const RtpPacket::Ptr &rtp) {
+    auto it = _seq_offset.find(rtp->getSSRC());
+    if (it == _seq_offset.end() || !it->second) {
+        return rtp;
+    }
+    auto ret = RtpPacket::create();
+    ret->assign(rtp->data(), rtp->size());
+    ret->type = rtp->type;
+    ret->sample_rate = rtp->sample_rate;
+    ret->ntp_stamp = rtp->ntp_stamp;
+    ret->getHeader()->seq = htons((uint16_t) (rtp->getSeq() - it->second));
+    return ret;
+}
+
+} // namespace mediakit
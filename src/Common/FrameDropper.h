@@ -0,0 +1,153 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_FRAMEDROPPER_H
+#define ZLMEDIAKIT_FRAMEDROPPER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Extension/Frame.h"
+#include "Common/Metrics.h"
+
+namespace mediakit {
+
+class RtpPacket;
+class RtmpPacket;
+
+/**
+ * 慢速播放器丢帧策略，每个播放会话一个实例
+ * 估算会话的发送积压字节数(socket繁忙期间累计发送的字节数，socket恢复可写后清零):
+ *  积压超过general.drop_non_ref_bytes时，丢弃非参考帧，其他帧不受影响，解码不会花屏；
+ *  积压超过general.skip_to_key_bytes时，丢弃后续所有音视频包，积压清空后音频恢复发送，视频遇到下一个关键帧时恢复发送；
+ *  同一视频帧的多个包只在第一个包时判断一次是否丢弃，不会只发送半帧。
+ * 这样单个慢速播放器不会在发送缓存中堆积几十MB数据，也不会因为缓存越积越多导致延时不断增大
+ */
+class FrameDropper {
+public:
+    using Ptr = std::shared_ptr<FrameDropper>;
+
+    enum PacketKind {
+        //音频或其他非视频包
+        kind_audio = 0,
+        //关键帧(含配置帧)的开始，可以从此处恢复发送
+        kind_key_start,
+        //参考帧或关键帧后续分片
+        kind_ref,
+        //非参考帧
+        kind_non_ref,
+    };
+
+    /**
+     * @param schema 播放协议，用于统计指标
+     */
+    FrameDropper(const std::string &schema);
+
+    /**
+     * 设置视频编码，rtp包判断帧类型时需要
+     */
+    void setVideoCodec(CodecId codec);
+
+    /**
+     * 输入一个待发送的包，判断是否丢弃
+     * @param kind 包类型
+     * @param bytes 包大小
+     * @param busy socket是否繁忙(发送缓存有积压)
+     * @param stamp 包所属帧的时间戳，用于判断视频包是否属于同一帧
+     * @return 是否丢弃该包
+     */
+    bool input(PacketKind kind, size_t bytes, bool busy, uint32_t stamp);
+
+    bool inputRtp(const std::shared_ptr<RtpPacket> &rtp, bool busy);
+    bool inputRtmp(const std::shared_ptr<RtmpPacket> &rtmp, bool busy);
+
+    /**
+     * 是否开启丢帧，阈值都为0时关闭
+     */
+    static bool enabled();
+
+    /**
+     * 该编码的rtp包能否判断关键帧，不能判断时不能跳至下一个关键帧
+     */
+    static bool canSkipToKey(CodecId codec);
+
+    /**
+     * 根据rtp负载判断h264/h265包类型，其他编码都视为参考帧
+     */
+    static PacketKind getRtpKind(CodecId codec, const uint8_t *payload, size_t size);
+
+    /**
+     * 根据flv video tag判断h264/h265包类型
+     */
+    static PacketKind getRtmpKind(const RtmpPacket &rtmp);
+
+    uint64_t getDropNonRefCount() const { return _drop_non_ref; }
+    uint64_t getDropSkipCount() const { return _drop_skip; }
+    uint64_t getSkipTimes() const { return _skip_times; }
+
+private:
+    enum DropReason {
+        drop_none = 0,
+        drop_non_ref,
+        drop_skip,
+    };
+
+    bool checkSkip();
+    DropReason checkFrame(PacketKind kind, bool busy);
+
+private:
+    bool _skipping = false;
+    //rtp视频编码无法判断关键帧时不进入跳帧模式
+    bool _skip_enabled = true;
+    bool _has_video = false;
+    uint32_t _frame_stamp = 0;
+    DropReason _frame_drop = drop_none;
+    CodecId _video_codec = CodecInvalid;
+    size_t _pending_bytes = 0;
+    uint64_t _drop_non_ref = 0;
+    uint64_t _drop_skip = 0;
+    uint64_t _skip_times = 0;
+    MetricCounter *_non_ref_packets;
+    MetricCounter *_non_ref_bytes;
+    MetricCounter *_skip_packets;
+    MetricCounter *_skip_bytes;
+    MetricCounter *_skip_events;
+};
+
+/**
+ * 主动丢弃rtp包后，重写该ssrc后续包的seq，使发送出去的seq保持连续
+ * 否则接收端会把主动丢弃的包当作网络丢包，反复nack请求重传(而重传缓存中并没有这些包)，并计入丢包率
+ * rtp包在环形缓存中被所有播放器共享，不能原地修改，seq有偏移时拷贝一份再修改
+ * 时间戳不修改：被丢弃的帧对应的时间确实已经流逝，接收端按时间戳正常播放即可
+ */
+class RtpSeqRewriter {
+public:
+    /**
+     * 记录一个被丢弃(未发送)的包
+     */
+    void onDrop(const std::shared_ptr<RtpPacket> &rtp);
+
+    /**
+     * 获取实际发送的包，seq无需修改时返回原包
+     */
+    std::shared_ptr<RtpPacket> rewrite(const std::shared_ptr<RtpPacket> &rtp);
+
+    /**
+     * 是否丢弃过包，未丢弃过时无需重写
+     */
+    bool hasOffset() const { return !_seq_offset.empty(); }
+
+private:
+    //ssrc -> 已丢弃的包个数(seq偏移量)
+    std::unordered_map<uint32_t, uint16_t> _seq_offset;
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_FRAMEDROPPER_H
@@ -8,6 +8,8 @@
  * may be found in the AUTHORS file in the root of the source tree.
  */
 #include <mutex>
+#include <list>
+#include <algorithm>
 #include "Util/util.h"
 #include "Util/NoticeCenter.h"
 #include "Network/sockutil.h"
@@ -26,12 +28,108 @@ namespace toolkit {
 
 namespace mediakit {
 
-static recursive_mutex s_media_source_mtx;
-using StreamMap = unordered_map<string/*strema_id*/, weak_ptr<MediaSource> >;
-using AppStreamMap = unordered_map<string/*app*/, StreamMap>;
-using VhostAppStreamMap = unordered_map<string/*vhost*/, AppStreamMap>;
-using SchemaVhostAppStreamMap = unordered_map<string/*schema*/, VhostAppStreamMap>;
-static SchemaVhostAppStreamMap s_media_source_map;
+/**
+ * 媒体源注册表
+ * 以schema/vhost/app/stream拼接成的扁平key做hash分片，每个分片独立加锁写入；
+ * 分片内的map采用写时复制，查找时用std::atomic_load取快照，不获取分片写锁，也不会等待写者拷贝map；
+ * 注意shared_ptr的atomic_load并非无锁，libstdc++中会短暂持有按地址hash的全局互斥锁，临界区仅为引用计数加一
+ */
+class MediaSourceRegistry {
+public:
+    using MediaMap = unordered_map<string/*schema/vhost/app/stream*/, weak_ptr<MediaSource> >;
+    using MediaMapPtr = std::shared_ptr<const MediaMap>;
+
+    static MediaSourceRegistry &Instance() {
+        static MediaSourceRegistry s_instance;
+        return s_instance;
+    }
+
+    static string getKey(const string &schema, const string &vhost, const string &app, const string &stream) {
+        string key;
+        key.reserve(schema.size() + vhost.size() + app.size() + stream.size() + 3);
+        key.append(schema).append(1, '/').append(vhost).append(1, '/').append(app).append(1, '/').append(stream);
+        return key;
+    }
+
+    MediaSource::Ptr find(const string &key) const {
+        auto map = std::atomic_load(&getShard(key)._map);
+        auto it = map->find(key);
+        return it == map->end() ? nullptr : it->second.lock();
+    }
+
+    /**
+     * 注册媒体源
+     * @return 该key已被其他存活的媒体源占用时返回该媒体源，否则返回nullptr
+     */
+    MediaSource::Ptr add(const string &key, const MediaSource::Ptr &src) {
+        auto &shard = getShard(key);
+        lock_guard<mutex> lck(shard._mtx);
+        auto it = shard._map->find(key);
+        if (it != shard._map->end()) {
+            if (auto exist = it->second.lock()) {
+                return exist;
+            }
+        }
+        auto map = std::make_shared<MediaMap>(*shard._map);
+        (*map)[key] = src;
+        std::atomic_store(&shard._map, MediaMapPtr(std::move(map)));
+        return nullptr;
+    }
+
+    /**
+     * 注销媒体源，对象已经销毁或者对象就是自己时才移除
+     * @return 是否移除成功
+     */
+    bool remove(const string &key, const MediaSource *thiz) {
+        auto &shard = getShard(key);
+        lock_guard<mutex> lck(shard._mtx);
+        auto it = shard._map->find(key);
+        if (it == shard._map->end()) {
+            return false;
+        }
+        auto src = it->second.lock();
+        if (src && src.get() != thiz) {
+            return false;
+        }
+        auto map = std::make_shared<MediaMap>(*shard._map);
+        map->erase(key);
+        std::atomic_store(&shard._map, MediaMapPtr(std::move(map)));
+        return true;
+    }
+
+    template<typename FUNC>
+    void for_each(const FUNC &func) const {
+        for (auto &shard : _shards) {
+            auto map = std::atomic_load(&shard._map);
+            for (auto &pr : *map) {
+                func(pr.second);
+            }
+        }
+    }
+
+private:
+    //分片个数，必须为2的幂
+    static constexpr size_t kShardCount = 64;
+
+    struct Shard {
+        //仅用于串行化写操作
+        mutex _mtx;
+        MediaMapPtr _map = std::make_shared<MediaMap>();
+    };
+
+    MediaSourceRegistry() = default;
+
+    Shard &getShard(const string &key) {
+        return _shards[std::hash<string>()(key) & (kShardCount - 1)];
+    }
+
+    const Shard &getShard(const string &key) const {
+        return _shards[std::hash<string>()(key) & (kShardCount - 1)];
+    }
+
+private:
+    Shard _shards[kShardCount];
+};
 
 string getOriginTypeString(MediaOriginType type){
 #define SWITCH_CASE(type) case MediaOriginType::type : return #type
@@ -46,6 +144,7 @@ string getOriginTypeString(MediaOriginType type){
         SWITCH_CASE(device_chn);
         SWITCH_CASE(rtc_push);
         SWITCH_CASE(srt_push);
+        SWITCH_CASE(transcode);
         default : return "unknown";
     }
 }
@@ -247,6 +346,15 @@ bool MediaSource::seekTo(uint32_t stamp) {
     return listener->seekTo(*this, stamp);
 }
 
+void MediaSource::seekToAsync(uint32_t stamp, const function<void(bool)> &cb) {
+    auto listener = _listener.lock();
+    if (!listener) {
+        cb(false);
+        return;
+    }
+    listener->seekToAsync(*this, stamp, cb);
+}
+
 bool MediaSource::pause(bool pause) {
     auto listener = _listener.lock();
     if (!listener) {
@@ -283,6 +391,14 @@ float MediaSource::getLossRate(mediakit::TrackType type) {
     return listener->getLossRate(*this, type);
 }
 
+bool MediaSource::requestKeyFrame() {
+    auto listener = _listener.lock();
+    if (!listener) {
+        return false;
+    }
+    return listener->requestKeyFrame(*this);
+}
+
 toolkit::EventPoller::Ptr MediaSource::getOwnerPoller() {
     toolkit::EventPoller::Ptr ret;
     auto listener = _listener.lock();
@@ -348,36 +464,21 @@ bool MediaSource::stopSendRtp(const string &ssrc) {
     return listener->stopSendRtp(*this, ssrc);
 }
 
-template<typename MAP, typename LIST, typename First, typename ...KeyTypes>
-static void for_each_media_l(const MAP &map, LIST &list, const First &first, const KeyTypes &...keys) {
-    if (first.empty()) {
-        for (auto &pr : map) {
-            for_each_media_l(pr.second, list, keys...);
-        }
-    }
-    else {
-        auto it = map.find(first);
-        if (it != map.end()) {
-            for_each_media_l(it->second, list, keys...);
-        }
+void MediaSource::startTranscode(const MediaSourceEvent::TranscodeArgs &args, const std::function<void(const toolkit::SockException &)> cb) {
+    auto listener = _listener.lock();
+    if (!listener) {
+        cb(SockException(Err_other, "尚未设置事件监听器"));
+        return;
     }
+    return listener->startTranscode(*this, args, cb);
 }
 
-template<typename MAP, typename LIST, typename First>
-static void for_each_media_l(const MAP &map, LIST &list, const First &first) {
-    if (first.empty()) {
-        for (auto &pr : map) {
-            if(auto ptr = pr.second.lock())
-                list.emplace_back(std::move(ptr));
-        }
-    }
-    else{
-        auto it = map.find(first);
-        if (it != map.end()) {
-            if(auto ptr = it->second.lock())
-                list.emplace_back(std::move(ptr));
-        }
+bool MediaSource::stopTranscode(const string &stream_id) {
+    auto listener = _listener.lock();
+    if (!listener) {
+        return false;
     }
+    return listener->stopTranscode(*this, stream_id);
 }
 
 void MediaSource::for_each_media(const function<void(const Ptr &src)> &cb,
@@ -385,11 +486,27 @@ void MediaSource::for_each_media(const function<void(const Ptr &src)> &cb,
                                  const string &vhost,
                                  const string &app,
                                  const string &stream) {
-    deque<Ptr> src_list;
-    {
-        lock_guard<recursive_mutex> lock(s_media_source_mtx);
-        for_each_media_l(s_media_source_map, src_list, schema, vhost, app, stream);
+    auto &registry = MediaSourceRegistry::Instance();
+    if (!schema.empty() && !vhost.empty() && !app.empty() && !stream.empty()) {
+        //精确查找，无需遍历
+        if (auto src = registry.find(MediaSourceRegistry::getKey(schema, vhost, app, stream))) {
+            cb(src);
+        }
+        return;
     }
+
+    deque<Ptr> src_list;
+    registry.for_each([&](const weak_ptr<MediaSource> &weak_src) {
+        auto src = weak_src.lock();
+        if (!src ||
+            (!schema.empty() && src->getSchema() != schema) ||
+            (!vhost.empty() && src->getVhost() != vhost) ||
+            (!app.empty() && src->getApp() != app) ||
+            (!stream.empty() && src->getId() != stream)) {
+            return;
+        }
+        src_list.emplace_back(std::move(src));
+    });
     for (auto &src : src_list) {
         cb(src);
     }
@@ -407,8 +524,7 @@ static MediaSource::Ptr find_l(const string &schema, const string &vhost_in, con
         return nullptr;
     }
 
-    MediaSource::Ptr ret;
-    MediaSource::for_each_media([&](const MediaSource::Ptr &src) { ret = std::move(const_cast<MediaSource::Ptr &>(src)); }, schema, vhost, app, id);
+    MediaSource::Ptr ret = MediaSourceRegistry::Instance().find(MediaSourceRegistry::getKey(schema, vhost, app, id));
 
     if(!ret && from_mp4 && schema != HLS_SCHEMA){
         //未找到媒体源，则读取mp4创建一个
@@ -419,79 +535,249 @@ static MediaSource::Ptr find_l(const string &schema, const string &vhost_in, con
 }
 
 static void findAsync_l(const MediaInfo &info, const std::shared_ptr<Session> &session, bool retry,
-                        const function<void(const MediaSource::Ptr &src)> &cb){
-    auto src = find_l(info._schema, info._vhost, info._app, info._streamid, true);
-    if (src || !retry) {
-        cb(src);
-        return;
-    }
+                        const function<void(const MediaSource::Ptr &src)> &cb);
+
+/**
+ * 异步查找流请求合并
+ * 同一个vhost/app/stream同时只存在一次等待(flight)：只有第一个播放请求会广播流未找到事件(触发hook或拉流)，
+ * 后续播放请求直接挂在该flight上；流注册后一次性唤醒所有同schema的等待者，
+ * 流未找到事件的close_player回调会一次性关闭所有等待者；
+ * flight最多存在general.maxStreamWaitMS，过期后的播放请求会开始新的flight并重新广播流未找到事件，
+ * 防止hook失败或无响应时，持续有播放请求加入导致再也不会广播流未找到事件。
+ */
+class FindAsyncCoalescer {
+public:
+    class Waiter {
+    public:
+        using Ptr = std::shared_ptr<Waiter>;
+        MediaInfo info;
+        weak_ptr<Session> session;
+        EventPoller::Ptr poller;
+        EventPoller::DelayTask::Ptr timeout;
+        function<void(const MediaSource::Ptr &src)> cb;
+    };
+
+    class Flight {
+    public:
+        using Ptr = std::shared_ptr<Flight>;
+        string key;
+        Ticker ticker;
+        bool resolved = false;
+        list<Waiter::Ptr> waiters;
+    };
+
+    static FindAsyncCoalescer &Instance() {
+        static FindAsyncCoalescer s_instance;
+        return s_instance;
+    }
+
+    void wait(const MediaInfo &info, const std::shared_ptr<Session> &session, const function<void(const MediaSource::Ptr &src)> &cb) {
+        GET_CONFIG(int, maxWaitMS, General::kMaxStreamWaitTimeMS);
+        auto waiter = std::make_shared<Waiter>();
+        waiter->info = info;
+        waiter->session = session;
+        waiter->poller = session->getPoller();
+        std::shared_ptr<atomic_flag> invoked(new atomic_flag{false});
+        waiter->cb = [cb, invoked](const MediaSource::Ptr &src) {
+            if (invoked->test_and_set()) {
+                //回调已经执行过了
+                return;
+            }
+            cb(src);
+        };
+
+        auto key = info._vhost + "/" + info._app + "/" + info._streamid;
+        Flight::Ptr flight;
+        bool first = false;
+        size_t waiter_count = 0;
+        {
+            lock_guard<mutex> lck(_mtx);
+            auto &ref = _flights[key];
+            if (!ref || ref->ticker.elapsedTime() >= (uint64_t)maxWaitMS) {
+                //旧的flight已过期，由其等待者的超时定时器持有，超时后自然释放
+                ref = std::make_shared<Flight>();
+                ref->key = key;
+                first = true;
+                ++_statistic.flights;
+            } else {
+                ++_statistic.coalesced;
+            }
+            flight = ref;
+            std::weak_ptr<Waiter> weak_waiter = waiter;
+            //强引用flight，过期被替换的flight在其等待者结束前不会释放
+            waiter->timeout = waiter->poller->doDelayTask(maxWaitMS, [this, flight, weak_waiter]() {
+                // 最多等待一定时间，如在这个时间内，流还未注册上，则返回空
+                onTimeout(flight, weak_waiter);
+                return 0;
+            });
+            flight->waiters.emplace_back(waiter);
+            waiter_count = flight->waiters.size();
+            ++_statistic.waiters;
+        }
 
-    GET_CONFIG(int, maxWaitMS, General::kMaxStreamWaitTimeMS);
-    void *listener_tag = session.get();
-    auto poller = session->getPoller();
-    std::shared_ptr<atomic_flag> invoked(new atomic_flag{false});
-    auto cb_once = [cb, invoked](const MediaSource::Ptr &src) {
-        if (invoked->test_and_set()) {
-            //回调已经执行过了
+        if (!first) {
+            DebugL << "合并异步查找流请求:" << info.getUrl() << ", 等待者个数:" << waiter_count;
             return;
         }
-        cb(src);
-    };
 
-    auto on_timeout = poller->doDelayTask(maxWaitMS, [cb_once, listener_tag]() {
-        // 最多等待一定时间，如在这个时间内，流还未注册上，则返回空
-        NoticeCenter::Instance().delListener(listener_tag, Broadcast::kBroadcastMediaChanged);
-        cb_once(nullptr);
-        return 0;
-    });
+        std::weak_ptr<Flight> weak_flight = flight;
+        //监听媒体注册事件，每个flight只监听一次
+        NoticeCenter::Instance().addListener(flight.get(), Broadcast::kBroadcastMediaChanged, [this, weak_flight, info](BroadcastMediaChangedArgs) {
+            if (!bRegist || sender.getVhost() != info._vhost || sender.getApp() != info._app || sender.getId() != info._streamid) {
+                //不是自己感兴趣的事件，忽略之
+                return;
+            }
+            onRegist(weak_flight, sender.getSchema());
+        });
 
-    auto cancel_all = [on_timeout, listener_tag]() {
-        //取消延时任务，防止多次回调
-        on_timeout->cancel();
-        //取消媒体注册事件监听
-        NoticeCenter::Instance().delListener(listener_tag, Broadcast::kBroadcastMediaChanged);
-    };
+        function<void()> close_player = [this, weak_flight]() { closeAll(weak_flight); };
+        //广播未找到流,此时可以立即去拉流，这样还来得及
+        NoticeCenter::Instance().emitEvent(Broadcast::kBroadcastNotFoundStream, info, static_cast<SockInfo &>(*session), close_player);
+    }
+
+    FindAsyncStatistic getStatistic() {
+        lock_guard<mutex> lck(_mtx);
+        auto ret = _statistic;
+        ret.pending_flights = _flights.size();
+        ret.pending_waiters = 0;
+        for (auto &pr : _flights) {
+            ret.pending_waiters += pr.second->waiters.size();
+        }
+        return ret;
+    }
+
+private:
+    FindAsyncCoalescer() = default;
+
+    //移除flight，调用者需加锁
+    void removeFlight_l(const Flight::Ptr &flight) {
+        auto it = _flights.find(flight->key);
+        if (it != _flights.end() && it->second == flight) {
+            _flights.erase(it);
+        }
+    }
 
-    weak_ptr<Session> weak_session = session;
-    auto on_register = [weak_session, info, cb_once, cancel_all, poller](BroadcastMediaChangedArgs) {
-        if (!bRegist ||
-            sender.getSchema() != info._schema ||
-            sender.getVhost() != info._vhost ||
-            sender.getApp() != info._app ||
-            sender.getId() != info._streamid) {
-            //不是自己感兴趣的事件，忽略之
+    void onRegist(const std::weak_ptr<Flight> &weak_flight, const string &schema) {
+        auto flight = weak_flight.lock();
+        if (!flight) {
             return;
         }
+        list<Waiter::Ptr> waiters;
+        bool finished = false;
+        {
+            lock_guard<mutex> lck(_mtx);
+            for (auto it = flight->waiters.begin(); it != flight->waiters.end();) {
+                if ((*it)->info._schema == schema) {
+                    waiters.emplace_back(std::move(*it));
+                    it = flight->waiters.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (!waiters.empty() && !flight->resolved) {
+                //统计从流未找到到流注册成功的耗时
+                flight->resolved = true;
+                auto latency = flight->ticker.elapsedTime();
+                ++_statistic.latency_count;
+                _statistic.latency_total_ms += latency;
+                _statistic.latency_max_ms = MAX(_statistic.latency_max_ms, latency);
+            }
+            _statistic.resolved += waiters.size();
+            if (flight->waiters.empty()) {
+                removeFlight_l(flight);
+                finished = true;
+            }
+        }
+        if (finished) {
+            NoticeCenter::Instance().delListener(flight.get(), Broadcast::kBroadcastMediaChanged);
+        }
+        for (auto &waiter : waiters) {
+            waiter->poller->async([waiter]() {
+                waiter->timeout->cancel();
+                if (auto strong_session = waiter->session.lock()) {
+                    //播发器请求的流终于注册上了，切换到自己的线程再回复
+                    DebugL << "收到媒体注册事件,回复播放器:" << waiter->info.getUrl();
+                    //再找一遍媒体源，一般能找到
+                    findAsync_l(waiter->info, strong_session, false, waiter->cb);
+                }
+            }, false);
+        }
+    }
 
-        poller->async([weak_session, cancel_all, info, cb_once]() {
-            cancel_all();
-            if (auto strong_session = weak_session.lock()) {
-                //播发器请求的流终于注册上了，切换到自己的线程再回复
-                DebugL << "收到媒体注册事件,回复播放器:" << info.getUrl();
-                //再找一遍媒体源，一般能找到
-                findAsync_l(info, strong_session, false, cb_once);
+    void onTimeout(const std::weak_ptr<Flight> &weak_flight, const std::weak_ptr<Waiter> &weak_waiter) {
+        auto flight = weak_flight.lock();
+        auto waiter = weak_waiter.lock();
+        if (!flight || !waiter) {
+            return;
+        }
+        bool finished = false;
+        {
+            lock_guard<mutex> lck(_mtx);
+            auto it = std::find(flight->waiters.begin(), flight->waiters.end(), waiter);
+            if (it == flight->waiters.end()) {
+                //已经被唤醒或关闭
+                return;
             }
-        }, false);
-    };
+            flight->waiters.erase(it);
+            ++_statistic.timeout;
+            if (flight->waiters.empty()) {
+                removeFlight_l(flight);
+                finished = true;
+            }
+        }
+        if (finished) {
+            NoticeCenter::Instance().delListener(flight.get(), Broadcast::kBroadcastMediaChanged);
+        }
+        //定时器在本播放器线程触发，直接回调
+        waiter->cb(nullptr);
+    }
+
+    void closeAll(const std::weak_ptr<Flight> &weak_flight) {
+        auto flight = weak_flight.lock();
+        if (!flight) {
+            return;
+        }
+        list<Waiter::Ptr> waiters;
+        {
+            lock_guard<mutex> lck(_mtx);
+            waiters.swap(flight->waiters);
+            _statistic.closed += waiters.size();
+            removeFlight_l(flight);
+        }
+        NoticeCenter::Instance().delListener(flight.get(), Broadcast::kBroadcastMediaChanged);
+        for (auto &waiter : waiters) {
+            waiter->poller->async([waiter]() {
+                waiter->timeout->cancel();
+                //告诉播放器，流不存在，这样会立即断开播放器
+                waiter->cb(nullptr);
+            });
+        }
+    }
 
-    //监听媒体注册事件
-    NoticeCenter::Instance().addListener(listener_tag, Broadcast::kBroadcastMediaChanged, on_register);
+private:
+    mutex _mtx;
+    FindAsyncStatistic _statistic;
+    unordered_map<string/*vhost/app/stream*/, Flight::Ptr> _flights;
+};
 
-    function<void()> close_player = [cb_once, cancel_all, poller]() {
-        poller->async([cancel_all, cb_once]() {
-            cancel_all();
-            //告诉播放器，流不存在，这样会立即断开播放器
-            cb_once(nullptr);
-        });
-    };
-    //广播未找到流,此时可以立即去拉流，这样还来得及
-    NoticeCenter::Instance().emitEvent(Broadcast::kBroadcastNotFoundStream, info, static_cast<SockInfo &>(*session), close_player);
+static void findAsync_l(const MediaInfo &info, const std::shared_ptr<Session> &session, bool retry,
+                        const function<void(const MediaSource::Ptr &src)> &cb){
+    auto src = find_l(info._schema, info._vhost, info._app, info._streamid, true);
+    if (src || !retry) {
+        cb(src);
+        return;
+    }
+    FindAsyncCoalescer::Instance().wait(info, session, cb);
 }
 
 void MediaSource::findAsync(const MediaInfo &info, const std::shared_ptr<Session> &session, const function<void (const Ptr &)> &cb) {
     return findAsync_l(info, session, true, cb);
 }
 
+FindAsyncStatistic MediaSource::getFindAsyncStatistic() {
+    return FindAsyncCoalescer::Instance().getStatistic();
+}
+
 MediaSource::Ptr MediaSource::find(const string &schema, const string &vhost, const string &app, const string &id, bool from_mp4) {
     return find_l(schema, vhost, app, id, from_mp4);
 }
@@ -520,55 +806,20 @@ void MediaSource::emitEvent(bool regist){
 }
 
 void MediaSource::regist() {
-    {
-        //减小互斥锁临界区
-        lock_guard<recursive_mutex> lock(s_media_source_mtx);
-        auto &ref = s_media_source_map[_schema][_vhost][_app][_stream_id];
-        auto src = ref.lock();
-        if (src) {
-            if (src.get() == this) {
-                return;
-            }
-            //增加判断, 防止当前流已注册时再次注册
-            throw std::invalid_argument("media source already existed:" + getUrl());
+    auto exist = MediaSourceRegistry::Instance().add(MediaSourceRegistry::getKey(_schema, _vhost, _app, _stream_id), shared_from_this());
+    if (exist) {
+        if (exist.get() == this) {
+            return;
         }
-        ref = shared_from_this();
+        //增加判断, 防止当前流已注册时再次注册
+        throw std::invalid_argument("media source already existed:" + getUrl());
     }
     emitEvent(true);
 }
 
-template<typename MAP, typename First, typename ...KeyTypes>
-static bool erase_media_source(bool &hit, const MediaSource *thiz, MAP &map, const First &first, const KeyTypes &...keys) {
-    auto it = map.find(first);
-    if (it != map.end() && erase_media_source(hit, thiz, it->second, keys...)) {
-        map.erase(it);
-    }
-    return map.empty();
-}
-
-template<typename MAP, typename First>
-static bool erase_media_source(bool &hit, const MediaSource *thiz, MAP &map, const First &first) {
-    auto it = map.find(first);
-    if (it != map.end()) {
-        auto src = it->second.lock();
-        if (!src || src.get() == thiz) {
-            //对象已经销毁或者对象就是自己，那么移除之
-            map.erase(it);
-            hit = true;
-        }
-    }
-    return map.empty();
-}
-
 //反注册该源
 bool MediaSource::unregist() {
-    bool ret = false;
-    {
-        //减小互斥锁临界区
-        lock_guard<recursive_mutex> lock(s_media_source_mtx);
-        erase_media_source(ret, this, s_media_source_map, _schema, _vhost, _app, _stream_id);
-    }
-
+    auto ret = MediaSourceRegistry::Instance().remove(MediaSourceRegistry::getKey(_schema, _vhost, _app, _stream_id), this);
     if (ret) {
         emitEvent(false);
     }
@@ -724,6 +975,15 @@ bool MediaSourceEventInterceptor::seekTo(MediaSource &sender, uint32_t stamp) {
     return listener->seekTo(sender, stamp);
 }
 
+void MediaSourceEventInterceptor::seekToAsync(MediaSource &sender, uint32_t stamp, const function<void(bool)> &cb) {
+    auto listener = _listener.lock();
+    if (!listener) {
+        cb(false);
+        return;
+    }
+    listener->seekToAsync(sender, stamp, cb);
+}
+
 bool MediaSourceEventInterceptor::pause(MediaSource &sender, bool pause) {
     auto listener = _listener.lock();
     if (!listener) {
@@ -780,6 +1040,14 @@ float MediaSourceEventInterceptor::getLossRate(MediaSource &sender, TrackType ty
     return -1; //异常返回-1
 }
 
+bool MediaSourceEventInterceptor::requestKeyFrame(MediaSource &sender) {
+    auto listener = _listener.lock();
+    if (listener) {
+        return listener->requestKeyFrame(sender);
+    }
+    return false;
+}
+
 toolkit::EventPoller::Ptr MediaSourceEventInterceptor::getOwnerPoller(MediaSource &sender) {
     auto listener = _listener.lock();
     if (listener) {
@@ -829,6 +1097,23 @@ bool MediaSourceEventInterceptor::stopSendRtp(MediaSource &sender, const string
     return false;
 }
 
+void MediaSourceEventInterceptor::startTranscode(MediaSource &sender, const MediaSourceEvent::TranscodeArgs &args, const std::function<void(const toolkit::SockException &)> cb) {
+    auto listener = _listener.lock();
+    if (listener) {
+        listener->startTranscode(sender, args, cb);
+    } else {
+        MediaSourceEvent::startTranscode(sender, args, cb);
+    }
+}
+
+bool MediaSourceEventInterceptor::stopTranscode(MediaSource &sender, const string &stream_id) {
+    auto listener = _listener.lock();
+    if (listener) {
+        return listener->stopTranscode(sender, stream_id);
+    }
+    return false;
+}
+
 void MediaSourceEventInterceptor::setDelegate(const std::weak_ptr<MediaSourceEvent> &listener) {
     if (listener.lock().get() == this) {
         throw std::invalid_argument("can not set self as a delegate");
@@ -18,6 +18,7 @@
 #include "Network/Socket.h"
 #include "Extension/Track.h"
 #include "Record/Recorder.h"
+#include "Common/Metrics.h"
 
 namespace toolkit {
 class Session;
@@ -35,7 +36,8 @@ enum class MediaOriginType : uint8_t {
     mp4_vod,
     device_chn,
     rtc_push,
-    srt_push
+    srt_push,
+    transcode
 };
 
 std::string getOriginTypeString(MediaOriginType type);
@@ -64,6 +66,8 @@ public:
 
     // 通知拖动进度条
     virtual bool seekTo(MediaSource &sender, uint32_t stamp) { return false; }
+    // 通知拖动进度条，seek完成后回调结果；在后台线程中seek的媒体源需要重载此函数
+    virtual void seekToAsync(MediaSource &sender, uint32_t stamp, const std::function<void(bool)> &cb) { cb(seekTo(sender, stamp)); }
     // 通知暂停或恢复
     virtual bool pause(MediaSource &sender, bool pause) { return false; }
     // 通知倍数
@@ -83,6 +87,8 @@ public:
     virtual void onRegist(MediaSource &sender, bool regist) {}
     // 获取丢包率
     virtual float getLossRate(MediaSource &sender, TrackType type) { return -1; }
+    // 请求推流端尽快发送关键帧，例如播放器因带宽不足跳帧后需要尽快恢复画面
+    virtual bool requestKeyFrame(MediaSource &sender) { return false; }
     // 获取所在线程, 此函数一般强制重载
     virtual toolkit::EventPoller::Ptr getOwnerPoller(MediaSource &sender) { throw NotImplemented(toolkit::demangle(typeid(*this).name()) + "::getOwnerPoller not implemented"); }
 
@@ -130,6 +136,45 @@ public:
     // 停止发送ps-rtp
     virtual bool stopSendRtp(MediaSource &sender, const std::string &ssrc) {return false; }
 
+    class TranscodeArgs {
+    public:
+        class Rendition {
+        public:
+            // 该码率的流id，为空时为stream_id加上_{height}p后缀
+            std::string stream_id;
+            // 目标分辨率，为0时与源流一致
+            int width = 0;
+            int height = 0;
+            // 目标视频码率，单位bit/s，为0时由编码器决定
+            int video_bitrate = 0;
+        };
+
+        // 转码后的流id，为空时为源流id加上_transcoded后缀
+        // 多码率转码时为hls主索引文件对应的流id
+        std::string stream_id;
+        // 目标视频编码格式，CodecInvalid代表不输出视频
+        CodecId video_codec = CodecH264;
+        // 目标分辨率，为0时与源流一致
+        int width = 0;
+        int height = 0;
+        // 目标视频码率，单位bit/s，为0时由编码器决定
+        int video_bitrate = 0;
+        // 目标音频编码格式，CodecInvalid代表不输出音频
+        CodecId audio_codec = CodecAAC;
+        // 目标音频码率，单位bit/s，为0时由编码器决定
+        int audio_bitrate = 0;
+        // 编解码线程数
+        int thread_num = 2;
+        // 多码率转码，源流只解码一次，每个码率单独缩放编码并注册为一个流，同时生成hls主索引文件
+        // 不为空时忽略width、height、video_bitrate
+        std::vector<Rendition> renditions;
+    };
+
+    // 开始转码，转码结果作为新的流注册
+    virtual void startTranscode(MediaSource &sender, const TranscodeArgs &args, const std::function<void(const toolkit::SockException &)> cb) { cb(toolkit::SockException(toolkit::Err_other, "not implemented")); };
+    // 停止转码，stream_id为空时停止全部
+    virtual bool stopTranscode(MediaSource &sender, const std::string &stream_id) { return false; }
+
 private:
     toolkit::Timer::Ptr _async_close_timer;
 };
@@ -233,6 +278,7 @@ public:
     std::shared_ptr<toolkit::SockInfo> getOriginSock(MediaSource &sender) const override;
 
     bool seekTo(MediaSource &sender, uint32_t stamp) override;
+    void seekToAsync(MediaSource &sender, uint32_t stamp, const std::function<void(bool)> &cb) override;
     bool pause(MediaSource &sender,  bool pause) override;
     bool speed(MediaSource &sender, float speed) override;
     bool close(MediaSource &sender) override;
@@ -244,7 +290,10 @@ public:
     std::vector<Track::Ptr> getMediaTracks(MediaSource &sender, bool trackReady = true) const override;
     void startSendRtp(MediaSource &sender, const SendRtpArgs &args, const std::function<void(uint16_t, const toolkit::SockException &)> cb) override;
     bool stopSendRtp(MediaSource &sender, const std::string &ssrc) override;
+    void startTranscode(MediaSource &sender, const TranscodeArgs &args, const std::function<void(const toolkit::SockException &)> cb) override;
+    bool stopTranscode(MediaSource &sender, const std::string &stream_id) override;
     float getLossRate(MediaSource &sender, TrackType type) override;
+    bool requestKeyFrame(MediaSource &sender) override;
     toolkit::EventPoller::Ptr getOwnerPoller(MediaSource &sender) override;
 
 private:
@@ -274,6 +323,32 @@ public:
     std::string _param_strs;
 };
 
+/**
+ * 异步查找流(按需拉流)请求合并统计
+ */
+class FindAsyncStatistic {
+public:
+    //触发的流未找到事件次数(合并后，每个vhost/app/stream在最大等待时间内只会触发一次)
+    uint64_t flights = 0;
+    //进入等待的播放请求总数
+    uint64_t waiters = 0;
+    //被合并到已有等待中的播放请求数
+    uint64_t coalesced = 0;
+    //等待到流注册成功的播放请求数
+    uint64_t resolved = 0;
+    //等待超时的播放请求数
+    uint64_t timeout = 0;
+    //被主动关闭(溯源或hook失败)的播放请求数
+    uint64_t closed = 0;
+    //当前正在等待的流个数与播放请求个数
+    uint64_t pending_flights = 0;
+    uint64_t pending_waiters = 0;
+    //从流未找到到流注册成功的耗时统计，单位毫秒
+    uint64_t latency_count = 0;
+    uint64_t latency_total_ms = 0;
+    uint64_t latency_max_ms = 0;
+};
+
 /**
  * 媒体源，任何rtsp/rtmp的直播流都源自该对象
  */
@@ -306,6 +381,9 @@ public:
     // 获取所有Track
     std::vector<Track::Ptr> getTracks(bool ready = true) const override;
 
+    // 获取发送给所有播放器的累计字节数计数器，播放会话开始播放时获取，发送数据时累加
+    const MetricCounter::Ptr &getEgressCounter() const { return _egress_counter; }
+
     // 获取流当前时间戳
     virtual uint32_t getTimeStamp(TrackType type) { return 0; };
     // 设置时间戳
@@ -345,6 +423,8 @@ public:
 
     // 拖动进度条
     bool seekTo(uint32_t stamp);
+    // 拖动进度条，seek完成后回调结果
+    void seekToAsync(uint32_t stamp, const std::function<void(bool)> &cb);
     // 暂停
     bool pause(bool pause);
     // 倍数播放
@@ -361,8 +441,14 @@ public:
     void startSendRtp(const MediaSourceEvent::SendRtpArgs &args, const std::function<void(uint16_t, const toolkit::SockException &)> cb);
     // 停止发送ps-rtp
     bool stopSendRtp(const std::string &ssrc);
+    // 开始转码
+    void startTranscode(const MediaSourceEvent::TranscodeArgs &args, const std::function<void(const toolkit::SockException &)> cb);
+    // 停止转码
+    bool stopTranscode(const std::string &stream_id);
     // 获取丢包率
     float getLossRate(mediakit::TrackType type);
+    // 请求关键帧
+    bool requestKeyFrame();
     // 获取所在线程
     toolkit::EventPoller::Ptr getOwnerPoller();
 
@@ -377,8 +463,10 @@ public:
     // 忽略schema，同步查找流，可能返回rtmp/rtsp/hls类型
     static Ptr find(const std::string &vhost, const std::string &app, const std::string &stream_id, bool from_mp4 = false);
 
-    // 异步查找流
+    // 异步查找流，同一个vhost/app/stream的并发请求会被合并，只触发一次流未找到事件
     static void findAsync(const MediaInfo &info, const std::shared_ptr<toolkit::Session> &session, const std::function<void(const Ptr &src)> &cb);
+    // 获取异步查找流请求合并统计
+    static FindAsyncStatistic getFindAsyncStatistic();
     // 遍历所有流
     static void for_each_media(const std::function<void(const Ptr &src)> &cb, const std::string &schema = "", const std::string &vhost = "", const std::string &app = "", const std::string &stream = "");
     // 从mp4文件生成MediaSource
@@ -396,6 +484,7 @@ private:
 
 protected:
     toolkit::BytesSpeed _speed[TrackMax];
+    MetricCounter::Ptr _egress_counter = std::make_shared<MetricCounter>();
 
 private:
     std::atomic_flag _owned { false };
@@ -0,0 +1,234 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <set>
+#include <sstream>
+#include "Metrics.h"
+#include "Util/util.h"
+#include "Util/onceToken.h"
+#include "Poller/EventPoller.h"
+#include "Common/MediaSource.h"
+#include "Common/MultiMediaSourceMuxer.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+//EventPoller任务延时采样间隔
+static constexpr int kPollerSampleIntervalMS = 1000;
+
+size_t MetricCounter::getShardIndex() {
+    static atomic<size_t> s_next { 0 };
+    static thread_local size_t s_index = s_next++ % kShardCount;
+    return s_index;
+}
+
+/////////////////////////////////////MetricHistogram/////////////////////////////////////
+
+MetricHistogram::MetricHistogram(vector<uint64_t> bounds) {
+    _bounds = std::move(bounds);
+    _buckets.reset(new MetricCounter[_bounds.size() + 1]);
+}
+
+void MetricHistogram::observe(uint64_t value) {
+    size_t i = 0;
+    while (i < _bounds.size() && value > _bounds[i]) {
+        ++i;
+    }
+    _buckets[i].add();
+    _sum.add(value);
+}
+
+vector<uint64_t> MetricHistogram::getBuckets() const {
+    vector<uint64_t> ret(_bounds.size() + 1);
+    for (size_t i = 0; i < ret.size(); ++i) {
+        ret[i] = _buckets[i].value();
+    }
+    return ret;
+}
+
+/////////////////////////////////////Metrics/////////////////////////////////////
+
+INSTANCE_IMP(Metrics)
+
+MetricCounter &Metrics::getCounter(const string &name, const string &labels, const string &help) {
+    lock_guard<mutex> lck(_mtx);
+    auto &family = _families[name];
+    family.help = help;
+    family.type = "counter";
+    auto &ref = family.counters[labels];
+    if (!ref) {
+        ref.reset(new MetricCounter);
+    }
+    return *ref;
+}
+
+MetricHistogram &Metrics::getHistogram(const string &name, const string &labels, const string &help,
+                                       const vector<uint64_t> &bounds, double scale) {
+    lock_guard<mutex> lck(_mtx);
+    auto &family = _families[name];
+    family.help = help;
+    family.type = "histogram";
+    family.scale = scale;
+    auto &ref = family.histograms[labels];
+    if (!ref) {
+        ref.reset(new MetricHistogram(bounds));
+    }
+    return *ref;
+}
+
+void Metrics::startSampler() {
+    static onceToken token([this]() {
+        size_t index = 0;
+        EventPollerPool::Instance().for_each([&](const TaskExecutor::Ptr &executor) {
+            //单位微秒，导出单位为秒
+            _poller_delay.emplace_back(&getHistogram("zlm_poller_task_delay_seconds", "poller=\"" + to_string(index++) + "\"",
+                                                     "Delay between posting a task to an EventPoller and its execution",
+                                                     { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000 }, 1e-6));
+        });
+        if (_poller_delay.empty()) {
+            return;
+        }
+        auto histograms = _poller_delay;
+        EventPollerPool::Instance().getPoller()->doDelayTask(kPollerSampleIntervalMS, [histograms]() {
+            size_t index = 0;
+            EventPollerPool::Instance().for_each([&](const TaskExecutor::Ptr &executor) {
+                auto histogram = histograms[index++ % histograms.size()];
+                auto start = getCurrentMicrosecond();
+                executor->async([histogram, start]() { histogram->observe(getCurrentMicrosecond() - start); }, false);
+            });
+            return kPollerSampleIntervalMS;
+        });
+    });
+}
+
+string Metrics::escapeLabel(const string &value) {
+    string ret;
+    ret.reserve(value.size());
+    for (auto ch : value) {
+        switch (ch) {
+            case '\\': ret.append("\\\\"); break;
+            case '"': ret.append("\\\""); break;
+            case '\n': ret.append("\\n"); break;
+            default: ret.push_back(ch); break;
+        }
+    }
+    return ret;
+}
+
+static string toString(double value) {
+    stringstream ss;
+    ss.precision(15);
+    ss << value;
+    return ss.str();
+}
+
+static string joinLabels(const string &labels, const string &extra) {
+    if (labels.empty()) {
+        return "{" + extra + "}";
+    }
+    return "{" + labels + "," + extra + "}";
+}
+
+static void appendHeader(string &out, const string &name, const string &type, const string &help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+string Metrics::dump() {
+    string out;
+    {
+        lock_guard<mutex> lck(_mtx);
+        for (auto &pr : _families) {
+            auto &name = pr.first;
+            auto &family = pr.second;
+            appendHeader(out, name, family.type, family.help);
+            for (auto &counter : family.counters) {
+                out.append(name);
+                if (!counter.first.empty()) {
+                    out.append("{").append(counter.first).append("}");
+                }
+                out.append(" ").append(to_string(counter.second->value())).append("\n");
+            }
+            for (auto &histogram : family.histograms) {
+                auto &labels = histogram.first;
+                auto &bounds = histogram.second->getBounds();
+                auto buckets = histogram.second->getBuckets();
+                uint64_t count = 0;
+                for (size_t i = 0; i < buckets.size(); ++i) {
+                    count += buckets[i];
+                    auto le = i < bounds.size() ? toString(bounds[i] * family.scale) : string("+Inf");
+                    out.append(name).append("_bucket").append(joinLabels(labels, "le=\"" + le + "\""));
+                    out.append(" ").append(to_string(count)).append("\n");
+                }
+                auto label_str = labels.empty() ? string() : "{" + labels + "}";
+                out.append(name).append("_sum").append(label_str).append(" ");
+                out.append(toString(histogram.second->getSum() * family.scale)).append("\n");
+                out.append(name).append("_count").append(label_str).append(" ").append(to_string(count)).append("\n");
+            }
+        }
+    }
+    dumpStreams(out);
+    return out;
+}
+
+void Metrics::dumpStreams(string &out) {
+    //按指标名分组输出，同名指标必须连续
+    map<string, pair<string/*type help*/, string/*lines*/> > families;
+    auto append = [&](const string &name, const char *type, const char *help, const string &labels, const string &value) {
+        auto &family = families[name];
+        if (family.first.empty()) {
+            family.first = string(type) + " " + help;
+        }
+        family.second.append(name).append("{").append(labels).append("} ").append(value).append("\n");
+    };
+
+    set<void *> muxers;
+    MediaSource::for_each_media([&](const MediaSource::Ptr &src) {
+        auto stream_labels = "vhost=\"" + escapeLabel(src->getVhost()) + "\",app=\"" + escapeLabel(src->getApp()) + "\",stream=\""
+            + escapeLabel(src->getId()) + "\"";
+        auto labels = "schema=\"" + escapeLabel(src->getSchema()) + "\"," + stream_labels;
+
+        append("zlm_stream_readers", "gauge", "Number of players per protocol", labels, to_string(src->readerCount()));
+        append("zlm_stream_ingress_bytes_per_second", "gauge", "Ingress bitrate of the stream in bytes per second", labels,
+               to_string(src->getBytesSpeed()));
+        append("zlm_stream_egress_bytes_total", "counter", "Bytes sent to players of the stream", labels,
+               to_string(src->getEgressCounter()->value()));
+
+        auto muxer = dynamic_pointer_cast<MultiMediaSourceMuxer>(src->getListener().lock());
+        if (!muxer || !muxers.emplace(muxer.get()).second) {
+            //同一个流的多个协议共享一个muxer，只统计一次
+            return;
+        }
+        auto &metrics = muxer->getFrameMetrics();
+        append("zlm_stream_total_readers", "gauge", "Number of players of all protocols", stream_labels, to_string(muxer->totalReaderCount()));
+        append("zlm_stream_video_frames_total", "counter", "Video frames received", stream_labels, to_string(metrics.video_frames.load()));
+        append("zlm_stream_audio_frames_total", "counter", "Audio frames received", stream_labels, to_string(metrics.audio_frames.load()));
+        append("zlm_stream_key_frames_total", "counter", "Video key frames received", stream_labels, to_string(metrics.key_frames.load()));
+        append("zlm_stream_gop_frames", "gauge", "Frame count of the last complete GOP", stream_labels, to_string(metrics.gop_frames.load()));
+        append("zlm_stream_gop_seconds", "gauge", "Duration of the last complete GOP", stream_labels, toString(metrics.gop_ms.load() / 1000.0));
+        for (auto &track : src->getTracks(false)) {
+            auto video = dynamic_pointer_cast<VideoTrack>(track);
+            if (video) {
+                append("zlm_stream_video_fps", "gauge", "Video frame rate declared by the track", stream_labels, toString(video->getVideoFps()));
+                break;
+            }
+        }
+    });
+
+    for (auto &pr : families) {
+        auto pos = pr.second.first.find(' ');
+        appendHeader(out, pr.first, pr.second.first.substr(0, pos), pr.second.first.substr(pos + 1));
+        out.append(pr.second.second);
+    }
+}
+
+} // namespace mediakit
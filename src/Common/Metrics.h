@@ -0,0 +1,146 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_METRICS_H
+#define ZLMEDIAKIT_METRICS_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mediakit {
+
+/**
+ * 分片计数器
+ * 每个线程固定写入其中一个分片(按缓存行隔开)，多线程并发累加时无锁且不会互相争抢缓存行，
+ * 读取时汇总所有分片，适合热点路径上常开的统计
+ */
+class MetricCounter {
+public:
+    using Ptr = std::shared_ptr<MetricCounter>;
+
+    MetricCounter() = default;
+    MetricCounter(const MetricCounter &) = delete;
+    MetricCounter &operator=(const MetricCounter &) = delete;
+
+    void add(uint64_t n = 1) {
+        _shards[getShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t ret = 0;
+        for (auto &shard : _shards) {
+            ret += shard.value.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+private:
+    static size_t getShardIndex();
+
+private:
+    static constexpr size_t kShardCount = 16;
+
+    class Shard {
+    public:
+        std::atomic<uint64_t> value { 0 };
+        //填充至缓存行大小，防止伪共享
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    Shard _shards[kShardCount];
+};
+
+/**
+ * 直方图，桶上限由小到大排列，最后隐含一个+Inf桶
+ */
+class MetricHistogram {
+public:
+    MetricHistogram(std::vector<uint64_t> bounds);
+
+    void observe(uint64_t value);
+
+    const std::vector<uint64_t> &getBounds() const { return _bounds; }
+
+    /**
+     * 获取每个桶(非累加)的计数，个数为桶上限个数加一
+     */
+    std::vector<uint64_t> getBuckets() const;
+    uint64_t getSum() const { return _sum.value(); }
+
+private:
+    std::vector<uint64_t> _bounds;
+    std::unique_ptr<MetricCounter[]> _buckets;
+    MetricCounter _sum;
+};
+
+/**
+ * 指标注册表与prometheus文本格式导出
+ * 获取到的计数器/直方图引用永久有效，热点路径上应以函数内static引用缓存，避免每次加锁查找
+ */
+class Metrics {
+public:
+    static Metrics &Instance();
+
+    /**
+     * 获取(不存在时创建)计数器
+     * @param name 指标名，例如zlm_webrtc_nack_received_total
+     * @param labels prometheus标签，例如type="hls"，无标签时为空
+     * @param help 指标说明
+     */
+    MetricCounter &getCounter(const std::string &name, const std::string &labels, const std::string &help);
+
+    /**
+     * 获取(不存在时创建)直方图
+     * @param bounds 桶上限
+     * @param scale 导出时桶上限与总和乘以的系数，例如值单位为微秒，导出单位为秒时为1e-6
+     */
+    MetricHistogram &getHistogram(const std::string &name, const std::string &labels, const std::string &help,
+                                  const std::vector<uint64_t> &bounds, double scale = 1);
+
+    /**
+     * 开始定时采样各EventPoller线程的任务执行延时
+     */
+    void startSampler();
+
+    /**
+     * 导出prometheus/openmetrics文本格式
+     */
+    std::string dump();
+
+    /**
+     * prometheus标签值转义
+     */
+    static std::string escapeLabel(const std::string &value);
+
+private:
+    Metrics() = default;
+    void dumpStreams(std::string &out);
+
+private:
+    class Family {
+    public:
+        std::string help;
+        std::string type;
+        double scale = 1;
+        std::map<std::string, std::unique_ptr<MetricCounter> > counters;
+        std::map<std::string, std::unique_ptr<MetricHistogram> > histograms;
+    };
+
+    std::mutex _mtx;
+    std::map<std::string, Family> _families;
+    std::vector<MetricHistogram *> _poller_delay;
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_METRICS_H
@@ -18,6 +18,7 @@
 #include "Rtmp/RtmpMediaSourceMuxer.h"
 #include "TS/TSMediaSourceMuxer.h"
 #include "FMP4/FMP4MediaSourceMuxer.h"
+#include "Codec/Transcoder.h"
 
 using namespace std;
 using namespace toolkit;
@@ -28,6 +29,9 @@ namespace toolkit {
 
 namespace mediakit {
 
+//帧级别GOP缓存最大帧数，超过后清空并等待下一个关键帧，防止无关键帧的流导致内存暴增
+static constexpr size_t kMaxGopCacheFrames = 1024;
+
 static std::shared_ptr<MediaSinkInterface> makeRecorder(MediaSource &sender, const vector<Track::Ptr> &tracks, Recorder::type type, const ProtocolOption &option){
     auto recorder = Recorder::createRecorder(type, sender.getVhost(), sender.getApp(), sender.getId(), option);
     for (auto &track : tracks) {
@@ -114,6 +118,12 @@ MultiMediaSourceMuxer::MultiMediaSourceMuxer(const string &vhost, const string &
     }
 #endif
 
+    //按需转协议时，由共享的GOP缓存保证新观看者秒开，各协议无人观看时无需再打包与缓存GOP
+    _enable_gop_cache = (_rtsp && option.rtsp_demand) || (_rtmp && option.rtmp_demand) || (_ts && option.ts_demand) || (_hls && option.hls_demand);
+#if defined(ENABLE_MP4)
+    _enable_gop_cache = _enable_gop_cache || (_fmp4 && option.fmp4_demand);
+#endif
+
     //音频相关设置
     enableAudio(option.enable_audio);
     enableMuteAudio(option.add_mute_audio);
@@ -161,6 +171,9 @@ int MultiMediaSourceMuxer::totalReaderCount() const {
 
 #if defined(ENABLE_RTPPROXY)
     ret += (int)_rtp_sender.size();
+#endif
+#if defined(ENABLE_FFMPEG)
+    ret += (int)_transcoder.size();
 #endif
     return ret;
 }
@@ -294,6 +307,92 @@ bool MultiMediaSourceMuxer::stopSendRtp(MediaSource &sender, const string &ssrc)
 #endif//ENABLE_RTPPROXY
 }
 
+void MultiMediaSourceMuxer::startTranscode(MediaSource &sender, const MediaSourceEvent::TranscodeArgs &args_in, const std::function<void(const toolkit::SockException &)> cb) {
+#if defined(ENABLE_FFMPEG)
+    auto args = args_in;
+    if (args.stream_id.empty()) {
+        args.stream_id = _stream_id + "_transcoded";
+    }
+    if (args.stream_id == _stream_id || _transcoder.find(args.stream_id) != _transcoder.end()) {
+        cb(SockException(Err_other, "该转码流已存在:" + args.stream_id));
+        return;
+    }
+    auto tracks = getTracks(true);
+    if (tracks.empty()) {
+        cb(SockException(Err_other, "源流track未就绪"));
+        return;
+    }
+
+    Transcoder::Ptr transcoder;
+    try {
+        transcoder = std::make_shared<Transcoder>(getOwnerPoller(sender), _vhost, _app, _stream_id, args);
+    } catch (std::exception &ex) {
+        cb(SockException(Err_other, ex.what()));
+        return;
+    }
+    for (auto &stream_id : transcoder->getOutputStreamIds()) {
+        //转码后的流注册时如果已存在会抛异常，提前检查并返回给调用者
+        if (MediaSource::find(_vhost, _app, stream_id)) {
+            cb(SockException(Err_other, "转码目标流已存在:" + stream_id));
+            return;
+        }
+    }
+    bool has_track = false;
+    for (auto &track : tracks) {
+        if (transcoder->addTrack(track)) {
+            has_track = true;
+        }
+    }
+    if (!has_track) {
+        cb(SockException(Err_other, "创建编解码器失败或无可转码的track"));
+        return;
+    }
+    try {
+        transcoder->addTrackCompleted();
+    } catch (std::exception &ex) {
+        //检查后目标流仍可能被其他线程抢先注册
+        cb(SockException(Err_other, ex.what()));
+        return;
+    }
+
+    auto sender_ptr = sender.shared_from_this();
+    weak_ptr<MultiMediaSourceMuxer> weak_self = shared_from_this();
+    auto stream_id = args.stream_id;
+    transcoder->setOnClose([weak_self, stream_id, sender_ptr](const toolkit::SockException &ex) {
+        if (auto strong_self = weak_self.lock()) {
+            WarnL << "stream:" << strong_self->shortUrl() << " stop transcode:" << stream_id << ", reason:" << ex.what();
+            strong_self->_transcoder.erase(stream_id);
+            //触发观看人数统计
+            strong_self->onReaderChanged(*sender_ptr, strong_self->totalReaderCount());
+        }
+    });
+    _transcoder[stream_id] = std::move(transcoder);
+    onReaderChanged(sender, totalReaderCount());
+    cb(SockException());
+#else
+    cb(SockException(Err_other, "该功能未启用，编译时请打开ENABLE_FFMPEG宏"));
+#endif//ENABLE_FFMPEG
+}
+
+bool MultiMediaSourceMuxer::stopTranscode(MediaSource &sender, const string &stream_id) {
+#if defined(ENABLE_FFMPEG)
+    onceToken token(nullptr, [&]() {
+        //关闭转码，可能触发无人观看事件
+        onReaderChanged(sender, totalReaderCount());
+    });
+    if (stream_id.empty()) {
+        //关闭全部
+        auto size = _transcoder.size();
+        _transcoder.clear();
+        return size;
+    }
+    //关闭特定的
+    return _transcoder.erase(stream_id);
+#else
+    return false;
+#endif//ENABLE_FFMPEG
+}
+
 vector<Track::Ptr> MultiMediaSourceMuxer::getMediaTracks(MediaSource &sender, bool trackReady) const {
     return getTracks(trackReady);
 }
@@ -364,6 +463,8 @@ void MultiMediaSourceMuxer::onAllTrackReady() {
 
 void MultiMediaSourceMuxer::resetTracks() {
     MediaSink::resetTracks();
+    _gop_cache.clear();
+    _gop_has_delta = false;
 
     if (_rtmp) {
         _rtmp->resetTracks();
@@ -386,6 +487,12 @@ void MultiMediaSourceMuxer::resetTracks() {
     }
 #endif
 
+#if defined(ENABLE_FFMPEG)
+    for (auto &pr : _transcoder) {
+        pr.second->resetTracks();
+    }
+#endif
+
     //拷贝智能指针，目的是为了防止跨线程调用设置录像相关api导致的线程竞争问题
     auto hls = _hls;
     if (hls) {
@@ -398,6 +505,98 @@ void MultiMediaSourceMuxer::resetTracks() {
     }
 }
 
+bool MultiMediaSourceMuxer::waitGop() {
+    auto hls = _hls;
+    auto ret = (_rtmp && _rtmp->waitGop()) || (_rtsp && _rtsp->waitGop()) || (_ts && _ts->waitGop()) || (hls && hls->waitGop());
+#if defined(ENABLE_MP4)
+    ret = ret || (_fmp4 && _fmp4->waitGop());
+#endif
+    return ret;
+}
+
+bool MultiMediaSourceMuxer::updateGopCache(const Frame::Ptr &frame) {
+    if (!_enable_gop_cache || !waitGop()) {
+        //所有协议都在打包并缓存自己的GOP(或未开启按需)，不需要共享的GOP缓存，避免重复缓存
+        if (!_gop_cache.empty()) {
+            _gop_cache.clear();
+            _gop_has_delta = false;
+        }
+        return false;
+    }
+    bool is_video = frame->getTrackType() == TrackVideo;
+    bool gop_start = is_video && (frame->keyFrame() || frame->configFrame());
+    if (gop_start && _gop_has_delta) {
+        //新的GOP开始，清空上一个GOP
+        _gop_cache.clear();
+        _gop_has_delta = false;
+    }
+    if (_gop_cache.empty() && !gop_start) {
+        //GOP缓存必须以关键帧或配置帧开始
+        return false;
+    }
+    if (_gop_cache.size() >= kMaxGopCacheFrames) {
+        WarnL << "GOP cache overflow, clear it:" << shortUrl();
+        _gop_cache.clear();
+        _gop_has_delta = false;
+        return false;
+    }
+    if (is_video && !gop_start) {
+        _gop_has_delta = true;
+    }
+    _gop_cache.emplace_back(Frame::getCacheAbleFrame(frame));
+    return true;
+}
+
+static void addMetric(std::atomic<uint64_t> &val, uint64_t n = 1) {
+    //单线程写入，无需原子加
+    val.store(val.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void MultiMediaSourceMuxer::updateFrameMetrics(const Frame::Ptr &frame) {
+    switch (frame->getTrackType()) {
+        case TrackAudio: addMetric(_frame_metrics.audio_frames); break;
+        case TrackVideo: {
+            if (frame->configFrame() || (_gop_frame_count && frame->dts() == _last_video_dts)) {
+                //配置帧或同一帧的多个slice不重复统计
+                break;
+            }
+            _last_video_dts = frame->dts();
+            addMetric(_frame_metrics.video_frames);
+            if (frame->keyFrame()) {
+                addMetric(_frame_metrics.key_frames);
+                if (_gop_frame_count) {
+                    //上一个GOP结束
+                    _frame_metrics.gop_frames.store(_gop_frame_count, std::memory_order_relaxed);
+                    _frame_metrics.gop_ms.store(frame->dts() - _gop_start_dts, std::memory_order_relaxed);
+                }
+                _gop_start_dts = frame->dts();
+                _gop_frame_count = 0;
+            }
+            ++_gop_frame_count;
+            break;
+        }
+        default: break;
+    }
+}
+
+template <typename MUXER>
+bool MultiMediaSourceMuxer::inputFrameWithGop(MUXER &muxer, const Frame::Ptr &frame, bool in_gop) {
+    if (!muxer->fetchNeedGop() || _gop_cache.empty()) {
+        return muxer->inputFrame(frame);
+    }
+    //GOP缓存中的帧与各协议共享，只在有观看者时才打包
+    bool ret = false;
+    for (auto &cached : _gop_cache) {
+        if (muxer->inputFrame(cached)) {
+            ret = true;
+        }
+    }
+    if (!in_gop && muxer->inputFrame(frame)) {
+        ret = true;
+    }
+    return ret;
+}
+
 bool MultiMediaSourceMuxer::onTrackFrame(const Frame::Ptr &frame_in) {
     auto frame = frame_in;
    if (_option.modify_stamp) {
@@ -405,18 +604,20 @@ bool MultiMediaSourceMuxer::onTrackFrame(const Frame::Ptr &frame_in) {
         frame = std::make_shared<FrameStamp>(frame, _stamp[frame->getTrackType()],true);
     }
 
+    updateFrameMetrics(frame);
+    auto in_gop = updateGopCache(frame);
     bool ret = false;
-    if (_rtmp && _rtmp->inputFrame(frame))
+    if (_rtmp && inputFrameWithGop(_rtmp, frame, in_gop))
         ret =  true;
-    if (_rtsp && _rtsp->inputFrame(frame))
+    if (_rtsp && inputFrameWithGop(_rtsp, frame, in_gop))
         ret =  true;
-    if (_ts && _ts->inputFrame(frame))
+    if (_ts && inputFrameWithGop(_ts, frame, in_gop))
         ret = true;
 
     //拷贝智能指针，目的是为了防止跨线程调用设置录像相关api导致的线程竞争问题
     //此处使用智能指针拷贝来确保线程安全，比互斥锁性能更优
     auto hls = _hls;
-    if (hls && hls->inputFrame(frame))
+    if (hls && inputFrameWithGop(hls, frame, in_gop))
         ret =  true;
 
     auto mp4 = _mp4;
@@ -424,7 +625,7 @@ bool MultiMediaSourceMuxer::onTrackFrame(const Frame::Ptr &frame_in) {
         ret = true;
 
 #if defined(ENABLE_MP4)
-    if (_fmp4 && _fmp4->inputFrame(frame))
+    if (_fmp4 && inputFrameWithGop(_fmp4, frame, in_gop))
         ret = true;
 #endif
 
@@ -434,6 +635,13 @@ bool MultiMediaSourceMuxer::onTrackFrame(const Frame::Ptr &frame_in) {
             ret = true;
     }
 #endif //ENABLE_RTPPROXY
+
+#if defined(ENABLE_FFMPEG)
+    for (auto &pr : _transcoder) {
+        if (pr.second->inputFrame(frame))
+            ret = true;
+    }
+#endif //ENABLE_FFMPEG
     return ret;
 }
 
@@ -455,6 +663,10 @@ bool MultiMediaSourceMuxer::isEnabled(){
         if (_rtp_sender.size())
             flag = true;
 #endif //ENABLE_RTPPROXY
+#if defined(ENABLE_FFMPEG)
+        if (_transcoder.size())
+            flag = true;
+#endif //ENABLE_FFMPEG
         _is_enable = flag;
         if (_is_enable) {
             //无人观看时，不刷新计时器,因为无人观看时每次都会检查一遍，所以刷新计数器无意义且浪费cpu
@@ -11,6 +11,7 @@
 #ifndef ZLMEDIAKIT_MULTIMEDIASOURCEMUXER_H
 #define ZLMEDIAKIT_MULTIMEDIASOURCEMUXER_H
 
+#include <deque>
 #include "Common/Stamp.h"
 #include "Common/MediaSource.h"
 #include "Common/MediaSink.h"
@@ -22,8 +23,22 @@ class RtmpMediaSourceMuxer;
 class TSMediaSourceMuxer;
 class FMP4MediaSourceMuxer;
 class RtpSender;
+class Transcoder;
 
 
+/**
+ * 流级别帧统计，只由流的输入线程写入，/metrics导出时跨线程读取
+ */
+class StreamFrameMetrics {
+public:
+    std::atomic<uint64_t> video_frames { 0 };
+    std::atomic<uint64_t> audio_frames { 0 };
+    std::atomic<uint64_t> key_frames { 0 };
+    //上一个完整GOP的帧数与时长(毫秒)
+    std::atomic<uint64_t> gop_frames { 0 };
+    std::atomic<uint64_t> gop_ms { 0 };
+};
+
 class MultiMediaSourceMuxer : public MediaSourceEventInterceptor, public MediaSink, public std::enable_shared_from_this<MultiMediaSourceMuxer>{
 public:
     typedef std::shared_ptr<MultiMediaSourceMuxer> Ptr;
@@ -112,6 +127,20 @@ public:
      */
     bool stopSendRtp(MediaSource &sender, const std::string &ssrc) override;
 
+    /**
+     * 开始转码，转码后的流作为新的流注册
+     * @param args 转码参数
+     * @param cb 启动成功或失败回调
+     */
+    void startTranscode(MediaSource &sender, const MediaSourceEvent::TranscodeArgs &args, const std::function<void(const toolkit::SockException &)> cb) override;
+
+    /**
+     * 停止转码
+     * @param stream_id 转码后的流id，为空时停止全部
+     * @return 是否成功
+     */
+    bool stopTranscode(MediaSource &sender, const std::string &stream_id) override;
+
     /**
      * 获取所有Track
      * @param trackReady 是否筛选过滤未就绪的track
@@ -129,6 +158,11 @@ public:
     const std::string& getStreamId() const;
     std::string shortUrl() const;
 
+    /**
+     * 获取帧率、GOP等帧级别统计
+     */
+    const StreamFrameMetrics &getFrameMetrics() const { return _frame_metrics; }
+
 protected:
     /////////////////////////////////MediaSink override/////////////////////////////////
 
@@ -150,6 +184,29 @@ protected:
      */
     bool onTrackFrame(const Frame::Ptr &frame) override;
 
+private:
+    /**
+     * 更新帧级别的GOP缓存
+     * @return 该帧是否已经追加到GOP缓存末尾
+     */
+    bool updateGopCache(const Frame::Ptr &frame);
+
+    /**
+     * 是否有按需模式的协议正在依赖共享的GOP缓存
+     */
+    bool waitGop();
+
+    /**
+     * 输入帧到协议复用器，如果该复用器刚从无人观看恢复，则先输入整个GOP缓存
+     */
+    template <typename MUXER>
+    bool inputFrameWithGop(MUXER &muxer, const Frame::Ptr &frame, bool in_gop);
+
+    /**
+     * 更新帧级别统计
+     */
+    void updateFrameMetrics(const Frame::Ptr &frame);
+
 private:
     bool _is_enable = false;
     bool _create_in_poller = false;
@@ -160,10 +217,25 @@ private:
     toolkit::Ticker _last_check;
     Stamp _stamp[2];
     std::weak_ptr<Listener> _track_listener;
+    //是否开启帧级别的GOP缓存(任意协议开启按需转协议时开启)
+    bool _enable_gop_cache = false;
+    //GOP缓存中是否已经有非关键帧的视频帧
+    bool _gop_has_delta = false;
+    //各协议共享的帧级别GOP缓存，帧数据为引用计数，不拷贝；只在有按需协议无人观看或等待输入GOP时保留
+    std::deque<Frame::Ptr> _gop_cache;
+    //当前GOP的起始时间戳、帧数，最近视频帧时间戳
+    uint64_t _gop_start_dts = 0;
+    uint64_t _last_video_dts = 0;
+    uint64_t _gop_frame_count = 0;
+    StreamFrameMetrics _frame_metrics;
 #if defined(ENABLE_RTPPROXY)
     std::unordered_map<std::string, std::shared_ptr<RtpSender>> _rtp_sender;
 #endif //ENABLE_RTPPROXY
 
+#if defined(ENABLE_FFMPEG)
+    std::unordered_map<std::string, std::shared_ptr<Transcoder>> _transcoder;
+#endif //ENABLE_FFMPEG
+
 #if defined(ENABLE_MP4)
     std::shared_ptr<FMP4MediaSourceMuxer> _fmp4;
 #endif
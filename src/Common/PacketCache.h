@@ -1,7 +1,10 @@
 ﻿#ifndef _SRC_PACKET_CACHE_H_
 #define _SRC_PACKET_CACHE_H_
+#include <typeinfo>
 #include "Common/config.h"
+#include "Common/Metrics.h"
 #include "Util/List.h"
+#include "Util/util.h"
 
 #pragma once
 namespace mediakit {
@@ -50,6 +53,10 @@ public:
         if (_cache->empty()) {
             return;
         }
+        //统计每次合并写的包个数
+        static auto &s_batch = Metrics::Instance().getHistogram("zlm_packet_cache_flush_batch_size",
+            "type=\"" + toolkit::demangle(typeid(packet).name()) + "\"", "Packets merged into one PacketCache flush", { 1, 2, 4, 8, 16, 32, 64, 128, 256 });
+        s_batch.observe(_cache->size());
         onFlush(std::move(_cache), _key_pos);
         _cache = std::make_shared<packet_list>();
         _key_pos = false;
@@ -0,0 +1,156 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "PacketPacer.h"
+#include "Common/config.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+//时间轮每格5毫秒，共64格；超出范围的等待时间按最大范围注册，到期后pacer会重新计算
+static constexpr uint64_t kTickMS = 5;
+static constexpr size_t kSlotCount = 64;
+
+/**
+ * pacer时间轮，每个EventPoller线程一个实例
+ * 同一线程的所有pacer共用一个定时任务，避免每个发送链路各自创建定时器；所有pacer队列清空后定时任务自动停止
+ */
+class PacerTimerWheel {
+public:
+    static PacerTimerWheel &Instance() {
+        //poller线程与进程同生命周期，不析构，防止线程退出时定时任务引用已释放的对象
+        static thread_local auto s_instance = new PacerTimerWheel;
+        return *s_instance;
+    }
+
+    void add(const EventPoller::Ptr &poller, weak_ptr<PacketPacerBase> pacer, uint64_t delay_ms) {
+        auto ticks = MAX((delay_ms + kTickMS - 1) / kTickMS, (uint64_t)1);
+        ticks = MIN(ticks, (uint64_t)kSlotCount - 1);
+        _slots[(_index + ticks) % kSlotCount].emplace_back(std::move(pacer));
+        ++_count;
+        if (_running) {
+            return;
+        }
+        _running = true;
+        _stamp = getCurrentMillisecond();
+        poller->doDelayTask(kTickMS, [this]() -> uint64_t { return onTick(); });
+    }
+
+private:
+    uint64_t onTick() {
+        auto now = getCurrentMillisecond();
+        //定时任务可能被其他任务阻塞而延后执行，补齐错过的格子
+        while (_count && _stamp + kTickMS <= now) {
+            _stamp += kTickMS;
+            _index = (_index + 1) % kSlotCount;
+            vector<weak_ptr<PacketPacerBase>> slot;
+            slot.swap(_slots[_index]);
+            _count -= slot.size();
+            for (auto &weak_pacer : slot) {
+                auto pacer = weak_pacer.lock();
+                if (pacer) {
+                    pacer->_scheduled = false;
+                    pacer->onTimer();
+                }
+            }
+        }
+        if (!_count) {
+            _running = false;
+            return 0;
+        }
+        return kTickMS;
+    }
+
+private:
+    bool _running = false;
+    size_t _index = 0;
+    size_t _count = 0;
+    uint64_t _stamp = 0;
+    vector<weak_ptr<PacketPacerBase>> _slots[kSlotCount];
+};
+
+PacketPacerBase::PacketPacerBase(EventPoller::Ptr poller, const string &schema) {
+    GET_CONFIG(size_t, burst_bytes, General::kPacerBurstBytes);
+    _tokens = burst_bytes;
+    _poller = std::move(poller);
+    auto labels = "schema=\"" + schema + "\"";
+    _queue_delay = &Metrics::Instance().getHistogram("zlm_pacer_queue_delay_seconds", labels, "Max queueing delay of each batch released by the packet pacer",
+                                                     { 1, 5, 10, 20, 50, 100, 200, 500 }, 1e-3);
+    _paced_packets = &Metrics::Instance().getCounter("zlm_pacer_queued_packets_total", labels, "Packets delayed by the packet pacer");
+}
+
+bool PacketPacerBase::enabled() {
+    GET_CONFIG(float, rate_multiplier, General::kPacerRateMultiplier);
+    return rate_multiplier > 0;
+}
+
+uint64_t PacketPacerBase::getPacingBitrate() const {
+    GET_CONFIG(float, rate_multiplier, General::kPacerRateMultiplier);
+    GET_CONFIG(uint32_t, max_delay_ms, General::kPacerMaxDelayMS);
+    uint64_t bitrate = (_target_bitrate ? _target_bitrate : _input_bitrate) * rate_multiplier;
+    if (bitrate && max_delay_ms) {
+        //排队数据须在max_delay_ms内发送完毕
+        bitrate = MAX(bitrate, (uint64_t)_queue_bytes * 8 * 1000 / max_delay_ms);
+    }
+    return bitrate;
+}
+
+void PacketPacerBase::refill(uint64_t now_ms) {
+    GET_CONFIG(size_t, burst_bytes, General::kPacerBurstBytes);
+    if (_refill_stamp && now_ms > _refill_stamp) {
+        _tokens += (double)getPacingBitrate() * (now_ms - _refill_stamp) / 8000;
+    }
+    _refill_stamp = now_ms;
+    _tokens = MIN(_tokens, (double)burst_bytes);
+}
+
+void PacketPacerBase::onInput(size_t bytes, uint64_t now_ms) {
+    refill(now_ms);
+    if (!_input_stamp) {
+        _input_stamp = now_ms;
+    }
+    _input_bytes += bytes;
+    auto elapsed = now_ms - _input_stamp;
+    if (elapsed >= 1000) {
+        auto bitrate = _input_bytes * 8 * 1000 / elapsed;
+        //平滑处理，防止gop内关键帧与普通帧大小差异导致码率抖动
+        _input_bitrate = _input_bitrate ? (_input_bitrate * 3 + bitrate) / 4 : bitrate;
+        _input_bytes = 0;
+        _input_stamp = now_ms;
+    }
+}
+
+void PacketPacerBase::onSendDirect(size_t bytes) {
+    refill(getCurrentMillisecond());
+    _tokens -= bytes;
+}
+
+void PacketPacerBase::schedule() {
+    if (_scheduled) {
+        return;
+    }
+    _scheduled = true;
+    uint64_t delay = kTickMS;
+    auto bitrate = getPacingBitrate();
+    if (bitrate && _tokens < 0) {
+        //令牌恢复为正数所需时间
+        delay = (uint64_t)(-_tokens * 8000 / bitrate) + 1;
+    }
+    PacerTimerWheel::Instance().add(_poller, shared_from_this(), delay);
+}
+
+void PacketPacerBase::onQueueDelay(uint64_t delay_ms, size_t packets) {
+    _queue_delay->observe(delay_ms);
+    _paced_packets->add(packets);
+}
+
+} // namespace mediakit
@@ -0,0 +1,187 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_PACKETPACER_H
+#define ZLMEDIAKIT_PACKETPACER_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <functional>
+#include "Util/List.h"
+#include "Util/util.h"
+#include "Poller/EventPoller.h"
+#include "Common/Metrics.h"
+
+namespace mediakit {
+
+/**
+ * 令牌桶发送平滑器(pacer)，每个发送链路一个实例，只能在所属EventPoller线程中使用
+ * 关键帧通常在同一时刻产生几十上百个rtp包，一次性写入socket容易撑爆链路上的缓冲区造成突发丢包，
+ * 丢包引起的nack重传又会叠加在下一次突发上；pacer按照 基准码率 * general.pacer_rate_multiplier 的速率放行数据，
+ * 令牌最多累积general.pacer_burst_bytes字节，超出部分进入队列，由时间轮定时器按令牌恢复速度分批发送。
+ * 基准码率为setTargetBitrate设置的目标码率(例如webrtc带宽估计结果)，未设置时使用输入码率；
+ * 为了防止码率估计偏低时延时无限增大，排队数据最多在general.pacer_max_delay_ms内发送完毕。
+ */
+class PacketPacerBase : public std::enable_shared_from_this<PacketPacerBase> {
+public:
+    using Ptr = std::shared_ptr<PacketPacerBase>;
+
+    /**
+     * @param poller 所属线程
+     * @param schema 发送协议，用于统计指标
+     */
+    PacketPacerBase(toolkit::EventPoller::Ptr poller, const std::string &schema);
+    virtual ~PacketPacerBase() = default;
+
+    /**
+     * 是否开启pacer，general.pacer_rate_multiplier为0时关闭
+     */
+    static bool enabled();
+
+    /**
+     * 设置基准码率(bit/s)，为0时使用输入码率
+     */
+    void setTargetBitrate(uint64_t bitrate) { _target_bitrate = bitrate; }
+
+    /**
+     * 不经过队列直接发送的数据(例如nack重传)，同样消耗令牌，防止重传叠加在关键帧突发上
+     */
+    void onSendDirect(size_t bytes);
+
+    /**
+     * 获取当前放行速率(bit/s)，为0代表不限速
+     */
+    uint64_t getPacingBitrate() const;
+
+    size_t getQueueBytes() const { return _queue_bytes; }
+
+protected:
+    friend class PacerTimerWheel;
+
+    /**
+     * 时间轮定时器触发
+     */
+    virtual void onTimer() = 0;
+
+    /**
+     * 统计输入码率并补充令牌
+     */
+    void onInput(size_t bytes, uint64_t now_ms);
+    void refill(uint64_t now_ms);
+
+    /**
+     * 令牌不足时，按令牌恢复速度计算下次发送时间并注册到时间轮
+     */
+    void schedule();
+
+    void onQueueDelay(uint64_t delay_ms, size_t packets);
+
+protected:
+    //令牌数(字节)，发送时可以透支一个包
+    double _tokens = 0;
+    size_t _queue_bytes = 0;
+
+private:
+    bool _scheduled = false;
+    uint64_t _target_bitrate = 0;
+    uint64_t _refill_stamp = 0;
+    //输入码率统计
+    uint64_t _input_bitrate = 0;
+    uint64_t _input_bytes = 0;
+    uint64_t _input_stamp = 0;
+    toolkit::EventPoller::Ptr _poller;
+    MetricHistogram *_queue_delay;
+    MetricCounter *_paced_packets;
+};
+
+/**
+ * @tparam Packet 数据包智能指针类型，需要支持->size()
+ */
+template <typename Packet>
+class PacketPacer : public PacketPacerBase {
+public:
+    using Ptr = std::shared_ptr<PacketPacer>;
+    using onSendCB = std::function<void(const toolkit::List<Packet> &pkts)>;
+
+    /**
+     * @param cb 实际发送回调，同一批次的包一次性回调，方便合并写
+     */
+    PacketPacer(toolkit::EventPoller::Ptr poller, const std::string &schema, onSendCB cb)
+        : PacketPacerBase(std::move(poller), schema), _cb(std::move(cb)) {}
+
+    /**
+     * 输入一批待发送的数据包，令牌充足且无排队时立即发送，否则进入队列
+     */
+    void inputList(const toolkit::List<Packet> &pkts) {
+        size_t bytes = 0;
+        pkts.for_each([&](const Packet &pkt) { bytes += pkt->size(); });
+        auto now = toolkit::getCurrentMillisecond();
+        onInput(bytes, now);
+        if (_queue.empty() && (!getPacingBitrate() || _tokens >= bytes)) {
+            //无需平滑，直接发送，不产生拷贝
+            _tokens -= bytes;
+            _cb(pkts);
+            return;
+        }
+        pkts.for_each([&](const Packet &pkt) { _queue.emplace_back(pkt, now); });
+        _queue_bytes += bytes;
+        drain(now);
+    }
+
+    /**
+     * 取出所有排队的数据包，不再平滑发送，用于销毁前直接发送剩余数据
+     */
+    toolkit::List<Packet> takeAll() {
+        toolkit::List<Packet> ret;
+        for (auto &pr : _queue) {
+            ret.emplace_back(std::move(pr.first));
+        }
+        _queue.clear();
+        _queue_bytes = 0;
+        return ret;
+    }
+
+protected:
+    void onTimer() override { drain(toolkit::getCurrentMillisecond()); }
+
+private:
+    void drain(uint64_t now) {
+        refill(now);
+        auto unlimited = !getPacingBitrate();
+        uint64_t max_delay = 0;
+        toolkit::List<Packet> send_list;
+        while (!_queue.empty() && (unlimited || _tokens > 0)) {
+            auto &front = _queue.front();
+            auto bytes = front.first->size();
+            _tokens -= bytes;
+            _queue_bytes -= bytes;
+            send_list.emplace_back(std::move(front.first));
+            max_delay = MAX(max_delay, now - front.second);
+            _queue.pop_front();
+        }
+        if (!send_list.empty()) {
+            onQueueDelay(max_delay, send_list.size());
+            //发送失败时回调中可能销毁本对象，先持有强引用
+            auto strong_self = shared_from_this();
+            _cb(send_list);
+        }
+        if (!_queue.empty()) {
+            schedule();
+        }
+    }
+
+private:
+    onSendCB _cb;
+    std::deque<std::pair<Packet, uint64_t/*入队时间*/>> _queue;
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_PACKETPACER_H
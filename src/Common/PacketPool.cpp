@@ -0,0 +1,66 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <map>
+#include <set>
+#include <mutex>
+#include "PacketPool.h"
+#include "config.h"
+
+using namespace std;
+
+namespace mediakit {
+
+class PacketPoolEntry {
+public:
+    //线程退出后累计的统计值
+    PacketPoolStatistic history;
+    set<PacketPoolCounter *> counters;
+};
+
+static mutex s_pool_mtx;
+static map<string, PacketPoolEntry> s_pool_map;
+
+void PacketPoolRegistry::addCounter(const char *name, PacketPoolCounter *counter) {
+    lock_guard<mutex> lck(s_pool_mtx);
+    s_pool_map[name].counters.emplace(counter);
+}
+
+void PacketPoolRegistry::delCounter(const char *name, PacketPoolCounter *counter) {
+    lock_guard<mutex> lck(s_pool_mtx);
+    auto &entry = s_pool_map[name];
+    entry.history.hit += counter->hit;
+    entry.history.miss += counter->miss;
+    entry.history.recycle += counter->recycle;
+    entry.history.drop += counter->drop;
+    entry.counters.erase(counter);
+}
+
+void PacketPoolRegistry::for_each(const function<void(const string &name, const PacketPoolStatistic &stat)> &cb) {
+    lock_guard<mutex> lck(s_pool_mtx);
+    for (auto &pr : s_pool_map) {
+        auto stat = pr.second.history;
+        for (auto counter : pr.second.counters) {
+            stat.hit += counter->hit;
+            stat.miss += counter->miss;
+            stat.recycle += counter->recycle;
+            stat.drop += counter->drop;
+            stat.cached += counter->cached;
+        }
+        cb(pr.first, stat);
+    }
+}
+
+size_t getPacketPoolSize() {
+    GET_CONFIG(uint32_t, pool_size, General::kPacketPoolSize);
+    return pool_size;
+}
+
+} // namespace mediakit
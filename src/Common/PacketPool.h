@@ -0,0 +1,343 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_PACKETPOOL_H
+#define ZLMEDIAKIT_PACKETPOOL_H
+
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace mediakit {
+
+/**
+ * 单个线程内某类型对象池的计数器
+ * 只由所属线程写入，其他线程(getStatistic)只读，所以不需要原子加
+ */
+class PacketPoolCounter {
+public:
+    std::atomic<uint64_t> hit { 0 };
+    std::atomic<uint64_t> miss { 0 };
+    std::atomic<uint64_t> recycle { 0 };
+    std::atomic<uint64_t> drop { 0 };
+    std::atomic<uint64_t> cached { 0 };
+
+    static void add(std::atomic<uint64_t> &val, int64_t delta = 1) {
+        val.store(val.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+};
+
+class PacketPoolStatistic {
+public:
+    //对象从线程缓存中复用次数
+    uint64_t hit = 0;
+    //线程缓存为空，重新new的次数
+    uint64_t miss = 0;
+    //对象释放后回收进线程缓存的次数
+    uint64_t recycle = 0;
+    //线程缓存已满或对象占用内存过大，直接delete的次数
+    uint64_t drop = 0;
+    //当前所有线程缓存的对象个数
+    uint64_t cached = 0;
+};
+
+/**
+ * 对象池统计注册表，线程缓存创建/销毁时注册/注销
+ */
+class PacketPoolRegistry {
+public:
+    static void addCounter(const char *name, PacketPoolCounter *counter);
+    static void delCounter(const char *name, PacketPoolCounter *counter);
+    static void for_each(const std::function<void(const std::string &name, const PacketPoolStatistic &stat)> &cb);
+};
+
+/**
+ * 每个线程每种尺寸级别最多缓存的对象个数，对应配置项general.packetPoolSize，为0时关闭对象池
+ */
+size_t getPacketPoolSize();
+
+/**
+ * 固定大小内存块的线程缓存，用于shared_ptr控制块的分配，避免每个包额外一次malloc
+ */
+template <size_t kBlockSize>
+class PacketBlockCache {
+public:
+    static void *allocate() {
+        auto cache = instance();
+        if (cache && !cache->_blocks.empty()) {
+            auto ret = cache->_blocks.back();
+            cache->_blocks.pop_back();
+            return ret;
+        }
+        return ::operator new(kBlockSize);
+    }
+
+    static void deallocate(void *ptr) {
+        auto cache = instance();
+        if (cache && cache->_blocks.size() < 4 * getPacketPoolSize()) {
+            cache->_blocks.emplace_back(ptr);
+            return;
+        }
+        ::operator delete(ptr);
+    }
+
+private:
+    PacketBlockCache() = default;
+
+    ~PacketBlockCache() {
+        exited() = true;
+        for (auto ptr : _blocks) {
+            ::operator delete(ptr);
+        }
+    }
+
+    static bool &exited() {
+        //trivial类型的thread_local无析构，线程退出过程中仍然可以安全访问
+        static thread_local bool s_exited = false;
+        return s_exited;
+    }
+
+    static PacketBlockCache *instance() {
+        if (exited()) {
+            return nullptr;
+        }
+        static thread_local PacketBlockCache s_cache;
+        return &s_cache;
+    }
+
+private:
+    std::vector<void *> _blocks;
+};
+
+/**
+ * shared_ptr控制块分配器
+ */
+template <typename T>
+class PacketBlockAllocator {
+public:
+    using value_type = T;
+
+    PacketBlockAllocator() = default;
+    template <typename U>
+    PacketBlockAllocator(const PacketBlockAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        if (n != 1) {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T *>(PacketBlockCache<sizeof(T)>::allocate());
+    }
+
+    void deallocate(T *ptr, size_t n) {
+        if (n != 1) {
+            ::operator delete(ptr);
+            return;
+        }
+        PacketBlockCache<sizeof(T)>::deallocate(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const PacketBlockAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const PacketBlockAllocator<U> &) const { return false; }
+};
+
+/**
+ * 线程本地对象池，用于RtpPacket、RtmpPacket、FrameImp等高频创建的对象
+ * 每个EventPoller线程独占一份缓存，分配与回收全程无锁；
+ * 对象在哪个线程释放就回收进哪个线程的缓存，缓存个数有上限，内存不会无限增长；
+ * 对于一个线程创建、另一个线程释放的情况(例如推流线程创建、播放线程释放)，释放线程缓存满后把整批对象转移到全局中转站，
+ * 创建线程缓存为空时再从中转站整批取回，加锁次数按批摊薄。
+ * 回收时按对象当前占用的内存大小划分尺寸级别:
+ *  0: <= 2KB，对应mtu大小的rtp包、音频帧
+ *  1: <= 16KB，对应普通视频帧
+ *  2: <= 128KB，对应关键帧等大帧
+ *  超过128KB的对象不缓存，直接释放，防止长期占用内存
+ * Traits需要提供:
+ *  static const char *name();
+ *  static size_t capacity(const T &obj);
+ */
+template <typename T, typename Traits>
+class PacketPool {
+public:
+    using Ptr = std::shared_ptr<T>;
+    static constexpr size_t kSizeClassCount = 3;
+    static constexpr size_t kMaxDepotBatch = 8;
+
+    /**
+     * 获取一个对象，对象内容未重置，由调用者负责清空
+     * @param size_hint 预计对象需要的内存大小，用于选择尺寸级别，0代表未知
+     */
+    static Ptr obtain(size_t size_hint = 0) {
+        if (!getPacketPoolSize()) {
+            //对象池已关闭，不访问线程缓存与中转站
+            return Ptr(new T(), [](T *ptr) { delete ptr; });
+        }
+        T *ptr = nullptr;
+        auto cache = instance();
+        if (cache) {
+            ptr = cache->pop(getSizeClass(size_hint));
+            PacketPoolCounter::add(ptr ? cache->_counter.hit : cache->_counter.miss);
+        }
+        if (!ptr) {
+            ptr = new T();
+        }
+        return Ptr(ptr, [](T *ptr) { recycle(ptr); }, PacketBlockAllocator<T>());
+    }
+
+private:
+    PacketPool(const char *name) {
+        PacketPoolRegistry::addCounter(name, &_counter);
+    }
+
+    ~PacketPool() {
+        exited() = true;
+        for (auto &objs : _objects) {
+            for (auto ptr : objs) {
+                delete ptr;
+            }
+        }
+        _counter.cached = 0;
+        PacketPoolRegistry::delCounter(Traits::name(), &_counter);
+    }
+
+    static size_t getSizeClass(size_t size) {
+        if (size <= 2 * 1024) {
+            return 0;
+        }
+        if (size <= 16 * 1024) {
+            return 1;
+        }
+        if (size <= 128 * 1024) {
+            return 2;
+        }
+        return kSizeClassCount;
+    }
+
+    T *pop(size_t size_class) {
+        //优先使用同级别或更大级别的对象，避免重新分配内存
+        for (size_t i = 0; i < kSizeClassCount; ++i) {
+            auto &objs = _objects[(size_class + i) % kSizeClassCount];
+            if (!objs.empty()) {
+                auto ret = objs.back();
+                objs.pop_back();
+                PacketPoolCounter::add(_counter.cached, -1);
+                return ret;
+            }
+        }
+        //本线程缓存已空，从中转站取回一批；中转站为空时不加锁，防止每次未命中都竞争全局锁
+        auto &depot = Depot::Instance();
+        if (!depot._batch_count.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lck(depot._mtx);
+        for (size_t i = 0; i < kSizeClassCount; ++i) {
+            auto index = (size_class + i) % kSizeClassCount;
+            auto &batches = depot._batches[index];
+            if (!batches.empty()) {
+                auto &objs = _objects[index];
+                objs.swap(batches.back());
+                batches.pop_back();
+                depot._batch_count.fetch_sub(1, std::memory_order_release);
+                auto ret = objs.back();
+                objs.pop_back();
+                PacketPoolCounter::add(depot._counter.cached, -(int64_t)objs.size() - 1);
+                PacketPoolCounter::add(_counter.cached, objs.size());
+                return ret;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * 本线程缓存已满，尝试把整批对象转移到中转站
+     */
+    bool flushToDepot(size_t size_class) {
+        auto &depot = Depot::Instance();
+        auto &objs = _objects[size_class];
+        std::lock_guard<std::mutex> lck(depot._mtx);
+        auto &batches = depot._batches[size_class];
+        if (batches.size() >= kMaxDepotBatch) {
+            return false;
+        }
+        PacketPoolCounter::add(depot._counter.cached, objs.size());
+        PacketPoolCounter::add(_counter.cached, -(int64_t)objs.size());
+        batches.emplace_back();
+        batches.back().swap(objs);
+        depot._batch_count.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    static void recycle(T *ptr) {
+        auto cache = instance();
+        if (cache) {
+            auto size_class = getSizeClass(Traits::capacity(*ptr));
+            //尺寸越大的级别缓存个数越少
+            auto max_size = getPacketPoolSize() >> (2 * size_class);
+            if (size_class < kSizeClassCount && max_size
+                && (cache->_objects[size_class].size() < max_size || cache->flushToDepot(size_class))) {
+                cache->_objects[size_class].emplace_back(ptr);
+                PacketPoolCounter::add(cache->_counter.recycle);
+                PacketPoolCounter::add(cache->_counter.cached);
+                return;
+            }
+            PacketPoolCounter::add(cache->_counter.drop);
+        }
+        delete ptr;
+    }
+
+    static bool &exited() {
+        static thread_local bool s_exited = false;
+        return s_exited;
+    }
+
+    /**
+     * 全局中转站，每种尺寸级别最多保存kMaxDepotBatch批对象
+     */
+    class Depot {
+    public:
+        static Depot &Instance() {
+            //不析构，防止进程退出时其他线程的缓存还在访问
+            static auto s_depot = new Depot;
+            return *s_depot;
+        }
+
+    private:
+        Depot() { PacketPoolRegistry::addCounter(Traits::name(), &_counter); }
+
+    private:
+        friend class PacketPool;
+        std::mutex _mtx;
+        // 所有尺寸级别的批次总数，加锁修改，无锁读取用于快速判断中转站是否为空
+        std::atomic<size_t> _batch_count { 0 };
+        PacketPoolCounter _counter;
+        std::vector<std::vector<T *> > _batches[kSizeClassCount];
+    };
+
+    static PacketPool *instance() {
+        if (exited()) {
+            //线程退出中，缓存已销毁
+            return nullptr;
+        }
+        static thread_local PacketPool s_pool(Traits::name());
+        return &s_pool;
+    }
+
+private:
+    PacketPoolCounter _counter;
+    std::vector<T *> _objects[kSizeClassCount];
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_PACKETPOOL_H
@@ -0,0 +1,89 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <set>
+#include "SendBatchStatistic.h"
+
+using namespace std;
+
+namespace mediakit {
+
+static mutex s_statistic_mtx;
+static set<const SendBatchStatistic *> s_statistic_set;
+
+SendBatchStatistic::SendBatchStatistic(string type) {
+    _type = std::move(type);
+    for (auto &bucket : _buckets) {
+        bucket = 0;
+    }
+    lock_guard<mutex> lck(s_statistic_mtx);
+    s_statistic_set.emplace(this);
+}
+
+SendBatchStatistic::~SendBatchStatistic() {
+    lock_guard<mutex> lck(s_statistic_mtx);
+    s_statistic_set.erase(this);
+}
+
+void SendBatchStatistic::setIdentifier(string identifier) {
+    lock_guard<mutex> lck(_mtx);
+    _identifier = std::move(identifier);
+}
+
+string SendBatchStatistic::getIdentifier() const {
+    lock_guard<mutex> lck(_mtx);
+    return _identifier;
+}
+
+void SendBatchStatistic::setTransport(string transport) {
+    lock_guard<mutex> lck(_mtx);
+    _transport = std::move(transport);
+}
+
+string SendBatchStatistic::getTransport() const {
+    lock_guard<mutex> lck(_mtx);
+    return _transport;
+}
+
+void SendBatchStatistic::onFlush() {
+    if (!_pending) {
+        return;
+    }
+    size_t index = 0;
+    for (auto size = _pending; size > 1 && index + 1 < kBucketCount; size >>= 1) {
+        ++index;
+    }
+    ++_buckets[index];
+    _packets += _pending;
+    ++_flushes;
+    _pending = 0;
+}
+
+array<uint64_t, SendBatchStatistic::kBucketCount> SendBatchStatistic::getHistogram() const {
+    array<uint64_t, kBucketCount> ret;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        ret[i] = _buckets[i];
+    }
+    return ret;
+}
+
+const char *SendBatchStatistic::getBucketName(size_t index) {
+    static const char *s_names[kBucketCount] = { "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64+" };
+    return index < kBucketCount ? s_names[index] : "";
+}
+
+void SendBatchStatistic::for_each(const function<void(const SendBatchStatistic &)> &cb) {
+    lock_guard<mutex> lck(s_statistic_mtx);
+    for (auto ptr : s_statistic_set) {
+        cb(*ptr);
+    }
+}
+
+} // namespace mediakit
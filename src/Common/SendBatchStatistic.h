@@ -0,0 +1,91 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_SENDBATCHSTATISTIC_H
+#define ZLMEDIAKIT_SENDBATCHSTATISTIC_H
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <functional>
+
+namespace mediakit {
+
+/**
+ * 发送侧批量发送统计(只统计发送，接收侧未做recvmmsg等批量读取)
+ * 每次flush时记录本批次累计的数据包个数(udp时为一次sendmmsg合并的包数，tcp时为一次合并写的包数)，用于验证合并写效果
+ * 直方图区间按2的幂划分: 1, 2-3, 4-7, 8-15, 16-31, 32-63, 64+
+ */
+class SendBatchStatistic {
+public:
+    static constexpr size_t kBucketCount = 7;
+
+    /**
+     * @param type 协议类型，例如webrtc、srt、rtp
+     */
+    SendBatchStatistic(std::string type);
+    ~SendBatchStatistic();
+
+    SendBatchStatistic(const SendBatchStatistic &) = delete;
+    SendBatchStatistic &operator=(const SendBatchStatistic &) = delete;
+
+    /**
+     * 设置唯一标识，例如对端地址
+     */
+    void setIdentifier(std::string identifier);
+
+    /**
+     * 设置传输方式，udp或tcp，默认udp
+     * webrtc在ice-tcp时也经过同一发送路径，需要区分统计
+     */
+    void setTransport(std::string transport);
+
+    /**
+     * 发送一个数据包(未flush)
+     */
+    void onPacket() { ++_pending; }
+
+    /**
+     * flush socket，结束本批次
+     */
+    void onFlush();
+
+    const std::string &getType() const { return _type; }
+    std::string getIdentifier() const;
+    std::string getTransport() const;
+    uint64_t getPacketCount() const { return _packets; }
+    uint64_t getFlushCount() const { return _flushes; }
+    std::array<uint64_t, kBucketCount> getHistogram() const;
+
+    /**
+     * 获取直方图区间名
+     */
+    static const char *getBucketName(size_t index);
+
+    /**
+     * 遍历所有统计对象，可以跨线程调用
+     */
+    static void for_each(const std::function<void(const SendBatchStatistic &)> &cb);
+
+private:
+    // 只在所属线程修改
+    size_t _pending = 0;
+    std::string _type;
+    std::string _identifier;
+    std::string _transport = "udp";
+    mutable std::mutex _mtx;
+    std::atomic<uint64_t> _packets { 0 };
+    std::atomic<uint64_t> _flushes { 0 };
+    std::array<std::atomic<uint64_t>, kBucketCount> _buckets;
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_SENDBATCHSTATISTIC_H
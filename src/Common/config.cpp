@@ -75,6 +75,16 @@ const string kEnableFFmpegLog = GENERAL_FIELD "enable_ffmpeg_log";
 const string kWaitTrackReadyMS = GENERAL_FIELD "wait_track_ready_ms";
 const string kWaitAddTrackMS = GENERAL_FIELD "wait_add_track_ms";
 const string kUnreadyFrameCache = GENERAL_FIELD "unready_frame_cache";
+const string kPacketPoolSize = GENERAL_FIELD "packet_pool_size";
+const string kDropNonRefBytes = GENERAL_FIELD "drop_non_ref_bytes";
+const string kSkipToKeyBytes = GENERAL_FIELD "skip_to_key_bytes";
+const string kPacerRateMultiplier = GENERAL_FIELD "pacer_rate_multiplier";
+const string kPacerBurstBytes = GENERAL_FIELD "pacer_burst_bytes";
+const string kPacerMaxDelayMS = GENERAL_FIELD "pacer_max_delay_ms";
+const string kFileIOEngine = GENERAL_FIELD "file_io_engine";
+const string kFileIOThreads = GENERAL_FIELD "file_io_threads";
+const string kFileIOQueueDepth = GENERAL_FIELD "file_io_queue_depth";
+const string kFileCacheMB = GENERAL_FIELD "file_cache_mb";
 
 static onceToken token([]() {
     mINI::Instance()[kFlowThreshold] = 1024;
@@ -89,6 +99,16 @@ static onceToken token([]() {
     mINI::Instance()[kWaitTrackReadyMS] = 10000;
     mINI::Instance()[kWaitAddTrackMS] = 3000;
     mINI::Instance()[kUnreadyFrameCache] = 100;
+    mINI::Instance()[kPacketPoolSize] = 512;
+    mINI::Instance()[kDropNonRefBytes] = 1024 * 1024;
+    mINI::Instance()[kSkipToKeyBytes] = 4 * 1024 * 1024;
+    mINI::Instance()[kPacerRateMultiplier] = 2.5;
+    mINI::Instance()[kPacerBurstBytes] = 64 * 1024;
+    mINI::Instance()[kPacerMaxDelayMS] = 200;
+    mINI::Instance()[kFileIOEngine] = "auto";
+    mINI::Instance()[kFileIOThreads] = 4;
+    mINI::Instance()[kFileIOQueueDepth] = 256;
+    mINI::Instance()[kFileCacheMB] = 256;
 });
 
 } // namespace General
@@ -275,14 +295,22 @@ const string kAppName = RECORD_FIELD "appName";
 const string kSampleMS = RECORD_FIELD "sampleMS";
 const string kFileBufSize = RECORD_FIELD "fileBufSize";
 const string kFastStart = RECORD_FIELD "fastStart";
+const string kEnableFmp4 = RECORD_FIELD "enableFmp4";
+const string kEnableIndex = RECORD_FIELD "enableIndex";
 const string kFileRepeat = RECORD_FIELD "fileRepeat";
+const string kDiskWriterThreads = RECORD_FIELD "diskWriterThreads";
+const string kDiskWriterMaxQueueMB = RECORD_FIELD "diskWriterMaxQueueMB";
 
 static onceToken token([]() {
     mINI::Instance()[kAppName] = "record";
     mINI::Instance()[kSampleMS] = 500;
     mINI::Instance()[kFileBufSize] = 64 * 1024;
     mINI::Instance()[kFastStart] = false;
+    mINI::Instance()[kEnableFmp4] = false;
+    mINI::Instance()[kEnableIndex] = true;
     mINI::Instance()[kFileRepeat] = false;
+    mINI::Instance()[kDiskWriterThreads] = 2;
+    mINI::Instance()[kDiskWriterMaxQueueMB] = 32;
 });
 } // namespace Record
 
@@ -296,6 +324,8 @@ const string kSegmentRetain = HLS_FIELD "segRetain";
 const string kFileBufSize = HLS_FIELD "fileBufSize";
 const string kBroadcastRecordTs = HLS_FIELD "broadcastRecordTs";
 const string kDeleteDelaySec = HLS_FIELD "deleteDelaySec";
+const string kInMemory = HLS_FIELD "inMemory";
+const string kPartDuration = HLS_FIELD "partDur";
 
 static onceToken token([]() {
     mINI::Instance()[kSegmentDuration] = 2;
@@ -305,6 +335,8 @@ static onceToken token([]() {
     mINI::Instance()[kFileBufSize] = 64 * 1024;
     mINI::Instance()[kBroadcastRecordTs] = false;
     mINI::Instance()[kDeleteDelaySec] = 10;
+    mINI::Instance()[kInMemory] = false;
+    mINI::Instance()[kPartDuration] = 0;
 });
 } // namespace Hls
 
@@ -178,6 +178,26 @@ extern const std::string kWaitTrackReadyMS;
 extern const std::string kWaitAddTrackMS;
 // 如果track未就绪，我们先缓存帧数据，但是有最大个数限制(100帧时大约4秒)，防止内存溢出
 extern const std::string kUnreadyFrameCache;
+// RtpPacket/RtmpPacket/FrameImp线程本地对象池每个线程每种尺寸级别最多缓存的对象个数，设置为0则关闭对象池
+extern const std::string kPacketPoolSize;
+// 播放会话发送积压(socket繁忙期间累计发送的字节数)超过该值时丢弃非参考帧，设置为0则关闭
+extern const std::string kDropNonRefBytes;
+// 播放会话发送积压超过该值时丢弃后续所有数据，直到积压清空后从下一个关键帧恢复发送，设置为0则关闭
+extern const std::string kSkipToKeyBytes;
+// webrtc与rtp发送平滑(pacer)的放行速率为 基准码率(webrtc带宽估计结果或输入码率) * 该倍数，设置为0则关闭pacer
+extern const std::string kPacerRateMultiplier;
+// pacer令牌桶容量，即不经排队可以一次性突发发送的最大字节数
+extern const std::string kPacerBurstBytes;
+// pacer最大排队时延，排队数据超过该时长仍未发送完毕时提高放行速率
+extern const std::string kPacerMaxDelayMS;
+// http文件下载与mp4点播的文件读取引擎: auto/io_uring/thread/sync，sync为在poller线程中同步读取
+extern const std::string kFileIOEngine;
+// thread引擎读文件线程数，mp4点播解复用也在这些线程中执行
+extern const std::string kFileIOThreads;
+// io_uring引擎每个poller线程的提交队列深度
+extern const std::string kFileIOQueueDepth;
+// http文件下载(含hls点播)与mp4点播共用的文件内容缓存大小(MB)，设置为0则关闭
+extern const std::string kFileCacheMB;
 } // namespace General
 
 namespace Protocol {
@@ -310,8 +330,16 @@ extern const std::string kSampleMS;
 extern const std::string kFileBufSize;
 // mp4录制完成后是否进行二次关键帧索引写入头部
 extern const std::string kFastStart;
+// mp4录制是否使用fmp4格式(每个gop一个moof分片，文件尾部写入mfra索引)，关闭文件时不需要回读重写，开启后fastStart无效
+extern const std::string kEnableFmp4;
+// 是否生成录制时间索引(每路流录制目录下的.record_index文件)，用于按时间跨文件点播
+extern const std::string kEnableIndex;
 // mp4文件是否重头循环读取
 extern const std::string kFileRepeat;
+// 录制(hls/mp4)磁盘写线程个数
+extern const std::string kDiskWriterThreads;
+// 每个录制写入器排队数据上限，单位MB，超过一半开始丢帧，超过上限丢弃数据，置0则不限制
+extern const std::string kDiskWriterMaxQueueMB;
 } // namespace Record
 
 ////////////HLS相关配置///////////
@@ -330,6 +358,10 @@ extern const std::string kFileBufSize;
 extern const std::string kBroadcastRecordTs;
 // hls直播文件删除延时，单位秒
 extern const std::string kDeleteDelaySec;
+// hls直播切片是否只保存在内存中(不写磁盘)
+extern const std::string kInMemory;
+// LL-HLS分片时长，单位秒，置0关闭LL-HLS
+extern const std::string kPartDuration;
 } // namespace Hls
 
 ////////////Rtp代理相关配置///////////
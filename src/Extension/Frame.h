@@ -14,8 +14,10 @@
 #include <map>
 #include <mutex>
 #include <functional>
+#include <type_traits>
 #include "Util/List.h"
 #include "Network/Buffer.h"
+#include "Common/PacketPool.h"
 
 namespace mediakit {
 class Stamp;
@@ -170,23 +172,26 @@ private:
     toolkit::ObjectStatistic<Frame> _statistic;
 };
 
+template <typename C>
+class FramePoolTraits {
+public:
+    static const char *name() { return "FrameImp"; }
+    static size_t capacity(const C &frame) { return frame._buffer.capacity(); }
+};
+
 class FrameImp : public Frame {
 public:
     using Ptr = std::shared_ptr<FrameImp>;
 
     template <typename C = FrameImp>
     static std::shared_ptr<C> create() {
-#if 0
-        static ResourcePool<C> packet_pool;
-        static onceToken token([]() {
-            packet_pool.setSize(1024);
-        });
-        auto ret = packet_pool.obtain2();
+        //从线程本地对象池获取，H264Frame等子类的_codec_id在构造时已确定，无需重置
+        auto ret = PacketPool<C, FramePoolTraits<C> >::obtain();
         ret->clear();
+        if (std::is_same<C, FrameImp>::value) {
+            ret->_codec_id = CodecInvalid;
+        }
         return ret;
-#else
-        return std::shared_ptr<C>(new C());
-#endif
     }
 
     char *data() const override { return (char *)_buffer.data(); }
@@ -217,6 +222,8 @@ private:
 
 protected:
     friend class toolkit::ResourcePool_l<FrameImp>;
+    template <typename T, typename Traits>
+    friend class PacketPool;
     FrameImp() = default;
 };
 
@@ -10,6 +10,7 @@
 
 #include "H264.h"
 #include "SPSParser.h"
+#include "StartCode.h"
 #include "Util/logger.h"
 #include "Util/base64.h"
 
@@ -40,22 +41,14 @@ bool getAVCInfo(const string &strSps, int &iVideoWidth, int &iVideoHeight, float
     return getAVCInfo(strSps.data(), strSps.size(), iVideoWidth, iVideoHeight, iVideoFps);
 }
 
-static const char *memfind(const char *buf, ssize_t len, const char *subbuf, ssize_t sublen) {
-    for (auto i = 0; i < len - sublen; ++i) {
-        if (memcmp(buf + i, subbuf, sublen) == 0) {
-            return buf + i;
-        }
-    }
-    return NULL;
-}
-
 void splitH264(
     const char *ptr, size_t len, size_t prefix, const std::function<void(const char *, size_t, size_t)> &cb) {
     auto start = ptr + prefix;
     auto end = ptr + len;
     size_t next_prefix;
     while (true) {
-        auto next_start = memfind(start, end - start, "\x00\x00\x01", 3);
+        //下一帧起始码后至少还有1个字节
+        auto next_start = end - start > 1 ? findStartCode(start, end - start - 1) : nullptr;
         if (next_start) {
             //找到下一帧
             if (*(next_start - 1) == 0x00) {
@@ -0,0 +1,179 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include "StartCode.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define START_CODE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// gcc/clang可以单独为avx2函数生成代码，不需要全局开启-mavx2
+#define START_CODE_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || (defined(__ARM_NEON) && defined(__arm__))
+#define START_CODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace mediakit {
+
+static inline uint32_t countTrailingZero(uint64_t mask) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, (uint32_t) mask)) {
+        return index;
+    }
+    _BitScanForward(&index, (uint32_t) (mask >> 32));
+    return index + 32;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+const char *findStartCodeScalar(const char *ptr, size_t len) {
+    if (len < 3) {
+        return nullptr;
+    }
+    auto p = (const uint8_t *) ptr;
+    auto end = p + len - 2;
+    while (p < end) {
+        // 根据第3个字节跳过不可能的位置，大部分情况下每次跳过3个字节
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[1]) {
+            p += 2;
+        } else if (p[0] || p[2] != 1) {
+            p += 1;
+        } else {
+            return (const char *) p;
+        }
+    }
+    return nullptr;
+}
+
+#if defined(START_CODE_SSE2)
+static const char *findStartCodeSSE2(const char *ptr, size_t len) {
+    size_t i = 0;
+    if (len >= 18) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        // 每次比较16个位置，需要读取18个字节
+        for (; i + 18 <= len; i += 16) {
+            auto b0 = _mm_loadu_si128((const __m128i *) (ptr + i));
+            auto b1 = _mm_loadu_si128((const __m128i *) (ptr + i + 1));
+            auto b2 = _mm_loadu_si128((const __m128i *) (ptr + i + 2));
+            auto hit = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, one));
+            auto mask = (uint32_t) _mm_movemask_epi8(hit);
+            if (mask) {
+                return ptr + i + countTrailingZero(mask);
+            }
+        }
+    }
+    return findStartCodeScalar(ptr + i, len - i);
+}
+#endif
+
+#if defined(START_CODE_AVX2)
+__attribute__((target("avx2"))) static const char *findStartCodeAVX2(const char *ptr, size_t len) {
+    size_t i = 0;
+    if (len >= 34) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi8(1);
+        // 每次比较32个位置，需要读取34个字节
+        for (; i + 34 <= len; i += 32) {
+            auto b0 = _mm256_loadu_si256((const __m256i *) (ptr + i));
+            auto b1 = _mm256_loadu_si256((const __m256i *) (ptr + i + 1));
+            auto b2 = _mm256_loadu_si256((const __m256i *) (ptr + i + 2));
+            auto hit = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)), _mm256_cmpeq_epi8(b2, one));
+            auto mask = (uint32_t) _mm256_movemask_epi8(hit);
+            if (mask) {
+                return ptr + i + countTrailingZero(mask);
+            }
+        }
+    }
+    return findStartCodeSSE2(ptr + i, len - i);
+}
+#endif
+
+#if defined(START_CODE_NEON)
+static const char *findStartCodeNEON(const char *ptr, size_t len) {
+    size_t i = 0;
+    if (len >= 18) {
+        const uint8x16_t zero = vdupq_n_u8(0);
+        const uint8x16_t one = vdupq_n_u8(1);
+        for (; i + 18 <= len; i += 16) {
+            auto b0 = vld1q_u8((const uint8_t *) (ptr + i));
+            auto b1 = vld1q_u8((const uint8_t *) (ptr + i + 1));
+            auto b2 = vld1q_u8((const uint8_t *) (ptr + i + 2));
+            auto hit = vandq_u8(vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)), vceqq_u8(b2, one));
+            // 把16字节的比较结果压缩为64位，每个字节对应4个bit
+            auto narrowed = vshrn_n_u16(vreinterpretq_u16_u8(hit), 4);
+            auto mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+            if (mask) {
+                return ptr + i + (countTrailingZero(mask) >> 2);
+            }
+        }
+    }
+    return findStartCodeScalar(ptr + i, len - i);
+}
+#endif
+
+using StartCodeFinder = const char *(*)(const char *, size_t);
+
+class StartCodeFinderSelector {
+public:
+    StartCodeFinderSelector() {
+#if defined(START_CODE_AVX2)
+        if (__builtin_cpu_supports("avx2")) {
+            finder = findStartCodeAVX2;
+            name = "avx2";
+            return;
+        }
+#endif
+#if defined(START_CODE_SSE2)
+        finder = findStartCodeSSE2;
+        name = "sse2";
+#elif defined(START_CODE_NEON)
+        finder = findStartCodeNEON;
+        name = "neon";
+#endif
+    }
+
+    static StartCodeFinderSelector &Instance() {
+        static StartCodeFinderSelector s_instance;
+        return s_instance;
+    }
+
+public:
+    StartCodeFinder finder = findStartCodeScalar;
+    const char *name = "scalar";
+};
+
+const char *findStartCode(const char *ptr, size_t len) {
+    static auto s_finder = StartCodeFinderSelector::Instance().finder;
+    return s_finder(ptr, len);
+}
+
+const char *getStartCodeFinderName() {
+    return StartCodeFinderSelector::Instance().name;
+}
+
+} // namespace mediakit
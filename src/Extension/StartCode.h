@@ -0,0 +1,38 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_STARTCODE_H
+#define ZLMEDIAKIT_STARTCODE_H
+
+#include <cstddef>
+
+namespace mediakit {
+
+/**
+ * 查找h264/h265 annexb格式的起始码0x00 00 01
+ * 运行时根据cpu选择avx2/sse2/neon或纯c实现
+ * @param ptr 数据指针
+ * @param len 数据长度，起始码必须完整位于该范围内
+ * @return 起始码第一个字节的位置，未找到返回nullptr
+ */
+const char *findStartCode(const char *ptr, size_t len);
+
+/**
+ * 纯c实现的起始码查找，用于对比测试
+ */
+const char *findStartCodeScalar(const char *ptr, size_t len);
+
+/**
+ * 当前使用的起始码查找实现名称，例如avx2、sse2、neon、scalar
+ */
+const char *getStartCodeFinderName();
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_STARTCODE_H
@@ -9,6 +9,7 @@
  */
 
 #include <csignal>
+#include <cstring>
 #include <tuple>
 
 #ifndef _WIN32
@@ -27,6 +28,8 @@
 #include "HttpBody.h"
 #include "HttpClient.h"
 #include "Common/macros.h"
+#include "Common/AsyncFileReader.h"
+#include "Common/FileChunkCache.h"
 
 #ifndef _WIN32
 #define ENABLE_MMAP
@@ -134,6 +137,7 @@ static std::shared_ptr<char> getSharedMmap(const string &file_path, int64_t &fil
 #endif
 
 HttpFileBody::HttpFileBody(const string &file_path, bool use_mmap) {
+    _file_path = file_path;
 #ifdef ENABLE_MMAP
     if (use_mmap ) {
         _map_addr = getSharedMmap(file_path, _read_to);
@@ -154,6 +158,11 @@ HttpFileBody::HttpFileBody(const string &file_path, bool use_mmap) {
             _read_to = File::fileSize(fp);
         }
     }
+    if (_read_to > 0 && FileChunkCache::enabled()) {
+        uint64_t file_size = 0;
+        _cache_key = FileChunkCache::makeFileKey(file_path, file_size);
+        _file_size = MIN(file_size, (uint64_t)_read_to);
+    }
 }
 
 void HttpFileBody::setRange(uint64_t offset, uint64_t max_size) {
@@ -207,8 +216,26 @@ Buffer::Ptr HttpFileBody::readData(size_t size) {
         //没有剩余字节了
         return nullptr;
     }
+    if (!_cache_key.empty()) {
+        if (auto ret = readCache(size)) {
+            return ret;
+        }
+        auto index = _file_offset / FileChunkCache::kChunkSize;
+        if (_map_addr) {
+            if (auto ret = mapChunk(index, size)) {
+                return ret;
+            }
+        } else if (auto chunk = loadChunk(index)) {
+            return onChunk(index, std::move(chunk), size);
+        }
+        //读取失败，走原逻辑
+    }
     if (!_map_addr) {
         // fread模式
+        if (_fp_dirty) {
+            _fp_dirty = false;
+            fseek64(_fp.get(), _file_offset, SEEK_SET);
+        }
         ssize_t iRead;
         auto ret = _pool.obtain2();
         ret->setCapacity(size + 1);
@@ -237,6 +264,150 @@ Buffer::Ptr HttpFileBody::readData(size_t size) {
     }
 }
 
+//判断mmap内存是否都在page cache中，访问不在page cache中的内存会阻塞在缺页中断上
+static bool isMmapResident(const char *addr, size_t size) {
+#if defined(__linux__) || defined(__linux)
+    static auto page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    auto start = (uintptr_t)addr & ~(page_size - 1);
+    auto len = (uintptr_t)addr + size - start;
+    static thread_local vector<unsigned char> s_vec;
+    s_vec.resize((len + page_size - 1) / page_size);
+    if (mincore((void *)start, len, s_vec.data()) == -1) {
+        //无法判断时按原逻辑同步读取
+        return true;
+    }
+    for (auto flag : s_vec) {
+        if (!(flag & 0x01)) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+bool HttpFileBody::openFile() {
+    if (_fp) {
+        return true;
+    }
+    //mmap模式下冷数据通过文件读取，同时预热page cache
+    auto fp = fopen(_file_path.data(), "rb");
+    if (!fp) {
+        return false;
+    }
+    _fp.reset(fp, fclose);
+    return true;
+}
+
+Buffer::Ptr HttpFileBody::readCache(size_t size) {
+    auto index = _file_offset / FileChunkCache::kChunkSize;
+    if (!_chunk || _chunk_index != index) {
+        //同一chunk分多次发送，只查找一次缓存
+        _chunk = FileChunkCache::Instance().get(_cache_key, index);
+        _chunk_index = index;
+        if (!_chunk) {
+            return nullptr;
+        }
+    }
+    return sliceChunk(size);
+}
+
+Buffer::Ptr HttpFileBody::mapChunk(uint64_t index, size_t size) {
+    auto offset = index * FileChunkCache::kChunkSize;
+    if (offset >= _file_size) {
+        return nullptr;
+    }
+    auto len = (size_t)MIN((uint64_t)FileChunkCache::kChunkSize, _file_size - offset);
+    auto &cache = FileChunkCache::Instance();
+    if (cache.admit(_cache_key, index, len)) {
+        //短时间内多次读取，拷贝后放入缓存
+        auto chunk = BufferRaw::create();
+        chunk->setCapacity(len + 1);
+        memcpy(chunk->data(), _map_addr.get() + offset, len);
+        chunk->setSize(len);
+        cache.insert(_cache_key, index, chunk);
+        _chunk = std::move(chunk);
+    } else {
+        //未准入缓存，直接引用mmap内存，与page cache共享，不拷贝
+        _chunk = std::make_shared<BufferMmap>(_map_addr, offset, len);
+    }
+    _chunk_index = index;
+    return sliceChunk(size);
+}
+
+Buffer::Ptr HttpFileBody::loadChunk(uint64_t index) {
+    auto offset = index * FileChunkCache::kChunkSize;
+    if (offset >= _file_size || !_fp) {
+        return nullptr;
+    }
+    _fp_dirty = true;
+    return FileChunkCache::readChunk(_fp.get(), index, _file_size);
+}
+
+Buffer::Ptr HttpFileBody::onChunk(uint64_t index, Buffer::Ptr chunk, size_t size) {
+    FileChunkCache::Instance().put(_cache_key, index, chunk);
+    _chunk = std::move(chunk);
+    _chunk_index = index;
+    return sliceChunk(size);
+}
+
+Buffer::Ptr HttpFileBody::sliceChunk(size_t size) {
+    auto pos = (size_t)(_file_offset - _chunk_index * FileChunkCache::kChunkSize);
+    if (pos >= _chunk->size()) {
+        //读取文件异常，文件真实长度小于声明长度
+        _file_offset = _read_to;
+        return nullptr;
+    }
+    size = MIN(size, _chunk->size() - pos);
+    _file_offset += size;
+    return std::make_shared<BufferOffset<Buffer::Ptr> >(_chunk, pos, size);
+}
+
+void HttpFileBody::readDataAsync(size_t size, const function<void(const Buffer::Ptr &buf)> &cb) {
+    size = (size_t)(MIN(remainSize(), (int64_t)size));
+    if (size && !_cache_key.empty()) {
+        if (auto ret = readCache(size)) {
+            cb(ret);
+            return;
+        }
+        auto index = _file_offset / FileChunkCache::kChunkSize;
+        auto offset = index * FileChunkCache::kChunkSize;
+        auto len = (size_t)MIN((uint64_t)FileChunkCache::kChunkSize, _file_size - offset);
+        if (!AsyncFileReader::enabled() || (_map_addr && isMmapResident(_map_addr.get() + offset, len)) || !openFile()) {
+            cb(readData(size));
+            return;
+        }
+        //整块读取后放入缓存
+        auto self = static_pointer_cast<HttpFileBody>(shared_from_this());
+        AsyncFileReader::Instance().read(_fp, offset, len, [self, index, size, cb](const Buffer::Ptr &chunk, int err) {
+            if (!chunk) {
+                if (err) {
+                    WarnL << "read file err:" << strerror(err);
+                }
+                cb(nullptr);
+                return;
+            }
+            cb(self->onChunk(index, chunk, size));
+        });
+        return;
+    }
+
+    if (!size || !AsyncFileReader::enabled() || (_map_addr && isMmapResident(_map_addr.get() + _file_offset, size)) || !openFile()) {
+        //热数据直接同步读取(mmap零拷贝)
+        cb(readData(size));
+        return;
+    }
+    //异步读取不改变文件读写位置，之后同步fread前需要seek
+    _fp_dirty = true;
+    auto offset = _file_offset;
+    _file_offset += size;
+    AsyncFileReader::Instance().read(_fp, offset, size, [cb](const Buffer::Ptr &buf, int err) {
+        if (!buf && err) {
+            WarnL << "read file err:" << strerror(err);
+        }
+        cb(buf);
+    });
+}
+
 //////////////////////////////////////////////////////////////////
 
 HttpMultiFormBody::HttpMultiFormBody(const HttpArgs &args, const string &filePath, const string &boundary) {
@@ -129,11 +129,33 @@ public:
 
     int64_t remainSize() override;
     toolkit::Buffer::Ptr readData(size_t size) override;
+    /**
+     * 开启异步文件读取时，数据不在page cache中才在读文件引擎中读取，否则同步读取
+     */
+    void readDataAsync(size_t size, const std::function<void(const toolkit::Buffer::Ptr &buf)> &cb) override;
     int sendFile(int fd) override;
 
+private:
+    bool openFile();
+    //从文件内容缓存读取，未命中返回nullptr
+    toolkit::Buffer::Ptr readCache(size_t size);
+    //mmap模式下未准入缓存的chunk直接引用mmap内存
+    toolkit::Buffer::Ptr mapChunk(uint64_t index, size_t size);
+    toolkit::Buffer::Ptr loadChunk(uint64_t index);
+    toolkit::Buffer::Ptr onChunk(uint64_t index, toolkit::Buffer::Ptr chunk, size_t size);
+    toolkit::Buffer::Ptr sliceChunk(size_t size);
+
 private:
     int64_t _read_to = 0;
     uint64_t _file_offset = 0;
+    //异步读取后文件读写位置与_file_offset不一致
+    bool _fp_dirty = false;
+    std::string _file_path;
+    //文件内容缓存标识，为空时不使用缓存
+    std::string _cache_key;
+    uint64_t _file_size = 0;
+    uint64_t _chunk_index = 0;
+    toolkit::Buffer::Ptr _chunk;
     std::shared_ptr<FILE> _fp;
     std::shared_ptr<char> _map_addr;
     toolkit::ResourcePool<toolkit::BufferRaw> _pool;
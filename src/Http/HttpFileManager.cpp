@@ -13,6 +13,7 @@
 #include <dirent.h>
 #endif //!defined(_WIN32)
 #include <iomanip>
+#include <atomic>
 #include "HttpFileManager.h"
 #include "Util/File.h"
 #include "HttpConst.h"
@@ -33,6 +34,10 @@ namespace mediakit {
 static int kHlsCookieSecond = 60;
 static const string kCookieName = "ZL_COOKIE";
 static const string kHlsSuffix = "/hls.m3u8";
+static const string kHlsSegmentSuffix = ".ts";
+// LL-HLS阻塞式刷新参数
+static const string kHlsMsnKey = "_HLS_msn";
+static const string kHlsPartKey = "_HLS_part";
 
 struct HttpCookieAttachment {
     //是否已经查找到过MediaSource
@@ -334,6 +339,45 @@ static string pathCat(const string &a, const string &b){
     return a + '/' + b;
 }
 
+/**
+ * 从内存回复hls切片
+ * @param cookie 播放m3u8时生成的cookie，可能为空
+ * @param media_info ts切片的url信息
+ * @param file_path 切片文件绝对路径
+ * @param cb 回调对象
+ */
+static void responseMemorySegment(const HttpServerCookie::Ptr &cookie, const MediaInfo &media_info, const string &file_path, const HttpFileManager::invoker &cb) {
+    HlsMediaSource::Ptr src;
+    StrCaseMap header_out;
+    if (cookie) {
+        header_out["Set-Cookie"] = cookie->getCookie(cookie->getAttach<HttpCookieAttachment>()._path);
+        auto &hls_data = cookie->getAttach<HttpCookieAttachment>()._hls_data;
+        if (hls_data) {
+            src = hls_data->getMediaSource();
+        }
+    }
+    if (!src) {
+        //不带cookie访问，切片路径形如 app/stream/日期/小时/分-秒_序号.ts
+        auto stream_id = media_info._streamid.substr(0, media_info._streamid.find('/'));
+        src = dynamic_pointer_cast<HlsMediaSource>(MediaSource::find(HLS_SCHEMA, media_info._vhost, media_info._app, stream_id));
+    }
+    auto segment = src ? src->getSegment(file_path) : nullptr;
+    if (!segment) {
+        //切片已经被删除或流已经下线
+        sendNotFound(cb);
+        return;
+    }
+    if (cookie) {
+        auto &hls_data = cookie->getAttach<HttpCookieAttachment>()._hls_data;
+        if (hls_data) {
+            // 一次性增加一个ts文件的尺寸
+            hls_data->addByteUsage(segment->size());
+        }
+    }
+    //切片被删除后，发送中的切片内存由HttpBufferBody持有，发送完毕后释放
+    cb(200, HttpFileManager::getContentType(file_path.data()), header_out, std::make_shared<HttpBufferBody>(std::move(segment)));
+}
+
 /**
  * 访问文件
  * @param sender 事件触发者
@@ -344,10 +388,17 @@ static string pathCat(const string &a, const string &b){
  */
 static void accessFile(Session &sender, const Parser &parser, const MediaInfo &media_info, const string &file_path, const HttpFileManager::invoker &cb) {
     bool is_hls = end_with(file_path, kHlsSuffix);
+    bool is_memory_segment = false;
     if (!is_hls && !File::fileExist(file_path.data())) {
-        //文件不存在且不是hls,那么直接返回404
-        sendNotFound(cb);
-        return;
+        GET_CONFIG(bool, hls_in_memory, Hls::kInMemory);
+        GET_CONFIG(float, hls_part_duration, Hls::kPartDuration);
+        if ((!hls_in_memory && hls_part_duration <= 0) || !end_with(file_path, kHlsSegmentSuffix)) {
+            //文件不存在且不是hls,那么直接返回404
+            sendNotFound(cb);
+            return;
+        }
+        //hls内存模式或LL-HLS分片，ts切片不在文件系统中
+        is_memory_segment = true;
     }
     if (is_hls) {
         // hls，那么移除掉后缀获取真实的stream_id并且修改协议为HLS
@@ -357,7 +408,7 @@ static void accessFile(Session &sender, const Parser &parser, const MediaInfo &m
 
     weak_ptr<Session> weakSession = sender.shared_from_this();
     //判断是否有权限访问该文件
-    canAccessPath(sender, parser, media_info, false, [cb, file_path, parser, is_hls, media_info, weakSession](const string &err_msg, const HttpServerCookie::Ptr &cookie) {
+    canAccessPath(sender, parser, media_info, false, [cb, file_path, parser, is_hls, is_memory_segment, media_info, weakSession](const string &err_msg, const HttpServerCookie::Ptr &cookie) {
         auto strongSession = weakSession.lock();
         if (!strongSession) {
             // http客户端已经断开，不需要回复
@@ -373,6 +424,12 @@ static void accessFile(Session &sender, const Parser &parser, const MediaInfo &m
             return;
         }
 
+        if (is_memory_segment) {
+            //直接从内存回复ts切片
+            responseMemorySegment(cookie, media_info, file_path, cb);
+            return;
+        }
+
         auto response_file = [is_hls](const HttpServerCookie::Ptr &cookie, const HttpFileManager::invoker &cb, const string &file_path, const Parser &parser, const string &file_content = "") {
             StrCaseMap httpHeader;
             if (cookie) {
@@ -412,8 +469,45 @@ static void accessFile(Session &sender, const Parser &parser, const MediaInfo &m
 
         auto src = cookie->getAttach<HttpCookieAttachment>()._hls_data->getMediaSource();
         if (src) {
-            //直接从内存获取m3u8索引文件(而不是从文件系统)
-            response_file(cookie, cb, file_path, parser, src->getIndexFile());
+            auto &args = parser.getUrlArgs();
+            if (args.find(kHlsMsnKey) == args.end()) {
+                //直接从内存获取m3u8索引文件(而不是从文件系统)
+                response_file(cookie, cb, file_path, parser, src->getIndexFile());
+                return;
+            }
+            //LL-HLS阻塞式刷新，等待m3u8包含指定的切片或分片
+            auto msn = atoll(args[kHlsMsnKey].data());
+            auto part = args.find(kHlsPartKey) == args.end() ? -1 : atoi(args[kHlsPartKey].data());
+            auto done = std::make_shared<std::atomic<bool> >(false);
+            auto on_index = [response_file, cookie, cb, file_path, parser, done](const string &file) {
+                if (done->exchange(true)) {
+                    //已经超时回复
+                    return;
+                }
+                response_file(cookie, cb, file_path, parser, file);
+            };
+            uint64_t request_id = 0;
+            if (!src->getIndexFile(msn, part, on_index, request_id)) {
+                cb(400, "text/html", StrCaseMap(), std::make_shared<HttpStringBody>("_HLS_msn is too far in the future"));
+                return;
+            }
+            //最多等待3个切片时长，超时则回复最新的m3u8
+            GET_CONFIG(float, seg_duration, Hls::kSegmentDuration);
+            std::weak_ptr<HlsMediaSource> weak_src = src;
+            strongSession->getPoller()->doDelayTask((uint64_t) MAX(seg_duration * 3 * 1000, 1000), [weak_src, on_index, request_id, cb, done]() {
+                auto src = weak_src.lock();
+                if (!src) {
+                    //等待期间流已注销，不能回复空的m3u8
+                    if (!done->exchange(true)) {
+                        sendNotFound(cb);
+                    }
+                    return 0;
+                }
+                //超时后移除等待中的请求
+                src->cancelIndexFile(request_id);
+                on_index(src->getIndexFile());
+                return 0;
+            });
             return;
         }
         if (cookie->getAttach<HttpCookieAttachment>()._find_src) {
@@ -244,6 +244,7 @@ bool HttpSession::checkLiveStream(const string &schema, const string  &url_suffi
                 strong_self->sendNotFound(close_flag);
             } else {
                 strong_self->_is_live_stream = true;
+                strong_self->_egress_counter = src->getEgressCounter();
                 cb(src);
             }
         });
@@ -377,6 +378,9 @@ bool HttpSession::checkLiveStreamFlv(const function<void()> &cb){
             }
         }
 
+        if (FrameDropper::enabled()) {
+            _frame_dropper = std::make_shared<FrameDropper>(_live_over_websocket ? "ws-flv" : "http-flv");
+        }
         start(getPoller(), rtmp_src, start_pts);
     });
 }
@@ -760,6 +764,9 @@ void HttpSession::onWrite(const Buffer::Ptr &buffer, bool flush) {
     }
 
     _ticker.resetTime();
+    if (_egress_counter) {
+        _egress_counter->add(buffer->size());
+    }
     if (!_live_over_websocket) {
         _total_bytes_usage += buffer->size();
         send(buffer);
@@ -807,4 +814,8 @@ std::shared_ptr<FlvMuxer> HttpSession::getSharedPtr(){
     return dynamic_pointer_cast<FlvMuxer>(shared_from_this());
 }
 
+bool HttpSession::onDropRtmp(const RtmpPacket::Ptr &pkt) {
+    return _frame_dropper && _frame_dropper->inputRtmp(pkt, isSocketBusy());
+}
+
 } /* namespace mediakit */
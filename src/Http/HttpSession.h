@@ -20,6 +20,7 @@
 #include "HttpFileManager.h"
 #include "TS/TSMediaSource.h"
 #include "FMP4/FMP4MediaSource.h"
+#include "Common/FrameDropper.h"
 
 namespace mediakit {
 
@@ -51,6 +52,7 @@ protected:
     void onWrite(const toolkit::Buffer::Ptr &data, bool flush) override ;
     void onDetach() override;
     std::shared_ptr<FlvMuxer> getSharedPtr() override;
+    bool onDropRtmp(const RtmpPacket::Ptr &pkt) override;
 
     //HttpRequestSplitter override
     ssize_t onRecvHeader(const char *data,size_t len) override;
@@ -131,6 +133,10 @@ private:
 
     //消耗的总流量
     uint64_t _total_bytes_usage = 0;
+    //直播源的发送字节数统计
+    MetricCounter::Ptr _egress_counter;
+    //http/websocket-flv慢速播放器丢帧策略
+    FrameDropper::Ptr _frame_dropper;
 
     std::string _origin;
     // 请求上下文
@@ -0,0 +1,288 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <set>
+#include <thread>
+#include "DiskWriter.h"
+#include "Util/util.h"
+#include "Util/File.h"
+#include "Util/logger.h"
+#include "Util/uv_errno.h"
+#include "Thread/semaphore.h"
+#include "Common/config.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+class DiskWriterPool::Worker {
+public:
+    Worker(size_t index) {
+        _thread = std::thread([this, index]() { run(index); });
+    }
+
+    ~Worker() {
+        // 空任务代表退出，退出前会执行完所有排队的任务，保证录制数据落盘
+        async(nullptr);
+        _thread.join();
+    }
+
+    void async(function<void()> task) {
+        {
+            lock_guard<mutex> lck(_mtx);
+            _tasks.emplace_back(std::move(task));
+        }
+        _sem.post();
+    }
+
+private:
+    void run(size_t index) {
+        setThreadName(("disk writer " + to_string(index)).data());
+        while (true) {
+            _sem.wait();
+            function<void()> task;
+            {
+                lock_guard<mutex> lck(_mtx);
+                if (_tasks.empty()) {
+                    continue;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+            if (!task) {
+                break;
+            }
+            try {
+                task();
+            } catch (std::exception &ex) {
+                WarnL << "disk writer task exception: " << ex.what();
+            }
+        }
+    }
+
+private:
+    mutex _mtx;
+    semaphore _sem;
+    List<function<void()> > _tasks;
+    std::thread _thread;
+};
+
+INSTANCE_IMP(DiskWriterPool)
+
+DiskWriterPool::DiskWriterPool() {
+    GET_CONFIG(uint32_t, thread_num, Record::kDiskWriterThreads);
+    auto size = MAX(thread_num, 1u);
+    for (size_t i = 0; i < size; ++i) {
+        _workers.emplace_back(std::make_shared<Worker>(i));
+    }
+    InfoL << "disk writer thread size: " << size;
+}
+
+DiskWriterPool::~DiskWriterPool() = default;
+
+size_t DiskWriterPool::getWorker() {
+    return _index++ % _workers.size();
+}
+
+void DiskWriterPool::async(size_t worker, function<void()> task) {
+    _workers[worker % _workers.size()]->async(std::move(task));
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+
+static mutex s_mtx;
+static set<DiskWriter *> s_writers;
+
+DiskWriter::DiskWriter(string tag) {
+    _tag = std::move(tag);
+    _worker = DiskWriterPool::Instance().getWorker();
+    lock_guard<mutex> lck(s_mtx);
+    s_writers.emplace(this);
+}
+
+DiskWriter::~DiskWriter() {
+    {
+        lock_guard<mutex> lck(s_mtx);
+        s_writers.erase(this);
+    }
+    if (_queue_size) {
+        WarnL << "disk writer destroyed with " << _queue_size << " pending operations: " << _tag;
+    }
+}
+
+void DiskWriter::open(string path, string mode, size_t buf_size) {
+    {
+        lock_guard<mutex> lck(_mtx);
+        _path = path;
+    }
+    Operation op;
+    op.task = [this, path, mode, buf_size](FILE *) {
+        _file = nullptr;
+        auto fp = File::create_file(path.data(), mode.data());
+        if (!fp) {
+            WarnL << "create file failed: " << path << " " << get_uv_errmsg();
+            return;
+        }
+        std::shared_ptr<char> file_buf;
+        if (buf_size) {
+            file_buf.reset(new char[buf_size], [](char *ptr) { delete[] ptr; });
+            setvbuf(fp, file_buf.get(), _IOFBF, buf_size);
+        }
+        // 强引用file_buf，保证其生命周期不短于文件
+        _file.reset(fp, [file_buf](FILE *fp) {
+            fclose(fp);
+        });
+    };
+    addOperation(std::move(op));
+}
+
+bool DiskWriter::write(Buffer::Ptr buf, bool force) {
+    if (!buf || !buf->size()) {
+        return true;
+    }
+    GET_CONFIG(uint32_t, max_queue_mb, Record::kDiskWriterMaxQueueMB);
+    auto size = buf->size();
+    if (!force && max_queue_mb && _queue_bytes + size > max_queue_mb * 1024 * 1024) {
+        // 磁盘写入跟不上，丢弃数据而不是阻塞poller线程
+        if (!_overflow) {
+            _overflow = true;
+            WarnL << "disk writer queue overflow, start drop data: " << _tag << ", queue bytes: " << _queue_bytes;
+        }
+        _drop_bytes += size;
+        return false;
+    }
+    if (_overflow) {
+        _overflow = false;
+        InfoL << "disk writer queue recovered: " << _tag << ", total drop bytes: " << _drop_bytes;
+    }
+    _queue_bytes += size;
+    Operation op;
+    op.buf = std::move(buf);
+    addOperation(std::move(op));
+    return true;
+}
+
+void DiskWriter::seek(uint64_t offset) {
+    Operation op;
+    op.task = [offset](FILE *fp) {
+        if (fp) {
+#if defined(_WIN32) || defined(_WIN64)
+            _fseeki64(fp, offset, SEEK_SET);
+#else
+            fseek(fp, offset, SEEK_SET);
+#endif
+        }
+    };
+    addOperation(std::move(op));
+}
+
+void DiskWriter::close(function<void()> cb) {
+    Operation op;
+    op.task = [this, cb](FILE *) {
+        //关闭并flush文件到磁盘
+        _file = nullptr;
+        if (cb) {
+            cb();
+        }
+    };
+    addOperation(std::move(op));
+}
+
+void DiskWriter::async(Task task) {
+    Operation op;
+    op.task = std::move(task);
+    addOperation(std::move(op));
+}
+
+void DiskWriter::sync(const Task &task) {
+    semaphore sem;
+    async([&](FILE *fp) {
+        if (task) {
+            task(fp);
+        }
+        sem.post();
+    });
+    sem.wait();
+}
+
+bool DiskWriter::isBusy() const {
+    GET_CONFIG(uint32_t, max_queue_mb, Record::kDiskWriterMaxQueueMB);
+    return max_queue_mb && _queue_bytes > max_queue_mb * 1024 * 1024 / 2;
+}
+
+string DiskWriter::getPath() const {
+    lock_guard<mutex> lck(_mtx);
+    return _path;
+}
+
+uint64_t DiskWriter::getAvgLatencyMS() const {
+    uint64_t count = _latency_count;
+    return count ? _latency_us / count / 1000 : 0;
+}
+
+void DiskWriter::for_each(const function<void(const DiskWriter &)> &cb) {
+    lock_guard<mutex> lck(s_mtx);
+    for (auto writer : s_writers) {
+        cb(*writer);
+    }
+}
+
+void DiskWriter::addOperation(Operation op) {
+    op.stamp = getCurrentMicrosecond(true);
+    ++_queue_size;
+    lock_guard<mutex> lck(_mtx);
+    _operations.emplace_back(std::move(op));
+    if (_scheduled) {
+        // 写线程尚未取走数据，本次数据会与之前的数据一起写入
+        return;
+    }
+    _scheduled = true;
+    auto self = shared_from_this();
+    DiskWriterPool::Instance().async(_worker, [self]() { self->onDrain(); });
+}
+
+void DiskWriter::onDrain() {
+    List<Operation> operations;
+    while (true) {
+        {
+            lock_guard<mutex> lck(_mtx);
+            if (_operations.empty()) {
+                _scheduled = false;
+                return;
+            }
+            operations.swap(_operations);
+        }
+        // 一次写入所有排队的数据，小块数据由文件缓存合并
+        operations.for_each([&](Operation &op) {
+            if (op.buf) {
+                auto size = op.buf->size();
+                if (_file && fwrite(op.buf->data(), size, 1, _file.get()) == 1) {
+                    _write_bytes += size;
+                } else {
+                    _drop_bytes += size;
+                }
+                _queue_bytes -= size;
+                auto latency = getCurrentMicrosecond(true) - op.stamp;
+                _latency_us += latency;
+                ++_latency_count;
+                if (latency > _max_latency_us) {
+                    _max_latency_us = latency;
+                }
+            } else if (op.task) {
+                op.task(_file.get());
+            }
+            --_queue_size;
+        });
+        operations.clear();
+    }
+}
+
+} // namespace mediakit
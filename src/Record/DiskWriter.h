@@ -0,0 +1,165 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_DISKWRITER_H
+#define ZLMEDIAKIT_DISKWRITER_H
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include "Util/List.h"
+#include "Network/Buffer.h"
+
+namespace mediakit {
+
+/**
+ * 磁盘写线程池
+ * 录制相关的磁盘io(创建、写入、删除文件)都在此线程池中执行，防止慢速磁盘阻塞poller线程
+ */
+class DiskWriterPool {
+public:
+    static DiskWriterPool &Instance();
+    ~DiskWriterPool();
+
+    /**
+     * 轮询分配一个写线程，返回其索引
+     */
+    size_t getWorker();
+
+    /**
+     * 在指定写线程中执行任务，同一线程中的任务按投递顺序串行执行
+     */
+    void async(size_t worker, std::function<void()> task);
+
+private:
+    DiskWriterPool();
+
+private:
+    class Worker;
+    std::atomic<size_t> _index { 0 };
+    std::vector<std::shared_ptr<Worker> > _workers;
+};
+
+/**
+ * 异步文件写入器
+ * 一个写入器对应一路流或一个录制文件，其所有文件操作按投递顺序在同一写线程中执行；
+ * 写线程每次取出全部排队的数据连续写入(合并写)，数据为引用计数的Buffer，不拷贝
+ */
+class DiskWriter : public std::enable_shared_from_this<DiskWriter> {
+public:
+    using Ptr = std::shared_ptr<DiskWriter>;
+    // 在写线程中执行的任务，参数为当前打开的文件(可能为nullptr)
+    using Task = std::function<void(FILE *fp)>;
+
+    /**
+     * @param tag 统计标识，例如vhost/app/stream
+     */
+    DiskWriter(std::string tag);
+    ~DiskWriter();
+
+    /**
+     * 打开文件(会自动创建目录)，之后的写入和seek都作用于该文件，之前打开的文件会被关闭
+     * @param path 文件路径
+     * @param mode fopen的方式
+     * @param buf_size 文件写缓存大小，为0时使用系统默认值
+     */
+    void open(std::string path, std::string mode, size_t buf_size);
+
+    /**
+     * 写入数据
+     * @param buf 数据，写入完成前会一直持有其引用
+     * @param force 为false时，排队数据超过上限将丢弃本次数据
+     * @return 是否成功加入写队列
+     */
+    bool write(toolkit::Buffer::Ptr buf, bool force = false);
+
+    /**
+     * 移动文件写位置
+     */
+    void seek(uint64_t offset);
+
+    /**
+     * 关闭文件
+     * @param cb 文件关闭后在写线程中回调
+     */
+    void close(std::function<void()> cb = nullptr);
+
+    /**
+     * 在写线程中执行任务，与文件操作保持顺序，例如删除文件、写索引文件
+     */
+    void async(Task task);
+
+    /**
+     * 等待所有排队的操作完成后在写线程中执行任务，并阻塞等待其完成
+     * 会阻塞当前线程，不可在poller线程中调用
+     */
+    void sync(const Task &task);
+
+    /**
+     * 排队数据是否已超过上限的一半，调用者应该开始丢帧(例如丢弃到下一个关键帧)
+     */
+    bool isBusy() const;
+
+    const std::string &getTag() const { return _tag; }
+    std::string getPath() const;
+    // 排队中的操作个数
+    size_t getQueueSize() const { return _queue_size; }
+    // 排队中的数据字节数
+    size_t getQueueBytes() const { return _queue_bytes; }
+    uint64_t getWriteBytes() const { return _write_bytes; }
+    uint64_t getDropBytes() const { return _drop_bytes; }
+    // 数据从入队到写入完成的平均耗时，单位毫秒
+    uint64_t getAvgLatencyMS() const;
+    // 数据从入队到写入完成的最大耗时，单位毫秒
+    uint64_t getMaxLatencyMS() const { return _max_latency_us / 1000; }
+
+    /**
+     * 遍历所有写入器，可以跨线程调用
+     */
+    static void for_each(const std::function<void(const DiskWriter &)> &cb);
+
+private:
+    class Operation {
+    public:
+        toolkit::Buffer::Ptr buf;
+        Task task;
+        // 入队时间，单位微秒
+        uint64_t stamp = 0;
+    };
+
+    void addOperation(Operation op);
+    void onDrain();
+
+private:
+    bool _scheduled = false;
+    bool _overflow = false;
+    size_t _worker;
+    std::string _tag;
+    std::string _path;
+    mutable std::mutex _mtx;
+    toolkit::List<Operation> _operations;
+
+    std::atomic<size_t> _queue_size { 0 };
+    std::atomic<size_t> _queue_bytes { 0 };
+    std::atomic<uint64_t> _write_bytes { 0 };
+    std::atomic<uint64_t> _drop_bytes { 0 };
+    std::atomic<uint64_t> _latency_us { 0 };
+    std::atomic<uint64_t> _latency_count { 0 };
+    std::atomic<uint64_t> _max_latency_us { 0 };
+
+    // 以下只在写线程中访问
+    std::shared_ptr<FILE> _file;
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_DISKWRITER_H
@@ -15,11 +15,25 @@ using namespace std;
 
 namespace mediakit {
 
-HlsMaker::HlsMaker(float seg_duration, uint32_t seg_number, bool seg_keep) {
+HlsMaker::HlsMaker(float seg_duration, uint32_t seg_number, bool seg_keep, float part_duration) {
     //最小允许设置为0，0个切片代表点播
     _seg_number = seg_number;
     _seg_duration = seg_duration;
     _seg_keep = seg_keep;
+    //LL-HLS只对直播有效，并且分片时长必须小于切片时长
+    if (seg_number && part_duration > 0 && part_duration < seg_duration) {
+        _part_duration = part_duration;
+    }
+}
+
+uint64_t HlsMaker::getCompletedCount() const {
+    //存在未完成的切片时，该切片的索引为_file_index - 1
+    return _last_file_name.empty() ? _file_index : _file_index - 1;
+}
+
+void HlsMaker::getLiveEdge(int64_t &msn, int &part) const {
+    msn = getCompletedCount();
+    part = _last_file_name.empty() ? -1 : (int) _parts.size() - 1;
 }
 
 void HlsMaker::makeIndexFile(bool eof) {
@@ -32,7 +46,7 @@ void HlsMaker::makeIndexFile(bool eof) {
     }
 
     char file_content[1024];
-    auto sequence = _seg_number ? (_file_index > _seg_number ? _file_index - _seg_number : 0LL) : 0LL;
+    auto sequence = _seg_number ? getCompletedCount() - _seg_dur_list.size() : 0LL;
     if (_seg_number == 0) {
         // 录像点播支持时移
         snprintf(file_content, sizeof(file_content),
@@ -43,6 +57,19 @@ void HlsMaker::makeIndexFile(bool eof) {
                  "#EXT-X-MEDIA-SEQUENCE:%llu\n",
                  (maxSegmentDuration + 999) / 1000,
                  sequence);
+    } else if (isPartEnabled()) {
+        //LL-HLS，播放器可以阻塞式刷新m3u8，并从距离直播边缘3个分片处开始播放
+        snprintf(file_content, sizeof(file_content),
+                 "#EXTM3U\n"
+                 "#EXT-X-VERSION:6\n"
+                 "#EXT-X-TARGETDURATION:%u\n"
+                 "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n"
+                 "#EXT-X-PART-INF:PART-TARGET=%.3f\n"
+                 "#EXT-X-MEDIA-SEQUENCE:%llu\n",
+                 (maxSegmentDuration + 999) / 1000,
+                 _part_duration * 3,
+                 _part_duration,
+                 sequence);
     } else {
         snprintf(file_content, sizeof(file_content),
                  "#EXTM3U\n"
@@ -57,11 +84,31 @@ void HlsMaker::makeIndexFile(bool eof) {
     std::string m3u8;
     m3u8.assign(file_content);
 
+    auto append_parts = [&](const std::vector<PartInfo> &parts) {
+        for (auto &part : parts) {
+            snprintf(file_content, sizeof(file_content), "#EXT-X-PART:DURATION=%.3f,URI=\"%s\"%s\n", part.duration / 1000.0,
+                     part.name.data(), part.independent ? ",INDEPENDENT=YES" : "");
+            m3u8.append(file_content);
+        }
+    };
+
+    size_t index = 0;
     for (auto &tp : _seg_dur_list) {
+        if (++index == _seg_dur_list.size()) {
+            //只保留最近一个完整切片的分片信息
+            append_parts(_last_parts);
+        }
         snprintf(file_content, sizeof(file_content), "#EXTINF:%.3f,\n%s\n", std::get<0>(tp) / 1000.0, std::get<1>(tp).data());
         m3u8.append(file_content);
     }
 
+    if (isPartEnabled() && !eof && !_last_file_name.empty()) {
+        //正在生成的切片的分片，以及下一个分片的预加载提示
+        append_parts(_parts);
+        snprintf(file_content, sizeof(file_content), "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\"\n", getPartName(_parts.size()).data());
+        m3u8.append(file_content);
+    }
+
     if (eof) {
         snprintf(file_content, sizeof(file_content), "#EXT-X-ENDLIST\n");
         m3u8.append(file_content);
@@ -70,20 +117,33 @@ void HlsMaker::makeIndexFile(bool eof) {
 }
 
 
-void HlsMaker::inputData(void *data, size_t len, uint64_t timestamp, bool is_idr_fast_packet) {
-    if (data && len) {
+void HlsMaker::inputData(const toolkit::Buffer::Ptr &buffer, uint64_t timestamp, bool is_idr_fast_packet) {
+    if (buffer && buffer->size()) {
         if (timestamp < _last_timestamp) {
             //时间戳回退了，切片时长重新计时
             WarnL << "stamp reduce: " << _last_timestamp << " -> " << timestamp;
-            _last_seg_timestamp = _last_timestamp = timestamp;
+            _part_start = _last_seg_timestamp = _last_timestamp = timestamp;
         }
         if (is_idr_fast_packet) {
             //尝试切片ts
             addNewSegment(timestamp);
         }
         if (!_last_file_name.empty()) {
+            if (isPartEnabled()) {
+                if (_part_bytes && timestamp >= _part_start + _part_duration * 1000) {
+                    //到了分片时间，完成上个分片并更新m3u8
+                    flushPart(timestamp);
+                    makeIndexFile(false);
+                }
+                if (!_part_bytes) {
+                    //新的分片
+                    _part_start = timestamp;
+                    _part_independent = is_idr_fast_packet;
+                }
+                _part_bytes += buffer->size();
+            }
             //存在切片才写入ts数据
-            onWriteSegment((char *) data, len);
+            onWriteSegment(buffer);
             _last_timestamp = timestamp;
         }
     } else {
@@ -118,6 +178,8 @@ void HlsMaker::addNewSegment(uint64_t stamp) {
         return;
     }
 
+    //上个切片的最后一个分片在新切片开始时结束
+    flushPart(stamp);
     //关闭并保存上一个切片
     flushLastSegment(false);
     //新增切片
@@ -131,6 +193,11 @@ void HlsMaker::flushLastSegment(bool eof){
         //不存在上个切片
         return;
     }
+    if (isPartEnabled()) {
+        flushPart(_last_timestamp);
+        _last_parts = std::move(_parts);
+        _parts.clear();
+    }
     //文件创建到最后一次数据写入的时间即为切片长度
     auto seg_dur = _last_timestamp - _last_seg_timestamp;
     if (seg_dur <= 0) {
@@ -145,6 +212,19 @@ void HlsMaker::flushLastSegment(bool eof){
     makeIndexFile(eof);
 }
 
+void HlsMaker::flushPart(uint64_t timestamp) {
+    if (!isPartEnabled() || !_part_bytes || _last_file_name.empty()) {
+        return;
+    }
+    int duration = timestamp > _part_start ? timestamp - _part_start : 0;
+    if (duration <= 0) {
+        duration = 1;
+    }
+    auto name = onFlushPart(_parts.size());
+    _parts.emplace_back(PartInfo { duration, std::move(name), _part_independent });
+    _part_bytes = 0;
+}
+
 bool HlsMaker::isKeep() {
     return _seg_keep;
 }
@@ -155,6 +235,9 @@ void HlsMaker::clear() {
     _last_seg_timestamp = 0;
     _seg_dur_list.clear();
     _last_file_name.clear();
+    _part_bytes = 0;
+    _parts.clear();
+    _last_parts.clear();
 }
 
 }//namespace mediakit
@@ -14,6 +14,8 @@
 #include <string>
 #include <deque>
 #include <tuple>
+#include <vector>
+#include "Network/Buffer.h"
 
 namespace mediakit {
 
@@ -23,18 +25,18 @@ public:
      * @param seg_duration 切片文件长度
      * @param seg_number 切片个数
      * @param seg_keep 是否保留切片文件
+     * @param part_duration LL-HLS分片(EXT-X-PART)时长，单位秒，0为关闭，只对直播有效
      */
-    HlsMaker(float seg_duration = 5, uint32_t seg_number = 3, bool seg_keep = false);
+    HlsMaker(float seg_duration = 5, uint32_t seg_number = 3, bool seg_keep = false, float part_duration = 0);
     virtual ~HlsMaker() = default;
 
     /**
      * 写入ts数据
-     * @param data 数据
-     * @param len 数据长度
+     * @param buffer 数据，为空时代表flush切片
      * @param timestamp 毫秒时间戳
      * @param is_idr_fast_packet 是否为关键帧第一个包
      */
-    void inputData(void *data, size_t len, uint64_t timestamp, bool is_idr_fast_packet);
+    void inputData(const toolkit::Buffer::Ptr &buffer, uint64_t timestamp, bool is_idr_fast_packet);
 
     /**
      * 是否为直播
@@ -70,16 +72,40 @@ protected:
 
     /**
      * 写当前ts切片文件回调
-     * @param data
-     * @param len
+     * @param buffer 切片数据，可以持有其引用以便异步写入
      */
-    virtual void onWriteSegment(const char *data, size_t len) = 0;
+    virtual void onWriteSegment(const toolkit::Buffer::Ptr &buffer) = 0;
 
     /**
      * 写m3u8文件回调
      */
     virtual void onWriteHls(const std::string &data) = 0;
 
+    /**
+     * LL-HLS分片完成回调，分片数据为上次分片完成后onWriteSegment写入的数据
+     * @param part_index 分片在当前切片中的索引
+     * @return 分片文件名
+     */
+    virtual std::string onFlushPart(uint32_t part_index) { return ""; }
+
+    /**
+     * 获取当前切片中LL-HLS分片的文件名，用于EXT-X-PRELOAD-HINT
+     * @param part_index 分片在当前切片中的索引
+     */
+    virtual std::string getPartName(uint32_t part_index) { return ""; }
+
+    /**
+     * 是否开启LL-HLS分片
+     */
+    bool isPartEnabled() const { return _part_duration > 0; }
+
+    /**
+     * 获取最新m3u8的直播边缘，用于LL-HLS阻塞式刷新
+     * @param msn 最新切片的序号(可能尚未完成)
+     * @param part 该切片中最新完成的分片索引，-1代表没有完成的分片
+     */
+    void getLiveEdge(int64_t &msn, int &part) const;
+
     /**
      * 上一个 ts 切片写入完成, 可在这里进行通知处理
      * @param duration_ms 上一个 ts 切片的时长, 单位为毫秒
@@ -110,7 +136,25 @@ private:
      */
     void addNewSegment(uint64_t timestamp);
 
+    /**
+     * 完成当前LL-HLS分片
+     * @param timestamp 分片结束时间戳
+     */
+    void flushPart(uint64_t timestamp);
+
+    /**
+     * 获取已完成切片个数
+     */
+    uint64_t getCompletedCount() const;
+
 private:
+    class PartInfo {
+    public:
+        int duration;
+        std::string name;
+        bool independent;
+    };
+
     float _seg_duration = 0;
     // 0 点播模式, > 0 live模式(只保留_seg_number个最新的segment)
     uint32_t _seg_number = 0;
@@ -121,6 +165,15 @@ private:
     std::string _last_file_name;
     // 索引 + 文件名 列表，用于生成m3u8文件
     std::deque<std::tuple<int,std::string> > _seg_dur_list;
+
+    float _part_duration = 0;
+    bool _part_independent = false;
+    size_t _part_bytes = 0;
+    uint64_t _part_start = 0;
+    // 当前切片已完成的分片
+    std::vector<PartInfo> _parts;
+    // 上个切片的分片，m3u8中保留其EXT-X-PART
+    std::vector<PartInfo> _last_parts;
 };
 
 }//namespace mediakit
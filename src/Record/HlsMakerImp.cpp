@@ -11,6 +11,7 @@
 #include <ctime>
 #include <sys/stat.h>
 #include "HlsMakerImp.h"
+#include "RecordIndex.h"
 #include "Util/util.h"
 #include "Util/uv_errno.h"
 #include "Util/File.h"
@@ -26,15 +27,18 @@ HlsMakerImp::HlsMakerImp(const string &m3u8_file,
                          uint32_t bufSize,
                          float seg_duration,
                          uint32_t seg_number,
-                         bool seg_keep):HlsMaker(seg_duration, seg_number, seg_keep) {
+                         bool seg_keep,
+                         bool in_memory,
+                         float part_duration,
+                         const string &tag):HlsMaker(seg_duration, seg_number, seg_keep, part_duration) {
     _poller = EventPollerPool::Instance().getPoller();
     _path_prefix = m3u8_file.substr(0, m3u8_file.rfind('/'));
     _path_hls = m3u8_file;
     _params = params;
     _buf_size = bufSize;
-    _file_buf.reset(new char[bufSize], [](char *ptr) {
-        delete[] ptr;
-    });
+    //hls录制(点播)或保留切片时仍然需要写文件
+    _in_memory = in_memory && isLive() && !isKeep();
+    _writer = std::make_shared<DiskWriter>(tag);
 
     _info.folder = _path_prefix;
 }
@@ -45,6 +49,12 @@ HlsMakerImp::~HlsMakerImp() {
 
 void HlsMakerImp::clearCache() {
     clearCache(true, false);
+    //清空m3u8索引，在写线程中排队，防止被之前尚未写完的m3u8覆盖
+    setIndexFile("");
+}
+
+bool HlsMakerImp::isBusy() const {
+    return _writer->isBusy();
 }
 
 void HlsMakerImp::clearCache(bool immediately, bool eof) {
@@ -55,17 +65,25 @@ void HlsMakerImp::clearCache(bool immediately, bool eof) {
     }
 
     clear();
-    _file = nullptr;
     _segment_file_paths.clear();
+    _part_file_paths.clear();
+    _part_buffers.clear();
+    if ((_in_memory || isPartEnabled()) && _media_src) {
+        _media_src->clearSegments();
+    }
 
-    //hls直播才删除文件
+    //hls直播才删除文件，删除操作也在写线程中执行，保证在切片写完后才删除
     GET_CONFIG(uint32_t, delay, Hls::kDeleteDelaySec);
+    auto path_prefix = _path_prefix;
+    auto writer = _writer;
+    auto del_file = [writer, path_prefix]() {
+        writer->async([path_prefix](FILE *) { File::delete_file(path_prefix.data()); });
+    };
     if (!delay || immediately) {
-        File::delete_file(_path_prefix.data());
+        del_file();
     } else {
-        auto path_prefix = _path_prefix;
-        _poller->doDelayTask(delay * 1000, [path_prefix]() {
-            File::delete_file(path_prefix.data());
+        _poller->doDelayTask(delay * 1000, [del_file]() {
+            del_file();
             return 0;
         });
     }
@@ -82,18 +100,35 @@ string HlsMakerImp::onOpenSegment(uint64_t index) {
         if (isLive()) {
             _segment_file_paths.emplace(index, segment_path);
         }
+        _segment_name_base = segment_name.substr(0, segment_name.size() - 3);
+        _segment_path_base = segment_path.substr(0, segment_path.size() - 3);
+    }
+    if (isPartEnabled()) {
+        //m3u8中只保留最近一个完整切片的分片，更早的分片可以删除了
+        _part_buffers.clear();
+        while (!_part_file_paths.empty() && _part_file_paths.begin()->first + 2 <= index) {
+            for (auto &path : _part_file_paths.begin()->second) {
+                if (_media_src) {
+                    _media_src->delSegment(path);
+                }
+            }
+            _part_file_paths.erase(_part_file_paths.begin());
+        }
+    }
+    _segment_broken = false;
+    if (_in_memory) {
+        _segment_buffers.clear();
+    } else {
+        _writer->open(segment_path, "wb", _buf_size);
     }
-    _file = makeFile(segment_path, true);
 
     //保存本切片的元数据
     _info.start_time = ::time(NULL);
+    _segment_start_ms = getCurrentMillisecond(true);
     _info.file_name = segment_name;
     _info.file_path = segment_path;
     _info.url = _info.app + "/" + _info.stream + "/" + segment_name;
 
-    if (!_file) {
-        WarnL << "create file failed," << segment_path << " " << get_uv_errmsg();
-    }
     if (_params.empty()) {
         return segment_name;
     }
@@ -103,60 +138,175 @@ string HlsMakerImp::onOpenSegment(uint64_t index) {
 void HlsMakerImp::onDelSegment(uint64_t index) {
     auto it = _segment_file_paths.find(index);
     if (it != _segment_file_paths.end()) {
-        File::delete_file(it->second.data());
+        auto path = std::move(it->second);
         _segment_file_paths.erase(it);
+        if (_in_memory) {
+            //正在被http发送的切片由发送者持有引用，发送完毕后释放
+            if (_media_src) {
+                _media_src->delSegment(path);
+            }
+            return;
+        }
+        _writer->async([path](FILE *) { File::delete_file(path.data()); });
     }
 }
 
-void HlsMakerImp::onWriteSegment(const char *data, size_t len) {
-    if (_file) {
-        fwrite(data, len, 1, _file.get());
+void HlsMakerImp::onWriteSegment(const Buffer::Ptr &buffer) {
+    //持有buffer引用，在写线程中写入或切片完成时合并，不拷贝数据
+    if (_in_memory) {
+        _segment_buffers.emplace_back(buffer);
+    } else if (!_segment_broken && !_writer->write(buffer)) {
+        //写队列已满丢弃了数据，切片中间出现空洞会导致花屏，剩余数据也不再写入，保证切片在断点前是完整的
+        _segment_broken = true;
+        WarnL << "disk writer overflow, segment truncated: " << _info.file_path;
+    }
+    if (isPartEnabled()) {
+        _part_buffers.emplace_back(buffer);
     }
     if (_media_src) {
         // 更新speed
-        _media_src->onSegmentSize(len);
+        _media_src->onSegmentSize(buffer->size());
     }
 }
 
 void HlsMakerImp::onWriteHls(const std::string &data) {
-    auto hls = makeFile(_path_hls);
-    if (hls) {
-        fwrite(data.data(), data.size(), 1, hls.get());
-        hls.reset();
-        if (_media_src) {
-            _media_src->setIndexFile(data);
-        }
-    } else {
-        WarnL << "create hls file " << _path_hls << " failed:" << get_uv_errmsg();
+    if (_in_memory) {
+        //切片已经在内存中，直接更新索引
+        setIndexFile(data);
+        return;
     }
+    auto path_hls = _path_hls;
+    _writer->async([path_hls, data](FILE *) {
+        auto hls = File::create_file(path_hls.data(), "wb");
+        if (!hls) {
+            WarnL << "create hls file " << path_hls << " failed:" << get_uv_errmsg();
+            return;
+        }
+        fwrite(data.data(), data.size(), 1, hls);
+        fclose(hls);
+    });
+    //m3u8文件写入后再更新内存中的索引，此时其引用的ts切片已经写完
+    setIndexFile(data);
     //DebugL << "\r\n"  << string(data,len);
 }
 
-void HlsMakerImp::onFlushLastSegment(uint64_t duration_ms) {
-    //关闭并flush文件到磁盘
-    _file = nullptr;
-
-    GET_CONFIG(bool, broadcastRecordTs, Hls::kBroadcastRecordTs);
-    if (broadcastRecordTs) {
-        _info.time_len = duration_ms / 1000.0f;
-        _info.file_size = File::fileSize(_info.file_path.data());
-        NoticeCenter::Instance().emitEvent(Broadcast::kBroadcastRecordTs, _info);
+void HlsMakerImp::setIndexFile(string index_file) {
+    if (!_media_src) {
+        return;
     }
+    //该m3u8的直播边缘，用于LL-HLS阻塞式刷新
+    int64_t msn;
+    int part;
+    getLiveEdge(msn, part);
+    if (_in_memory) {
+        //内存模式不涉及磁盘io，与原先一样在当前线程设置索引
+        _media_src->setIndexFile(std::move(index_file), msn, part);
+        return;
+    }
+    std::weak_ptr<HlsMediaSource> weak_src = _media_src;
+    auto poller = _poller;
+    _writer->async([weak_src, poller, index_file, msn, part](FILE *) {
+        auto src = weak_src.lock();
+        if (!src) {
+            return;
+        }
+        //HlsMediaSource注册等操作需要切回其归属线程
+        EventPoller::Ptr owner;
+        try {
+            owner = src->getOwnerPoller();
+        } catch (std::exception &) {
+            owner = poller;
+        }
+        owner->async([weak_src, index_file, msn, part]() {
+            if (auto src = weak_src.lock()) {
+                src->setIndexFile(index_file, msn, part);
+            }
+        }, false);
+    });
 }
 
-std::shared_ptr<FILE> HlsMakerImp::makeFile(const string &file, bool setbuf) {
-    auto file_buf = _file_buf;
-    auto ret = std::shared_ptr<FILE>(File::create_file(file.data(), "wb"), [file_buf](FILE *fp) {
-        if (fp) {
-            fclose(fp);
+void HlsMakerImp::onFlushLastSegment(uint64_t duration_ms) {
+    GET_CONFIG(bool, broadcastRecordTs, Hls::kBroadcastRecordTs);
+    if (_in_memory) {
+        flushMemorySegment();
+        if (broadcastRecordTs) {
+            _info.time_len = duration_ms / 1000.0f;
+            NoticeCenter::Instance().emitEvent(Broadcast::kBroadcastRecordTs, _info);
         }
+        return;
+    }
+    //hls点播或保留切片时，切片文件会一直保留，加入录制时间索引；不完整的切片不加入索引
+    bool add_index = (!isLive() || isKeep()) && RecordIndex::enabled() && !_segment_broken;
+    if (!broadcastRecordTs && !add_index) {
+        //关闭并flush文件到磁盘
+        _writer->close();
+        return;
+    }
+    auto info = _info;
+    info.time_len = duration_ms / 1000.0f;
+    auto start_ms = _segment_start_ms;
+    bool broadcast = broadcastRecordTs;
+    _writer->close([info, start_ms, duration_ms, add_index, broadcast]() mutable {
+        if (add_index) {
+            RecordIndex::Instance().addSegment(info.folder, start_ms, duration_ms, info.file_path);
+        }
+        if (!broadcast) {
+            return;
+        }
+        //文件关闭后才能获取到正确的文件大小
+        info.file_size = File::fileSize(info.file_path.data());
+        NoticeCenter::Instance().emitEvent(Broadcast::kBroadcastRecordTs, info);
     });
-    if (ret && setbuf) {
-        setvbuf(ret.get(), _file_buf.get(), _IOFBF, _buf_size);
+}
+
+static Buffer::Ptr mergeBuffers(std::vector<Buffer::Ptr> &buffers) {
+    size_t size = 0;
+    for (auto &buffer : buffers) {
+        size += buffer->size();
+    }
+    //合并为一整块内存，http回复时直接引用，不再拷贝
+    auto ret = BufferRaw::create();
+    ret->setCapacity(size + 1);
+    size_t offset = 0;
+    for (auto &buffer : buffers) {
+        memcpy(ret->data() + offset, buffer->data(), buffer->size());
+        offset += buffer->size();
     }
+    ret->setSize(size);
+    buffers.clear();
     return ret;
 }
 
+void HlsMakerImp::flushMemorySegment() {
+    auto segment = mergeBuffers(_segment_buffers);
+    _info.file_size = segment->size();
+    if (_media_src) {
+        _media_src->addSegment(_info.file_path, std::move(segment));
+    }
+}
+
+string HlsMakerImp::onFlushPart(uint32_t part_index) {
+    //分片只保存在内存中，由http服务器直接回复
+    auto path = _segment_path_base + ".p" + std::to_string(part_index) + ".ts";
+    auto part = mergeBuffers(_part_buffers);
+    if (_media_src) {
+        _media_src->addSegment(path, std::move(part));
+    }
+    int64_t msn;
+    int last_part;
+    getLiveEdge(msn, last_part);
+    _part_file_paths[msn].emplace_back(std::move(path));
+    return getPartName(part_index);
+}
+
+string HlsMakerImp::getPartName(uint32_t part_index) {
+    auto name = _segment_name_base + ".p" + std::to_string(part_index) + ".ts";
+    if (_params.empty()) {
+        return name;
+    }
+    return name + "?" + _params;
+}
+
 void HlsMakerImp::setMediaSource(const string &vhost, const string &app, const string &stream_id) {
     _media_src = std::make_shared<HlsMediaSource>(vhost, app, stream_id);
     _info.app = app;
@@ -168,4 +318,73 @@ HlsMediaSource::Ptr HlsMakerImp::getMediaSource() const {
     return _media_src;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+HlsMasterMakerImp::HlsMasterMakerImp(const string &m3u8_file, const string &params, const string &vhost, const string &app, const string &stream_id) {
+    _path_hls = m3u8_file;
+    _params = params;
+    _stream_id = stream_id;
+    _writer = std::make_shared<DiskWriter>("hls_master:" + vhost + "/" + app + "/" + stream_id);
+    _media_src = std::make_shared<HlsMediaSource>(vhost, app, stream_id);
+}
+
+HlsMasterMakerImp::~HlsMasterMakerImp() {
+    //在写线程中删除所在目录，排在主索引文件写入之后
+    auto dir = _path_hls.substr(0, _path_hls.rfind('/'));
+    _writer->async([dir](FILE *) { File::delete_file(dir.data()); });
+}
+
+static bool isValidVariant(const string &stream_id, const string &master_id) {
+    //流id作为相对路径的一部分，不能跳出app目录
+    return !stream_id.empty() && stream_id != "." && stream_id != ".." && stream_id != master_id
+        && stream_id.find_first_of("/\\?#\r\n") == string::npos;
+}
+
+size_t HlsMasterMakerImp::makeIndexFile(const std::vector<Variant> &variants) {
+    _StrPrinter m3u8;
+    m3u8 << "#EXTM3U\n"
+         << "#EXT-X-VERSION:3\n";
+    size_t count = 0;
+    for (auto &variant : variants) {
+        if (!isValidVariant(variant.stream_id, _stream_id)) {
+            WarnL << "invalid hls variant stream id: " << variant.stream_id << ", master: " << _stream_id;
+            continue;
+        }
+        ++count;
+        m3u8 << "#EXT-X-STREAM-INF:BANDWIDTH=" << variant.bandwidth;
+        if (variant.width && variant.height) {
+            m3u8 << ",RESOLUTION=" << variant.width << "x" << variant.height;
+        }
+        //各码率流与主索引文件位于同一app目录下
+        m3u8 << "\n../" << variant.stream_id << "/hls.m3u8";
+        if (!_params.empty()) {
+            m3u8 << "?" << _params;
+        }
+        m3u8 << "\n";
+    }
+
+    if (!count) {
+        //没有可引用的码率流，不注册HlsMediaSource
+        return 0;
+    }
+    auto path_hls = _path_hls;
+    string data = m3u8;
+    _writer->async([path_hls, data](FILE *) {
+        auto hls = File::create_file(path_hls.data(), "wb");
+        if (!hls) {
+            WarnL << "create hls file " << path_hls << " failed:" << get_uv_errmsg();
+            return;
+        }
+        fwrite(data.data(), data.size(), 1, hls);
+        fclose(hls);
+    });
+    //http服务器从内存中回复主索引文件，不依赖磁盘文件；设置索引文件后才会注册HlsMediaSource
+    _media_src->setIndexFile(std::move(m3u8));
+    return count;
+}
+
+HlsMediaSource::Ptr HlsMasterMakerImp::getMediaSource() const {
+    return _media_src;
+}
+
 }//namespace mediakit
\ No newline at end of file
@@ -13,9 +13,11 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include <stdlib.h>
 #include "HlsMaker.h"
 #include "HlsMediaSource.h"
+#include "DiskWriter.h"
 
 namespace mediakit {
 
@@ -26,7 +28,10 @@ public:
                 uint32_t bufSize  = 64 * 1024,
                 float seg_duration = 5,
                 uint32_t seg_number = 3,
-                bool seg_keep = false);
+                bool seg_keep = false,
+                bool in_memory = false,
+                float part_duration = 0,
+                const std::string &tag = "hls");
 
     ~HlsMakerImp() override;
 
@@ -48,30 +53,95 @@ public:
       */
      void clearCache();
 
+    /**
+     * 磁盘写入是否跟不上，此时应该丢帧
+     */
+    bool isBusy() const;
+
 protected:
     std::string onOpenSegment(uint64_t index) override ;
     void onDelSegment(uint64_t index) override;
-    void onWriteSegment(const char *data, size_t len) override;
+    void onWriteSegment(const toolkit::Buffer::Ptr &buffer) override;
     void onWriteHls(const std::string &data) override;
     void onFlushLastSegment(uint64_t duration_ms) override;
+    std::string onFlushPart(uint32_t part_index) override;
+    std::string getPartName(uint32_t part_index) override;
 
 private:
-    std::shared_ptr<FILE> makeFile(const std::string &file,bool setbuf = false);
     void clearCache(bool immediately, bool eof);
+    void setIndexFile(std::string index_file);
+    void flushMemorySegment();
 
 private:
+    // hls直播切片只保存在内存中，由HlsMediaSource提供给http服务器
+    bool _in_memory = false;
     int _buf_size;
     std::string _params;
     std::string _path_hls;
     std::string _path_prefix;
     RecordInfo _info;
-    std::shared_ptr<FILE> _file;
-    std::shared_ptr<char> _file_buf;
+    //当前切片开始录制的时间(unix时间戳)，单位毫秒
+    uint64_t _segment_start_ms = 0;
+    // 当前切片有数据被写队列拒绝，切片已不完整，剩余数据不再写入
+    bool _segment_broken = false;
+    // 切片、m3u8文件的创建、写入、删除都在磁盘写线程中按顺序执行
+    DiskWriter::Ptr _writer;
+    // 内存模式下当前切片的数据
+    std::vector<toolkit::Buffer::Ptr> _segment_buffers;
+    // 当前LL-HLS分片的数据
+    std::vector<toolkit::Buffer::Ptr> _part_buffers;
+    // 当前切片去除.ts后缀的文件名与路径，用于生成分片文件名
+    std::string _segment_name_base;
+    std::string _segment_path_base;
+    // 切片索引对应的分片路径，分片只保存在内存中
+    std::map<uint64_t/*index*/, std::vector<std::string>/*part_path*/> _part_file_paths;
     HlsMediaSource::Ptr _media_src;
     toolkit::EventPoller::Ptr _poller;
     // 用于记录索引对应文件路径: 直播模式时有用(用于onDelSegment), 点播模式因不需要删除文件，所以为空
     std::map<uint64_t/*index*/,std::string/*file_path*/> _segment_file_paths;
 };
 
+/**
+ * 多码率hls主索引文件(master playlist)生成器
+ * 主索引文件只引用各码率流的hls.m3u8，本身不切片
+ */
+class HlsMasterMakerImp {
+public:
+    using Ptr = std::shared_ptr<HlsMasterMakerImp>;
+
+    class Variant {
+    public:
+        // 码率流id，与主索引文件位于同一app下
+        std::string stream_id;
+        // 峰值码率，单位bit/s
+        int bandwidth = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    HlsMasterMakerImp(const std::string &m3u8_file, const std::string &params, const std::string &vhost, const std::string &app, const std::string &stream_id);
+    ~HlsMasterMakerImp();
+
+    /**
+     * 生成主索引文件，并注册对应的HlsMediaSource
+     * 流id非法(为空、包含路径分隔符、与主索引同名)的码率流不会被引用
+     * @return 主索引文件中引用的码率流个数
+     */
+    size_t makeIndexFile(const std::vector<Variant> &variants);
+
+    /**
+     * 获取MediaSource
+     */
+    HlsMediaSource::Ptr getMediaSource() const;
+
+private:
+    std::string _params;
+    std::string _path_hls;
+    std::string _stream_id;
+    // 主索引文件的写入与删除在磁盘写线程中执行
+    DiskWriter::Ptr _writer;
+    HlsMediaSource::Ptr _media_src;
+};
+
 }//namespace mediakit
 #endif //HLSMAKERIMP_H
@@ -64,7 +64,7 @@ HlsMediaSource::Ptr HlsCookieData::getMediaSource() const {
     return _src.lock();
 }
 
-void HlsMediaSource::setIndexFile(std::string index_file)
+void HlsMediaSource::setIndexFile(std::string index_file, int64_t msn, int part)
 {
     if (!_ring) {
         std::weak_ptr<HlsMediaSource> weakSelf = std::dynamic_pointer_cast<HlsMediaSource>(shared_from_this());
@@ -82,11 +82,82 @@ void HlsMediaSource::setIndexFile(std::string index_file)
     //赋值m3u8索引文件内容
     std::lock_guard<std::mutex> lck(_mtx_index);
     _index_file = std::move(index_file);
+    _live_msn = msn;
+    _live_part = part;
 
     if (!_index_file.empty()) {
         _list_cb.for_each([&](const std::function<void(const std::string& str)>& cb) { cb(_index_file); });
         _list_cb.clear();
+
+        //回复已经满足条件的LL-HLS阻塞式刷新请求
+        for (auto it = _blocking_requests.begin(); it != _blocking_requests.end();) {
+            if (!isLiveEdgeReached(it->msn, it->part)) {
+                ++it;
+                continue;
+            }
+            it->cb(_index_file);
+            it = _blocking_requests.erase(it);
+        }
+    }
+}
+
+bool HlsMediaSource::isLiveEdgeReached(int64_t msn, int part) const {
+    if (part < 0) {
+        //等待该切片完成
+        return _live_msn > msn;
+    }
+    return _live_msn > msn || (_live_msn == msn && _live_part >= part);
+}
+
+bool HlsMediaSource::getIndexFile(int64_t msn, int part, std::function<void(const std::string &str)> cb, uint64_t &request_id) {
+    std::lock_guard<std::mutex> lck(_mtx_index);
+    request_id = 0;
+    if (!_index_file.empty() && isLiveEdgeReached(msn, part)) {
+        cb(_index_file);
+        return true;
     }
+    if (_live_msn >= 0 && msn > _live_msn + 2) {
+        //请求的切片太远，按照LL-HLS规范应该回复400
+        return false;
+    }
+    request_id = ++_blocking_id;
+    _blocking_requests.emplace_back(BlockingRequest { request_id, msn, part, std::move(cb) });
+    return true;
+}
+
+void HlsMediaSource::cancelIndexFile(uint64_t request_id) {
+    if (!request_id) {
+        return;
+    }
+    std::lock_guard<std::mutex> lck(_mtx_index);
+    for (auto it = _blocking_requests.begin(); it != _blocking_requests.end(); ++it) {
+        if (it->id == request_id) {
+            //释放回调持有的cookie，防止播放器个数统计虚高
+            _blocking_requests.erase(it);
+            return;
+        }
+    }
+}
+
+void HlsMediaSource::addSegment(const std::string &path, toolkit::Buffer::Ptr buffer) {
+    std::lock_guard<std::mutex> lck(_mtx_segment);
+    _segments[path] = std::move(buffer);
+}
+
+void HlsMediaSource::delSegment(const std::string &path) {
+    std::lock_guard<std::mutex> lck(_mtx_segment);
+    _segments.erase(path);
+}
+
+void HlsMediaSource::clearSegments() {
+    std::lock_guard<std::mutex> lck(_mtx_segment);
+    _segments.clear();
+}
+
+toolkit::Buffer::Ptr HlsMediaSource::getSegment(const std::string &path) const {
+    std::lock_guard<std::mutex> lck(_mtx_segment);
+    auto it = _segments.find(path);
+    return it == _segments.end() ? nullptr : it->second;
 }
 
 void HlsMediaSource::getIndexFile(std::function<void(const std::string& str)> cb)
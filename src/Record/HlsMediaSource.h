@@ -14,7 +14,9 @@
 #include "Common/MediaSource.h"
 #include "Util/TimeTicker.h"
 #include "Util/RingBuffer.h"
+#include <list>
 #include <atomic>
+#include <unordered_map>
 
 namespace mediakit {
 
@@ -41,14 +43,32 @@ public:
 
     /**
      * 设置或清空m3u8索引文件内容
+     * @param index_file m3u8索引文件内容
+     * @param msn 该m3u8中最新切片的序号(可能尚未完成)，用于LL-HLS阻塞式刷新
+     * @param part 该切片中最新完成的分片索引，-1代表没有完成的分片
      */
-    void setIndexFile(std::string index_file);
+    void setIndexFile(std::string index_file, int64_t msn = -1, int part = -1);
 
     /**
      * 异步获取m3u8文件
      */
     void getIndexFile(std::function<void(const std::string &str)> cb);
 
+    /**
+     * LL-HLS阻塞式获取m3u8文件(_HLS_msn/_HLS_part)
+     * m3u8包含指定切片(或分片)后才回调，可能在其他线程回调
+     * @param msn 切片序号
+     * @param part 分片索引，-1代表等待整个切片完成
+     * @param request_id 返回等待中的请求id，用于超时后取消等待；立即回调时为0
+     * @return 请求的切片距离直播边缘太远时返回false，不会回调
+     */
+    bool getIndexFile(int64_t msn, int part, std::function<void(const std::string &str)> cb, uint64_t &request_id);
+
+    /**
+     * 取消等待中的LL-HLS阻塞式刷新请求(例如请求超时)
+     */
+    void cancelIndexFile(uint64_t request_id);
+
     /**
      * 同步获取m3u8文件
      */
@@ -59,10 +79,49 @@ public:
 
     void onSegmentSize(size_t bytes) { _speed[TrackVideo] += bytes; }
 
+    /**
+     * 添加内存hls切片，可以跨线程调用
+     * @param path 切片文件路径，与http请求映射的文件路径一致
+     * @param buffer 切片完整内容
+     */
+    void addSegment(const std::string &path, toolkit::Buffer::Ptr buffer);
+
+    /**
+     * 删除内存hls切片，正在被http发送的切片在发送完毕后释放
+     */
+    void delSegment(const std::string &path);
+
+    /**
+     * 清空所有内存hls切片
+     */
+    void clearSegments();
+
+    /**
+     * 获取内存hls切片，不存在时返回nullptr
+     */
+    toolkit::Buffer::Ptr getSegment(const std::string &path) const;
+
+private:
+    bool isLiveEdgeReached(int64_t msn, int part) const;
+
 private:
+    class BlockingRequest {
+    public:
+        uint64_t id;
+        int64_t msn;
+        int part;
+        std::function<void(const std::string &)> cb;
+    };
+
+    int64_t _live_msn = -1;
+    int _live_part = -1;
+    uint64_t _blocking_id = 0;
     RingType::Ptr _ring;
     std::string _index_file;
     mutable std::mutex _mtx_index;
+    std::list<BlockingRequest> _blocking_requests;
+    mutable std::mutex _mtx_segment;
+    std::unordered_map<std::string/*file_path*/, toolkit::Buffer::Ptr> _segments;
     toolkit::List<std::function<void(const std::string &)>> _list_cb;
 };
 
@@ -14,6 +14,7 @@
 #include "HlsMakerImp.h"
 #include "MPEG.h"
 #include "Common/config.h"
+#include "Common/Metrics.h"
 
 namespace mediakit {
 
@@ -22,14 +23,16 @@ class HlsRecorder final : public MediaSourceEventInterceptor, public MpegMuxer,
 public:
     using Ptr = std::shared_ptr<HlsRecorder>;
 
-    HlsRecorder(const std::string &m3u8_file, const std::string &params, const ProtocolOption &option) : MpegMuxer(false) {
+    HlsRecorder(const std::string &m3u8_file, const std::string &params, const ProtocolOption &option, const std::string &tag = "hls") : MpegMuxer(false) {
         GET_CONFIG(uint32_t, hlsNum, Hls::kSegmentNum);
         GET_CONFIG(bool, hlsKeep, Hls::kSegmentKeep);
         GET_CONFIG(uint32_t, hlsBufSize, Hls::kFileBufSize);
         GET_CONFIG(float, hlsDuration, Hls::kSegmentDuration);
+        GET_CONFIG(bool, hlsInMemory, Hls::kInMemory);
+        GET_CONFIG(float, hlsPartDuration, Hls::kPartDuration);
 
         _option = option;
-        _hls = std::make_shared<HlsMakerImp>(m3u8_file, params, hlsBufSize, hlsDuration, hlsNum, hlsKeep);
+        _hls = std::make_shared<HlsMakerImp>(m3u8_file, params, hlsBufSize, hlsDuration, hlsNum, hlsKeep, hlsInMemory, hlsPartDuration, tag);
         //清空上次的残余文件
         _hls->clearCache();
     }
@@ -54,8 +57,13 @@ public:
             // hls直播时，如果无人观看就删除视频缓存，目的是为了防止视频跳跃
             _clear_cache = true;
         }
-        else
+        else {
+            if (!_enabled) {
+                //从无人观看恢复，需要先输入GOP缓存，让切片以关键帧开始
+                _need_gop = true;
+            }
             _enabled = true;
+        }
         MediaSourceEventInterceptor::onReaderChanged(sender, size);
     }
 
@@ -64,9 +72,13 @@ public:
             _clear_cache = false;
             //清空旧的m3u8索引文件于ts切片
             _hls->clearCache();
-            _hls->getMediaSource()->setIndexFile("");
         }
         if (_enabled || !_option.hls_demand) {
+            if (dropFrame(frame)) {
+                static auto &s_drop = Metrics::Instance().getCounter("zlm_record_drop_frames_total", "type=\"hls\"", "Frames dropped because the disk writer is busy");
+                s_drop.add();
+                return false;
+            }
             return MpegMuxer::inputFrame(frame);
         }
         return false;
@@ -77,18 +89,54 @@ public:
         return _option.hls_demand ? (_clear_cache ? true : _enabled) : true;
     }
 
+    /**
+     * 是否需要先输入GOP缓存，调用后清除该标记
+     */
+    bool fetchNeedGop() {
+        auto ret = _need_gop;
+        _need_gop = false;
+        return ret;
+    }
+
+    /**
+     * 是否依赖共享的GOP缓存：按需模式下无人观看(不打包也不缓存GOP)，或刚恢复观看尚未输入GOP缓存
+     */
+    bool waitGop() const {
+        return _need_gop || (_option.hls_demand && !_enabled);
+    }
+
 private:
     void onWrite(std::shared_ptr<toolkit::Buffer> buffer, uint64_t timestamp, bool key_pos) override {
-        if (!buffer) {
-            _hls->inputData(nullptr, 0, timestamp, key_pos);
-        } else {
-            _hls->inputData(buffer->data(), buffer->size(), timestamp, key_pos);
+        _hls->inputData(buffer, timestamp, key_pos);
+    }
+
+    /**
+     * 磁盘写入跟不上时丢帧，恢复后从视频关键帧开始写入
+     */
+    bool dropFrame(const Frame::Ptr &frame) {
+        if (frame->getTrackType() == TrackVideo) {
+            _have_video = true;
+        }
+        if (!_drop_frame) {
+            if (!_hls->isBusy()) {
+                return false;
+            }
+            _drop_frame = true;
+            WarnL << "hls disk writer is busy, start drop frame: " << _hls->getMediaSource()->getUrl();
         }
+        if (_hls->isBusy() || (_have_video && !frame->configFrame() && !frame->keyFrame())) {
+            return true;
+        }
+        _drop_frame = false;
+        return false;
     }
 
 private:
+    bool _have_video = false;
+    bool _drop_frame = false;
     bool _enabled = true;
     bool _clear_cache = false;
+    bool _need_gop = false;
     ProtocolOption _option;
     std::shared_ptr<HlsMakerImp> _hls;
 };
@@ -13,6 +13,7 @@
 #include "Util/File.h"
 #include "Util/logger.h"
 #include "Common/config.h"
+#include "Common/FileChunkCache.h"
 
 using namespace toolkit;
 using namespace std;
@@ -97,6 +98,14 @@ void MP4FileDisk::openFile(const char *file, const char *mode) {
         fflush(fp);
         fclose(fp);
     });
+
+    _cache_key.clear();
+    _chunk = nullptr;
+    _offset = 0;
+    if (mode[0] == 'r' && FileChunkCache::enabled()) {
+        //点播读取mp4时通过文件内容缓存读取，多个播放器共享热点数据
+        _cache_key = FileChunkCache::makeFileKey(file, _file_size);
+    }
 }
 
 void MP4FileDisk::closeFile() {
@@ -104,6 +113,34 @@ void MP4FileDisk::closeFile() {
 }
 
 int MP4FileDisk::onRead(void *data, size_t bytes) {
+    if (!_cache_key.empty()) {
+        auto ptr = (char *)data;
+        while (bytes) {
+            auto index = _offset / FileChunkCache::kChunkSize;
+            if (!_chunk || _chunk_index != index) {
+                _chunk = FileChunkCache::Instance().get(_cache_key, index);
+                if (!_chunk) {
+                    _chunk = FileChunkCache::readChunk(_file.get(), index, _file_size);
+                    if (!_chunk) {
+                        return 0 != ferror(_file.get()) ? ferror(_file.get()) : -1 /*EOF*/;
+                    }
+                    FileChunkCache::Instance().put(_cache_key, index, _chunk);
+                }
+                _chunk_index = index;
+            }
+            auto &chunk = _chunk;
+            auto pos = (size_t)(_offset - index * FileChunkCache::kChunkSize);
+            if (pos >= chunk->size()) {
+                return -1 /*EOF*/;
+            }
+            auto size = MIN(bytes, chunk->size() - pos);
+            memcpy(ptr, chunk->data() + pos, size);
+            ptr += size;
+            bytes -= size;
+            _offset += size;
+        }
+        return 0;
+    }
     if (bytes == fread(data, 1, bytes, _file.get())){
         return 0;
     }
@@ -111,17 +148,130 @@ int MP4FileDisk::onRead(void *data, size_t bytes) {
 }
 
 int MP4FileDisk::onWrite(const void *data, size_t bytes) {
+    if (!_cache_key.empty()) {
+        //文件被修改，不再使用缓存
+        _cache_key.clear();
+        _chunk = nullptr;
+        fseek64(_file.get(), _offset, SEEK_SET);
+    }
     return bytes == fwrite(data, 1, bytes, _file.get()) ? 0 : ferror(_file.get());
 }
 
 int MP4FileDisk::onSeek(uint64_t offset) {
+    if (!_cache_key.empty()) {
+        //实际文件读写位置在readChunk时设置
+        _offset = offset;
+        return 0;
+    }
     return fseek64(_file.get(), offset, SEEK_SET);
 }
 
 uint64_t MP4FileDisk::onTell() {
+    if (!_cache_key.empty()) {
+        return _offset;
+    }
     return ftell64(_file.get());
 }
 
+/////////////////////////////////////////////////////MP4FileAsyncDisk/////////////////////////////////////////////////////////
+
+MP4FileAsyncDisk::~MP4FileAsyncDisk() {
+    if (_writer) {
+        //不阻塞等待，文件在写线程中关闭
+        flushCache();
+        _writer->close();
+    }
+}
+
+void MP4FileAsyncDisk::openFile(const char *file, const char *mode, const std::string &tag) {
+    GET_CONFIG(uint32_t, mp4BufSize, Record::kFileBufSize);
+    _cache_size = MAX(mp4BufSize, 4 * 1024u);
+    _offset = 0;
+    _writer = std::make_shared<DiskWriter>(tag);
+    //libmov的写入已在_cache中合并，文件使用默认缓存即可
+    _writer->open(file, mode, 0);
+}
+
+void MP4FileAsyncDisk::closeFile() {
+    if (!_writer) {
+        return;
+    }
+    flushCache();
+    _writer->close();
+    //等待文件关闭
+    _writer->sync(nullptr);
+    _writer = nullptr;
+}
+
+bool MP4FileAsyncDisk::isBusy() const {
+    return _writer && _writer->isBusy();
+}
+
+void MP4FileAsyncDisk::flushCache() {
+    if (_cache && _cache->size()) {
+        //mp4数据不能丢弃，否则文件损坏，由上层根据isBusy()丢帧
+        _writer->write(std::move(_cache), true);
+    }
+    _cache = nullptr;
+}
+
+int MP4FileAsyncDisk::onWrite(const void *data, size_t bytes) {
+    if (!_writer) {
+        return -1;
+    }
+    if (_cache && _cache->size() + bytes > _cache_size) {
+        flushCache();
+    }
+    if (!_cache) {
+        _cache = BufferRaw::create();
+        _cache->setCapacity(MAX(bytes, _cache_size));
+        _cache->setSize(0);
+    }
+    //libmov传入的是裸指针，需要拷贝
+    memcpy(_cache->data() + _cache->size(), data, bytes);
+    _cache->setSize(_cache->size() + bytes);
+    _offset += bytes;
+    return 0;
+}
+
+int MP4FileAsyncDisk::onSeek(uint64_t offset) {
+    if (!_writer) {
+        return -1;
+    }
+    flushCache();
+    _writer->seek(offset);
+    _offset = offset;
+    return 0;
+}
+
+uint64_t MP4FileAsyncDisk::onTell() {
+    return _offset;
+}
+
+int MP4FileAsyncDisk::onRead(void *data, size_t bytes) {
+    //只有fastStart时关闭文件前会回读，此时在后台线程中，可以阻塞等待
+    if (!_writer) {
+        return -1;
+    }
+    flushCache();
+    int ret = -1;
+    auto offset = _offset;
+    _writer->sync([&](FILE *fp) {
+        if (!fp || fseek64(fp, offset, SEEK_SET) != 0) {
+            return;
+        }
+        if (bytes == fread(data, 1, bytes, fp)) {
+            ret = 0;
+        }
+        //读写切换前需要seek
+        fseek64(fp, offset + bytes, SEEK_SET);
+    });
+    if (ret == 0) {
+        _offset += bytes;
+    }
+    return ret;
+}
+
 /////////////////////////////////////////////////////MP4FileMemory/////////////////////////////////////////////////////////
 
 string MP4FileMemory::getAndClearMemory(){
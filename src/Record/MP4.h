@@ -23,6 +23,8 @@
 #include "mpeg4-aac.h"
 #include "mov-buffer.h"
 #include "mov-format.h"
+#include "Network/Buffer.h"
+#include "DiskWriter.h"
 
 namespace mediakit {
 
@@ -105,9 +107,59 @@ protected:
     int onWrite(const void *data, size_t bytes) override;
 
 private:
+    //只读打开时通过文件内容缓存读取，为空时不使用缓存
+    std::string _cache_key;
+    uint64_t _file_size = 0;
+    uint64_t _offset = 0;
+    //当前读取的chunk，libmov每次只读几个字节到几KB，同一chunk只查找或读取一次
+    uint64_t _chunk_index = 0;
+    toolkit::Buffer::Ptr _chunk;
     std::shared_ptr<FILE> _file;
 };
 
+//异步写磁盘MP4文件类，文件io在磁盘写线程中执行
+class MP4FileAsyncDisk : public MP4FileIO {
+public:
+    using Ptr = std::shared_ptr<MP4FileAsyncDisk>;
+    MP4FileAsyncDisk() = default;
+    ~MP4FileAsyncDisk() override;
+
+    /**
+     * 打开磁盘文件，文件在写线程中创建
+     * @param file 文件路径
+     * @param mode fopen的方式
+     * @param tag 磁盘写入器的统计标识
+     */
+    void openFile(const char *file, const char *mode, const std::string &tag = "mp4");
+
+    /**
+     * 关闭磁盘文件，会阻塞等待数据全部写入磁盘，不可在poller线程中调用
+     */
+    void closeFile();
+
+    /**
+     * 磁盘写入是否跟不上，此时应该丢帧
+     */
+    bool isBusy() const;
+
+protected:
+    uint64_t onTell() override;
+    int onSeek(uint64_t offset) override;
+    int onRead(void *data, size_t bytes) override;
+    int onWrite(const void *data, size_t bytes) override;
+
+private:
+    void flushCache();
+
+private:
+    // 逻辑读写位置，写操作都在写线程中异步执行
+    uint64_t _offset = 0;
+    size_t _cache_size = 0;
+    // 合并libmov的小块写入
+    toolkit::BufferRaw::Ptr _cache;
+    DiskWriter::Ptr _writer;
+};
+
 class MP4FileMemory : public MP4FileIO{
 public:
     using Ptr = std::shared_ptr<MP4FileMemory>;
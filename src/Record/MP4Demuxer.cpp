@@ -33,9 +33,14 @@ void MP4Demuxer::openMP4(const std::string &file) {
     _mov_reader = _mp4_file->createReader();
     getAllTracks();
     _duration_ms = mov_reader_getduration(_mov_reader.get());
+    //关键帧索引在首次seek时才解析，不增加打开文件的耗时
+    _file_path = file;
+    _index_loaded = false;
 }
 
 void MP4Demuxer::closeMP4() {
+    _index.reset();
+    _index_loaded = false;
     _mov_reader.reset();
     _mp4_file.reset();
 }
@@ -153,7 +158,21 @@ void MP4Demuxer::onAudioTrack(uint32_t track_id, uint8_t object, int channel_cou
     }
 }
 
+const MP4Index::Ptr &MP4Demuxer::getIndex() const {
+    if (!_index_loaded) {
+        _index_loaded = true;
+        _index = MP4Index::get(_file_path);
+    }
+    return _index;
+}
+
 int64_t MP4Demuxer::seekTo(int64_t stamp_ms) {
+    auto &index = getIndex();
+    auto key_stamp = index ? index->seekKeyFrame(stamp_ms) : -1;
+    if (key_stamp >= 0) {
+        //二分查找关键帧，libmov按精确时间戳定位，之后读取的第一帧视频即为该关键帧
+        stamp_ms = key_stamp;
+    }
     if(0 != mov_reader_seek(_mov_reader.get(),&stamp_ms)){
         return -1;
     }
@@ -200,7 +219,7 @@ Frame::Ptr MP4Demuxer::readFrame(bool &keyFrame, bool &eof) {
 
         case 1 : {
             keyFrame = ctx.flags & MOV_AV_FLAG_KEYFREAME;
-            return makeFrame(ctx.track_id, ctx.buffer, ctx.pts, ctx.dts);
+            return makeFrame(ctx.track_id, ctx.buffer, ctx.pts + _stamp_offset, ctx.dts + _stamp_offset);
         }
 
         default : {
@@ -274,6 +293,13 @@ std::vector<Track::Ptr> MP4Demuxer::getTracks(bool trackReady) const {
 }
 
 uint64_t MP4Demuxer::getDurationMS() const {
+    if (!_duration_ms && _mov_reader) {
+        //fmp4录像moov中的时长在录制开始时写入(为0)，以索引中最后一个分片的结束时间为准
+        auto &index = getIndex();
+        if (index) {
+            _duration_ms = index->getDurationMS();
+        }
+    }
     return _duration_ms;
 }
 
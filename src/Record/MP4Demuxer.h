@@ -12,6 +12,7 @@
 #define ZLMEDIAKIT_MP4DEMUXER_H
 #ifdef ENABLE_MP4
 #include "MP4.h"
+#include "MP4Index.h"
 #include "Extension/Track.h"
 #include "Util/ResourcePool.h"
 namespace mediakit {
@@ -63,21 +64,33 @@ public:
     std::vector<Track::Ptr> getTracks(bool trackReady) const override;
 
     /**
-     * 获取文件长度
+     * 获取文件长度，fmp4文件可能需要加载关键帧索引，与seekTo一样不能跨线程并发调用
      * @return 文件长度，单位毫秒
      */
     uint64_t getDurationMS() const;
 
+    /**
+     * 设置输出帧的时间戳偏移量，跨文件连续点播时使用
+     * @param offset_ms 偏移量，单位毫秒
+     */
+    void setStampOffset(int64_t offset_ms) { _stamp_offset = offset_ms; }
+
 private:
     int getAllTracks();
     void onVideoTrack(uint32_t track_id, uint8_t object, int width, int height, const void *extra, size_t bytes);
     void onAudioTrack(uint32_t track_id, uint8_t object, int channel_count, int bit_per_sample, int sample_rate, const void *extra, size_t bytes);
     Frame::Ptr makeFrame(uint32_t track_id, const toolkit::Buffer::Ptr &buf, int64_t pts, int64_t dts);
+    const MP4Index::Ptr &getIndex() const;
 
 private:
     MP4FileDisk::Ptr _mp4_file;
     MP4FileDisk::Reader _mov_reader;
-    uint64_t _duration_ms = 0;
+    std::string _file_path;
+    //同一文件的读取者共享的关键帧索引，首次seek时才加载
+    mutable bool _index_loaded = false;
+    mutable MP4Index::Ptr _index;
+    mutable uint64_t _duration_ms = 0;
+    int64_t _stamp_offset = 0;
     std::map<int, Track::Ptr> _track_to_codec;
     toolkit::ResourcePool<toolkit::BufferRaw> _buffer_pool;
 };
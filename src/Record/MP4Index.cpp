@@ -0,0 +1,497 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <list>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include "MP4Index.h"
+#include "Util/File.h"
+#include "Util/util.h"
+#include "Util/logger.h"
+#include "Util/TimeTicker.h"
+#include "Rtmp/utils.h"
+#include "Common/Metrics.h"
+#include "Common/FileChunkCache.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+//最近使用的索引保持强引用，防止点播播放器轮流打开同一文件时反复解析
+static constexpr size_t kRecentIndexCount = 32;
+//单个样本表box的最大长度，防止异常文件导致申请过多内存
+static constexpr uint64_t kMaxTableSize = 64 * 1024 * 1024;
+
+#define BOX_TYPE(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+namespace {
+
+struct Box {
+    uint32_t type = 0;
+    //box负载(不含box头)的偏移量与长度
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+struct TrackBoxes {
+    uint32_t track_id = 0;
+    uint32_t handler = 0;
+    uint32_t timescale = 0;
+    Box stts;
+    Box stss;
+};
+
+class BoxReader {
+public:
+    BoxReader(FILE *fp) : _fp(fp) {}
+
+    bool readAt(uint64_t offset, void *data, size_t size) {
+        if (fseek64(_fp, offset, SEEK_SET) != 0) {
+            return false;
+        }
+        return size == fread(data, 1, size, _fp);
+    }
+
+    /**
+     * 遍历[start, end)范围内的box，只读取box头
+     * @param cb 返回false时停止遍历
+     */
+    bool forEach(uint64_t start, uint64_t end, const function<bool(const Box &box)> &cb) {
+        while (start + 8 <= end) {
+            uint8_t header[16];
+            if (!readAt(start, header, 8)) {
+                return false;
+            }
+            uint64_t size = load_be32(header);
+            uint64_t header_size = 8;
+            if (size == 1) {
+                //64位长度
+                if (start + 16 > end || !readAt(start + 8, header + 8, 8)) {
+                    return false;
+                }
+                size = ((uint64_t)load_be32(header + 8) << 32) | load_be32(header + 12);
+                header_size = 16;
+            } else if (size == 0) {
+                //box一直到文件末尾
+                size = end - start;
+            }
+            if (size < header_size || start + size > end) {
+                return false;
+            }
+            Box box;
+            box.type = load_be32(header + 4);
+            box.offset = start + header_size;
+            box.size = size - header_size;
+            if (!cb(box)) {
+                return true;
+            }
+            start += size;
+        }
+        return true;
+    }
+
+    bool readBox(const Box &box, string &data) {
+        if (box.size > kMaxTableSize) {
+            return false;
+        }
+        data.resize((size_t)box.size);
+        return readAt(box.offset, (char *)data.data(), data.size());
+    }
+
+    //读取full box中的表项个数(跳过version与flags)
+    static bool getEntryCount(const string &data, size_t entry_size, uint32_t &count) {
+        if (data.size() < 8) {
+            return false;
+        }
+        count = load_be32(data.data() + 4);
+        return (uint64_t)count * entry_size <= data.size() - 8;
+    }
+
+private:
+    FILE *_fp;
+};
+
+} // namespace
+
+//毫秒，向上取整，保证libmov换算回track时间刻度后不会落到前一个关键帧
+static uint32_t toStampMS(uint64_t time, uint32_t timescale) {
+    return (uint32_t)((time * 1000 + timescale - 1) / timescale);
+}
+
+static bool parseTrack(BoxReader &reader, const Box &trak, TrackBoxes &track) {
+    return reader.forEach(trak.offset, trak.offset + trak.size, [&](const Box &child) {
+        if (child.type == BOX_TYPE('t', 'k', 'h', 'd')) {
+            //version(1) flags(3) creation_time modification_time track_ID(4)，version 1时时间为64位
+            uint8_t buf[24];
+            if (child.size >= sizeof(buf) && reader.readAt(child.offset, buf, sizeof(buf))) {
+                track.track_id = load_be32(buf + (buf[0] == 1 ? 20 : 12));
+            }
+            return true;
+        }
+        if (child.type != BOX_TYPE('m', 'd', 'i', 'a')) {
+            return true;
+        }
+        reader.forEach(child.offset, child.offset + child.size, [&](const Box &box) {
+            switch (box.type) {
+                case BOX_TYPE('m', 'd', 'h', 'd'): {
+                    //version(1) flags(3) creation_time modification_time timescale(4)，version 1时时间为64位
+                    uint8_t buf[24];
+                    if (box.size >= sizeof(buf) && reader.readAt(box.offset, buf, sizeof(buf))) {
+                        track.timescale = load_be32(buf + (buf[0] == 1 ? 20 : 12));
+                    }
+                    break;
+                }
+                case BOX_TYPE('h', 'd', 'l', 'r'): {
+                    //version(1) flags(3) pre_defined(4) handler_type(4)
+                    uint8_t buf[12];
+                    if (box.size >= sizeof(buf) && reader.readAt(box.offset, buf, sizeof(buf))) {
+                        track.handler = load_be32(buf + 8);
+                    }
+                    break;
+                }
+                case BOX_TYPE('m', 'i', 'n', 'f'): {
+                    reader.forEach(box.offset, box.offset + box.size, [&](const Box &stbl) {
+                        if (stbl.type != BOX_TYPE('s', 't', 'b', 'l')) {
+                            return true;
+                        }
+                        reader.forEach(stbl.offset, stbl.offset + stbl.size, [&](const Box &table) {
+                            if (table.type == BOX_TYPE('s', 't', 't', 's')) {
+                                track.stts = table;
+                            } else if (table.type == BOX_TYPE('s', 't', 's', 's')) {
+                                track.stss = table;
+                            }
+                            return true;
+                        });
+                        return false;
+                    });
+                    break;
+                }
+                default: break;
+            }
+            return true;
+        });
+        return false;
+    });
+}
+
+//根据stts计算stss中关键帧的时间戳
+static bool getKeyFrames(BoxReader &reader, const TrackBoxes &track, vector<uint32_t> &key_frames) {
+    string stss, stts;
+    uint32_t key_count, stts_count;
+    if (!reader.readBox(track.stss, stss) || !BoxReader::getEntryCount(stss, 4, key_count)) {
+        return false;
+    }
+    if (!reader.readBox(track.stts, stts) || !BoxReader::getEntryCount(stts, 8, stts_count)) {
+        return false;
+    }
+    vector<uint32_t> samples(key_count);
+    for (uint32_t i = 0; i < key_count; ++i) {
+        //sample序号从1开始
+        samples[i] = load_be32(stss.data() + 8 + 4 * i);
+    }
+    sort(samples.begin(), samples.end());
+
+    key_frames.clear();
+    key_frames.reserve(key_count);
+    size_t key_index = 0;
+    uint64_t sample = 1;
+    uint64_t dts = 0;
+    for (uint32_t i = 0; i < stts_count && key_index < samples.size(); ++i) {
+        auto ptr = stts.data() + 8 + 8 * i;
+        uint64_t count = load_be32(ptr);
+        uint64_t delta = load_be32(ptr + 4);
+        for (; key_index < samples.size() && samples[key_index] < sample + count; ++key_index) {
+            if (samples[key_index] < sample) {
+                continue;
+            }
+            auto key_dts = dts + (samples[key_index] - sample) * delta;
+            key_frames.emplace_back(toStampMS(key_dts, track.timescale));
+        }
+        sample += count;
+        dts += count * delta;
+    }
+    return true;
+}
+
+//计算moof分片中该track的结束时间(tfdt + 所有样本时长)，单位为track时间刻度
+static uint64_t getFragmentEnd(BoxReader &reader, uint64_t file_size, uint64_t moof_offset, uint32_t track_id) {
+    uint64_t end = 0;
+    reader.forEach(moof_offset, file_size, [&](const Box &moof) {
+        if (moof.type != BOX_TYPE('m', 'o', 'o', 'f')) {
+            return false;
+        }
+        reader.forEach(moof.offset, moof.offset + moof.size, [&](const Box &traf) {
+            if (traf.type != BOX_TYPE('t', 'r', 'a', 'f')) {
+                return true;
+            }
+            bool match = false;
+            uint64_t base_time = 0;
+            uint64_t duration = 0;
+            uint32_t default_duration = 0;
+            reader.forEach(traf.offset, traf.offset + traf.size, [&](const Box &box) {
+                string data;
+                if (box.type == BOX_TYPE('t', 'f', 'h', 'd')) {
+                    //version(1) flags(3) track_ID(4) [base_data_offset(8)] [sample_description_index(4)] [default_sample_duration(4)]
+                    if (!reader.readBox(box, data) || data.size() < 8) {
+                        return false;
+                    }
+                    match = load_be32(data.data() + 4) == track_id;
+                    auto flags = load_be32(data.data()) & 0xFFFFFF;
+                    size_t pos = 8 + (flags & 0x01 ? 8 : 0) + (flags & 0x02 ? 4 : 0);
+                    if ((flags & 0x08) && pos + 4 <= data.size()) {
+                        default_duration = load_be32(data.data() + pos);
+                    }
+                    return match;
+                }
+                if (box.type == BOX_TYPE('t', 'f', 'd', 't')) {
+                    if (!reader.readBox(box, data) || data.size() < 8) {
+                        return true;
+                    }
+                    if (data[0] == 1 && data.size() >= 12) {
+                        base_time = ((uint64_t)load_be32(data.data() + 4) << 32) | load_be32(data.data() + 8);
+                    } else {
+                        base_time = load_be32(data.data() + 4);
+                    }
+                    return true;
+                }
+                if (box.type == BOX_TYPE('t', 'r', 'u', 'n')) {
+                    //version(1) flags(3) sample_count(4) [data_offset(4)] [first_sample_flags(4)] samples...
+                    if (!reader.readBox(box, data) || data.size() < 8) {
+                        return true;
+                    }
+                    auto flags = load_be32(data.data()) & 0xFFFFFF;
+                    auto count = load_be32(data.data() + 4);
+                    if (!(flags & 0x100)) {
+                        duration += (uint64_t)count * default_duration;
+                        return true;
+                    }
+                    size_t pos = 8 + (flags & 0x01 ? 4 : 0) + (flags & 0x04 ? 4 : 0);
+                    size_t sample_size = 4 + (flags & 0x200 ? 4 : 0) + (flags & 0x400 ? 4 : 0) + (flags & 0x800 ? 4 : 0);
+                    for (uint32_t i = 0; i < count && pos + 4 <= data.size(); ++i, pos += sample_size) {
+                        duration += load_be32(data.data() + pos);
+                    }
+                }
+                return true;
+            });
+            if (match) {
+                end = base_time + duration;
+                return false;
+            }
+            return true;
+        });
+        return false;
+    });
+    return end;
+}
+
+//fmp4文件通过尾部的mfra/tfra获取随机访问点(每个分片的起始时间)
+static bool getFragmentKeyFrames(BoxReader &reader, uint64_t file_size, const TrackBoxes &track, vector<uint32_t> &key_frames, uint64_t &duration_ms) {
+    //mfro固定位于文件最后16字节: size(4) type(4) version/flags(4) mfra_size(4)
+    uint8_t mfro[16];
+    if (file_size < sizeof(mfro) || !reader.readAt(file_size - sizeof(mfro), mfro, sizeof(mfro)) || load_be32(mfro + 4) != BOX_TYPE('m', 'f', 'r', 'o')) {
+        //录制未正常结束，没有写入mfra
+        return false;
+    }
+    uint64_t mfra_size = load_be32(mfro + 12);
+    if (mfra_size < sizeof(mfro) || mfra_size > file_size) {
+        return false;
+    }
+    bool found = false;
+    uint64_t last_moof = 0;
+    reader.forEach(file_size - mfra_size, file_size, [&](const Box &mfra) {
+        if (mfra.type != BOX_TYPE('m', 'f', 'r', 'a')) {
+            return false;
+        }
+        reader.forEach(mfra.offset, mfra.offset + mfra.size, [&](const Box &box) {
+            string tfra;
+            if (box.type != BOX_TYPE('t', 'f', 'r', 'a') || !reader.readBox(box, tfra) || tfra.size() < 16) {
+                return true;
+            }
+            if (load_be32(tfra.data() + 4) != track.track_id) {
+                return true;
+            }
+            //version(1) flags(3) track_ID(4) reserved(26bit)+traf/trun/sample序号长度(各2bit) number_of_entry(4)
+            bool version1 = tfra[0] == 1;
+            auto lengths = load_be32(tfra.data() + 8);
+            size_t entry_size = (version1 ? 16 : 8) + ((lengths >> 4) & 0x03) + ((lengths >> 2) & 0x03) + (lengths & 0x03) + 3;
+            uint32_t count;
+            if (!BoxReader::getEntryCount(tfra.substr(8), entry_size, count)) {
+                return false;
+            }
+            key_frames.reserve(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                auto ptr = tfra.data() + 16 + entry_size * i;
+                uint64_t time, moof_offset;
+                if (version1) {
+                    time = ((uint64_t)load_be32(ptr) << 32) | load_be32(ptr + 4);
+                    moof_offset = ((uint64_t)load_be32(ptr + 8) << 32) | load_be32(ptr + 12);
+                } else {
+                    time = load_be32(ptr);
+                    moof_offset = load_be32(ptr + 4);
+                }
+                key_frames.emplace_back(toStampMS(time, track.timescale));
+                last_moof = MAX(last_moof, moof_offset);
+            }
+            found = true;
+            return false;
+        });
+        return false;
+    });
+    if (!found) {
+        return false;
+    }
+    sort(key_frames.begin(), key_frames.end());
+    key_frames.erase(unique(key_frames.begin(), key_frames.end()), key_frames.end());
+    //moov中的时长在录制开始时写入，以最后一个分片的结束时间为准
+    auto end = getFragmentEnd(reader, file_size, last_moof, track.track_id);
+    duration_ms = MAX(duration_ms, end * 1000 / track.timescale);
+    return true;
+}
+
+shared_ptr<MP4Index> MP4Index::parse(const string &file) {
+    auto fp = fopen(file.data(), "rb");
+    if (!fp) {
+        return nullptr;
+    }
+    shared_ptr<FILE> file_ptr(fp, fclose);
+    auto ret = make_shared<MP4Index>();
+    auto file_size = File::fileSize(fp);
+    BoxReader reader(fp);
+    bool fragmented = false;
+    vector<TrackBoxes> tracks;
+    reader.forEach(0, file_size, [&](const Box &moov) {
+        if (moov.type != BOX_TYPE('m', 'o', 'o', 'v')) {
+            //跳过ftyp、mdat等box
+            return true;
+        }
+        reader.forEach(moov.offset, moov.offset + moov.size, [&](const Box &box) {
+            switch (box.type) {
+                case BOX_TYPE('m', 'v', 'h', 'd'): {
+                    //version(1) flags(3) creation_time modification_time timescale(4) duration，version 1时时间为64位
+                    uint8_t buf[32];
+                    if (box.size >= sizeof(buf) && reader.readAt(box.offset, buf, sizeof(buf))) {
+                        uint32_t timescale;
+                        uint64_t duration;
+                        if (buf[0] == 1) {
+                            timescale = load_be32(buf + 20);
+                            duration = ((uint64_t)load_be32(buf + 24) << 32) | load_be32(buf + 28);
+                        } else {
+                            timescale = load_be32(buf + 12);
+                            duration = load_be32(buf + 16);
+                        }
+                        ret->_duration_ms = timescale ? duration * 1000 / timescale : 0;
+                    }
+                    break;
+                }
+                case BOX_TYPE('m', 'v', 'e', 'x'): fragmented = true; break;
+                case BOX_TYPE('t', 'r', 'a', 'k'): {
+                    TrackBoxes track;
+                    parseTrack(reader, box, track);
+                    if (track.timescale) {
+                        tracks.emplace_back(track);
+                    }
+                    break;
+                }
+                default: break;
+            }
+            return true;
+        });
+        return false;
+    });
+
+    //以第一个视频track为准，纯音频fmp4以第一个track为准
+    auto it = find_if(tracks.begin(), tracks.end(), [](const TrackBoxes &track) { return track.handler == BOX_TYPE('v', 'i', 'd', 'e'); });
+    if (it == tracks.end() && fragmented && !tracks.empty()) {
+        it = tracks.begin();
+    }
+    if (it == tracks.end()) {
+        return ret;
+    }
+    if (fragmented) {
+        if (!getFragmentKeyFrames(reader, file_size, *it, ret->_key_frames, ret->_duration_ms)) {
+            ret->_key_frames.clear();
+        }
+    } else if (it->stts.size && it->stss.size) {
+        if (!getKeyFrames(reader, *it, ret->_key_frames)) {
+            ret->_key_frames.clear();
+        }
+    }
+    return ret;
+}
+
+MP4Index::Ptr MP4Index::get(const string &file) {
+    static auto &s_hits = Metrics::Instance().getCounter("zlm_mp4_index_cache_hits_total", "", "Mp4 key frame index cache hits");
+    static auto &s_misses = Metrics::Instance().getCounter("zlm_mp4_index_cache_misses_total", "", "Mp4 key frame index cache misses");
+    static mutex s_mtx;
+    static unordered_map<string, weak_ptr<const MP4Index> > s_index_map;
+    static list<Ptr> s_recent;
+
+    uint64_t file_size = 0;
+    //文件被改写后key随之改变
+    auto key = FileChunkCache::makeFileKey(file, file_size);
+    if (key.empty()) {
+        return nullptr;
+    }
+    {
+        lock_guard<mutex> lck(s_mtx);
+        auto it = s_index_map.find(key);
+        if (it != s_index_map.end()) {
+            if (auto ret = it->second.lock()) {
+                s_hits.add();
+                s_recent.remove(ret);
+                s_recent.emplace_front(ret);
+                return ret;
+            }
+        }
+    }
+
+    s_misses.add();
+    Ticker ticker;
+    Ptr ret = parse(file);
+    if (!ret) {
+        return nullptr;
+    }
+    DebugL << "parse mp4 index: " << file << ", key frames: " << ret->getKeyFrameCount() << ", cost: " << ticker.elapsedTime() << "ms";
+
+    lock_guard<mutex> lck(s_mtx);
+    //并发打开同一文件时可能重复解析，以最后一次为准
+    s_index_map[key] = ret;
+    s_recent.emplace_front(ret);
+    if (s_recent.size() > kRecentIndexCount) {
+        s_recent.pop_back();
+    }
+    if (s_index_map.size() > 2 * kRecentIndexCount) {
+        //清理已经没有读取者的索引
+        for (auto it = s_index_map.begin(); it != s_index_map.end();) {
+            if (it->second.expired()) {
+                it = s_index_map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return ret;
+}
+
+int64_t MP4Index::seekKeyFrame(int64_t stamp_ms) const {
+    if (_key_frames.empty()) {
+        return -1;
+    }
+    auto it = upper_bound(_key_frames.begin(), _key_frames.end(), (uint64_t)MAX(stamp_ms, (int64_t)0));
+    if (it == _key_frames.begin()) {
+        return _key_frames.front();
+    }
+    return *(--it);
+}
+
+} // namespace mediakit
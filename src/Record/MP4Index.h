@@ -0,0 +1,65 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_MP4INDEX_H
+#define ZLMEDIAKIT_MP4INDEX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace mediakit {
+
+/**
+ * mp4文件关键帧索引，同一文件(路径+大小+修改时间)的多个读取者共享一份
+ * 只读取moov中的mvhd/tkhd/mdhd/hdlr/stts/stss box，跳过mdat与stsz、stco等体积较大的样本表；
+ * fmp4文件读取尾部mfra中的tfra(每个分片的起始时间)与最后一个moof；
+ * 每个关键帧只占4个字节，数小时的录像索引也只有几十KB；
+ * seek时二分查找关键帧，libmov按关键帧的精确时间戳定位
+ */
+class MP4Index {
+public:
+    using Ptr = std::shared_ptr<const MP4Index>;
+
+    /**
+     * 获取文件的关键帧索引，优先从共享缓存中获取
+     * @param file mp4文件路径
+     * @return 文件不存在时返回nullptr；fmp4或无视频时返回的索引不含关键帧
+     */
+    static Ptr get(const std::string &file);
+
+    /**
+     * 解析mp4文件生成关键帧索引
+     */
+    static std::shared_ptr<MP4Index> parse(const std::string &file);
+
+    /**
+     * 查找不大于stamp_ms的最后一个关键帧
+     * @param stamp_ms 预期的时间轴位置，单位毫秒
+     * @return 关键帧时间戳，单位毫秒；没有关键帧索引时返回-1
+     */
+    int64_t seekKeyFrame(int64_t stamp_ms) const;
+
+    /**
+     * 文件长度，单位毫秒
+     */
+    uint64_t getDurationMS() const { return _duration_ms; }
+
+    size_t getKeyFrameCount() const { return _key_frames.size(); }
+
+private:
+    uint64_t _duration_ms = 0;
+    //视频关键帧时间戳(毫秒，向上取整)，升序
+    std::vector<uint32_t> _key_frames;
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_MP4INDEX_H
@@ -21,30 +21,48 @@ using namespace toolkit;
 
 namespace mediakit {
 
+//纯音频fmp4录制时每个分片的时长，单位毫秒
+static constexpr int64_t kAudioFragmentMS = 2000;
+
 MP4Muxer::~MP4Muxer() {
     closeMP4();
 }
 
-void MP4Muxer::openMP4(const string &file) {
+void MP4Muxer::openMP4(const string &file, const string &tag) {
     closeMP4();
     _file_name = file;
-    _mp4_file = std::make_shared<MP4FileDisk>();
-    _mp4_file->openFile(_file_name.data(), "wb+");
+    _tag = tag;
+    _mp4_file = std::make_shared<MP4FileAsyncDisk>();
+    _mp4_file->openFile(_file_name.data(), "wb+", _tag);
 }
 
 MP4FileIO::Writer MP4Muxer::createWriter() {
+    GET_CONFIG(bool, enable_fmp4, Record::kEnableFmp4);
+    setFragmentByGop(enable_fmp4);
+    if (enable_fmp4) {
+        //非segment模式的fmp4: ftyp+moov在文件头部，关闭时在文件尾部写入mfra随机访问索引
+        return _mp4_file->createWriter(0, true);
+    }
     GET_CONFIG(bool, mp4FastStart, Record::kFastStart);
     return _mp4_file->createWriter(mp4FastStart ? MOV_FLAG_FASTSTART : 0, false);
 }
 
 void MP4Muxer::closeMP4() {
+    //销毁mp4_writer时会写入moov等数据
     MP4MuxerInterface::resetTracks();
-    _mp4_file = nullptr;
+    if (_mp4_file) {
+        _mp4_file->closeFile();
+        _mp4_file = nullptr;
+    }
+}
+
+bool MP4Muxer::isBusy() const {
+    return _mp4_file && _mp4_file->isBusy();
 }
 
 void MP4Muxer::resetTracks() {
     MP4MuxerInterface::resetTracks();
-    openMP4(_file_name);
+    openMP4(_file_name, _tag);
 }
 
 /////////////////////////////////////////// MP4MuxerInterface /////////////////////////////////////////////
@@ -74,6 +92,7 @@ uint64_t MP4MuxerInterface::getDuration() const {
 void MP4MuxerInterface::resetTracks() {
     _started = false;
     _have_video = false;
+    _fragment_stamp = 0;
     _mov_writter = nullptr;
     _frame_merger.clear();
     _codec_to_trackid.clear();
@@ -109,6 +128,10 @@ bool MP4MuxerInterface::inputFrame(const Frame::Ptr &frame) {
             _frame_merger.inputFrame(frame, [this, &track_info](uint64_t dts, uint64_t pts, const Buffer::Ptr &buffer, bool have_idr) {
                 int64_t dts_out, pts_out;
                 track_info.stamp.revise(dts, pts, dts_out, pts_out);
+                if (have_idr && _fragment_by_gop) {
+                    //输出上一个gop，保证每个分片以关键帧开始
+                    saveSegment();
+                }
                 mp4_writer_write(_mov_writter.get(),
                                  track_info.track_id,
                                  buffer->data(),
@@ -123,6 +146,11 @@ bool MP4MuxerInterface::inputFrame(const Frame::Ptr &frame) {
         default: {
             int64_t dts_out, pts_out;
             track_info.stamp.revise(frame->dts(), frame->pts(), dts_out, pts_out);
+            if (_fragment_by_gop && !_have_video && dts_out >= _fragment_stamp + kAudioFragmentMS) {
+                //纯音频，按时长切分分片，防止数据一直缓存在内存中
+                saveSegment();
+                _fragment_stamp = dts_out;
+            }
             mp4_writer_write(_mov_writter.get(),
                              track_info.track_id,
                              frame->data() + frame->prefixSize(),
@@ -76,12 +76,19 @@ protected:
     // 类厂方法，由子类实现
     virtual MP4FileIO::Writer createWriter() = 0;
 
+    /**
+     * 写fmp4文件时由本类切分moof分片：有视频时每个gop一个分片，纯音频时按时长切分
+     */
+    void setFragmentByGop(bool enable) { _fragment_by_gop = enable; }
+
 private:
     void stampSync();
 
 private:
     bool _started = false;
     bool _have_video = false;
+    bool _fragment_by_gop = false;
+    int64_t _fragment_stamp = 0;
     MP4FileIO::Writer _mov_writter;
     struct track_info {
         int track_id = -1;
@@ -93,7 +100,8 @@ private:
 
 /*
  写Mp4到文件
- 正常mp4格式，并可设置faststart
+ 正常mp4格式，并可设置faststart；
+ 或fmp4格式(record.enableFmp4)，关闭文件时只追加mfra索引，不需要回读重写
 */
 class MP4Muxer : public MP4MuxerInterface{
 public:
@@ -110,20 +118,28 @@ public:
     /**
      * 打开mp4
      * @param file 文件完整路径
+     * @param tag 磁盘写入器的统计标识，例如vhost/app/stream
      */
-    void openMP4(const std::string &file);
+    void openMP4(const std::string &file, const std::string &tag = "mp4");
 
     /**
      * 手动关闭文件(对象析构时会自动关闭)
+     * 会阻塞等待文件写入磁盘，应该在后台线程中调用
      */
     void closeMP4();
 
+    /**
+     * 磁盘写入是否跟不上，此时应该丢帧
+     */
+    bool isBusy() const;
+
 protected:
     MP4FileIO::Writer createWriter() override;
 
 private:
     std::string _file_name;
-    MP4FileDisk::Ptr _mp4_file;
+    std::string _tag;
+    MP4FileAsyncDisk::Ptr _mp4_file;
 };
 
 /// 写fmp4到内存
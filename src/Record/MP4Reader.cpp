@@ -10,8 +10,10 @@
 
 #ifdef ENABLE_MP4
 
+#include <algorithm>
 #include "MP4Reader.h"
 #include "Common/config.h"
+#include "Common/AsyncFileReader.h"
 #include "Thread/WorkThreadPool.h"
 #include "Util/File.h"
 using std::string;
@@ -22,6 +24,10 @@ namespace mediakit {
 MP4Reader::MP4Reader(const string &vhost, const string &app, const string &stream_id, const string &file_path) {
     //读写文件建议放在后台线程
     _poller = WorkThreadPool::Instance().getPoller();
+    if (AsyncFileReader::enabled()) {
+        //后台线程由多个点播共用，文件io再放到读文件线程中，防止冷数据阻塞其他点播
+        _io_poller = AsyncFileReader::Instance().getPoller();
+    }
     _file_path = file_path;
     if (_file_path.empty()) {
         GET_CONFIG(string, recordPath, Protocol::kMP4SavePath);
@@ -36,7 +42,35 @@ MP4Reader::MP4Reader(const string &vhost, const string &app, const string &strea
 
     _demuxer = std::make_shared<MP4Demuxer>();
     _demuxer->openMP4(_file_path);
+    //fmp4的时长需要加载关键帧索引，此时尚未开始异步读取，在构造时获取一次，之后不再跨线程访问_demuxer
+    _duration_ms = _demuxer->getDurationMS();
+    setupMuxer(vhost, app, stream_id);
+}
+
+MP4Reader::MP4Reader(const string &vhost, const string &app, const string &stream_id, std::vector<RecordIndex::Segment> segments, uint32_t start_stamp) {
+    _poller = WorkThreadPool::Instance().getPoller();
+    if (AsyncFileReader::enabled()) {
+        _io_poller = AsyncFileReader::Instance().getPoller();
+    }
+    if (segments.empty()) {
+        throw std::invalid_argument("no record segment to play");
+    }
+    _segments = std::move(segments);
+    uint64_t stamp = 0;
+    for (auto &segment : _segments) {
+        //跳过录制中断的时间段，切片首尾相接
+        _segment_stamps.emplace_back(stamp);
+        stamp += segment.duration_ms;
+    }
+    _duration_ms = stamp;
+    _start_stamp = start_stamp;
+    _file_path = _segments.front().path;
+    _demuxer = std::make_shared<MP4Demuxer>();
+    _demuxer->openMP4(_file_path);
+    setupMuxer(vhost, app, stream_id);
+}
 
+void MP4Reader::setupMuxer(const string &vhost, const string &app, const string &stream_id) {
     if (stream_id.empty()) {
         return;
     }
@@ -44,7 +78,7 @@ MP4Reader::MP4Reader(const string &vhost, const string &app, const string &strea
     //读取mp4文件并流化时，不重复生成mp4/hls文件
     option.enable_mp4 = false;
     option.enable_hls = false;
-    _muxer = std::make_shared<MultiMediaSourceMuxer>(vhost, app, stream_id, _demuxer->getDurationMS() / 1000.0f, option);
+    _muxer = std::make_shared<MultiMediaSourceMuxer>(vhost, app, stream_id, getDurationMS() / 1000.0f, option);
     auto tracks = _demuxer->getTracks(false);
     if (tracks.empty()) {
         throw std::runtime_error("Mp4File has no track:" + _file_path);
@@ -66,33 +100,86 @@ bool MP4Reader::readSample() {
         return true;
     }
 
+    if (_io_poller) {
+        readSampleAsync();
+        return true;
+    }
+
+    auto eof = readFrames(getCurrentStamp(), _last_dts, [this](const Frame::Ptr &frame) {
+        if (_muxer) {
+            _muxer->inputFrame(frame);
+        }
+    });
+    return !eof || onEof();
+}
+
+bool MP4Reader::readFrames(uint32_t stamp, uint32_t &last_dts, const std::function<void(const Frame::Ptr &frame)> &cb) {
     bool keyFrame = false;
     bool eof = false;
-    while (!eof && _last_dts < getCurrentStamp()) {
-        auto frame = _demuxer->readFrame(keyFrame, eof);
+    while (!eof && last_dts < stamp) {
+        auto frame = readFrame(keyFrame, eof);
         if (!frame) {
             continue;
         }
-        _last_dts = frame->dts();
-        if (_muxer) {
-            _muxer->inputFrame(frame);
-        }
+        last_dts = frame->dts();
+        cb(frame);
     }
+    return eof;
+}
 
+bool MP4Reader::onEof() {
     GET_CONFIG(bool, file_repeat, Record::kFileRepeat);
-    if (eof && (file_repeat || _file_repeat)) {
+    if (file_repeat || _file_repeat) {
         //需要从头开始看
         seekTo(0);
         return true;
     }
+    return false;
+}
 
-    return !eof;
+void MP4Reader::readSampleAsync() {
+    if (_reading || _seeking) {
+        //上次读取或seek还未完成(磁盘较慢)，下次定时器触发时一并读取
+        return;
+    }
+    _reading = true;
+    auto stamp = getCurrentStamp();
+    auto last_dts = _last_dts;
+    uint32_t version = _seek_version;
+    std::weak_ptr<MP4Reader> weak_self = shared_from_this();
+    _io_poller->async([weak_self, stamp, last_dts, version]() mutable {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return;
+        }
+        //不加锁，磁盘io期间不阻塞本对象线程
+        auto frames = std::make_shared<std::vector<Frame::Ptr> >();
+        auto eof = strong_self->readFrames(stamp, last_dts, [&](const Frame::Ptr &frame) { frames->emplace_back(frame); });
+        strong_self->_poller->async([strong_self, frames, eof, last_dts, version]() {
+            std::lock_guard<std::recursive_mutex> lck(strong_self->_mtx);
+            strong_self->_reading = false;
+            if (version != strong_self->_seek_version) {
+                //读取期间发生了seek，丢弃旧位置的数据
+                return;
+            }
+            strong_self->_last_dts = last_dts;
+            if (strong_self->_muxer) {
+                for (auto &frame : *frames) {
+                    strong_self->_muxer->inputFrame(frame);
+                }
+            }
+            if (eof && !strong_self->onEof()) {
+                //读取完毕，停止定时器
+                strong_self->_timer = nullptr;
+            }
+        }, false);
+    }, false);
 }
 
 bool MP4Reader::readNextSample() {
     bool keyFrame = false;
     bool eof = false;
-    auto frame = _demuxer->readFrame(keyFrame, eof);
+    auto frame = readFrame(keyFrame, eof);
     if (!frame) {
         return false;
     }
@@ -116,6 +203,10 @@ void MP4Reader::startReadMP4(uint64_t sample_ms, bool ref_self, bool file_repeat
         //注册后再切换OwnerPoller
         _muxer->setMediaListener(strong_self);
     }
+    if (_start_stamp) {
+        //跨文件点播从指定时间点开始
+        seekTo(_start_stamp);
+    }
 
     auto timer_sec = (sample_ms ? sample_ms : sampleMS) / 1000.0f;
 
@@ -145,6 +236,39 @@ const MP4Demuxer::Ptr &MP4Reader::getDemuxer() const {
     return _demuxer;
 }
 
+uint64_t MP4Reader::getDurationMS() const {
+    return _duration_ms;
+}
+
+Frame::Ptr MP4Reader::readFrame(bool &key_frame, bool &eof) {
+    auto frame = _demuxer->readFrame(key_frame, eof);
+    while (eof && _segment_index + 1 < _segments.size()) {
+        auto index = _segment_index + 1;
+        if (!openSegment(index)) {
+            //跳过无法打开的切片
+            _segment_index = index;
+            continue;
+        }
+        frame = _demuxer->readFrame(key_frame, eof);
+    }
+    return frame;
+}
+
+bool MP4Reader::openSegment(size_t index) {
+    try {
+        auto demuxer = std::make_shared<MP4Demuxer>();
+        demuxer->openMP4(_segments[index].path);
+        //切片内的时间戳加上切片在时间轴上的开始位置
+        demuxer->setStampOffset(_segment_stamps[index]);
+        _demuxer = std::move(demuxer);
+        _segment_index = index;
+        return true;
+    } catch (std::exception &ex) {
+        WarnL << "open record segment failed: " << _segments[index].path << ", " << ex.what();
+        return false;
+    }
+}
+
 uint32_t MP4Reader::getCurrentStamp() {
     return (uint32_t) (_seek_to + !_paused * _speed * _seek_ticker.elapsedTime());
 }
@@ -167,6 +291,21 @@ bool MP4Reader::seekTo(MediaSource &sender, uint32_t stamp) {
     return seekTo(stamp);
 }
 
+void MP4Reader::seekToAsync(MediaSource &sender, uint32_t stamp, const std::function<void(bool)> &cb) {
+    if (!_io_poller) {
+        cb(seekTo(sender, stamp));
+        return;
+    }
+    pause(sender, false);
+    TraceL << getOriginUrl(sender) << ",stamp:" << stamp;
+    std::lock_guard<std::recursive_mutex> lck(_mtx);
+    if (stamp > getDurationMS()) {
+        cb(false);
+        return;
+    }
+    seekDemuxerAsync(stamp, cb);
+}
+
 bool MP4Reader::pause(MediaSource &sender, bool pause) {
     if (_paused == pause) {
         return true;
@@ -195,19 +334,49 @@ bool MP4Reader::speed(MediaSource &sender, float speed) {
 
 bool MP4Reader::seekTo(uint32_t stamp_seek) {
     std::lock_guard<std::recursive_mutex> lck(_mtx);
-    if (stamp_seek > _demuxer->getDurationMS()) {
+    if (stamp_seek > getDurationMS()) {
         //超过文件长度
         return false;
     }
-    auto stamp = _demuxer->seekTo(stamp_seek);
-    if (stamp == -1) {
+    if (_io_poller) {
+        //在读文件线程中seek，这里只能返回是否开始seek，需要seek结果时请使用seekToAsync
+        seekDemuxerAsync(stamp_seek, nullptr);
+        return true;
+    }
+
+    Frame::Ptr key_frame;
+    uint32_t stamp = 0;
+    if (!seekDemuxer(stamp_seek, key_frame, stamp)) {
+        return false;
+    }
+    if (key_frame && _muxer) {
+        _muxer->inputFrame(key_frame);
+    }
+    //设置当前时间戳
+    setCurrentStamp(stamp);
+    return true;
+}
+
+bool MP4Reader::seekDemuxer(uint32_t stamp_seek, Frame::Ptr &key_frame, uint32_t &stamp) {
+    int64_t offset = 0;
+    if (!_segments.empty()) {
+        //二分查找时间轴位置所在的切片
+        auto index = (size_t)(std::upper_bound(_segment_stamps.begin(), _segment_stamps.end(), (uint64_t)stamp_seek) - _segment_stamps.begin());
+        index = index ? index - 1 : 0;
+        if (index != _segment_index && !openSegment(index)) {
+            return false;
+        }
+        offset = _segment_stamps[index];
+    }
+    auto ret = _demuxer->seekTo(stamp_seek - offset);
+    if (ret == -1) {
         //seek失败
         return false;
     }
 
     if (!_have_video) {
-        //没有视频，不需要搜索关键帧；设置当前时间戳
-        setCurrentStamp((uint32_t) stamp);
+        //没有视频，不需要搜索关键帧
+        stamp = (uint32_t) (ret + offset);
         return true;
     }
 
@@ -215,24 +384,64 @@ bool MP4Reader::seekTo(uint32_t stamp_seek) {
     bool keyFrame = false;
     bool eof = false;
     while (!eof) {
-        auto frame = _demuxer->readFrame(keyFrame, eof);
+        auto frame = readFrame(keyFrame, eof);
         if (!frame) {
             //文件读完了都未找到下一帧关键帧
             continue;
         }
         if (keyFrame || frame->keyFrame() || frame->configFrame()) {
             //定位到key帧
-            if (_muxer) {
-                _muxer->inputFrame(frame);
-            }
-            //设置当前时间戳
-            setCurrentStamp(frame->dts());
+            key_frame = std::move(frame);
+            stamp = key_frame->dts();
             return true;
         }
     }
     return false;
 }
 
+void MP4Reader::seekDemuxerAsync(uint32_t stamp_seek, const std::function<void(bool)> &cb) {
+    //seek完成前暂停读取，读取中的数据作废
+    _seeking = true;
+    uint32_t version = ++_seek_version;
+    std::weak_ptr<MP4Reader> weak_self = shared_from_this();
+    _io_poller->async([weak_self, stamp_seek, version, cb]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return;
+        }
+        Frame::Ptr key_frame;
+        uint32_t stamp = 0;
+        bool success = false;
+        //连续拖动，只执行最后一次seek
+        auto expired = version != strong_self->_seek_version;
+        if (!expired) {
+            success = strong_self->seekDemuxer(stamp_seek, key_frame, stamp);
+        }
+        strong_self->_poller->async([strong_self, key_frame, stamp, success, version, cb]() {
+            std::lock_guard<std::recursive_mutex> lck(strong_self->_mtx);
+            if (version != strong_self->_seek_version) {
+                //已被后续的seek取代
+                if (cb) {
+                    cb(false);
+                }
+                return;
+            }
+            strong_self->_seeking = false;
+            if (cb) {
+                cb(success);
+            }
+            if (!success) {
+                WarnL << "seek failed: " << strong_self->_file_path;
+                return;
+            }
+            if (key_frame && strong_self->_muxer) {
+                strong_self->_muxer->inputFrame(key_frame);
+            }
+            strong_self->setCurrentStamp(stamp);
+        }, false);
+    }, false);
+}
+
 bool MP4Reader::close(MediaSource &sender) {
     _timer = nullptr;
     WarnL << "close media: " << sender.getUrl();
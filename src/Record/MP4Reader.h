@@ -12,7 +12,9 @@
 #define SRC_MEDIAFILE_MEDIAREADER_H_
 #ifdef ENABLE_MP4
 
+#include <atomic>
 #include "MP4Demuxer.h"
+#include "RecordIndex.h"
 #include "Common/MultiMediaSourceMuxer.h"
 
 namespace mediakit {
@@ -32,6 +34,16 @@ public:
      * @param file_path 文件路径，如果为空则根据配置文件和上面参数自动生成，否则使用指定的文件
      */
     MP4Reader(const std::string &vhost, const std::string &app, const std::string &stream_id, const std::string &file_path = "");
+
+    /**
+     * 按录制时间索引连续点播多个mp4切片，切片之间时间轴连续(跳过录制中断的时间段)
+     * @param vhost 虚拟主机
+     * @param app 应用名
+     * @param stream_id 流id
+     * @param segments 按时间排序的mp4录像切片
+     * @param start_stamp 开始播放的时间轴位置(相对第一个切片的开始)，单位毫秒
+     */
+    MP4Reader(const std::string &vhost, const std::string &app, const std::string &stream_id, std::vector<RecordIndex::Segment> segments, uint32_t start_stamp = 0);
     ~MP4Reader() override = default;
 
     /**
@@ -55,6 +67,7 @@ public:
 private:
     //MediaSourceEvent override
     bool seekTo(MediaSource &sender,uint32_t stamp) override;
+    void seekToAsync(MediaSource &sender, uint32_t stamp, const std::function<void(bool)> &cb) override;
     bool pause(MediaSource &sender, bool pause) override;
     bool speed(MediaSource &sender, float speed) override;
 
@@ -68,21 +81,50 @@ private:
     uint32_t getCurrentStamp();
     void setCurrentStamp(uint32_t stamp);
     bool seekTo(uint32_t stamp_seek);
+    //在读文件线程中解复用，完成后切回本对象线程输出
+    void readSampleAsync();
+    void seekDemuxerAsync(uint32_t stamp_seek, const std::function<void(bool)> &cb);
+    //解复用至指定时间戳，返回是否读到文件末尾
+    bool readFrames(uint32_t stamp, uint32_t &last_dts, const std::function<void(const Frame::Ptr &frame)> &cb);
+    //seek并搜索下一个关键帧
+    bool seekDemuxer(uint32_t stamp_seek, Frame::Ptr &key_frame, uint32_t &stamp);
+    //读到文件末尾时，返回是否继续读取
+    bool onEof();
+    void setupMuxer(const std::string &vhost, const std::string &app, const std::string &stream_id);
+    uint64_t getDurationMS() const;
+    //读取一帧，跨文件点播时当前切片读完后自动切换到下一个切片
+    Frame::Ptr readFrame(bool &key_frame, bool &eof);
+    bool openSegment(size_t index);
 
 private:
     bool _file_repeat = false;
     bool _have_video = false;
     bool _paused = false;
+    //异步读取中，以下变量只在本对象线程访问
+    bool _reading = false;
+    bool _seeking = false;
+    //读文件线程通过该版本号丢弃过期的seek
+    std::atomic<uint32_t> _seek_version { 0 };
     float _speed = 1.0;
     uint32_t _last_dts = 0;
     uint32_t _seek_to = 0;
+    //开始播放时seek的位置
+    uint32_t _start_stamp = 0;
+    //点播总时长，构造时确定，单位毫秒
+    uint64_t _duration_ms = 0;
     std::string _file_path;
+    //跨文件点播的切片，以及每个切片在时间轴上的开始位置
+    size_t _segment_index = 0;
+    std::vector<RecordIndex::Segment> _segments;
+    std::vector<uint64_t> _segment_stamps;
     std::recursive_mutex _mtx;
     toolkit::Ticker _seek_ticker;
     toolkit::Timer::Ptr _timer;
     MP4Demuxer::Ptr _demuxer;
     MultiMediaSourceMuxer::Ptr _muxer;
     toolkit::EventPoller::Ptr _poller;
+    //读文件线程，开启后_demuxer、_segment_index只在该线程中串行访问，不加锁
+    toolkit::EventPoller::Ptr _io_poller;
 };
 
 } /* namespace mediakit */
@@ -14,7 +14,9 @@
 #include "Util/File.h"
 #include "Util/logger.h"
 #include "Common/config.h"
+#include "Common/Metrics.h"
 #include "MP4Recorder.h"
+#include "RecordIndex.h"
 #include "Thread/WorkThreadPool.h"
 #include "MP4Muxer.h"
 
@@ -48,6 +50,7 @@ void MP4Recorder::createFile() {
 
     /////record 业务逻辑//////
     _info.start_time = ::time(NULL);
+    _start_ms = getCurrentMillisecond(true);
     _info.file_name = time + ".mp4";
     _info.file_path = full_path;
     GET_CONFIG(string, appName, Record::kAppName);
@@ -55,7 +58,7 @@ void MP4Recorder::createFile() {
 
     try {
         _muxer = std::make_shared<MP4Muxer>();
-        _muxer->openMP4(full_path_tmp);
+        _muxer->openMP4(full_path_tmp, "mp4:" + _info.vhost + "/" + _info.app + "/" + _info.stream);
         for (auto &track :_tracks) {
             //添加track
             _muxer->addTrack(track);
@@ -72,8 +75,10 @@ void MP4Recorder::asyncClose() {
     auto full_path_tmp = _full_path_tmp;
     auto full_path = _full_path;
     auto info = _info;
-    WorkThreadPool::Instance().getExecutor()->async([muxer, full_path_tmp, full_path, info]() mutable {
-        info.time_len = muxer->getDuration() / 1000.0f;
+    auto start_ms = _start_ms;
+    WorkThreadPool::Instance().getExecutor()->async([muxer, full_path_tmp, full_path, info, start_ms]() mutable {
+        auto duration_ms = muxer->getDuration();
+        info.time_len = duration_ms / 1000.0f;
         // 关闭mp4可能非常耗时，所以要放在后台线程执行
         muxer->closeMP4();
         if (!full_path_tmp.empty()) {
@@ -86,6 +91,10 @@ void MP4Recorder::asyncClose() {
             }
             // 临时文件名改成正式文件名，防止mp4未完成时被访问
             rename(full_path_tmp.data(), full_path.data());
+            if (RecordIndex::enabled()) {
+                //文件完成后才加入时间索引
+                RecordIndex::Instance().addSegment(info.folder, start_ms, duration_ms, full_path);
+            }
         }
         //触发mp4录制切片生成事件
         NoticeCenter::Instance().emitEvent(Broadcast::kBroadcastRecordMP4, info);
@@ -125,12 +134,34 @@ bool MP4Recorder::inputFrame(const Frame::Ptr &frame) {
     }
 
     if (_muxer) {
+        if (dropFrame(frame)) {
+            static auto &s_drop = Metrics::Instance().getCounter("zlm_record_drop_frames_total", "type=\"mp4\"", "Frames dropped because the disk writer is busy");
+            s_drop.add();
+            return false;
+        }
         //生成mp4文件
         return _muxer->inputFrame(frame);
     }
     return false;
 }
 
+bool MP4Recorder::dropFrame(const Frame::Ptr &frame) {
+    if (!_drop_frame) {
+        if (!_muxer->isBusy()) {
+            return false;
+        }
+        //磁盘写入跟不上，丢帧而不是阻塞poller线程或无限占用内存
+        _drop_frame = true;
+        WarnL << "mp4 disk writer is busy, start drop frame: " << _full_path;
+    }
+    if (_muxer->isBusy() || (_have_video && !frame->configFrame() && !frame->keyFrame())) {
+        return true;
+    }
+    //恢复后从视频关键帧开始写入
+    _drop_frame = false;
+    return false;
+}
+
 bool MP4Recorder::addTrack(const Track::Ptr &track) {
     //保存所有的track，为创建MP4MuxerFile做准备
     _tracks.emplace_back(track);
@@ -52,9 +52,11 @@ private:
     void createFile();
     void closeFile();
     void asyncClose();
+    bool dropFrame(const Frame::Ptr &frame);
 
 private:
     bool _have_video = false;
+    bool _drop_frame = false;
     size_t _max_second;
     std::string _folder_path;
     std::string _full_path;
@@ -63,6 +65,8 @@ private:
     std::shared_ptr<MP4Muxer> _muxer;
     std::list<Track::Ptr> _tracks;
     uint64_t _last_dts = 0;
+    //当前文件开始录制的时间(unix时间戳)，单位毫秒
+    uint64_t _start_ms = 0;
 };
 
 #endif ///ENABLE_MP4
@@ -0,0 +1,216 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <cstdlib>
+#include <algorithm>
+#include <sys/stat.h>
+#include "RecordIndex.h"
+#include "Common/config.h"
+#include "Util/File.h"
+#include "Util/util.h"
+#include "Util/logger.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+//索引文件名，放在每路流的录制目录下，不会被当成日期文件夹
+static const char kIndexFileName[] = ".record_index";
+//索引文件行数达到该值后才考虑重写
+static constexpr size_t kCompactMinLines = 1024;
+
+INSTANCE_IMP(RecordIndex)
+
+static string formatFolder(const string &folder) {
+    if (!folder.empty() && folder.back() != '/') {
+        return folder + '/';
+    }
+    return folder;
+}
+
+static bool compareSegment(const RecordIndex::Segment &a, const RecordIndex::Segment &b) {
+    return a.start_ms < b.start_ms;
+}
+
+bool RecordIndex::enabled() {
+    GET_CONFIG(bool, enable_index, Record::kEnableIndex);
+    return enable_index;
+}
+
+static bool fileExists(const string &path) {
+    struct stat st;
+    return stat(path.data(), &st) == 0;
+}
+
+shared_ptr<RecordIndex::Index> RecordIndex::getIndex(const string &folder, bool create) {
+    lock_guard<mutex> lck(_mtx);
+    auto it = _indexes.find(folder);
+    if (it != _indexes.end()) {
+        return it->second;
+    }
+    if (!create && !fileExists(folder + kIndexFileName)) {
+        return nullptr;
+    }
+    auto ret = std::make_shared<Index>();
+    _indexes.emplace(folder, ret);
+    return ret;
+}
+
+void RecordIndex::loadIndex(const string &folder, Index &index) {
+    index.loaded = true;
+    auto fp = fopen((folder + kIndexFileName).data(), "rb");
+    if (!fp) {
+        return;
+    }
+    shared_ptr<FILE> file(fp, fclose);
+    char line[1024];
+    //每行格式: 开始时间(毫秒) 时长(毫秒) 相对路径
+    while (fgets(line, sizeof(line), fp)) {
+        char *ptr = line;
+        Segment segment;
+        segment.start_ms = strtoull(ptr, &ptr, 10);
+        segment.duration_ms = strtoull(ptr, &ptr, 10);
+        if (*ptr != ' ' || !segment.start_ms) {
+            continue;
+        }
+        segment.path = ptr + 1;
+        trim(segment.path);
+        if (!segment.path.empty()) {
+            index.segments.emplace_back(std::move(segment));
+        }
+        ++index.file_lines;
+    }
+    stable_sort(index.segments.begin(), index.segments.end(), compareSegment);
+    index.compact_lines = index.file_lines;
+}
+
+void RecordIndex::compactIndex(const string &folder, Index &index, bool check_exists) {
+    auto &segments = index.segments;
+    if (check_exists) {
+        segments.erase(remove_if(segments.begin(), segments.end(), [&](const Segment &segment) {
+            return !fileExists(folder + segment.path);
+        }), segments.end());
+    }
+    //先写临时文件再改名，防止写入中途异常导致索引丢失
+    auto path = folder + kIndexFileName;
+    auto tmp = path + ".tmp";
+    auto fp = File::create_file(tmp.data(), "wb");
+    if (!fp) {
+        WarnL << "open record index failed: " << tmp << ", " << get_uv_errmsg();
+        return;
+    }
+    for (auto &segment : segments) {
+        fprintf(fp, "%llu %llu %s\n", (unsigned long long)segment.start_ms, (unsigned long long)segment.duration_ms, segment.path.data());
+    }
+    bool ok = fflush(fp) == 0;
+    fclose(fp);
+    if (!ok || rename(tmp.data(), path.data()) != 0) {
+        WarnL << "rewrite record index failed: " << path << ", " << get_uv_errmsg();
+        File::delete_file(tmp.data());
+        return;
+    }
+    index.file_lines = index.compact_lines = segments.size();
+}
+
+void RecordIndex::addSegment(const string &folder_in, uint64_t start_ms, uint64_t duration_ms, const string &file_path) {
+    auto folder = formatFolder(folder_in);
+    if (file_path.size() <= folder.size() || file_path.compare(0, folder.size(), folder) != 0) {
+        WarnL << "record file is not in record folder: " << file_path << ", " << folder;
+        return;
+    }
+    Segment segment;
+    segment.start_ms = start_ms;
+    segment.duration_ms = duration_ms;
+    //保存相对路径，录制目录整体迁移后索引仍然有效
+    segment.path = file_path.substr(folder.size());
+
+    auto index = getIndex(folder, true);
+    lock_guard<mutex> lck(index->mtx);
+    if (!index->loaded) {
+        //先加载已有索引，防止新增的切片被重复加载
+        loadIndex(folder, *index);
+    }
+    auto fp = File::create_file((folder + kIndexFileName).data(), "ab");
+    if (!fp) {
+        WarnL << "open record index failed: " << folder << kIndexFileName << ", " << get_uv_errmsg();
+        return;
+    }
+    fprintf(fp, "%llu %llu %s\n", (unsigned long long)start_ms, (unsigned long long)duration_ms, segment.path.data());
+    fclose(fp);
+    auto &segments = index->segments;
+    //通常按时间顺序追加
+    segments.insert(upper_bound(segments.begin(), segments.end(), segment, compareSegment), std::move(segment));
+    ++index->file_lines;
+    if (index->file_lines >= std::max(kCompactMinLines, 2 * index->compact_lines)) {
+        //索引文件行数翻倍才全量检查一次，均摊到每次追加的开销为常数
+        compactIndex(folder, *index, true);
+    }
+}
+
+vector<RecordIndex::Segment> RecordIndex::getSegments(const string &folder_in, uint64_t start_ms, uint64_t end_ms) {
+    auto folder = formatFolder(folder_in);
+    auto index = getIndex(folder, false);
+    vector<Segment> ret;
+    if (!index) {
+        return ret;
+    }
+    {
+        lock_guard<mutex> lck(index->mtx);
+        if (!index->loaded) {
+            loadIndex(folder, *index);
+        }
+        auto &segments = index->segments;
+        Segment key;
+        key.start_ms = start_ms;
+        auto it = upper_bound(segments.begin(), segments.end(), key, compareSegment);
+        if (it != segments.begin()) {
+            //包含start_ms的切片
+            --it;
+        }
+        for (; it != segments.end() && it->start_ms < end_ms; ++it) {
+            if (it->start_ms + it->duration_ms <= start_ms) {
+                continue;
+            }
+            ret.emplace_back(*it);
+            ret.back().path = folder + ret.back().path;
+        }
+    }
+    //过滤已经被删除的录像
+    auto it = stable_partition(ret.begin(), ret.end(), [](const Segment &segment) {
+        return fileExists(segment.path);
+    });
+    if (it == ret.end()) {
+        return ret;
+    }
+    {
+        //从内存索引中剔除，下次查询不再重复检查
+        lock_guard<mutex> lck(index->mtx);
+        auto &segments = index->segments;
+        for (auto del = it; del != ret.end(); ++del) {
+            auto range = equal_range(segments.begin(), segments.end(), *del, compareSegment);
+            auto path = del->path.substr(folder.size());
+            for (auto seg = range.first; seg != range.second; ++seg) {
+                if (seg->path == path) {
+                    segments.erase(seg);
+                    break;
+                }
+            }
+        }
+        if (index->file_lines >= kCompactMinLines && 2 * segments.size() <= index->file_lines) {
+            //一半以上的行已失效，重写索引文件
+            compactIndex(folder, *index, false);
+        }
+    }
+    ret.erase(it, ret.end());
+    return ret;
+}
+
+} // namespace mediakit
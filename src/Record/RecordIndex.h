@@ -0,0 +1,91 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_RECORDINDEX_H
+#define ZLMEDIAKIT_RECORDINDEX_H
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace mediakit {
+
+/**
+ * 录制时间索引，按录制目录(每路流一个)维护 (开始时间, 时长, 文件) 列表
+ * mp4录制关闭文件、hls点播切片完成时追加到该目录下的.record_index文件中，每个切片一行，
+ * 首次查询时加载到内存，按时间二分查找，不需要扫描目录；
+ * 已被删除的文件在查询或追加时从索引中剔除，索引文件行数翻倍后整体重写，防止无限增长；
+ * 切片内的关键帧定位由MP4Index完成
+ */
+class RecordIndex {
+public:
+    class Segment {
+    public:
+        // 切片开始录制的时间(unix时间戳)，单位毫秒
+        uint64_t start_ms = 0;
+        // 切片时长，单位毫秒
+        uint64_t duration_ms = 0;
+        // 切片文件完整路径
+        std::string path;
+    };
+
+    static RecordIndex &Instance();
+
+    /**
+     * 是否开启录制索引(record.enableIndex)
+     */
+    static bool enabled();
+
+    /**
+     * 追加一个录制完成的切片，会同步写磁盘，应在后台线程中调用
+     * @param folder 录制目录
+     * @param start_ms 切片开始录制的时间(unix时间戳)，单位毫秒
+     * @param duration_ms 切片时长，单位毫秒
+     * @param file_path 切片文件完整路径
+     */
+    void addSegment(const std::string &folder, uint64_t start_ms, uint64_t duration_ms, const std::string &file_path);
+
+    /**
+     * 查询与[start_ms, end_ms)时间范围有交集的切片，按时间排序，已被删除的文件会被过滤
+     * @param folder 录制目录
+     */
+    std::vector<Segment> getSegments(const std::string &folder, uint64_t start_ms, uint64_t end_ms);
+
+private:
+    RecordIndex() = default;
+
+    class Index {
+    public:
+        std::mutex mtx;
+        bool loaded = false;
+        // 索引文件的行数(包括已被剔除的切片)
+        size_t file_lines = 0;
+        // 上次重写索引文件后的行数
+        size_t compact_lines = 0;
+        // 按开始时间排序，文件路径为相对录制目录的路径
+        std::vector<Segment> segments;
+    };
+
+    /**
+     * @param create 索引不存在时是否创建，查询时只有索引文件存在才创建，防止任意流名导致内存增长
+     */
+    std::shared_ptr<Index> getIndex(const std::string &folder, bool create);
+    static void loadIndex(const std::string &folder, Index &index);
+    static void compactIndex(const std::string &folder, Index &index, bool check_exists);
+
+private:
+    std::mutex _mtx;
+    std::unordered_map<std::string, std::shared_ptr<Index> > _indexes;
+};
+
+} // namespace mediakit
+#endif // ZLMEDIAKIT_RECORDINDEX_H
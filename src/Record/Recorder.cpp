@@ -56,7 +56,9 @@ std::shared_ptr<MediaSinkInterface> Recorder::createRecorder(type type, const st
 #if defined(ENABLE_HLS)
             auto path = Recorder::getRecordPath(type, vhost, app, stream_id, option.hls_save_path);
             GET_CONFIG(bool, enable_vhost, General::kEnableVhost);
-            auto ret = std::make_shared<HlsRecorder>(path, enable_vhost ? string(VHOST_KEY) + "=" + vhost : "", option);
+            //磁盘写入器以流为单位统计，方便区分各流的写入情况
+            auto tag = "hls:" + vhost + "/" + app + "/" + stream_id;
+            auto ret = std::make_shared<HlsRecorder>(path, enable_vhost ? string(VHOST_KEY) + "=" + vhost : "", option, tag);
             ret->setMediaSource(vhost, app, stream_id);
             return ret;
 #else
@@ -107,8 +107,8 @@ void FlvMuxer::start(const EventPoller::Ptr &poller, const RtmpMediaSource::Ptr
             return;
         }
 
-        size_t i = 0;
-        auto size = pkt->size();
+        //延后一个包写入，确保最后一个写入的包会flush(最后的包可能被跳过)
+        const RtmpPacket::Ptr *last = nullptr;
         pkt->for_each([&](const RtmpPacket::Ptr &rtmp) {
             if (check) {
                 if (rtmp->time_stamp < start_pts) {
@@ -116,8 +116,17 @@ void FlvMuxer::start(const EventPoller::Ptr &poller, const RtmpMediaSource::Ptr
                 }
                 check = false;
             }
-            strong_self->onWriteRtmp(rtmp, ++i == size);
+            if (strong_self->onDropRtmp(rtmp)) {
+                return;
+            }
+            if (last) {
+                strong_self->onWriteRtmp(*last, false);
+            }
+            last = &rtmp;
         });
+        if (last) {
+            strong_self->onWriteRtmp(*last, true);
+        }
     });
 }
 
@@ -37,6 +37,8 @@ protected:
     virtual void onDetach() = 0;
     // 为了跨线程投递, 为啥不 enable_shared_from_this?
     virtual std::shared_ptr<FlvMuxer> getSharedPtr() = 0;
+    // 是否丢弃该rtmp包，用于慢速播放器丢帧
+    virtual bool onDropRtmp(const RtmpPacket::Ptr &pkt) { return false; }
 
 private:
     void writeFlvHeader(bool hasAudio, bool hasVideo);
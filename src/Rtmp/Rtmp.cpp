@@ -147,18 +147,16 @@ void Metadata::addTrack(AMFValue &metadata, const Track::Ptr &track) {
     });
 }
 
+class RtmpPacketPoolTraits {
+public:
+    static const char *name() { return "RtmpPacket"; }
+    static size_t capacity(const RtmpPacket &pkt) { return pkt.buffer.capacity(); }
+};
+
 RtmpPacket::Ptr RtmpPacket::create(){
-#if 0
-    static ResourcePool<RtmpPacket> packet_pool;
-    static onceToken token([]() {
-        packet_pool.setSize(1024);
-    });
-    auto ret = packet_pool.obtain2();
+    auto ret = PacketPool<RtmpPacket, RtmpPacketPoolTraits>::obtain();
     ret->clear();
     return ret;
-#else
-    return Ptr(new RtmpPacket);
-#endif
 }
 
 void RtmpPacket::clear()
@@ -190,6 +190,8 @@ public:
 
 private:
     friend class toolkit::ResourcePool_l<RtmpPacket>;
+    template <typename T, typename Traits>
+    friend class PacketPool;
     RtmpPacket(){
         clear();
     }
@@ -54,7 +54,12 @@ public:
     }
 
     void onReaderChanged(MediaSource &sender, int size) override {
-        _enabled = _option.rtmp_demand ? size : true;
+        bool enabled = _option.rtmp_demand ? size : true;
+        if (enabled && !_enabled) {
+            //从无人观看恢复，需要先输入GOP缓存，让播放器能立即收到关键帧
+            _need_gop = true;
+        }
+        _enabled = enabled;
         if (!size && _option.rtmp_demand) {
             _clear_cache = true;
         }
@@ -77,9 +82,26 @@ public:
         return _option.rtmp_demand ? (_clear_cache ? true : _enabled) : true;
     }
 
+    /**
+     * 是否需要先输入GOP缓存，调用后清除该标记
+     */
+    bool fetchNeedGop() {
+        auto ret = _need_gop;
+        _need_gop = false;
+        return ret;
+    }
+
+    /**
+     * 是否依赖共享的GOP缓存：按需模式下无人观看(不打包也不缓存GOP)，或刚恢复观看尚未输入GOP缓存
+     */
+    bool waitGop() const {
+        return _need_gop || (_option.rtmp_demand && !_enabled);
+    }
+
 private:
     bool _enabled = true;
     bool _clear_cache = false;
+    bool _need_gop = false;
     ProtocolOption _option;
     RtmpMediaSource::Ptr _media_src;
 };
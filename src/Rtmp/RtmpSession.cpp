@@ -299,6 +299,10 @@ void RtmpSession::sendPlayResponse(const string &err, const RtmpMediaSource::Ptr
     });
 
     src->pause(false);
+    _egress_counter = src->getEgressCounter();
+    if (FrameDropper::enabled()) {
+        _frame_dropper = std::make_shared<FrameDropper>(RTMP_SCHEMA);
+    }
     _ring_reader = src->getRing()->attach(getPoller());
     weak_ptr<RtmpSession> weak_self = dynamic_pointer_cast<RtmpSession>(shared_from_this());
     _ring_reader->setGetInfoCB([weak_self]() { return weak_self.lock(); });
@@ -308,15 +312,11 @@ void RtmpSession::sendPlayResponse(const string &err, const RtmpMediaSource::Ptr
             return;
         }
 
-        size_t i = 0;
-        auto size = pkt->size();
+        //最后一个包可能被丢帧策略丢弃，所以统一在最后flush
         strong_self->setSendFlushFlag(false);
-        pkt->for_each([&](const RtmpPacket::Ptr &rtmp){
-            if(++i == size){
-                strong_self->setSendFlushFlag(true);
-            }
-            strong_self->onSendMedia(rtmp);
-        });
+        pkt->for_each([&](const RtmpPacket::Ptr &rtmp) { strong_self->onSendMedia(rtmp); });
+        strong_self->flushAll();
+        strong_self->setSendFlushFlag(true);
     });
     _ring_reader->setDetachCB([weak_self]() {
         if (auto strong_self = weak_self.lock()) {
@@ -561,6 +561,13 @@ void RtmpSession::onCmd_seek(AMFDecoder &dec) {
 }
 
 void RtmpSession::onSendMedia(const RtmpPacket::Ptr &pkt) {
+    if (_frame_dropper && _frame_dropper->inputRtmp(pkt, isSocketBusy())) {
+        //发送积压过多，丢弃该包
+        return;
+    }
+    if (_egress_counter) {
+        _egress_counter->add(pkt->size());
+    }
     sendRtmp(pkt->type_id, pkt->stream_index, pkt, pkt->time_stamp, pkt->chunk_id);
 }
 
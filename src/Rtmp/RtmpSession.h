@@ -16,6 +16,7 @@
 #include "RtmpMediaSourceImp.h"
 #include "Util/TimeTicker.h"
 #include "Network/Session.h"
+#include "Common/FrameDropper.h"
 
 namespace mediakit {
 /// Rtmp服务器会话，负责承载rtmp推流和拉流功能.
@@ -105,6 +106,10 @@ private:
     RtmpMediaSourceImp::Ptr _push_src;
     std::shared_ptr<void> _push_src_ownership;
     RtmpMediaSource::RingType::RingReader::Ptr _ring_reader;
+    //直播源的发送字节数统计
+    MetricCounter::Ptr _egress_counter;
+    //慢速播放器丢帧策略
+    FrameDropper::Ptr _frame_dropper;
 };
 
 /**
@@ -27,6 +27,15 @@ RtpSender::RtpSender(EventPoller::Ptr poller) {
 }
 
 RtpSender::~RtpSender() {
+    //析构时不再经过pacer，直接发送剩余数据：先发送pacer中排队的数据，再发送缓存中尚未打包发送的数据；
+    //pacer只能在所属线程访问，在其他线程析构时pacer中排队的数据将被丢弃
+    if (_pacer && _poller->isCurrentThread()) {
+        auto rtp_list = _pacer->takeAll();
+        if (!rtp_list.empty()) {
+            sendRtpList(rtp_list);
+        }
+    }
+    _pacer = nullptr;
     flush();
 }
 
@@ -43,6 +52,13 @@ void RtpSender::startSend(const MediaSourceEvent::SendRtpArgs &args, const funct
     }
 
     weak_ptr<RtpSender> weak_self = shared_from_this();
+    if (!_pacer && PacketPacerBase::enabled()) {
+        _pacer = std::make_shared<PacketPacer<Buffer::Ptr>>(_poller, "rtp", [weak_self](const List<Buffer::Ptr> &rtp_list) {
+            if (auto strong_self = weak_self.lock()) {
+                strong_self->sendRtpList(rtp_list);
+            }
+        });
+    }
     if (args.passive) {
         // tcp被动发流模式
         _args.is_udp = false;
@@ -211,6 +227,7 @@ void RtpSender::onConnect(){
     } else if (_args.udp_rtcp_timeout) {
         createRtcpSocket();
     }
+    _send_batch.setIdentifier(_args.ssrc + "@" + _args.dst_url + ":" + to_string(_args.dst_port));
     //连接建立成功事件
     weak_ptr<RtpSender> weak_self = shared_from_this();
     _socket_rtp->setOnErr([weak_self](const SockException &err) {
@@ -290,19 +307,38 @@ void RtpSender::onFlushRtpList(shared_ptr<List<Buffer::Ptr> > rtp_list) {
         //连接成功后才能发送数据
         return;
     }
+    if (!_pacer) {
+        sendRtpList(*rtp_list);
+        return;
+    }
+    if (_poller->isCurrentThread()) {
+        _pacer->inputList(*rtp_list);
+        return;
+    }
+    //pacer只能在所属线程使用
+    auto pacer = _pacer;
+    _poller->async([pacer, rtp_list]() { pacer->inputList(*rtp_list); }, false);
+}
 
+void RtpSender::sendRtpList(const List<Buffer::Ptr> &rtp_list) {
+    if (!_is_connect) {
+        return;
+    }
     size_t i = 0;
-    auto size = rtp_list->size();
-    rtp_list->for_each([&](Buffer::Ptr &packet) {
+    auto size = rtp_list.size();
+    rtp_list.for_each([&](const Buffer::Ptr &packet) {
         if (_args.is_udp) {
             onSendRtpUdp(packet, i == 0);
             // udp模式，rtp over tcp前4个字节可以忽略
-            _socket_rtp->send(std::make_shared<BufferRtp>(std::move(packet), RtpPacket::kRtpTcpHeaderSize), nullptr, 0, ++i == size);
+            _socket_rtp->send(std::make_shared<BufferRtp>(packet, RtpPacket::kRtpTcpHeaderSize), nullptr, 0, ++i == size);
+            _send_batch.onPacket();
         } else {
             // tcp模式, rtp over tcp前2个字节可以忽略,只保留后续rtp长度的2个字节
-            _socket_rtp->send(std::make_shared<BufferRtp>(std::move(packet), 2), nullptr, 0, ++i == size);
+            _socket_rtp->send(std::make_shared<BufferRtp>(packet, 2), nullptr, 0, ++i == size);
         }
     });
+    //udp模式下整批rtp在最后一个包时flush(sendmmsg)
+    _send_batch.onFlush();
 }
 
 void RtpSender::onErr(const SockException &ex) {
@@ -16,6 +16,8 @@
 #include "Rtcp/RtcpContext.h"
 #include "Common/MediaSource.h"
 #include "Common/MediaSink.h"
+#include "Common/SendBatchStatistic.h"
+#include "Common/PacketPacer.h"
 
 namespace mediakit{
 
@@ -66,6 +68,8 @@ public:
 private:
     //合并写输出
     void onFlushRtpList(std::shared_ptr<toolkit::List<toolkit::Buffer::Ptr> > rtp_list);
+    //写socket，开启pacer时由pacer回调
+    void sendRtpList(const toolkit::List<toolkit::Buffer::Ptr> &rtp_list);
     //udp/tcp连接成功回调
     void onConnect();
     //异常断开socket事件
@@ -86,6 +90,10 @@ private:
     toolkit::Ticker _rtcp_send_ticker;
     toolkit::Ticker _rtcp_recv_ticker;
     std::function<void(const toolkit::SockException &ex)> _on_close;
+    //udp批量发送统计
+    SendBatchStatistic _send_batch { "rtp" };
+    //发送平滑，关闭时为空
+    PacketPacer<toolkit::Buffer::Ptr>::Ptr _pacer;
 };
 
 }//namespace mediakit
@@ -11,8 +11,9 @@
 #ifndef ZLMEDIAKIT_RTPRECEIVER_H
 #define ZLMEDIAKIT_RTPRECEIVER_H
 
-#include <map>
+#include <limits>
 #include <string>
+#include <vector>
 #include <memory>
 #include "Rtsp/Rtsp.h"
 #include "Extension/Frame.h"
@@ -21,9 +22,13 @@
 
 namespace mediakit {
 // 处理rtp乱序排序，并过滤重复包
+// 排序缓存为2的幂大小的环形数组(按seq & mask索引)，按需扩容至kMax，避免每个包一次内存分配
 template<typename T, typename SEQ = uint16_t, size_t kMax = 1024, size_t kMin = 32>
 class PacketSortor {
 public:
+    static_assert(kMax && (kMax & (kMax - 1)) == 0, "kMax must be power of 2");
+    static_assert(kMin <= kMax, "kMin must not be larger than kMax");
+
     PacketSortor() = default;
     ~PacketSortor() = default;
     // 输出排序后的包
@@ -36,17 +41,23 @@ public:
      * 清空状态
      */
     void clear() {
+        _is_inited = false;
         _seq_cycle_count = 0;
-        _pkt_cache_map.clear();
         _next_seq_out = 0;
         _max_sort_size = kMin;
+        _size = 0;
+        _jump_packets.clear();
+        for (auto &slot : _slots) {
+            slot.valid = false;
+            slot.packet = T();
+        }
     }
 
     /**
      * 获取排序缓存长度
      */
     size_t getJitterSize() const{
-        return _pkt_cache_map.size();
+        return _size;
     }
 
     /**
@@ -62,93 +73,181 @@ public:
      * @param packet 包负载
      */
     void sortPacket(SEQ seq, T packet) {
-        if(!_is_inited && _next_seq_out == 0){
+        if (!_is_inited) {
             _next_seq_out = seq;
+            _max_seq_in = seq;
             _is_inited = true;
         }
-        if (seq < _next_seq_out) {
-            if (_next_seq_out < seq + kMax) {
-                //过滤seq回退包，比已输出的seq还小的(回环包除外)
-                return;
+        // 距离下个待输出seq的偏移，按seq回环计算
+        SEQ diff = seq - _next_seq_out;
+        if (diff > ((std::numeric_limits<SEQ>::max)() >> 1)) {
+            //过滤seq回退包，比已输出的seq还小的
+            return;
+        }
+        if (diff >= kMax && (SEQ)(seq - _max_seq_in) >= kMax) {
+            //与已收到的最大seq也相差很远，可能是单个异常包，也可能是seq真的发生了跳变；
+            //先暂存，连续收到多个才认为是跳变，否则丢弃，防止单个异常包导致后续正常包都被当做回退包丢弃
+            _jump_packets.emplace_back(seq, std::move(packet));
+            if (_jump_packets.size() >= kJumpCount) {
+                resync();
             }
-        } else if (_next_seq_out && seq - _next_seq_out > ((std::numeric_limits<SEQ>::max)() >> 1)) {
-            //过滤seq跳变非常大的包(防止回环时乱序时收到非常大的seq)
             return;
         }
-
-        //放入排序缓存
-        _pkt_cache_map.emplace(seq, std::move(packet));
-        //尝试输出排序后的包
-        tryPopPacket();
+        //收到连续的包，之前暂存的跳变包为异常包
+        _jump_packets.clear();
+        if (diff >= kMax) {
+            //等待丢失的包时排序窗口已满，输出窗口前部的包，直到能容纳该seq
+            while (_size && (SEQ)(seq - _next_seq_out) >= kMax) {
+                popFirst();
+            }
+            if ((SEQ)(seq - _next_seq_out) >= kMax) {
+                setNextSeq(seq);
+            }
+            popContinuous();
+        }
+        inputPacket(seq, std::move(packet));
     }
 
     void flush(){
         //清空缓存
-        while (!_pkt_cache_map.empty()) {
-            popIterator(_pkt_cache_map.begin());
+        while (_size) {
+            popFirst();
         }
     }
 
 private:
-    void popPacket() {
-        auto it = _pkt_cache_map.begin();
-        if (it->first >= _next_seq_out) {
-            //过滤回跳包
-            popIterator(it);
+    struct Slot {
+        bool valid = false;
+        SEQ seq = 0;
+        T packet;
+    };
+
+    //连续收到多少个超出排序窗口的包才认为seq发生了跳变
+    static constexpr size_t kJumpCount = 8;
+
+    //放入排序窗口内的包
+    void inputPacket(SEQ seq, T packet) {
+        if ((SEQ)(seq - _max_seq_in) <= ((std::numeric_limits<SEQ>::max)() >> 1)) {
+            _max_seq_in = seq;
+        }
+        SEQ diff = seq - _next_seq_out;
+        if (diff >= _slots.size()) {
+            reserve(diff + 1);
+        }
+
+        auto &slot = _slots[seq & (_slots.size() - 1)];
+        if (slot.valid) {
+            //过滤重复包
             return;
         }
+        //放入排序缓存
+        slot.valid = true;
+        slot.seq = seq;
+        slot.packet = std::move(packet);
+        ++_size;
+        //尝试输出排序后的包
+        tryPopPacket();
+    }
 
-        if (_next_seq_out - it->first > ((std::numeric_limits<SEQ>::max)() >> 1)) {
-            //产生回环了
-            if (_pkt_cache_map.size() < 2 * kMin) {
-                //等足够多的数据后才处理回环, 因为后面还可能出现大的SEQ
-                return;
+    //seq发生跳变，输出排序窗口内所有的包，从暂存的跳变包中最小的seq重新开始排序
+    void resync() {
+        auto jump_packets = std::move(_jump_packets);
+        _jump_packets.clear();
+        auto first = jump_packets.back().first;
+        for (auto &pr : jump_packets) {
+            if ((SEQ)(first - pr.first) <= ((std::numeric_limits<SEQ>::max)() >> 1)) {
+                //pr.first不大于first(按回环计算)
+                first = pr.first;
             }
-            ++_seq_cycle_count;
-            //找到大的SEQ并清空掉，然后从小的SEQ重新开始排序
-            auto hit = _pkt_cache_map.upper_bound((SEQ)(_next_seq_out - _pkt_cache_map.size()));
-            while (hit != _pkt_cache_map.end()) {
-                //回环前，清空剩余的大的SEQ的数据
-                _cb(hit->first, hit->second);
-                hit = _pkt_cache_map.erase(hit);
+        }
+        flush();
+        setNextSeq(first);
+        _max_seq_in = first;
+        for (auto &pr : jump_packets) {
+            sortPacket(pr.first, std::move(pr.second));
+        }
+    }
+
+    Slot &getSlot(SEQ seq) {
+        return _slots[seq & (_slots.size() - 1)];
+    }
+
+    // 扩容环形缓存，并按新的mask重新放置已缓存的包
+    void reserve(size_t size) {
+        auto capacity = _slots.empty() ? kMin : _slots.size();
+        while (capacity < size) {
+            capacity <<= 1;
+        }
+        if (capacity > kMax) {
+            capacity = kMax;
+        }
+        std::vector<Slot> slots(capacity);
+        for (auto &slot : _slots) {
+            if (slot.valid) {
+                slots[slot.seq & (capacity - 1)] = std::move(slot);
             }
-            //下一个回环的数据
-            popIterator(_pkt_cache_map.begin());
         }
-        else {
-            //删除回跳的数据包
-            _pkt_cache_map.erase(it);
+        _slots.swap(slots);
+    }
+
+    // 更新下个待输出的seq，seq变小时说明产生了回环
+    void setNextSeq(SEQ seq) {
+        if (seq < _next_seq_out) {
+            ++_seq_cycle_count;
         }
+        _next_seq_out = seq;
     }
 
     // 删除并回调包，然后更新_next_seq_out
-    void popIterator(typename std::map<SEQ, T>::iterator it) {
-        auto seq = it->first;
-        auto data = std::move(it->second);
-        _pkt_cache_map.erase(it);
-        _next_seq_out = seq + 1;
+    void popSlot(Slot &slot) {
+        auto seq = slot.seq;
+        auto data = std::move(slot.packet);
+        slot.packet = T();
+        slot.valid = false;
+        --_size;
+        setNextSeq(seq + 1);
         _cb(seq, data);
     }
 
-    void tryPopPacket() {
-        int count = 0;
-        while ((!_pkt_cache_map.empty() && _pkt_cache_map.begin()->first == _next_seq_out)) {
+    // 跳过丢失的包，输出缓存中最小的seq
+    void popFirst() {
+        for (SEQ seq = _next_seq_out;; ++seq) {
+            auto &slot = getSlot(seq);
+            if (slot.valid) {
+                popSlot(slot);
+                return;
+            }
+        }
+    }
+
+    // 输出连续的包，返回输出个数
+    size_t popContinuous() {
+        size_t count = 0;
+        while (_size) {
+            auto &slot = getSlot(_next_seq_out);
+            if (!slot.valid) {
+                break;
+            }
             //找到下个包，直接输出
-            popPacket();
+            popSlot(slot);
             ++count;
         }
+        return count;
+    }
 
-        if (count) {
+    void tryPopPacket() {
+        if (popContinuous()) {
             setSortSize();
-        } else if (_pkt_cache_map.size() > _max_sort_size) {
+        } else if (_size > _max_sort_size) {
             //排序缓存溢出，不再继续排序
-            popPacket();
+            popFirst();
+            popContinuous();
             setSortSize();
         }
     }
 
     void setSortSize() {
-        _max_sort_size = kMin + _pkt_cache_map.size();
+        _max_sort_size = kMin + _size;
         if (_max_sort_size > kMax) {
             _max_sort_size = kMax;
         }
@@ -160,12 +259,18 @@ private:
 
     //下次应该输出的SEQ
     SEQ _next_seq_out = 0;
+    //已收到的最大SEQ
+    SEQ _max_seq_in = 0;
     //seq回环次数计数
     size_t _seq_cycle_count = 0;
     //排序缓存长度
     size_t _max_sort_size = kMin;
-    //pkt排序缓存，根据seq排序
-    std::map<SEQ, T> _pkt_cache_map;
+    //排序缓存中包个数
+    size_t _size = 0;
+    //pkt排序缓存，环形数组，大小为2的幂，以seq & (size - 1)为下标
+    std::vector<Slot> _slots;
+    //超出排序窗口的包，用于判断seq是否发生了跳变
+    std::vector<std::pair<SEQ, T> > _jump_packets;
     //回调
     SortCallback _cb;
 };
@@ -594,18 +594,17 @@ size_t RtpPacket::getPayloadSize() const {
     return getHeader()->getPayloadSize(size() - kRtpTcpHeaderSize);
 }
 
+class RtpPacketPoolTraits {
+public:
+    static const char *name() { return "RtpPacket"; }
+    static size_t capacity(const RtpPacket &pkt) { return pkt.getCapacity(); }
+};
+
 RtpPacket::Ptr RtpPacket::create() {
-#if 0
-    static ResourcePool<RtpPacket> packet_pool;
-    static onceToken token([]() {
-        packet_pool.setSize(1024);
-    });
-    auto ret = packet_pool.obtain2();
+    auto ret = PacketPool<RtpPacket, RtpPacketPoolTraits>::obtain();
     ret->setSize(0);
+    ret->ntp_stamp = 0;
     return ret;
-#else
-    return Ptr(new RtpPacket);
-#endif
 }
 
 TitleSdp::TitleSdp(float dur_sec, const std::map<string, string>& header, int version) : Sdp(0, 0) {
@@ -180,6 +180,8 @@ public:
 
 private:
     friend class toolkit::ResourcePool_l<RtpPacket>;
+    template <typename T, typename Traits>
+    friend class PacketPool;
     RtpPacket() = default;
 
 private:
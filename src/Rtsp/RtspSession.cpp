@@ -442,6 +442,7 @@ void RtspSession::onAuthSuccess() {
         }
         strong_self->_sessionid = makeRandStr(12);
         strong_self->_play_src = rtsp_src;
+        strong_self->_egress_counter = rtsp_src->getEgressCounter();
         for(auto &track : strong_self->_sdp_track){
             track->_ssrc = rtsp_src->getSsrc(track->_type);
             track->_seq = rtsp_src->getSequence(track->_type);
@@ -839,6 +840,14 @@ void RtspSession::handleReq_Play(const Parser &parser) {
     setSocketFlags();
 
     if (!_play_reader && _rtp_type != Rtsp::RTP_MULTICAST) {
+        if (_rtp_type == Rtsp::RTP_TCP && FrameDropper::enabled()) {
+            _frame_dropper = std::make_shared<FrameDropper>(RTSP_SCHEMA);
+            for (auto &track : _sdp_track) {
+                if (track->_type == TrackVideo) {
+                    _frame_dropper->setVideoCodec(getCodecId(track->_codec));
+                }
+            }
+        }
         weak_ptr<RtspSession> weak_self = dynamic_pointer_cast<RtspSession>(shared_from_this());
         _play_reader = play_src->getRing()->attach(getPoller(), use_gop);
         _play_reader->setGetInfoCB([weak_self]() { return weak_self.lock(); });
@@ -1200,9 +1209,18 @@ void RtspSession::sendRtpPacket(const RtspMediaSource::RingDataType &pkt) {
     switch (_rtp_type) {
         case Rtsp::RTP_TCP: {
             setSendFlushFlag(false);
-            pkt->for_each([&](const RtpPacket::Ptr &rtp) {
-                if (_target_play_track == TrackInvalid || _target_play_track == rtp->type) {
+            pkt->for_each([&](const RtpPacket::Ptr &rtp_in) {
+                if (_target_play_track == TrackInvalid || _target_play_track == rtp_in->type) {
+                    if (_frame_dropper && _frame_dropper->inputRtp(rtp_in, isSocketBusy())) {
+                        //发送积压过多，丢弃该包，后续包重新编号seq，防止播放器将其视为网络丢包
+                        _seq_rewriter.onDrop(rtp_in);
+                        return;
+                    }
+                    auto rtp = _seq_rewriter.hasOffset() ? _seq_rewriter.rewrite(rtp_in) : rtp_in;
                     updateRtcpContext(rtp);
+                    if (_egress_counter) {
+                        _egress_counter->add(rtp->size());
+                    }
                     send(rtp);
                 }
             });
@@ -1224,6 +1242,9 @@ void RtspSession::sendRtpPacket(const RtspMediaSource::RingDataType &pkt) {
                         return;
                     }
                     _bytes_usage += rtp->size() - RtpPacket::kRtpTcpHeaderSize;
+                    if (_egress_counter) {
+                        _egress_counter->add(rtp->size() - RtpPacket::kRtpTcpHeaderSize);
+                    }
                     sock->send(std::make_shared<BufferRtp>(rtp, RtpPacket::kRtpTcpHeaderSize), nullptr, 0, false);
                 }
             });
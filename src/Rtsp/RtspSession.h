@@ -19,6 +19,7 @@
 #include "RtpReceiver.h"
 #include "RtspMediaSource.h"
 #include "RtspMediaSourceImp.h"
+#include "Common/FrameDropper.h"
 
 namespace mediakit {
 class RtpMultiCaster;
@@ -169,6 +170,12 @@ private:
     std::weak_ptr<RtspMediaSource> _play_src;
     //直播源读取器
     RtspMediaSource::RingType::RingReader::Ptr _play_reader;
+    //直播源的发送字节数统计
+    MetricCounter::Ptr _egress_counter;
+    //慢速播放器丢帧策略，仅rtp over tcp时有效
+    FrameDropper::Ptr _frame_dropper;
+    //丢包后重写后续rtp包的seq，保持发送的seq连续
+    RtpSeqRewriter _seq_rewriter;
     //sdp里面有效的track,包含音频或视频
     std::vector<SdpTrack::Ptr> _sdp_track;
     //播放器setup指定的播放track,默认为TrackInvalid表示不指定即音视频都推
@@ -1,108 +1,112 @@
 ﻿#include "NackContext.hpp"
 
 namespace SRT {
-void NackContext::update(TimePoint now, std::list<PacketQueue::LostPair> &lostlist) {
-    for (auto item : lostlist) {
+
+// 丢包记录窗口的最大长度，超过后丢弃新的丢包区间
+static constexpr uint32_t kMaxNackSize = 1 << 20;
+
+void NackContext::update(TimePoint now, const PacketQueueInterface::LostList &lostlist) {
+    for (auto &item : lostlist) {
         mergeItem(now, item);
     }
 }
+
 void NackContext::getLostList(
-    TimePoint now, uint32_t rtt, uint32_t rtt_variance, std::list<PacketQueue::LostPair> &lostlist) {
+    TimePoint now, uint32_t rtt, uint32_t rtt_variance, PacketQueueInterface::LostList &lostlist) {
     lostlist.clear();
-    std::list<uint32_t> tmp_list;
-
-    for (auto it = _nack_map.begin(); it != _nack_map.end(); ++it) {
-        if (!it->second._is_nack) {
-            tmp_list.push_back(it->first);
-            it->second._ts = now;
-            it->second._is_nack = true;
-        } else {
-            if (DurationCountMicroseconds(now - it->second._ts) > rtt) {
-                tmp_list.push_back(it->first);
-                it->second._ts = now;
+    // 按seq顺序遍历，无需排序
+    bool finish = true;
+    for (uint32_t i = 0; i < _size; ++i) {
+        auto seq = genExpectedSeq(_first_seq + i);
+        auto &item = getItem(seq);
+        bool need_nack = false;
+        if (item._is_lost) {
+            if (!item._is_nack) {
+                item._is_nack = true;
+                need_nack = true;
+            } else if (DurationCountMicroseconds(now - item._ts) > rtt) {
+                need_nack = true;
             }
         }
-    }
-    tmp_list.sort();
-
-    if (tmp_list.empty()) {
-        return;
-    }
-
-    uint32_t min = *tmp_list.begin();
-    uint32_t max = *tmp_list.rbegin();
-
-    if ((max - min) >= (MAX_SEQ >> 1)) {
-        while ((max - tmp_list.front()) > (MAX_SEQ >> 1)) {
-            tmp_list.push_back(tmp_list.front());
-            tmp_list.pop_front();
+        if (!need_nack) {
+            finish = true;
+            continue;
         }
-    }
-
-    PacketQueue::LostPair lost;
-    bool finish = true;
-    for (auto cur = tmp_list.begin(); cur != tmp_list.end(); ++cur) {
+        item._ts = now;
         if (finish) {
-            lost.first = *cur;
-            lost.second = genExpectedSeq(*cur + 1);
+            lostlist.emplace_back(seq, genExpectedSeq(seq + 1));
             finish = false;
         } else {
-            if (lost.second == *cur) {
-                lost.second = genExpectedSeq(*cur + 1);
-            } else {
-                finish = true;
-                lostlist.push_back(lost);
-            }
+            lostlist.back().second = genExpectedSeq(seq + 1);
         }
     }
 }
+
 void NackContext::drop(uint32_t seq) {
-    if (_nack_map.empty())
+    if (!_size) {
         return;
-    uint32_t min = _nack_map.begin()->first;
-    uint32_t max = _nack_map.rbegin()->first;
-    bool is_cycle = false;
-    if ((max - min) >= (MAX_SEQ >> 1)) {
-        is_cycle = true;
     }
+    auto count = genExpectedSeq(seq + 1 - _first_seq);
+    if (count >= (MAX_SEQ >> 1)) {
+        // seq在窗口之前
+        return;
+    }
+    if (count > _size) {
+        count = _size;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        getItem(genExpectedSeq(_first_seq + i)) = NackItem();
+    }
+    _first_seq = genExpectedSeq(_first_seq + count);
+    _size -= count;
+}
 
-    for (auto it = _nack_map.begin(); it != _nack_map.end();) {
-        if (!is_cycle) {
-            // 不回环
-            if (it->first <= seq) {
-                it = _nack_map.erase(it);
-            } else {
-                it++;
-            }
-        } else {
-            if (it->first <= seq) {
-                if ((seq - it->first) >= (MAX_SEQ >> 1)) {
-                    WarnL << "cycle seq  " << seq << " " << it->first;
-                    it++;
-                } else {
-                    it = _nack_map.erase(it);
-                }
-            } else {
-                if ((it->first - seq) >= (MAX_SEQ >> 1)) {
-                    it = _nack_map.erase(it);
-                    WarnL << "cycle seq  " << seq << " " << it->first;
-                } else {
-                    it++;
-                }
-            }
-        }
+void NackContext::reserve(uint32_t size) {
+    if (size <= _nack_buf.size()) {
+        return;
+    }
+    uint32_t capacity = _nack_buf.empty() ? 64 : _nack_buf.size();
+    while (capacity < size) {
+        capacity <<= 1;
     }
+    std::vector<NackItem> buf(capacity);
+    for (uint32_t i = 0; i < _size; ++i) {
+        auto seq = genExpectedSeq(_first_seq + i);
+        buf[seq & (capacity - 1)] = getItem(seq);
+    }
+    _nack_buf.swap(buf);
 }
 
-void NackContext::mergeItem(TimePoint now, PacketQueue::LostPair &item) {
-    for (uint32_t i = item.first; i < item.second; ++i) {
-        auto it = _nack_map.find(i);
-        if (it != _nack_map.end()) {
-        } else {
-            NackItem tmp;
-            tmp._is_nack = false;
-            _nack_map.emplace(i, tmp);
-        }
+void NackContext::mergeItem(TimePoint now, const PacketQueueInterface::LostPair &item) {
+    auto count = genExpectedSeq(item.second - item.first);
+    if (!count || count >= (MAX_SEQ >> 1)) {
+        return;
+    }
+    if (!_size) {
+        _first_seq = item.first;
+    }
+
+    uint32_t first = _first_seq;
+    uint32_t size = _size;
+    auto offset = genExpectedSeq(item.first - _first_seq);
+    if (offset >= (MAX_SEQ >> 1)) {
+        // 丢包区间在窗口之前，向前扩展窗口
+        first = item.first;
+        size += genExpectedSeq(_first_seq - item.first);
+        offset = 0;
+    }
+    if (offset + count > size) {
+        size = offset + count;
+    }
+    if (size > kMaxNackSize) {
+        WarnL << "too many lost packets, first " << item.first << " last " << item.second - 1;
+        return;
+    }
+    reserve(size);
+    _first_seq = first;
+    _size = size;
+    for (uint32_t i = 0; i < count; ++i) {
+        getItem(genExpectedSeq(item.first + i))._is_lost = true;
     }
 }
 } // namespace SRT
\ No newline at end of file
@@ -2,28 +2,36 @@
 #define ZLMEDIAKIT_SRT_NACK_CONTEXT_H
 #include "Common.hpp"
 #include "PacketQueue.hpp"
-#include <list>
+#include <vector>
 
 namespace SRT {
+// 以seq为下标的环形丢包记录(大小为2的幂，按需扩容)
 class NackContext {
 public:
     NackContext() = default;
     ~NackContext() = default;
-    void update(TimePoint now, std::list<PacketQueue::LostPair> &lostlist);
-    void getLostList(TimePoint now, uint32_t rtt, uint32_t rtt_variance, std::list<PacketQueue::LostPair> &lostlist);
+    void update(TimePoint now, const PacketQueueInterface::LostList &lostlist);
+    void getLostList(TimePoint now, uint32_t rtt, uint32_t rtt_variance, PacketQueueInterface::LostList &lostlist);
     void drop(uint32_t seq);
 
-private:
-    void mergeItem(TimePoint now, PacketQueue::LostPair &item);
-
 private:
     class NackItem {
     public:
+        bool _is_lost = false;
         bool _is_nack = false;
         TimePoint _ts; // send nak time
     };
 
-    std::map<uint32_t, NackItem> _nack_map;
+    void mergeItem(TimePoint now, const PacketQueueInterface::LostPair &item);
+    void reserve(uint32_t size);
+    NackItem &getItem(uint32_t seq) { return _nack_buf[seq & (_nack_buf.size() - 1)]; }
+
+private:
+    // 第一个丢包seq
+    uint32_t _first_seq = 0;
+    // 最后一个丢包seq相对_first_seq的偏移加一
+    uint32_t _size = 0;
+    std::vector<NackItem> _nack_buf;
 };
 
 } // namespace SRT
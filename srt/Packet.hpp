@@ -317,8 +317,8 @@ public:
     bool loadFromData(uint8_t *buf, size_t len) override;
     bool storeToData() override;
 
-    std::list<LostPair> lost_list;
-    static size_t getCIFSize(std::list<LostPair> &lost);
+    std::vector<LostPair> lost_list;
+    static size_t getCIFSize(const std::vector<LostPair> &lost);
 };
 
 /*
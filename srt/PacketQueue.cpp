@@ -2,238 +2,36 @@
 
 namespace SRT {
 
-static inline bool isSeqEdge(uint32_t seq, uint32_t cap) {
-    return seq > (MAX_SEQ - cap);
-}
-
-static inline bool isSeqCycle(uint32_t first, uint32_t second) {
-    uint32_t diff;
-    if (first > second) {
-        diff = first - second;
-    } else {
-        diff = second - first;
-    }
-
-    if (diff > (MAX_SEQ >> 1)) {
-        return true;
-    } else {
-        return false;
-    }
-}
-
-static inline bool isTSCycle(uint32_t first, uint32_t second) {
-    uint32_t diff;
-    if (first > second) {
-        diff = first - second;
-    } else {
-        diff = second - first;
-    }
-
-    return diff > (MAX_TS >> 1);
-}
-
-PacketQueue::PacketQueue(uint32_t max_size, uint32_t init_seq, uint32_t latency)
-    : _pkt_cap(max_size)
-    , _pkt_latency(latency)
-    , _pkt_expected_seq(init_seq) {}
-
-void PacketQueue::tryInsertPkt(DataPacket::Ptr pkt) {
-    if (_pkt_expected_seq <= pkt->packet_seq_number) {
-        auto diff = pkt->packet_seq_number - _pkt_expected_seq;
-        if (diff >= (MAX_SEQ >> 1)) {
-            TraceL << "drop packet too later for cycle "
-                   << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number;
-            return;
-        } else {
-            _pkt_map.emplace(pkt->packet_seq_number, pkt);
-        }
-    } else {
-        auto diff = _pkt_expected_seq - pkt->packet_seq_number;
-        if (diff >= (MAX_SEQ >> 1)) {
-            _pkt_map.emplace(pkt->packet_seq_number, pkt);
-            TraceL << " cycle packet "
-                   << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number;
-        } else {
-            // TraceL << "drop packet too later "
-            //        << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number;
-        }
-    }
-}
-
-bool PacketQueue::inputPacket(DataPacket::Ptr pkt, std::list<DataPacket::Ptr> &out) {
-    tryInsertPkt(pkt);
-    auto it = _pkt_map.find(_pkt_expected_seq);
-    while (it != _pkt_map.end()) {
-        out.push_back(it->second);
-        _pkt_map.erase(it);
-        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
-        it = _pkt_map.find(_pkt_expected_seq);
-    }
-
-    // 以下两种弹出方式都有可能导致seq存在空洞
-    while (_pkt_map.size() > _pkt_cap) {
-        // 防止回环
-        it = _pkt_map.find(_pkt_expected_seq);
-        if (it != _pkt_map.end()) {
-            out.push_back(it->second);
-            _pkt_map.erase(it);
-        }
-        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
-    }
-
-    while (timeLatency() > _pkt_latency) {
-        it = _pkt_map.find(_pkt_expected_seq);
-        if (it != _pkt_map.end()) {
-            out.push_back(it->second);
-            _pkt_map.erase(it);
-        }
-        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
+static inline uint32_t countTrailingZero(uint64_t val) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(val);
+#else
+    uint32_t ret = 0;
+    while (!(val & 1)) {
+        val >>= 1;
+        ++ret;
     }
-
-    return true;
-}
-
-bool PacketQueue::drop(uint32_t first, uint32_t last, std::list<DataPacket::Ptr> &out) {
-    uint32_t end = genExpectedSeq(last + 1);
-    while (_pkt_expected_seq < end) {
-        auto it = _pkt_map.find(_pkt_expected_seq);
-        if (it != _pkt_map.end()) {
-            out.push_back(it->second);
-            _pkt_map.erase(it);
-        }
-        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
-    }
-    return true;
+    return ret;
+#endif
 }
 
-uint32_t PacketQueue::timeLatency() {
-    if (_pkt_map.empty()) {
-        return 0;
-    }
-    // @todo 考虑seq回环情况..
-    auto first = _pkt_map.begin()->second->timestamp;
-    auto last = _pkt_map.rbegin()->second->timestamp;
-    uint32_t dur;
-    if (last > first) {
-        dur = last - first;
-    } else {
-        dur = first - last;
-    }
-
-    if (dur > 0x80000000) {
-        dur = MAX_TS - dur;
-        WarnL << "cycle dur " << dur;
-    }
-
-    return dur;
-}
-
-std::list<PacketQueue::LostPair> PacketQueue::getLostSeq() {
-    std::list<PacketQueue::LostPair> re;
-    if (_pkt_map.empty()) {
-        return re;
-    }
-
-    if (getExpectedSize() == getSize()) {
-        return re;
-    }
-
-    uint32_t end = 0;
-    uint32_t first, last;
-
-    first = _pkt_map.begin()->second->packet_seq_number;
-    last = _pkt_map.rbegin()->second->packet_seq_number;
-    if ((last - first) > (MAX_SEQ >> 1)) {
-        TraceL << " cycle seq first " << first << " last " << last << " size " << _pkt_map.size();
-        end = first;
-    } else {
-        end = last;
-    }
-    PacketQueue::LostPair lost;
-    lost.first = 0;
-    lost.second = 0;
-
-    bool finish = true;
-    uint32_t i = _pkt_expected_seq;
-    while (i <= end) {
-        if (_pkt_map.find(i) == _pkt_map.end()) {
-            if (finish) {
-                finish = false;
-                lost.first = i;
-                lost.second = genExpectedSeq(i + 1);
-            } else {
-                lost.second = genExpectedSeq(i + 1);
-            }
-        } else {
-            if (!finish) {
-                finish = true;
-                re.push_back(lost);
-            }
-        }
-        i = genExpectedSeq(i + 1);
-    }
-
-    return re;
-}
-
-size_t PacketQueue::getSize() {
-    return _pkt_map.size();
-}
-
-size_t PacketQueue::getExpectedSize() {
-    if (_pkt_map.empty()) {
-        return 0;
-    }
-    // @todo seq回环情况
-    uint32_t max = _pkt_map.rbegin()->first;
-    uint32_t min = _pkt_map.begin()->first;
-    if ((max - min) >= (MAX_SEQ >> 1)) {
-        TraceL << "cycle expected seq " << _pkt_expected_seq << " min " << min << " max " << max 
-               << " size " << _pkt_map.size();
-        return MAX_SEQ - _pkt_expected_seq + min + 1;
-    } else {
-        return max - _pkt_expected_seq + 1;
+// 环形缓存大小为2的幂，且至少为一个bitmap字(64)
+static inline uint32_t getBufSize(uint32_t cap) {
+    uint32_t ret = 64;
+    while (ret < cap) {
+        ret <<= 1;
     }
+    return ret;
 }
 
-size_t PacketQueue::getAvailableBufferSize() {
-    auto size = getExpectedSize();
-    if (_pkt_cap > size) {
-        return _pkt_cap - size;
-    }
-
-    if (_pkt_cap > _pkt_map.size()) {
-        return _pkt_cap - _pkt_map.size();
-    }
-    WarnL << " cap " << _pkt_cap << " expected size " << size << " map size " << _pkt_map.size();
-    return _pkt_cap;
-}
-
-uint32_t PacketQueue::getExpectedSeq() {
-    return _pkt_expected_seq;
-}
-
-std::string PacketQueue::dump() {
-    toolkit::_StrPrinter printer;
-    if (_pkt_map.empty()) {
-        printer << " expected seq :" << _pkt_expected_seq;
-    } else {
-        printer << " expected seq :" << _pkt_expected_seq << " size:" << _pkt_map.size()
-                << " first:" << _pkt_map.begin()->second->packet_seq_number;
-        printer << " last:" << _pkt_map.rbegin()->second->packet_seq_number;
-        printer << " latency:" << timeLatency() / 1e3;
-    }
-    return std::move(printer);
-}
-
-//////////////////// PacketRecvQueue //////////////////////////////////
-
 PacketRecvQueue::PacketRecvQueue(uint32_t max_size, uint32_t init_seq, uint32_t latency, uint32_t flag)
     : _pkt_cap(max_size)
     , _pkt_latency(latency)
     , _pkt_expected_seq(init_seq)
     , _srt_flag(flag)
-    , _pkt_buf(max_size) {}
+    , _mask(getBufSize(max_size) - 1)
+    , _pkt_buf(_mask + 1)
+    , _pkt_bitmap((_mask + 1) / 64) {}
 
 bool  PacketRecvQueue::TLPKTDrop(){
     return (_srt_flag&HSExtMessage::HS_EXT_MSG_TLPKTDROP) && (_srt_flag &HSExtMessage::HS_EXT_MSG_TSBPDRCV);
@@ -241,38 +39,56 @@ bool  PacketRecvQueue::TLPKTDrop(){
 
 bool PacketRecvQueue::inputPacket(DataPacket::Ptr pkt, std::list<DataPacket::Ptr> &out) {
     // TraceL << dump() << " seq:" << pkt->packet_seq_number;
-    while (_size > 0 && _start == _end) {
-        if (_pkt_buf[_start]) {
-            out.push_back(_pkt_buf[_start]);
-            _size--;
-            _pkt_buf[_start] = nullptr;
-        }
-        _start = (_start + 1) % _pkt_cap;
-        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
+    if (_size > 0 && _expected_size >= _pkt_cap) {
+        // 缓存已满，弹出最早的包
+        popFront(out);
     }
 
-    tryInsertPkt(pkt);
+    tryInsertPkt(std::move(pkt));
+
+    while (_size > 0 && isReceived(getPos(0))) {
+        popFront(out);
+    }
+    while (TLPKTDrop() && timeLatency() > _pkt_latency) {
+        // 太晚的包不再等待重传，跳过空洞直接输出第一个已收到的包
+        auto offset = findOffset(0, _expected_size, true);
+        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + offset);
+        _expected_size -= offset;
+        popFront(out);
+    }
+    return true;
+}
 
-    DataPacket::Ptr it = _pkt_buf[_start];
-    while (it) {
-        out.push_back(it);
+void PacketRecvQueue::popFront(std::list<DataPacket::Ptr> &out) {
+    auto pos = getPos(0);
+    if (isReceived(pos)) {
+        _pkt_bitmap[pos >> 6] &= ~(1ULL << (pos & 63));
+        out.push_back(std::move(_pkt_buf[pos]));
+        _pkt_buf[pos] = nullptr;
         _size--;
-        _pkt_buf[_start] = nullptr;
-        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
-        _start = (_start + 1) % _pkt_cap;
-        it = _pkt_buf[_start];
     }
-    while (timeLatency() > _pkt_latency && TLPKTDrop()) {
-        it = _pkt_buf[_start];
-        if (it) {
-            _pkt_buf[_start] = nullptr;
-            out.push_back(it);
-            _size--;
+    _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
+    if (_expected_size) {
+        _expected_size--;
+    }
+}
+
+uint32_t PacketRecvQueue::findOffset(uint32_t offset, uint32_t end, bool received) const {
+    while (offset < end) {
+        auto pos = getPos(offset);
+        auto bits = _pkt_bitmap[pos >> 6];
+        if (!received) {
+            bits = ~bits;
+        }
+        // 忽略本字中pos之前的bit，缓存大小为64的整数倍，所以一个字内不会回环
+        bits &= ~0ULL << (pos & 63);
+        if (bits) {
+            auto ret = offset + countTrailingZero(bits) - (pos & 63);
+            return ret < end ? ret : end;
         }
-        _pkt_expected_seq = genExpectedSeq(_pkt_expected_seq + 1);
-        _start = (_start + 1) % _pkt_cap;
+        offset += 64 - (pos & 63);
     }
-    return true;
+    return end;
 }
 
 uint32_t PacketRecvQueue::timeLatency() {
@@ -298,39 +114,26 @@ uint32_t PacketRecvQueue::timeLatency() {
     return dur;
 }
 
-std::list<PacketQueueInterface::LostPair> PacketRecvQueue::getLostSeq() {
-    std::list<PacketQueueInterface::LostPair> re;
+void PacketRecvQueue::getLostSeq(LostList &lost) {
+    lost.clear();
     if (_size <= 0) {
-        return re;
+        return;
     }
 
     if (getExpectedSize() == getSize()) {
-        return re;
+        return;
     }
 
-    LostPair lost;
-    uint32_t steup = 0;
-    bool finish = true;
-
-    for (uint32_t i = _start; i != _end;) {
-        if (!_pkt_buf[i]) {
-            if (finish) {
-                finish = false;
-                lost.first = _pkt_expected_seq + steup;
-                lost.second = genExpectedSeq(lost.first + 1);
-            } else {
-                lost.second = genExpectedSeq(_pkt_expected_seq + steup + 1);
-            }
-        } else {
-            if (!finish) {
-                finish = true;
-                re.push_back(lost);
-            }
+    // 最后一个位置一定是已收到的包，所以每个丢包区间都有结束位置
+    uint32_t offset = 0;
+    while (offset < _expected_size) {
+        auto first = findOffset(offset, _expected_size, false);
+        if (first >= _expected_size) {
+            break;
         }
-        i = (i + 1) % _pkt_cap;
-        steup++;
+        offset = findOffset(first, _expected_size, true);
+        lost.emplace_back(genExpectedSeq(_pkt_expected_seq + first), genExpectedSeq(_pkt_expected_seq + offset));
     }
-    return re;
 }
 
 size_t PacketRecvQueue::getSize() {
@@ -338,27 +141,7 @@ size_t PacketRecvQueue::getSize() {
 }
 
 size_t PacketRecvQueue::getExpectedSize() {
-    if (_size <= 0) {
-        return 0;
-    }
-
-    uint32_t max, min;
-    auto first = _pkt_expected_seq;
-    auto last = getLast()->packet_seq_number;
-    if (last >= first) {
-        max = last;
-        min = first;
-    } else {
-        max = first;
-        min = last;
-    }
-    if ((max - min) >= (MAX_SEQ >> 1)) {
-        TraceL << "cycle "
-               << "expected seq " << _pkt_expected_seq << " min " << min << " max " << max << " size " << _size;
-        return MAX_SEQ - _pkt_expected_seq + min + 1;
-    } else {
-        return max - _pkt_expected_seq + 1;
-    }
+    return _expected_size;
 }
 
 size_t PacketRecvQueue::getAvailableBufferSize() {
@@ -387,115 +170,57 @@ std::string PacketRecvQueue::dump() {
                 << " first:" << getFirst()->packet_seq_number;
         printer << " last:" << getLast()->packet_seq_number;
         printer << " latency:" << timeLatency() / 1e3;
-        printer << " start:" << _start;
-        printer << " end:" << _end;
+        printer << " expected size:" << _expected_size;
     }
     return std::move(printer);
 }
 
 bool PacketRecvQueue::drop(uint32_t first, uint32_t last, std::list<DataPacket::Ptr> &out) {
-    uint32_t diff = 0;
-    if (isSeqCycle(_pkt_expected_seq, last)) {
-        if (last < _pkt_expected_seq) {
-            diff = MAX_SEQ - _pkt_expected_seq + last + 1;
-        } else {
-            WarnL << "drop first " << first << " last " << last << " expected " << _pkt_expected_seq;
-            return false;
-        }
-    } else {
-        if (last < _pkt_expected_seq) {
-            WarnL << "drop first " << first << " last " << last << " expected " << _pkt_expected_seq;
-            return false;
-        }
-        diff = last - _pkt_expected_seq + 1;
+    auto offset = genExpectedSeq(last - _pkt_expected_seq);
+    if (offset >= (MAX_SEQ >> 1)) {
+        // last比期望seq还小，已经输出过了
+        WarnL << "drop first " << first << " last " << last << " expected " << _pkt_expected_seq;
+        return false;
     }
 
+    uint32_t diff = offset + 1;
     if (diff > getExpectedSize()) {
         WarnL << " diff " << diff << " expected size " << getExpectedSize();
         return false;
     }
 
     for (uint32_t i = 0; i < diff; i++) {
-        auto pos = (i + _start) % _pkt_cap;
-        if (_pkt_buf[pos]) {
-            out.push_back(_pkt_buf[pos]);
-            _pkt_buf[pos] = nullptr;
-            _size--;
-        }
-    }
-
-    _pkt_expected_seq = genExpectedSeq(last + 1);
-    _start = (diff + _start) % _pkt_cap;
-    if (_size <= 0) {
-        _end = _start;
-        WarnL;
+        popFront(out);
     }
     return true;
 }
 
-void PacketRecvQueue::insertToCycleBuf(DataPacket::Ptr pkt, uint32_t diff) {
-    auto pos = (_start + diff) % _pkt_cap;
-
-    if (!_pkt_buf[pos]) {
-        _size++;
-    } else {
-        // WarnL << "repate packet " << pkt->packet_seq_number;
+void PacketRecvQueue::tryInsertPkt(DataPacket::Ptr pkt) {
+    // 相对期望seq的偏移，已考虑seq回环
+    auto diff = genExpectedSeq(pkt->packet_seq_number - _pkt_expected_seq);
+    if (diff >= (MAX_SEQ >> 1)) {
+        // TraceL << "drop packet too later "
+        //        << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number;
         return;
     }
-    _pkt_buf[pos] = pkt;
 
-    if (_start <= _end && pos >= _end) {
-        _end = (pos + 1) % _pkt_cap;
+    if (diff >= _pkt_cap) {
+        WarnL << "too new "
+              << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number << " cap "
+              << _pkt_cap;
         return;
     }
 
-    if (_start <= _end && pos < _start) {
-        _end = (pos + 1) % _pkt_cap;
+    auto pos = getPos(diff);
+    if (isReceived(pos)) {
+        // WarnL << "repate packet " << pkt->packet_seq_number;
         return;
     }
-
-    if (_start > _end && _end <= pos && _start > pos) {
-        _end = (pos + 1) % _pkt_cap;
-        return;
-    }
-}
-
-void PacketRecvQueue::tryInsertPkt(DataPacket::Ptr pkt) {
-    if (_pkt_expected_seq <= pkt->packet_seq_number) {
-        auto diff = pkt->packet_seq_number - _pkt_expected_seq;
-        if (diff >= (MAX_SEQ >> 1)) {
-            TraceL << "drop packet too later for cycle "
-                   << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number;
-            return;
-        } else {
-            if (diff >= _pkt_cap) {
-                WarnL << "too new "
-                      << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number << " cap "
-                      << _pkt_cap;
-                return;
-            }
-
-            insertToCycleBuf(pkt, diff);
-        }
-    } else {
-        auto diff = _pkt_expected_seq - pkt->packet_seq_number;
-        if (diff >= (MAX_SEQ >> 1)) {
-            diff = MAX_SEQ - diff;
-            if (diff >= _pkt_cap) {
-                WarnL << "too new "
-                      << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number << " cap "
-                      << _pkt_cap;
-                return;
-            }
-
-            insertToCycleBuf(pkt, diff);
-
-            TraceL << " cycle packet "
-                   << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number;
-        } else {
-            // TraceL << "drop packet too later "
-            //        << "expected seq=" << _pkt_expected_seq << " pkt seq=" << pkt->packet_seq_number;
-        }
+    _pkt_bitmap[pos >> 6] |= 1ULL << (pos & 63);
+    _pkt_buf[pos] = std::move(pkt);
+    _size++;
+    if (diff >= _expected_size) {
+        _expected_size = diff + 1;
     }
 }
 
@@ -503,36 +228,14 @@ DataPacket::Ptr PacketRecvQueue::getFirst() {
     if (_size <= 0) {
         return nullptr;
     }
-
-    uint32_t i = _start;
-    while (i != _start) {
-        if (_pkt_buf[i]) {
-            return _pkt_buf[i];
-        }
-        i = (i + 1) % _pkt_cap;
-    }
+    return _pkt_buf[getPos(findOffset(0, _expected_size, true))];
 }
 
 DataPacket::Ptr PacketRecvQueue::getLast() {
     if (_size <= 0) {
         return nullptr;
     }
-    uint32_t steup = 1;
-    uint32_t i = (_end + _pkt_cap - steup) % _pkt_cap;
-    /*
-    while (1) {
-        if (_pkt_buf[i]) {
-            _end = (i + 1) % _pkt_cap;
-            return _pkt_buf[i];
-        }
-        i = (_end + _pkt_cap - steup) % _pkt_cap;
-        steup++;
-    }
-    */
-    if (!_pkt_buf[i]) {
-        WarnL << "start " << _start << " end" << _end << " size " << _size;
-    }
-    return _pkt_buf[i];
+    return _pkt_buf[getPos(_expected_size - 1)];
 }
 
 } // namespace SRT
\ No newline at end of file
@@ -2,7 +2,6 @@
 #define ZLMEDIAKIT_SRT_PACKET_QUEUE_H
 #include "Packet.hpp"
 #include <list>
-#include <map>
 #include <vector>
 
 namespace SRT {
@@ -11,13 +10,15 @@ class PacketQueueInterface {
 public:
     using Ptr = std::shared_ptr<PacketQueueInterface>;
     using LostPair = std::pair<uint32_t, uint32_t>;
+    using LostList = std::vector<LostPair>;
 
     PacketQueueInterface() = default;
     virtual ~PacketQueueInterface() = default;
     virtual bool inputPacket(DataPacket::Ptr pkt, std::list<DataPacket::Ptr> &out) = 0;
 
     virtual uint32_t timeLatency() = 0;
-    virtual std::list<LostPair> getLostSeq() = 0;
+    // 获取丢包区间[first, second)，结果写入lost(会先清空)，lost可复用避免内存分配
+    virtual void getLostSeq(LostList &lost) = 0;
 
     virtual size_t getSize() = 0;
     virtual size_t getExpectedSize() = 0;
@@ -27,36 +28,10 @@ public:
     virtual std::string dump() = 0;
     virtual bool drop(uint32_t first, uint32_t last, std::list<DataPacket::Ptr> &out) = 0;
 };
-// for recv
-class PacketQueue : public PacketQueueInterface {
-public:
-    using Ptr = std::shared_ptr<PacketQueue>;
-
-    PacketQueue(uint32_t max_size, uint32_t init_seq, uint32_t latency);
-    ~PacketQueue() = default;
-
-    uint32_t timeLatency();
-    size_t getSize();
-    size_t getExpectedSize();
-    size_t getAvailableBufferSize();
-    uint32_t getExpectedSeq();
-
-    std::string dump();
-    // 丢包丢到last_seq
-    bool drop(uint32_t first, uint32_t last, std::list<DataPacket::Ptr> &out);
-    bool inputPacket(DataPacket::Ptr pkt, std::list<DataPacket::Ptr> &out);
-    std::list<LostPair> getLostSeq();
-private:
-    void tryInsertPkt(DataPacket::Ptr pkt);
-
-private:
-    uint32_t _pkt_cap;
-    uint32_t _pkt_latency;
-    uint32_t _pkt_expected_seq;
-    // seq -> packet
-    std::map<uint32_t, DataPacket::Ptr> _pkt_map;
-};
 
+// for recv
+// 以seq为下标的环形接收缓存(大小为2的幂)，并用bitmap记录已收到的包，
+// 插入为O(1)，丢包区间按64位一组扫描bitmap生成
 class PacketRecvQueue : public PacketQueueInterface {
 public:
     using Ptr = std::shared_ptr<PacketRecvQueue>;
@@ -66,7 +41,7 @@ public:
     bool inputPacket(DataPacket::Ptr pkt, std::list<DataPacket::Ptr> &out);
 
     uint32_t timeLatency();
-    std::list<LostPair> getLostSeq();
+    void getLostSeq(LostList &lost);
 
     size_t getSize();
     size_t getExpectedSize();
@@ -78,7 +53,12 @@ public:
 
 private:
     void tryInsertPkt(DataPacket::Ptr pkt);
-    void insertToCycleBuf(DataPacket::Ptr pkt, uint32_t diff);
+    // 弹出_pkt_expected_seq位置的包(可能为空洞)，并递增_pkt_expected_seq
+    void popFront(std::list<DataPacket::Ptr> &out);
+    // 查找[offset, end)范围内第一个收到(或未收到)的包相对_pkt_expected_seq的偏移，找不到返回end
+    uint32_t findOffset(uint32_t offset, uint32_t end, bool received) const;
+    uint32_t getPos(uint32_t offset) const { return (_pkt_expected_seq + offset) & _mask; }
+    bool isReceived(uint32_t pos) const { return _pkt_bitmap[pos >> 6] & (1ULL << (pos & 63)); }
     DataPacket::Ptr getFirst();
     DataPacket::Ptr getLast();
     bool TLPKTDrop();
@@ -90,9 +70,13 @@ private:
 
     uint32_t _srt_flag;
 
+    // 环形缓存大小减一，缓存大小为不小于_pkt_cap的2的幂
+    uint32_t _mask;
     std::vector<DataPacket::Ptr> _pkt_buf;
-    uint32_t _start = 0;
-    uint32_t _end = 0;
+    // 每个bit对应_pkt_buf中的一个位置，1表示已收到
+    std::vector<uint64_t> _pkt_bitmap;
+    // 最大已收到seq相对_pkt_expected_seq的偏移加一
+    uint32_t _expected_size = 0;
     size_t _size = 0;
 };
 
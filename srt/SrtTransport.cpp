@@ -7,6 +7,7 @@
 #include "Ack.hpp"
 #include "Packet.hpp"
 #include "SrtTransport.hpp"
+#include "Common/Metrics.h"
 
 namespace SRT {
 #define SRT_FIELD "srt."
@@ -48,6 +49,7 @@ void SrtTransport::setSession(Session::Ptr session) {
               << _selected_session->get_peer_ip() << ":" << _selected_session->get_peer_port() 
               << " -> " << session->get_peer_ip() << ":" << session->get_peer_port();
     }
+    _send_batch.setIdentifier(session->getIdentifier() + "@" + session->get_peer_ip() + ":" + std::to_string(session->get_peer_port()));
     _selected_session = session;
 }
 
@@ -367,6 +369,10 @@ void SrtTransport::sendMsgDropReq(uint32_t first, uint32_t last) {
 
 void SrtTransport::handleNAK(uint8_t *buf, int len, struct sockaddr_storage *addr) {
     // TraceL;
+    static auto &s_nak_received = mediakit::Metrics::Instance().getCounter("zlm_srt_nak_received_total", "", "SRT NAK packets received from peers");
+    static auto &s_retransmit = mediakit::Metrics::Instance().getCounter("zlm_srt_retransmit_total", "", "SRT data packets retransmitted");
+    static auto &s_drop_req = mediakit::Metrics::Instance().getCounter("zlm_srt_drop_request_sent_total", "", "SRT message drop requests sent for packets no longer buffered");
+    s_nak_received.add();
     NAKPacket pkt;
     pkt.loadFromData(buf, len);
     bool empty = false;
@@ -382,9 +388,11 @@ void SrtTransport::handleNAK(uint8_t *buf, int len, struct sockaddr_storage *add
             pkt->R = 1;
             pkt->storeToHeader();
             sendPacket(pkt, flush);
+            s_retransmit.add();
             empty = false;
         }
         if (empty) {
+            s_drop_req.add();
             sendMsgDropReq(it.first, it.second - 1);
         }
     }
@@ -421,12 +429,11 @@ void SrtTransport::handleDropReq(uint8_t *buf, int len, struct sockaddr_storage
     /*
     _recv_nack.drop(max_seq);
 
-    auto lost = _recv_buf->getLostSeq();
-    _recv_nack.update(_now, lost);
-    lost.clear();
-    _recv_nack.getLostList(_now, _rtt, _rtt_variance, lost);
-    if (!lost.empty()) {
-        sendNAKPacket(lost);
+    _recv_buf->getLostSeq(_lost_list);
+    _recv_nack.update(_now, _lost_list);
+    _recv_nack.getLostList(_now, _rtt, _rtt_variance, _lost_list);
+    if (!_lost_list.empty()) {
+        sendNAKPacket(_lost_list);
         // TraceL << "check lost send nack";
     }
     */
@@ -437,9 +444,9 @@ void SrtTransport::checkAndSendAckNak(){
         nak_interval = 20 * 1000;
     }
     if (_nak_ticker.elapsedTime(_now) > nak_interval) {
-        auto lost = _recv_buf->getLostSeq();
-        if (!lost.empty()) {
-            sendNAKPacket(lost);
+        _recv_buf->getLostSeq(_lost_list);
+        if (!_lost_list.empty()) {
+            sendNAKPacket(_lost_list);
         }
         _nak_ticker.resetTime(_now);
     }
@@ -560,9 +567,10 @@ void SrtTransport::sendLightACKPacket() {
     TraceL << "send  ack " << pkt->dump();
 }
 
-void SrtTransport::sendNAKPacket(std::list<PacketQueue::LostPair> &lost_list) {
+void SrtTransport::sendNAKPacket(const PacketQueueInterface::LostList &lost_list) {
+    static auto &s_nak_sent = mediakit::Metrics::Instance().getCounter("zlm_srt_nak_sent_total", "", "SRT NAK packets sent to peers");
+    s_nak_sent.add();
     NAKPacket::Ptr pkt = std::make_shared<NAKPacket>();
-    std::list<PacketQueue::LostPair> tmp;
     auto size = NAKPacket::getCIFSize(lost_list);
     size_t paylaod_size = getPayloadSize();
     if (size > paylaod_size) {
@@ -570,21 +578,12 @@ void SrtTransport::sendNAKPacket(std::list<PacketQueue::LostPair> &lost_list) {
         size_t num = paylaod_size / 8;
 
         size_t msgNum = (lost_list.size() + num - 1) / num;
-        decltype(lost_list.begin()) cur, next;
         for (size_t i = 0; i < msgNum; ++i) {
-            cur = lost_list.begin();
-            std::advance(cur, i * num);
-
-            if (i == msgNum - 1) {
-                next = lost_list.end();
-            } else {
-                next = lost_list.begin();
-                std::advance(next, (i + 1) * num);
-            }
-            tmp.assign(cur, next);
+            auto cur = lost_list.begin() + i * num;
+            auto next = (i == msgNum - 1) ? lost_list.end() : lost_list.begin() + (i + 1) * num;
             pkt->dst_socket_id = _peer_socket_id;
             pkt->timestamp = DurationCountMicroseconds(_now - _start_timestamp);
-            pkt->lost_list = tmp;
+            pkt->lost_list.assign(cur, next);
             pkt->storeToData();
             sendControlPacket(pkt, true);
         }
@@ -634,13 +633,12 @@ void SrtTransport::handleDataPacket(uint8_t *buf, int len, struct sockaddr_stora
         //_recv_nack.drop(last_seq);
     }
     /*
-    auto lost = _recv_buf->getLostSeq();
-    _recv_nack.update(_now, lost);
-    lost.clear();
-    _recv_nack.getLostList(_now, _rtt, _rtt_variance, lost);
-    if (!lost.empty()) {
+    _recv_buf->getLostSeq(_lost_list);
+    _recv_nack.update(_now, _lost_list);
+    _recv_nack.getLostList(_now, _rtt, _rtt_variance, _lost_list);
+    if (!_lost_list.empty()) {
         // TraceL << "check lost send nack immediately";
-        sendNAKPacket(lost);
+        sendNAKPacket(_lost_list);
     }
     */
    /*
@@ -651,9 +649,9 @@ void SrtTransport::handleDataPacket(uint8_t *buf, int len, struct sockaddr_stora
 
     if (_nak_ticker.elapsedTime(_now) > nak_interval) {
         // Periodic NAK reports
-        auto lost = _recv_buf->getLostSeq();
-        if (!lost.empty()) {
-            sendNAKPacket(lost);
+        _recv_buf->getLostSeq(_lost_list);
+        if (!_lost_list.empty()) {
+            sendNAKPacket(_lost_list);
             // TraceL<<"send NAK";
         } else {
             // TraceL<<"lost is empty";
@@ -694,8 +692,13 @@ void SrtTransport::sendPacket(Buffer::Ptr pkt, bool flush) {
     if (_selected_session) {
         auto tmp = _packet_pool.obtain2();
         tmp->assign(pkt->data(), pkt->size());
+        // 非flush的包只加入发送队列，flush时通过sendmmsg一次性发送
         _selected_session->setSendFlushFlag(flush);
         _selected_session->send(std::move(tmp));
+        _send_batch.onPacket();
+        if (flush) {
+            _send_batch.onFlush();
+        }
     } else {
         WarnL << "not reach this";
     }
@@ -1,6 +1,7 @@
 ﻿#ifndef ZLMEDIAKIT_SRT_TRANSPORT_H
 #define ZLMEDIAKIT_SRT_TRANSPORT_H
 
+#include <map>
 #include <atomic>
 #include <chrono>
 #include <memory>
@@ -10,6 +11,7 @@
 #include "Poller/EventPoller.h"
 #include "Poller/Timer.h"
 #include "Common/Stamp.h"
+#include "Common/SendBatchStatistic.h"
 #include "Common.hpp"
 #include "NackContext.hpp"
 #include "Packet.hpp"
@@ -83,7 +85,7 @@ private:
     void handlePeerError(uint8_t *buf, int len, struct sockaddr_storage *addr);
     void handleDataPacket(uint8_t *buf, int len, struct sockaddr_storage *addr);
 
-    void sendNAKPacket(std::list<PacketQueue::LostPair> &lost_list);
+    void sendNAKPacket(const PacketQueueInterface::LostList &lost_list);
     void sendACKPacket();
     void sendLightACKPacket();
     void sendKeepLivePacket();
@@ -129,6 +131,8 @@ private:
     PacketSendQueue::Ptr _send_buf;
     uint32_t _buf_delay = 120;
     PacketQueueInterface::Ptr _recv_buf;
+    // 复用的丢包列表，避免每次发送nak时分配内存
+    PacketQueueInterface::LostList _lost_list;
     // NackContext _recv_nack;
     uint32_t _rtt = 100 * 1000;
     uint32_t _rtt_variance = 50 * 1000;
@@ -152,6 +156,8 @@ private:
     Timer::Ptr _handleshake_timer;
 
     ResourcePool<BufferRaw> _packet_pool;
+    //udp批量发送统计
+    mediakit::SendBatchStatistic _send_batch { "srt" };
 
     //检测超时的定时器
     Timer::Ptr _timer;
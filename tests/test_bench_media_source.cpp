@@ -0,0 +1,126 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <random>
+#include <iostream>
+#include "Util/logger.h"
+#include "Util/TimeTicker.h"
+#include "Common/config.h"
+#include "Common/MediaSource.h"
+
+using namespace std;
+using namespace toolkit;
+using namespace mediakit;
+
+class BenchMediaSource : public MediaSource {
+public:
+    using Ptr = std::shared_ptr<BenchMediaSource>;
+    BenchMediaSource(const string &stream_id) : MediaSource(RTSP_SCHEMA, DEFAULT_VHOST, "live", stream_id) {}
+    ~BenchMediaSource() override = default;
+
+    int readerCount() override { return 0; }
+    void publish() { regist(); }
+};
+
+static string getStreamId(size_t index) {
+    return "stream_" + to_string(index);
+}
+
+//此程序用于MediaSource注册表并发查找与注册/注销的性能测试
+//用法: test_bench_media_source [流个数] [查找线程数] [注册线程数] [测试秒数]
+int main(int argc, char *argv[]) {
+    size_t stream_count = argc > 1 ? atoi(argv[1]) : 20000;
+    size_t reader_count = argc > 2 ? atoi(argv[2]) : thread::hardware_concurrency();
+    size_t writer_count = argc > 3 ? atoi(argv[3]) : 2;
+    int seconds = argc > 4 ? atoi(argv[4]) : 10;
+
+    //注册/注销会打印大量日志，只打印警告以上级别
+    Logger::Instance().add(std::make_shared<ConsoleChannel>("ConsoleChannel", LWarn));
+
+    //常驻流，占用一半的流id
+    vector<BenchMediaSource::Ptr> resident;
+    for (size_t i = 0; i < stream_count; i += 2) {
+        auto src = std::make_shared<BenchMediaSource>(getStreamId(i));
+        src->publish();
+        resident.emplace_back(std::move(src));
+    }
+
+    atomic<bool> exit_flag { false };
+    atomic<uint64_t> find_count { 0 };
+    atomic<uint64_t> hit_count { 0 };
+    atomic<uint64_t> regist_count { 0 };
+    atomic<uint64_t> list_count { 0 };
+    vector<thread> threads;
+
+    for (size_t i = 0; i < reader_count; ++i) {
+        threads.emplace_back([&, i]() {
+            mt19937 rng(i);
+            uint64_t finds = 0, hits = 0;
+            while (!exit_flag) {
+                if (MediaSource::find(RTSP_SCHEMA, DEFAULT_VHOST, "live", getStreamId(rng() % stream_count))) {
+                    ++hits;
+                }
+                ++finds;
+            }
+            find_count += finds;
+            hit_count += hits;
+        });
+    }
+
+    for (size_t i = 0; i < writer_count; ++i) {
+        threads.emplace_back([&, i]() {
+            mt19937 rng(1000 + i);
+            uint64_t regists = 0;
+            while (!exit_flag) {
+                //奇数流id不停的上下线
+                auto src = std::make_shared<BenchMediaSource>(getStreamId((rng() % (stream_count / 2)) * 2 + 1));
+                try {
+                    src->publish();
+                    ++regists;
+                } catch (std::exception &) {
+                    //其他线程已经注册了该流
+                }
+            }
+            regist_count += regists;
+        });
+    }
+
+    //模拟getMediaList等遍历请求
+    threads.emplace_back([&]() {
+        uint64_t lists = 0;
+        while (!exit_flag) {
+            size_t size = 0;
+            MediaSource::for_each_media([&](const MediaSource::Ptr &src) { ++size; }, RTSP_SCHEMA, DEFAULT_VHOST, "live");
+            ++lists;
+        }
+        list_count += lists;
+    });
+
+    Ticker ticker;
+    this_thread::sleep_for(chrono::seconds(seconds));
+    exit_flag = true;
+    for (auto &th : threads) {
+        th.join();
+    }
+
+    auto elapsed_ms = ticker.elapsedTime();
+    cout << "流个数:" << stream_count
+         << " 查找线程数:" << reader_count
+         << " 注册线程数:" << writer_count
+         << " 耗时(ms):" << elapsed_ms << endl;
+    cout << "查找次数/秒:" << find_count * 1000 / elapsed_ms
+         << " 命中率:" << (find_count ? hit_count * 100 / find_count : 0) << "%"
+         << " 注册注销次数/秒:" << regist_count * 1000 / elapsed_ms
+         << " 遍历次数/秒:" << list_count * 1000 / elapsed_ms << endl;
+    return 0;
+}
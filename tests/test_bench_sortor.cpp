@@ -0,0 +1,244 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include "Util/TimeTicker.h"
+#include "Rtsp/RtpReceiver.h"
+
+using namespace std;
+using namespace toolkit;
+using namespace mediakit;
+
+// 基于std::map的旧版排序器，作为性能对比基准
+template<typename T, typename SEQ = uint16_t, size_t kMax = 1024, size_t kMin = 32>
+class MapPacketSortor {
+public:
+    MapPacketSortor() = default;
+    ~MapPacketSortor() = default;
+    // 输出排序后的包
+    typedef std::function<void(SEQ seq, T& packet)> SortCallback;
+    void setOnSort(SortCallback cb) {
+        _cb = std::move(cb);
+    }
+
+    /**
+     * 清空状态
+     */
+    void clear() {
+        _seq_cycle_count = 0;
+        _pkt_cache_map.clear();
+        _next_seq_out = 0;
+        _max_sort_size = kMin;
+    }
+
+    /**
+     * 获取排序缓存长度
+     */
+    size_t getJitterSize() const{
+        return _pkt_cache_map.size();
+    }
+
+    /**
+     * 获取seq回环次数
+     */
+    size_t getCycleCount() const{
+        return _seq_cycle_count;
+    }
+
+    /**
+     * 输入并排序
+     * @param seq 序列号
+     * @param packet 包负载
+     */
+    void sortPacket(SEQ seq, T packet) {
+        if(!_is_inited && _next_seq_out == 0){
+            _next_seq_out = seq;
+            _is_inited = true;
+        }
+        if (seq < _next_seq_out) {
+            if (_next_seq_out < seq + kMax) {
+                //过滤seq回退包，比已输出的seq还小的(回环包除外)
+                return;
+            }
+        } else if (_next_seq_out && seq - _next_seq_out > ((std::numeric_limits<SEQ>::max)() >> 1)) {
+            //过滤seq跳变非常大的包(防止回环时乱序时收到非常大的seq)
+            return;
+        }
+
+        //放入排序缓存
+        _pkt_cache_map.emplace(seq, std::move(packet));
+        //尝试输出排序后的包
+        tryPopPacket();
+    }
+
+    void flush(){
+        //清空缓存
+        while (!_pkt_cache_map.empty()) {
+            popIterator(_pkt_cache_map.begin());
+        }
+    }
+
+private:
+    void popPacket() {
+        auto it = _pkt_cache_map.begin();
+        if (it->first >= _next_seq_out) {
+            //过滤回跳包
+            popIterator(it);
+            return;
+        }
+
+        if (_next_seq_out - it->first > ((std::numeric_limits<SEQ>::max)() >> 1)) {
+            //产生回环了
+            if (_pkt_cache_map.size() < 2 * kMin) {
+                //等足够多的数据后才处理回环, 因为后面还可能出现大的SEQ
+                return;
+            }
+            ++_seq_cycle_count;
+            //找到大的SEQ并清空掉，然后从小的SEQ重新开始排序
+            auto hit = _pkt_cache_map.upper_bound((SEQ)(_next_seq_out - _pkt_cache_map.size()));
+            while (hit != _pkt_cache_map.end()) {
+                //回环前，清空剩余的大的SEQ的数据
+                _cb(hit->first, hit->second);
+                hit = _pkt_cache_map.erase(hit);
+            }
+            //下一个回环的数据
+            popIterator(_pkt_cache_map.begin());
+        }
+        else {
+            //删除回跳的数据包
+            _pkt_cache_map.erase(it);
+        }
+    }
+
+    // 删除并回调包，然后更新_next_seq_out
+    void popIterator(typename std::map<SEQ, T>::iterator it) {
+        auto seq = it->first;
+        auto data = std::move(it->second);
+        _pkt_cache_map.erase(it);
+        _next_seq_out = seq + 1;
+        _cb(seq, data);
+    }
+
+    void tryPopPacket() {
+        int count = 0;
+        while ((!_pkt_cache_map.empty() && _pkt_cache_map.begin()->first == _next_seq_out)) {
+            //找到下个包，直接输出
+            popPacket();
+            ++count;
+        }
+
+        if (count) {
+            setSortSize();
+        } else if (_pkt_cache_map.size() > _max_sort_size) {
+            //排序缓存溢出，不再继续排序
+            popPacket();
+            setSortSize();
+        }
+    }
+
+    void setSortSize() {
+        _max_sort_size = kMin + _pkt_cache_map.size();
+        if (_max_sort_size > kMax) {
+            _max_sort_size = kMax;
+        }
+    }
+
+private:
+    //第一个包是已经进入
+    bool _is_inited = false;
+
+    //下次应该输出的SEQ
+    SEQ _next_seq_out = 0;
+    //seq回环次数计数
+    size_t _seq_cycle_count = 0;
+    //排序缓存长度
+    size_t _max_sort_size = kMin;
+    //pkt排序缓存，根据seq排序
+    std::map<SEQ, T> _pkt_cache_map;
+    //回调
+    SortCallback _cb;
+};
+
+using Packet = std::shared_ptr<uint64_t>;
+
+struct Trace {
+    string name;
+    vector<uint16_t> seqs;
+    vector<Packet> packets;
+};
+
+// 生成rtp seq序列，loss_percent为丢包率，reorder为乱序窗口大小
+static Trace makeTrace(const string &name, size_t count, int loss_percent, int reorder) {
+    Trace trace;
+    trace.name = name;
+    mt19937 rng(0);
+    uint16_t seq = rng();
+    for (size_t i = 0; i < count; ++i, ++seq) {
+        if ((int) (rng() % 100) < loss_percent) {
+            continue;
+        }
+        trace.seqs.push_back(seq);
+    }
+    for (size_t i = 0; reorder > 1 && i < trace.seqs.size(); i += reorder) {
+        auto end = min(trace.seqs.size(), i + reorder);
+        shuffle(trace.seqs.begin() + i, trace.seqs.begin() + end, rng);
+    }
+    for (auto seq : trace.seqs) {
+        trace.packets.emplace_back(std::make_shared<uint64_t>(seq));
+    }
+    return trace;
+}
+
+template<typename Sortor>
+static void runBench(const string &tag, const Trace &trace, int round) {
+    size_t output = 0;
+    Ticker ticker;
+    for (int i = 0; i < round; ++i) {
+        Sortor sortor;
+        sortor.setOnSort([&](uint16_t seq, Packet &packet) { ++output; });
+        for (size_t j = 0; j < trace.seqs.size(); ++j) {
+            sortor.sortPacket(trace.seqs[j], trace.packets[j]);
+        }
+        sortor.flush();
+    }
+    auto elapsed_us = ticker.elapsedTimeUS();
+    auto total = trace.seqs.size() * round;
+    cout << trace.name << " " << tag
+         << " 输入包数:" << total
+         << " 输出包数:" << output
+         << " 耗时(ms):" << elapsed_us / 1000
+         << " 每包耗时(ns):" << (total ? elapsed_us * 1000 / total : 0) << endl;
+}
+
+//此程序用于对比rtp排序器新旧实现的性能
+//用法: test_bench_sortor [每轮包数] [轮数]
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int round = argc > 2 ? atoi(argv[2]) : 10;
+
+    vector<Trace> traces;
+    //顺序
+    traces.emplace_back(makeTrace("顺序", count, 0, 0));
+    //少量丢包与乱序
+    traces.emplace_back(makeTrace("少量丢包乱序", count, 1, 4));
+    //大量乱序
+    traces.emplace_back(makeTrace("大量乱序", count, 5, 32));
+
+    for (auto &trace : traces) {
+        runBench<MapPacketSortor<Packet>>("map", trace, round);
+        runBench<PacketSortor<Packet>>("ring", trace, round);
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "Extension/StartCode.h"
+
+using namespace std;
+using namespace mediakit;
+
+//原先splitH264使用的逐字节查找
+static const char *memfind(const char *buf, ssize_t len, const char *subbuf, ssize_t sublen) {
+    for (auto i = 0; i < len - sublen; ++i) {
+        if (memcmp(buf + i, subbuf, sublen) == 0) {
+            return buf + i;
+        }
+    }
+    return NULL;
+}
+
+static const char *findStartCodeMemfind(const char *ptr, size_t len) {
+    //memfind不会检查最后一个位置，补上1个字节使结果一致
+    return memfind(ptr, len + 1, "\x00\x00\x01", 3);
+}
+
+static const char *findStartCodeNaive(const char *ptr, size_t len) {
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        if (ptr[i] == 0 && ptr[i + 1] == 0 && ptr[i + 2] == 1) {
+            return ptr + i;
+        }
+    }
+    return nullptr;
+}
+
+//生成类似4K I帧的annexb数据：若干个slice，内容随机并且经过防竞争处理(不含0x00 00 0x)
+static string makeFrame(size_t frame_size, size_t slice_count, mt19937 &rng) {
+    string ret;
+    ret.reserve(frame_size + 64);
+    auto slice_size = frame_size / slice_count;
+    for (size_t i = 0; i < slice_count; ++i) {
+        ret.append("\x00\x00\x00\x01", 4);
+        ret.push_back(0x65);
+        size_t zeros = 0;
+        for (size_t j = 0; j < slice_size; ++j) {
+            //码流中0字节占比较高
+            uint8_t byte = rng() % 4 == 0 ? 0 : rng() & 0xFF;
+            if (zeros >= 2 && byte <= 3) {
+                //插入防竞争字节
+                ret.push_back(0x03);
+                zeros = 0;
+            }
+            ret.push_back(byte);
+            zeros = byte ? 0 : zeros + 1;
+        }
+        if (zeros) {
+            ret.push_back(0x80);
+        }
+    }
+    return ret;
+}
+
+static vector<string> loadFrames(const char *file) {
+    //读取annexb格式的h264/h265文件，每个起始码之间为一个nalu，按4MB分块测试
+    ifstream ifs(file, ios::binary);
+    string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    vector<string> ret;
+    for (size_t pos = 0; pos < data.size(); pos += 4 * 1024 * 1024) {
+        ret.emplace_back(data.substr(pos, 4 * 1024 * 1024));
+    }
+    return ret;
+}
+
+using Finder = const char *(*)(const char *, size_t);
+
+static size_t scanAll(Finder finder, const string &frame) {
+    size_t count = 0;
+    auto ptr = frame.data();
+    auto end = ptr + frame.size();
+    while (ptr < end) {
+        auto pos = finder(ptr, end - ptr);
+        if (!pos) {
+            break;
+        }
+        ++count;
+        ptr = pos + 3;
+    }
+    return count;
+}
+
+static bool checkCorrect(mt19937 &rng) {
+    //随机数据与边界情况，与最简单的实现对比结果
+    for (int round = 0; round < 20000; ++round) {
+        string data(rng() % 300, '\0');
+        for (auto &ch : data) {
+            auto r = rng() % 8;
+            ch = r < 4 ? 0 : (r < 6 ? 1 : (char) rng());
+        }
+        for (size_t offset = 0; offset < min(data.size(), (size_t) 8); ++offset) {
+            auto ptr = data.data() + offset;
+            auto len = data.size() - offset;
+            if (findStartCode(ptr, len) != findStartCodeNaive(ptr, len) ||
+                findStartCodeScalar(ptr, len) != findStartCodeNaive(ptr, len)) {
+                cout << "结果不一致, round:" << round << " offset:" << offset << " len:" << len << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//此程序用于h264/h265起始码查找的性能测试
+//用法: test_bench_startcode [annexb文件路径] [循环次数]
+//不指定文件时生成类似4K I帧(约1MB，8个slice)的数据
+int main(int argc, char *argv[]) {
+    mt19937 rng(0);
+    if (!checkCorrect(rng)) {
+        return -1;
+    }
+
+    vector<string> frames;
+    if (argc > 1 && strcmp(argv[1], "-")) {
+        frames = loadFrames(argv[1]);
+    } else {
+        for (int i = 0; i < 8; ++i) {
+            frames.emplace_back(makeFrame(1024 * 1024, 8, rng));
+        }
+    }
+    int loops = argc > 2 ? atoi(argv[2]) : 100;
+
+    size_t total_bytes = 0;
+    for (auto &frame : frames) {
+        total_bytes += frame.size();
+    }
+    cout << "当前实现:" << getStartCodeFinderName() << " 数据量(字节):" << total_bytes << " 循环次数:" << loops << endl;
+
+    struct {
+        const char *name;
+        Finder finder;
+    } finders[] = {
+        { "memfind", findStartCodeMemfind },
+        { "scalar", findStartCodeScalar },
+        { getStartCodeFinderName(), findStartCode },
+    };
+
+    size_t expect = 0;
+    for (auto &item : finders) {
+        size_t count = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < loops; ++i) {
+            for (auto &frame : frames) {
+                count += scanAll(item.finder, frame);
+            }
+        }
+        auto elapsed_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        if (!expect) {
+            expect = count;
+        } else if (expect != count) {
+            cout << item.name << " 查找结果不一致:" << count << " != " << expect << endl;
+            return -1;
+        }
+        cout << item.name << " 耗时(ms):" << elapsed_us / 1000
+             << " 吞吐量(MB/s):" << (elapsed_us ? total_bytes * loops / elapsed_us : 0)
+             << " 起始码个数:" << count / loops << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,601 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+#include "json/json.h"
+#include "Util/CMD.h"
+#include "Util/util.h"
+#include "Util/logger.h"
+#include "Util/TimeTicker.h"
+#include "Network/TcpServer.h"
+#include "Common/config.h"
+#include "Common/Device.h"
+#include "Rtsp/RtspSession.h"
+#include "Rtmp/RtmpSession.h"
+#include "Http/HttpSession.h"
+#include "Http/HttpClientImp.h"
+#include "Player/MediaPlayer.h"
+#include "Thread/WorkThreadPool.h"
+
+using namespace std;
+using namespace toolkit;
+using namespace mediakit;
+
+#define BENCH_APP "bench"
+
+//合成的1280x720@25fps baseline sps与pps
+static const unsigned char s_sps[] = { 0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1F, 0xDA, 0x01, 0x40, 0x16, 0xE8,
+                                       0x40, 0x00, 0x00, 0x03, 0x00, 0x40, 0x00, 0x00, 0x0C, 0xA1 };
+static const unsigned char s_pps[] = { 0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x3C, 0x80 };
+static constexpr int kVideoFps = 25;
+static constexpr int kAudioSampleRate = 44100;
+static constexpr int kAudioSamplesPerFrame = 1024;
+
+//每帧视频负载中嵌入的时间戳标记: "ZLMB" + 16位十六进制微秒时间戳，全部为可见字符，不会产生起始码
+static const char s_marker[] = "ZLMB";
+static constexpr size_t kMarkerTagSize = 4;
+static constexpr size_t kMarkerSize = kMarkerTagSize + 16;
+
+class CMD_main : public CMD {
+public:
+    CMD_main() {
+        _parser.reset(new OptionParser(nullptr));
+        (*_parser) << Option('l', "level", Option::ArgRequired, to_string(LWarn).data(), false, "日志等级,LTrace~LError(0~4)", nullptr);
+        (*_parser) << Option('t', "threads", Option::ArgRequired, to_string(thread::hardware_concurrency()).data(), false, "启动事件触发线程数", nullptr);
+        (*_parser) << Option('s', "streams", Option::ArgRequired, "1", false, "合成推流个数", nullptr);
+        (*_parser) << Option('c', "count", Option::ArgRequired, "100", false, "每种协议的播放器个数，平均分配到各个流", nullptr);
+        (*_parser) << Option('p', "protocols", Option::ArgRequired, "rtsp_tcp,rtsp_udp,rtmp,http_flv,hls,webrtc,srt", false,
+                             "测试的播放协议，逗号分隔", nullptr);
+        (*_parser) << Option('b', "bitrate", Option::ArgRequired, "2048", false, "合成视频码率,单位kbps", nullptr);
+        (*_parser) << Option('g', "gop", Option::ArgRequired, "2", false, "合成视频gop时长,单位秒", nullptr);
+        (*_parser) << Option('w', "warmup", Option::ArgRequired, "5", false, "播放器全部启动后到开始统计的预热时长,单位秒", nullptr);
+        (*_parser) << Option('d', "duration", Option::ArgRequired, "15", false, "每项统计时长,单位秒", nullptr);
+        (*_parser) << Option('D', "delay", Option::ArgRequired, "5", false, "启动播放器间隔,单位毫秒", nullptr);
+        (*_parser) << Option('o', "out", Option::ArgRequired, "", false, "json报告输出文件，为空时打印到标准输出", nullptr);
+    }
+
+    ~CMD_main() override {}
+
+    const char *description() const override {
+        return "主程序命令参数";
+    }
+};
+
+/**
+ * 在进程内合成h264/aac直播流
+ * 视频帧负载为填充数据，仅在nal头之后嵌入生成时刻的时间戳，供播放端计算端到端延时
+ */
+class BenchPublisher : public std::enable_shared_from_this<BenchPublisher> {
+public:
+    using Ptr = std::shared_ptr<BenchPublisher>;
+
+    BenchPublisher(const string &stream, int bitrate_kbps, int gop_sec) {
+        ProtocolOption option;
+        option.enable_mp4 = false;
+        _channel = std::make_shared<DevChannel>(DEFAULT_VHOST, BENCH_APP, stream, 0, option);
+        VideoInfo video;
+        video.codecId = CodecH264;
+        video.iWidth = 1280;
+        video.iHeight = 720;
+        video.iFrameRate = kVideoFps;
+        video.iBitRate = bitrate_kbps * 1024;
+        _channel->initVideo(video);
+
+        AudioInfo audio;
+        audio.codecId = CodecAAC;
+        audio.iChannel = 2;
+        audio.iSampleBit = 16;
+        audio.iSampleRate = kAudioSampleRate;
+        _channel->initAudio(audio);
+        _channel->addTrackCompleted();
+
+        _gop_frames = MAX(1, gop_sec * kVideoFps);
+        _frame_size = MAX(kMarkerSize + 16, (size_t)bitrate_kbps * 1024 / 8 / kVideoFps);
+        _poller = EventPollerPool::Instance().getPoller();
+    }
+
+    void start() {
+        weak_ptr<BenchPublisher> weak_self = shared_from_this();
+        _poller->doDelayTask(1000 / kVideoFps, [weak_self]() -> uint64_t {
+            auto strong_self = weak_self.lock();
+            if (!strong_self) {
+                return 0;
+            }
+            strong_self->inputVideo();
+            return 1000 / kVideoFps;
+        });
+        _poller->doDelayTask(1000 * kAudioSamplesPerFrame / kAudioSampleRate, [weak_self]() -> uint64_t {
+            auto strong_self = weak_self.lock();
+            if (!strong_self) {
+                return 0;
+            }
+            strong_self->inputAudio();
+            return 1000 * kAudioSamplesPerFrame / kAudioSampleRate;
+        });
+    }
+
+private:
+    void inputVideo() {
+        auto stamp = _ticker.elapsedTime();
+        bool key = _video_index++ % _gop_frames == 0;
+        if (key) {
+            _channel->inputH264((char *)s_sps, sizeof(s_sps), stamp);
+            _channel->inputH264((char *)s_pps, sizeof(s_pps), stamp);
+        }
+        //关键帧大小按4个普通帧计算
+        string frame(key ? 4 * _frame_size : _frame_size, (char)0xAA);
+        frame[0] = frame[1] = frame[2] = 0;
+        frame[3] = 1;
+        frame[4] = key ? 0x65 : 0x41;
+        //first_mb_in_slice为0，代表新的一帧
+        frame[5] = (char)0x88;
+        char marker[kMarkerSize + 1];
+        snprintf(marker, sizeof(marker), "%s%016llx", s_marker, (unsigned long long)getCurrentMicrosecond());
+        frame.replace(6, kMarkerSize, marker, kMarkerSize);
+        _channel->inputH264(frame.data(), frame.size(), stamp);
+    }
+
+    void inputAudio() {
+        //aac lc 44100hz 双声道，负载为填充数据
+        static constexpr size_t kAudioFrameSize = 300;
+        char adts[kAudioFrameSize];
+        memset(adts, 0x11, sizeof(adts));
+        adts[0] = (char)0xFF;
+        adts[1] = (char)0xF1;
+        adts[2] = (char)(((2 - 1) << 6) | (4 << 2) | (2 >> 2));
+        adts[3] = (char)(((2 & 0x03) << 6) | ((kAudioFrameSize >> 11) & 0x03));
+        adts[4] = (char)((kAudioFrameSize >> 3) & 0xFF);
+        adts[5] = (char)(((kAudioFrameSize & 0x07) << 5) | 0x1F);
+        adts[6] = (char)0xFC;
+        _channel->inputAAC(adts + ADTS_HEADER_LEN, sizeof(adts) - ADTS_HEADER_LEN, _ticker.elapsedTime(), adts);
+    }
+
+private:
+    int _gop_frames;
+    size_t _frame_size;
+    size_t _video_index = 0;
+    Ticker _ticker;
+    DevChannel::Ptr _channel;
+    EventPoller::Ptr _poller;
+};
+
+/**
+ * 端到端延时采样
+ */
+class LatencyRecorder {
+public:
+    using Ptr = std::shared_ptr<LatencyRecorder>;
+
+    //在数据中查找时间戳标记并记录延时
+    void scan(const char *data, size_t size) {
+        auto now = getCurrentMicrosecond();
+        auto end = data + size;
+        auto ptr = data;
+        while (true) {
+            ptr = std::search(ptr, end, s_marker, s_marker + kMarkerTagSize);
+            if (end - ptr < (ssize_t)kMarkerSize) {
+                break;
+            }
+            auto stamp = strtoull(string(ptr + kMarkerTagSize, kMarkerSize - kMarkerTagSize).data(), nullptr, 16);
+            if (stamp && stamp <= now) {
+                lock_guard<mutex> lck(_mtx);
+                _samples.emplace_back(now - stamp);
+            }
+            ptr += kMarkerSize;
+        }
+    }
+
+    void clear() {
+        lock_guard<mutex> lck(_mtx);
+        _samples.clear();
+    }
+
+    Json::Value dump() {
+        decltype(_samples) samples;
+        {
+            lock_guard<mutex> lck(_mtx);
+            samples = _samples;
+        }
+        Json::Value ret;
+        ret["samples"] = (Json::UInt64)samples.size();
+        if (samples.empty()) {
+            return ret;
+        }
+        sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) {
+            return samples[MIN(samples.size() - 1, (size_t)(p * samples.size()))] / 1000.0;
+        };
+        ret["p50"] = percentile(0.50);
+        ret["p90"] = percentile(0.90);
+        ret["p99"] = percentile(0.99);
+        ret["max"] = samples.back() / 1000.0;
+        return ret;
+    }
+
+private:
+    mutex _mtx;
+    vector<uint64_t> _samples;
+};
+
+/**
+ * http-flv播放器，MediaPlayer不支持http-flv，这里只统计字节与延时，不解析flv
+ * 为了防止时间戳标记被tcp分包切断，保留上次数据尾部kMarkerSize-1个字节
+ */
+class FlvBenchClient : public HttpClientImp {
+public:
+    using Ptr = std::shared_ptr<FlvBenchClient>;
+
+    FlvBenchClient(const EventPoller::Ptr &poller, LatencyRecorder::Ptr recorder) {
+        setPoller(poller);
+        _recorder = std::move(recorder);
+    }
+
+    void setOnShutdown(function<void(const SockException &ex)> cb) {
+        _on_shutdown = std::move(cb);
+    }
+
+protected:
+    void onResponseHeader(const string &status, const HttpHeader &headers) override {
+        if (status != "200") {
+            throw invalid_argument("bad http status code:" + status);
+        }
+    }
+
+    void onResponseBody(const char *buf, size_t size) override {
+        if (!_recorder) {
+            return;
+        }
+        _tail.append(buf, size);
+        _recorder->scan(_tail.data(), _tail.size());
+        _tail.erase(0, _tail.size() - MIN(_tail.size(), kMarkerSize - 1));
+    }
+
+    void onResponseCompleted(const SockException &ex) override {
+        if (_on_shutdown) {
+            _on_shutdown(ex);
+        }
+    }
+
+private:
+    string _tail;
+    LatencyRecorder::Ptr _recorder;
+    function<void(const SockException &ex)> _on_shutdown;
+};
+
+/**
+ * 存活播放器集合，播放失败或中断时移除
+ * 播放器回调以弱引用方式访问本对象，本轮测试结束后迟到的回调不会误删下一轮的播放器
+ */
+class PlayerMap {
+public:
+    using Ptr = std::shared_ptr<PlayerMap>;
+
+    void add(std::shared_ptr<void> player) {
+        lock_guard<mutex> lck(_mtx);
+        _players.emplace(player.get(), std::move(player));
+    }
+
+    void remove(void *tag) {
+        //在锁外析构播放器
+        std::shared_ptr<void> player;
+        lock_guard<mutex> lck(_mtx);
+        auto it = _players.find(tag);
+        if (it != _players.end()) {
+            player = std::move(it->second);
+            _players.erase(it);
+        }
+    }
+
+    size_t size() {
+        lock_guard<mutex> lck(_mtx);
+        return _players.size();
+    }
+
+    void clear() {
+        decltype(_players) players;
+        lock_guard<mutex> lck(_mtx);
+        players.swap(_players);
+    }
+
+    static function<void(const SockException &ex)> getRemover(const PlayerMap::Ptr &map, void *tag) {
+        weak_ptr<PlayerMap> weak_map = map;
+        return [weak_map, tag](const SockException &ex) {
+            if (auto strong_map = weak_map.lock()) {
+                strong_map->remove(tag);
+            }
+        };
+    }
+
+private:
+    mutex _mtx;
+    unordered_map<void *, std::shared_ptr<void> > _players;
+};
+
+class ProtocolInfo {
+public:
+    string name;
+    //统计服务器发送字节数使用的MediaSource类型，为空时不统计
+    string schema;
+    //url前缀，不包含流id
+    string url_prefix;
+    string url_suffix;
+    int rtp_type = Rtsp::RTP_TCP;
+    bool flv = false;
+    //不支持的原因，为空时支持
+    string unsupported;
+};
+
+class Sample {
+public:
+    uint64_t wall_us = 0;
+    uint64_t cpu_us = 0;
+    uint64_t rss_kb = 0;
+    uint64_t egress = 0;
+};
+
+#if defined(_WIN32)
+//windows下暂不统计cpu与内存
+static uint64_t getCpuMicrosecond() { return 0; }
+static uint64_t getRssKB() { return 0; }
+#else
+static uint64_t getCpuMicrosecond() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static uint64_t getRssKB() {
+    ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (statm >> size >> resident) {
+        return resident * sysconf(_SC_PAGESIZE) / 1024;
+    }
+    //非linux系统使用峰值内存
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+#endif
+
+static uint64_t getEgressBytes(const string &schema) {
+    uint64_t ret = 0;
+    if (!schema.empty()) {
+        MediaSource::for_each_media([&](const MediaSource::Ptr &src) { ret += src->getEgressCounter()->value(); }, schema, DEFAULT_VHOST, BENCH_APP);
+    }
+    return ret;
+}
+
+static Sample takeSample(const string &schema) {
+    Sample ret;
+    ret.wall_us = getCurrentMicrosecond();
+    ret.cpu_us = getCpuMicrosecond();
+    ret.rss_kb = getRssKB();
+    ret.egress = getEgressBytes(schema);
+    return ret;
+}
+
+static string getStreamId(size_t index) {
+    return "stream_" + to_string(index);
+}
+
+//此程序用于回归性能测试
+//进程内启动rtsp/rtmp/http服务器，合成若干路h264/aac直播流，依次对每种协议挂载指定个数的回环播放器，
+//统计cpu占用、单路流内存、单个播放器的cpu与带宽开销以及端到端延时分布，结果以json格式输出。
+//注意: 播放器与服务器在同一进程，cpu统计包含播放器开销(播放器使用性能测试模式，不解复用)，
+//每种协议额外有一个解复用的探测播放器用于采样延时
+int main(int argc, char *argv[]) {
+    CMD_main cmd_main;
+    try {
+        cmd_main.operator()(argc, argv);
+    } catch (ExitException &) {
+        return 0;
+    } catch (std::exception &ex) {
+        cout << ex.what() << endl;
+        return -1;
+    }
+
+    int threads = cmd_main["threads"];
+    LogLevel log_level = (LogLevel)cmd_main["level"].as<int>();
+    log_level = MIN(MAX(log_level, LTrace), LError);
+    auto stream_count = MAX(1, cmd_main["streams"].as<int>());
+    auto player_count = cmd_main["count"].as<int>();
+    auto bitrate = cmd_main["bitrate"].as<int>();
+    auto gop = cmd_main["gop"].as<int>();
+    auto warmup_sec = cmd_main["warmup"].as<int>();
+    auto duration_sec = MAX(1, cmd_main["duration"].as<int>());
+    auto delay_ms = cmd_main["delay"].as<int>();
+    auto out_file = cmd_main["out"];
+
+    Logger::Instance().add(std::make_shared<ConsoleChannel>("ConsoleChannel", log_level));
+    Logger::Instance().setWriter(std::make_shared<AsyncLogWriter>());
+    EventPollerPool::setPoolSize(threads);
+    WorkThreadPool::setPoolSize(threads);
+
+    //只监听回环网卡，端口随机分配
+    TcpServer::Ptr rtsp_srv(new TcpServer());
+    TcpServer::Ptr rtmp_srv(new TcpServer());
+    TcpServer::Ptr http_srv(new TcpServer());
+    rtsp_srv->start<RtspSession>(0, "127.0.0.1");
+    rtmp_srv->start<RtmpSession>(0, "127.0.0.1");
+    http_srv->start<HttpSession>(0, "127.0.0.1");
+
+    auto rtsp_url = "rtsp://127.0.0.1:" + to_string(rtsp_srv->getPort()) + "/" BENCH_APP "/";
+    auto rtmp_url = "rtmp://127.0.0.1:" + to_string(rtmp_srv->getPort()) + "/" BENCH_APP "/";
+    auto http_url = "http://127.0.0.1:" + to_string(http_srv->getPort()) + "/" BENCH_APP "/";
+
+    vector<ProtocolInfo> all_protocols(7);
+    all_protocols[0].name = "rtsp_tcp";
+    all_protocols[0].schema = RTSP_SCHEMA;
+    all_protocols[0].url_prefix = rtsp_url;
+    all_protocols[1].name = "rtsp_udp";
+    all_protocols[1].schema = RTSP_SCHEMA;
+    all_protocols[1].url_prefix = rtsp_url;
+    all_protocols[1].rtp_type = Rtsp::RTP_UDP;
+    all_protocols[2].name = "rtmp";
+    all_protocols[2].schema = RTMP_SCHEMA;
+    all_protocols[2].url_prefix = rtmp_url;
+    all_protocols[3].name = "http_flv";
+    all_protocols[3].schema = RTMP_SCHEMA;
+    all_protocols[3].url_prefix = http_url;
+    all_protocols[3].url_suffix = ".live.flv";
+    all_protocols[3].flv = true;
+    //hls切片由http文件服务发送，未统计服务器发送字节数
+    all_protocols[4].name = "hls";
+    all_protocols[4].url_prefix = http_url;
+    all_protocols[4].url_suffix = "/hls.m3u8";
+    all_protocols[5].name = "webrtc";
+    all_protocols[5].unsupported = "no webrtc player client available";
+    all_protocols[6].name = "srt";
+    all_protocols[6].unsupported = "no srt player client available";
+
+    Json::Value report;
+    report["config"]["threads"] = threads;
+    report["config"]["cpu_cores"] = thread::hardware_concurrency();
+    report["config"]["streams"] = stream_count;
+    report["config"]["players_per_protocol"] = player_count;
+    report["config"]["bitrate_kbps"] = bitrate;
+    report["config"]["gop_sec"] = gop;
+    report["config"]["warmup_sec"] = warmup_sec;
+    report["config"]["duration_sec"] = duration_sec;
+
+    auto cpu_cores = [](const Sample &start, const Sample &end) {
+        return (double)(end.cpu_us - start.cpu_us) / MAX(1, end.wall_us - start.wall_us);
+    };
+
+    //合成推流，统计无人观看时的开销
+    auto rss_before_publish = getRssKB();
+    vector<BenchPublisher::Ptr> publishers;
+    for (auto i = 0; i < stream_count; ++i) {
+        auto publisher = std::make_shared<BenchPublisher>(getStreamId(i), bitrate, gop);
+        publisher->start();
+        publishers.emplace_back(std::move(publisher));
+    }
+    sleep(warmup_sec);
+    auto idle_start = takeSample("");
+    sleep(duration_sec);
+    auto idle_end = takeSample("");
+    auto idle_cpu_cores = cpu_cores(idle_start, idle_end);
+    report["idle"]["cpu_cores"] = idle_cpu_cores;
+    report["idle"]["cpu_percent_per_core"] = idle_cpu_cores * 100 / thread::hardware_concurrency();
+    report["idle"]["rss_kb"] = (Json::UInt64)idle_end.rss_kb;
+    report["idle"]["rss_per_stream_kb"] = (Json::Int64)(idle_end.rss_kb - rss_before_publish) / stream_count;
+
+    auto selected = split(cmd_main["protocols"], ",");
+    for (auto &protocol : all_protocols) {
+        if (find(selected.begin(), selected.end(), protocol.name) == selected.end()) {
+            continue;
+        }
+        auto &item = report["protocols"][protocol.name];
+        if (!protocol.unsupported.empty()) {
+            item["supported"] = false;
+            item["reason"] = protocol.unsupported;
+            continue;
+        }
+        item["supported"] = true;
+
+        auto player_map = std::make_shared<PlayerMap>();
+        auto recorder = std::make_shared<LatencyRecorder>();
+
+        //每路流第一个播放器为探测播放器，负责采样延时
+        auto add_player = [&](size_t index) {
+            auto url = protocol.url_prefix + getStreamId(index % stream_count) + protocol.url_suffix;
+            auto probe = index < (size_t)stream_count;
+            std::shared_ptr<void> holder;
+            if (protocol.flv) {
+                auto client = std::make_shared<FlvBenchClient>(EventPollerPool::Instance().getPoller(), probe ? recorder : nullptr);
+                client->setOnShutdown(PlayerMap::getRemover(player_map, client.get()));
+                client->sendRequest(url);
+                holder = std::move(client);
+            } else {
+                auto player = std::make_shared<MediaPlayer>();
+                auto remover = PlayerMap::getRemover(player_map, player.get());
+                weak_ptr<MediaPlayer> weak_player = player;
+                player->setOnCreateSocket([](const EventPoller::Ptr &poller) { return std::make_shared<Socket>(poller, false); });
+                player->setOnPlayResult([remover, weak_player, probe, recorder](const SockException &ex) {
+                    if (ex) {
+                        remover(ex);
+                        return;
+                    }
+                    auto strong_player = weak_player.lock();
+                    if (!probe || !strong_player) {
+                        return;
+                    }
+                    for (auto &track : strong_player->getTracks(false)) {
+                        if (track->getTrackType() == TrackVideo) {
+                            track->addDelegate([recorder](const Frame::Ptr &frame) {
+                                recorder->scan(frame->data(), frame->size());
+                                return true;
+                            });
+                        }
+                    }
+                });
+                player->setOnShutdown(remover);
+                (*player)[Client::kBenchmarkMode] = !probe;
+                (*player)[Client::kWaitTrackReady] = probe;
+                (*player)[Client::kRtpType] = protocol.rtp_type;
+                player->play(url);
+                holder = std::move(player);
+            }
+            player_map->add(std::move(holder));
+        };
+
+        auto rss_before_play = getRssKB();
+        auto total = player_count + stream_count;
+        for (auto i = 0; i < total; ++i) {
+            add_player(i);
+            if (delay_ms > 0) {
+                usleep(1000 * delay_ms);
+            }
+        }
+        sleep(warmup_sec);
+
+        recorder->clear();
+        auto start = takeSample(protocol.schema);
+        sleep(duration_sec);
+        auto end = takeSample(protocol.schema);
+
+        auto alive = player_map->size();
+        auto cores = cpu_cores(start, end);
+        auto wall_sec = (end.wall_us - start.wall_us) / 1000000.0;
+        item["players"] = total;
+        item["alive"] = (Json::UInt64)alive;
+        item["cpu_cores"] = cores;
+        item["cpu_percent_per_core"] = cores * 100 / thread::hardware_concurrency();
+        item["rss_kb"] = (Json::UInt64)end.rss_kb;
+        item["rss_per_player_kb"] = (Json::Int64)(end.rss_kb - rss_before_play) / MAX(1, (int)alive);
+        //扣除无人观看时的推流开销后，平摊到每个播放器上的cpu时间(微秒/秒)
+        item["cpu_us_per_player_sec"] = MAX(0.0, cores - idle_cpu_cores) * 1000000 / MAX(1, (int)alive);
+        if (protocol.schema.empty()) {
+            item["egress_bytes_per_player_sec"] = Json::nullValue;
+        } else {
+            item["egress_bytes_per_player_sec"] = (end.egress - start.egress) / wall_sec / MAX(1, (int)alive);
+        }
+        item["latency_ms"] = recorder->dump();
+
+        player_map->clear();
+        //等待服务器端会话全部断开
+        sleep(2);
+    }
+    publishers.clear();
+
+    auto json = report.toStyledString();
+    if (out_file.empty()) {
+        cout << json << endl;
+    } else {
+        ofstream(out_file) << json;
+    }
+    return 0;
+}
@@ -9,8 +9,12 @@
  */
 
 #include <map>
+#include <set>
 #include <list>
+#include <vector>
+#include <random>
 #include <iostream>
+#include <algorithm>
 #include <functional>
 #include "Rtsp/RtpReceiver.h"
 
@@ -271,6 +275,134 @@ void test_rand(){
 #endif
 }
 
+//模拟乱序(乱序距离小于kMin)、丢包、重复和回环，校验输出与输入一一对应且有序
+bool test_fuzz(uint32_t seed, size_t count, int loss_percent, int dup_percent, int reorder) {
+    mt19937 rng(seed);
+    //用64位的序号模拟无回环的seq，低16位即为rtp seq
+    uint64_t start = rng() % 0x10000;
+    vector<uint64_t> ext_list;
+    for (uint64_t i = start; i < start + count; ++i) {
+        if ((int) (rng() % 100) < loss_percent) {
+            //丢包
+            continue;
+        }
+        ext_list.push_back(i);
+        if ((int) (rng() % 100) < dup_percent) {
+            //重复包
+            ext_list.push_back(i);
+        }
+    }
+    //在reorder大小的窗口内打乱顺序
+    for (size_t i = 0; reorder > 1 && i < ext_list.size(); i += reorder) {
+        auto end = min(ext_list.size(), i + reorder);
+        shuffle(ext_list.begin() + i, ext_list.begin() + end, rng);
+    }
+
+    //第一个包确定起始seq，比它小的包都会被丢弃
+    auto first = ext_list.front();
+    set<uint64_t> expected;
+    for (auto ext : ext_list) {
+        if (ext >= first) {
+            expected.emplace(ext);
+        }
+    }
+
+    PacketSortor<uint64_t, uint16_t> sortor;
+    vector<uint64_t> sorted_list;
+    bool ok = true;
+    sortor.setOnSort([&](uint16_t seq, const uint64_t &packet) {
+        if (seq != (uint16_t) packet) {
+            ok = false;
+        }
+        sorted_list.push_back(packet);
+    });
+    for (auto ext : ext_list) {
+        sortor.sortPacket((uint16_t) ext, ext);
+    }
+    sortor.flush();
+
+    ok = ok && sortor.getJitterSize() == 0;
+    ok = ok && sorted_list.size() == expected.size() && equal(sorted_list.begin(), sorted_list.end(), expected.begin());
+    //回环次数等于输出seq跨越0xFFFF的次数
+    ok = ok && sortor.getCycleCount() == (sorted_list.back() >> 16) - (sorted_list.front() >> 16);
+    cout << "seed:" << seed
+         << " 输入数据个数:" << ext_list.size()
+         << " 输出数据个数:" << sorted_list.size()
+         << " 期望个数:" << expected.size()
+         << " 回环次数:" << sortor.getCycleCount()
+         << (ok ? " 成功" : " 失败") << endl;
+    return ok;
+}
+
+//随机seq输入，校验输出seq严格递增(按回环计算)且缓存不超过上限
+bool test_garbage(uint32_t seed, size_t count) {
+    mt19937 rng(seed);
+    PacketSortor<uint16_t, uint16_t> sortor;
+    bool ok = true;
+    bool has_last = false;
+    uint16_t last = 0;
+    size_t output = 0;
+    sortor.setOnSort([&](uint16_t seq, const uint16_t &packet) {
+        //相对上次输出的下一个seq，不能回退
+        uint16_t diff = seq - (uint16_t) (last + 1);
+        if (has_last && diff > 0x7FFF) {
+            ok = false;
+        }
+        has_last = true;
+        last = seq;
+        ++output;
+    });
+    uint16_t base = rng();
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t seq;
+        switch (rng() % 4) {
+            //完全随机
+            case 0: seq = rng(); break;
+            //大跳变
+            case 1: base += rng() % 4096; seq = base; break;
+            //附近的乱序
+            default: seq = base + rng() % 128 - 64; ++base; break;
+        }
+        sortor.sortPacket(seq, seq);
+        if (sortor.getJitterSize() > 1024) {
+            ok = false;
+        }
+    }
+    sortor.flush();
+    cout << "seed:" << seed << " 随机输入个数:" << count << " 输出数据个数:" << output << (ok ? " 成功" : " 失败") << endl;
+    return ok;
+}
+
+//顺序输入中夹杂单个超出排序窗口的异常包，以及真实的seq跳变，校验正常包不会被丢弃
+bool test_jump(uint16_t start) {
+    PacketSortor<uint16_t, uint16_t> sortor;
+    vector<uint16_t> sorted_list;
+    sortor.setOnSort([&](uint16_t seq, const uint16_t &packet) {
+        sorted_list.push_back(seq);
+    });
+    vector<uint16_t> expected;
+    for (uint16_t i = 0; i < 3000; ++i) {
+        uint16_t seq = start + i;
+        if (i == 100 || i == 2000) {
+            //异常包，应该被丢弃
+            sortor.sortPacket(seq + 5000, seq + 5000);
+        }
+        sortor.sortPacket(seq, seq);
+        expected.push_back(seq);
+    }
+    //seq跳变，跳变后的包都应该输出
+    for (uint16_t i = 0; i < 1000; ++i) {
+        uint16_t seq = start + 20000 + i;
+        sortor.sortPacket(seq, seq);
+        expected.push_back(seq);
+    }
+    sortor.flush();
+    bool ok = sorted_list == expected;
+    cout << "start:" << start << " 输出数据个数:" << sorted_list.size() << " 期望个数:" << expected.size()
+         << (ok ? " 成功" : " 失败") << endl;
+    return ok;
+}
+
 //该测试程序用于检验rtp排序算法的正确性
 int main(int argc, char *argv[]) {
     //测试真实的rtp seq
@@ -280,5 +412,21 @@ int main(int argc, char *argv[]) {
     //模拟rtp乱序、回环、丢包、重复情况
     cout << "###### 模拟的rtp seq #####" << endl;
     test_rand();
-    return 0;
+
+    //随机校验排序结果
+    cout << "###### 排序结果校验 #####" << endl;
+    bool ok = true;
+    for (uint32_t seed = 0; seed < 20; ++seed) {
+        //顺序
+        ok = test_fuzz(seed, 100000, 0, 0, 0) && ok;
+        //少量丢包与乱序
+        ok = test_fuzz(seed, 100000, 1, 1, 4) && ok;
+        //大量丢包、重复与乱序
+        ok = test_fuzz(seed, 100000, 10, 10, 16) && ok;
+        ok = test_garbage(seed, 100000) && ok;
+    }
+    ok = test_jump(0) && ok;
+    ok = test_jump(60000) && ok;
+    cout << (ok ? "排序结果校验成功" : "排序结果校验失败") << endl;
+    return ok ? 0 : -1;
 }
\ No newline at end of file
@@ -0,0 +1,230 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <map>
+#include <list>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include "../srt/PacketQueue.hpp"
+
+using namespace std;
+using namespace SRT;
+
+/**
+ * 基于map的参考实现，与PacketRecvQueue的规则(TSBPD、太晚丢弃、太新丢弃、重复包)一致，
+ * 不追求性能，每次操作都遍历全部缓存，用于校验环形缓存的结果
+ */
+class RefRecvQueue {
+public:
+    RefRecvQueue(uint32_t cap, uint32_t init_seq, uint32_t latency, uint32_t flag)
+        : _cap(cap), _latency(latency), _expected_seq(init_seq), _flag(flag) {}
+
+    void inputPacket(const DataPacket::Ptr &pkt, list<DataPacket::Ptr> &out) {
+        if (!_pkts.empty() && getExpectedSize() >= _cap) {
+            popFront(out);
+        }
+        auto diff = getOffset(pkt->packet_seq_number);
+        if (diff < (MAX_SEQ >> 1) && diff < _cap && !_pkts.count(pkt->packet_seq_number)) {
+            _pkts[pkt->packet_seq_number] = pkt;
+        }
+        while (_pkts.count(_expected_seq)) {
+            popFront(out);
+        }
+        bool tlpkt_drop = (_flag & HSExtMessage::HS_EXT_MSG_TLPKTDROP) && (_flag & HSExtMessage::HS_EXT_MSG_TSBPDRCV);
+        while (tlpkt_drop && timeLatency() > _latency) {
+            while (!_pkts.count(_expected_seq)) {
+                _expected_seq = genExpectedSeq(_expected_seq + 1);
+            }
+            popFront(out);
+        }
+    }
+
+    bool drop(uint32_t last, list<DataPacket::Ptr> &out) {
+        auto offset = getOffset(last);
+        if (offset >= (MAX_SEQ >> 1) || offset + 1 > getExpectedSize()) {
+            return false;
+        }
+        for (uint32_t i = 0; i <= offset; ++i) {
+            popFront(out);
+        }
+        return true;
+    }
+
+    void getLostSeq(PacketQueueInterface::LostList &lost) {
+        lost.clear();
+        auto size = getExpectedSize();
+        if (size == _pkts.size()) {
+            return;
+        }
+        bool in_lost = false;
+        for (uint32_t i = 0; i < size; ++i) {
+            auto seq = genExpectedSeq(_expected_seq + i);
+            if (_pkts.count(seq)) {
+                in_lost = false;
+                continue;
+            }
+            if (in_lost) {
+                lost.back().second = genExpectedSeq(seq + 1);
+            } else {
+                lost.emplace_back(seq, genExpectedSeq(seq + 1));
+                in_lost = true;
+            }
+        }
+    }
+
+    uint32_t getExpectedSize() {
+        uint32_t ret = 0;
+        for (auto &pr : _pkts) {
+            ret = max(ret, getOffset(pr.first) + 1);
+        }
+        return ret;
+    }
+
+    uint32_t getExpectedSeq() const { return _expected_seq; }
+    size_t getSize() const { return _pkts.size(); }
+
+private:
+    uint32_t getOffset(uint32_t seq) const { return genExpectedSeq(seq - _expected_seq); }
+
+    void popFront(list<DataPacket::Ptr> &out) {
+        auto it = _pkts.find(_expected_seq);
+        if (it != _pkts.end()) {
+            out.emplace_back(it->second);
+            _pkts.erase(it);
+        }
+        _expected_seq = genExpectedSeq(_expected_seq + 1);
+    }
+
+    DataPacket::Ptr getPacket(bool first) {
+        DataPacket::Ptr ret;
+        uint32_t ret_offset = 0;
+        for (auto &pr : _pkts) {
+            auto offset = getOffset(pr.first);
+            if (!ret || (first ? offset < ret_offset : offset > ret_offset)) {
+                ret = pr.second;
+                ret_offset = offset;
+            }
+        }
+        return ret;
+    }
+
+    uint32_t timeLatency() {
+        if (_pkts.empty()) {
+            return 0;
+        }
+        auto first = getPacket(true)->timestamp;
+        auto last = getPacket(false)->timestamp;
+        uint32_t dur = last > first ? last - first : first - last;
+        if (dur > 0x80000000) {
+            dur = MAX_TS - dur;
+        }
+        return dur;
+    }
+
+private:
+    uint32_t _cap;
+    uint32_t _latency;
+    uint32_t _expected_seq;
+    uint32_t _flag;
+    map<uint32_t, DataPacket::Ptr> _pkts;
+};
+
+static bool sameOutput(const list<DataPacket::Ptr> &a, const list<DataPacket::Ptr> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    return equal(a.begin(), a.end(), b.begin(), [](const DataPacket::Ptr &x, const DataPacket::Ptr &y) {
+        return x->packet_seq_number == y->packet_seq_number;
+    });
+}
+
+/**
+ * 随机生成包含丢包、重传乱序、重复包、太新的包、drop请求以及seq回环的输入，
+ * 逐包比较PacketRecvQueue与参考实现的输出、期望seq、缓存个数与丢包区间
+ */
+bool test_trace(uint32_t seed, int count) {
+    mt19937 rng(seed);
+    uint32_t cap = 100 + rng() % 400;
+    uint32_t latency = 20000 + rng() % 100000;
+    uint32_t flag = (seed % 2) ? 0xbf : 0;
+    //三分之一的用例从seq回环附近开始
+    uint32_t init_seq = (seed % 3 == 0) ? MAX_SEQ - rng() % 1000 : rng() & MAX_SEQ;
+
+    PacketRecvQueue queue(cap, init_seq, latency, flag);
+    RefRecvQueue ref(cap, init_seq, latency, flag);
+    uint32_t seq = init_seq;
+    uint32_t stamp = rng();
+    //丢失后等待重传的seq
+    vector<uint32_t> pending;
+    for (int i = 0; i < count; ++i) {
+        uint32_t pkt_seq;
+        auto kind = rng() % 10;
+        if (kind < 6 || pending.empty()) {
+            //顺序包，10%的概率丢失
+            pkt_seq = seq;
+            seq = genExpectedSeq(seq + 1);
+            stamp += 1000 + rng() % 3000;
+            if (rng() % 10 == 0) {
+                pending.emplace_back(pkt_seq);
+                continue;
+            }
+        } else if (kind < 8) {
+            //重传包
+            auto index = rng() % pending.size();
+            pkt_seq = pending[index];
+            pending.erase(pending.begin() + index);
+        } else if (kind < 9) {
+            //重复包或太晚的包
+            pkt_seq = genExpectedSeq(seq - 1 - rng() % 50);
+        } else {
+            //跳跃的包，可能超出缓存范围
+            pkt_seq = genExpectedSeq(seq + rng() % (2 * cap));
+        }
+        auto back = genExpectedSeq(seq - pkt_seq);
+        auto pkt = std::make_shared<DataPacket>();
+        pkt->packet_seq_number = pkt_seq;
+        pkt->timestamp = stamp - (back < 1000 ? back * 2000 : 0);
+
+        list<DataPacket::Ptr> out, ref_out;
+        queue.inputPacket(pkt, out);
+        ref.inputPacket(pkt, ref_out);
+        bool ok = sameOutput(out, ref_out) && queue.getExpectedSeq() == ref.getExpectedSeq()
+            && queue.getSize() == ref.getSize() && queue.getExpectedSize() == ref.getExpectedSize();
+
+        PacketQueueInterface::LostList lost, ref_lost;
+        queue.getLostSeq(lost);
+        ref.getLostSeq(ref_lost);
+        ok = ok && lost == ref_lost;
+
+        if (ok && i % 97 == 0) {
+            //对端发送的drop请求，可能超出已收到的范围
+            auto last = genExpectedSeq(ref.getExpectedSeq() + rng() % (ref.getExpectedSize() + 5));
+            list<DataPacket::Ptr> drop_out, ref_drop_out;
+            auto ret = queue.drop(0, last, drop_out);
+            ok = ret == ref.drop(last, ref_drop_out) && sameOutput(drop_out, ref_drop_out);
+        }
+        if (!ok) {
+            cout << "srt recv queue mismatch, seed:" << seed << ", packet index:" << i << ", seq:" << pkt_seq << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    bool ok = true;
+    for (uint32_t seed = 0; seed < 200; ++seed) {
+        ok = test_trace(seed, 5000) && ok;
+    }
+    cout << (ok ? "srt接收缓存校验成功" : "srt接收缓存校验失败") << endl;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,361 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "GccEstimator.h"
+#include "Util/util.h"
+#include "Rtcp/RtcpFCI.h"
+#include "Common/config.h"
+#include "Common/Metrics.h"
+
+using namespace std;
+using namespace toolkit;
+
+namespace mediakit {
+
+namespace Rtc {
+#define RTC_FIELD "rtc."
+//发送端带宽估计的最小、初始、最大码率，单位bit/s
+const string kGccMinBitRate = RTC_FIELD "gccMinBitRate";
+const string kGccStartBitRate = RTC_FIELD "gccStartBitRate";
+const string kGccMaxBitRate = RTC_FIELD "gccMaxBitRate";
+static onceToken token([]() {
+    mINI::Instance()[kGccMinBitRate] = 100 * 1000;
+    mINI::Instance()[kGccStartBitRate] = 1000 * 1000;
+    mINI::Instance()[kGccMaxBitRate] = 20 * 1000 * 1000;
+});
+}
+
+//最多保留的发送记录个数
+static constexpr size_t kMaxHistorySize = 8192;
+//同一组包的最大发送间隔
+static constexpr uint64_t kBurstUs = 5 * 1000;
+//趋势线窗口大小与平滑系数、增益
+static constexpr size_t kTrendlineWindowSize = 20;
+static constexpr double kTrendlineSmoothing = 0.9;
+static constexpr double kTrendlineGain = 4.0;
+//自适应阈值调整系数
+static constexpr double kThresholdUp = 0.0087;
+static constexpr double kThresholdDown = 0.039;
+//持续过载多久才判定为过载
+static constexpr double kOverusingTimeMs = 10;
+//过载时码率降至到达码率的比例
+static constexpr double kDecreaseFactor = 0.85;
+//到达码率统计窗口
+static constexpr uint64_t kAckedWindowUs = 500 * 1000;
+//码率增加时的响应时间(估计的rtt + 100ms)
+static constexpr double kResponseTimeMs = 200;
+
+GccEstimator::GccEstimator() {
+    GET_CONFIG(uint32_t, min_bitrate, Rtc::kGccMinBitRate);
+    GET_CONFIG(uint32_t, start_bitrate, Rtc::kGccStartBitRate);
+    GET_CONFIG(uint32_t, max_bitrate, Rtc::kGccMaxBitRate);
+    _min_bitrate = min_bitrate;
+    _max_bitrate = MAX(max_bitrate, min_bitrate);
+    _target_bitrate = MIN(MAX(start_bitrate, _min_bitrate), _max_bitrate);
+    _delay_bitrate = _loss_bitrate = _target_bitrate;
+}
+
+uint16_t GccEstimator::onSendRtp(size_t size, uint64_t now_us) {
+    if (_history.size() >= kMaxHistorySize) {
+        _history.pop_front();
+        ++_history_seq;
+    }
+    _history.emplace_back(SentPacket{now_us, size});
+    return _next_seq++;
+}
+
+void GccEstimator::onTwccFeedback(const FCI_TWCC &fci, size_t fci_size, uint64_t now_us) {
+    static auto &s_feedback = Metrics::Instance().getCounter("zlm_webrtc_twcc_feedback_total", "", "Transport-cc feedback received from webrtc players");
+    s_feedback.add();
+
+    auto status = fci.getPacketChunkList(fci_size);
+    auto seq = fci.getBaseSeq();
+    auto count = fci.getPacketCount();
+    //参考时间单位为64ms，接收时间增量单位为250us
+    int64_t arrival_us = (int64_t)fci.getReferenceTime() * 64 * 1000;
+
+    vector<PacketResult> results;
+    results.reserve(count);
+    size_t lost = 0, total = 0;
+    for (uint16_t i = 0; i < count; ++i, ++seq) {
+        if (_feedback_started && (int16_t)(seq - _feedback_seq) <= 0) {
+            //已经处理过的包
+            auto it = status.find(seq);
+            if (it != status.end() && it->second.first != SymbolStatus::not_received) {
+                arrival_us += it->second.second * 250;
+            }
+            continue;
+        }
+        _feedback_started = true;
+        _feedback_seq = seq;
+
+        auto it = status.find(seq);
+        if (it == status.end() || it->second.first == SymbolStatus::reserved) {
+            continue;
+        }
+        ++total;
+        if (it->second.first == SymbolStatus::not_received) {
+            ++lost;
+            continue;
+        }
+        arrival_us += it->second.second * 250;
+        size_t index = (uint16_t)(seq - _history_seq);
+        if (index >= _history.size()) {
+            //发送记录已经过期
+            continue;
+        }
+        auto &sent = _history[index];
+        results.emplace_back(PacketResult{sent.send_us, (uint64_t)MAX(arrival_us, (int64_t)0), sent.size});
+    }
+
+    updateLossBitrate(lost, total, now_us);
+    onPacketResults(results, now_us);
+    updateTarget();
+}
+
+void GccEstimator::onPacketResults(const vector<PacketResult> &results, uint64_t now_us) {
+    for (auto &pkt : results) {
+        //统计到达码率
+        _acked.emplace_back(pkt.arrival_us, pkt.size);
+        _acked_bytes += pkt.size;
+        while (!_acked.empty() && _acked.back().first - _acked.front().first > kAckedWindowUs) {
+            _acked_bytes -= _acked.front().second;
+            _acked.pop_front();
+        }
+
+        if (!_cur_group.valid) {
+            _cur_group.valid = true;
+            _cur_group.first_send_us = _cur_group.last_send_us = pkt.send_us;
+            _cur_group.arrival_us = pkt.arrival_us;
+            continue;
+        }
+        if (pkt.send_us < _cur_group.first_send_us) {
+            //乱序的包，忽略
+            continue;
+        }
+        if (pkt.send_us - _cur_group.first_send_us <= kBurstUs) {
+            //同一组
+            _cur_group.last_send_us = MAX(_cur_group.last_send_us, pkt.send_us);
+            _cur_group.arrival_us = MAX(_cur_group.arrival_us, pkt.arrival_us);
+            continue;
+        }
+        //新的一组开始，比较前两组的时延变化
+        if (_prev_group.valid) {
+            auto send_delta_ms = ((int64_t)_cur_group.last_send_us - (int64_t)_prev_group.last_send_us) / 1000.0;
+            auto arrival_delta_ms = ((int64_t)_cur_group.arrival_us - (int64_t)_prev_group.arrival_us) / 1000.0;
+            updateTrendline(arrival_delta_ms - send_delta_ms, send_delta_ms, _cur_group.arrival_us / 1000.0);
+        }
+        _prev_group = _cur_group;
+        _cur_group.first_send_us = _cur_group.last_send_us = pkt.send_us;
+        _cur_group.arrival_us = pkt.arrival_us;
+    }
+    updateDelayBitrate(now_us);
+}
+
+static double linearFitSlope(const deque<pair<double, double> > &samples) {
+    double sum_x = 0, sum_y = 0;
+    for (auto &pr : samples) {
+        sum_x += pr.first;
+        sum_y += pr.second;
+    }
+    auto avg_x = sum_x / samples.size();
+    auto avg_y = sum_y / samples.size();
+    double numerator = 0, denominator = 0;
+    for (auto &pr : samples) {
+        numerator += (pr.first - avg_x) * (pr.second - avg_y);
+        denominator += (pr.first - avg_x) * (pr.first - avg_x);
+    }
+    return denominator ? numerator / denominator : 0;
+}
+
+void GccEstimator::updateTrendline(double delay_delta_ms, double send_delta_ms, double arrival_ms) {
+    _num_deltas = MIN(_num_deltas + 1, (size_t)1000);
+    _accumulated_delay += delay_delta_ms;
+    _smoothed_delay = kTrendlineSmoothing * _smoothed_delay + (1 - kTrendlineSmoothing) * _accumulated_delay;
+    if (_first_arrival_ms < 0) {
+        _first_arrival_ms = arrival_ms;
+    }
+    _delay_samples.emplace_back(arrival_ms - _first_arrival_ms, _smoothed_delay);
+    if (_delay_samples.size() > kTrendlineWindowSize) {
+        _delay_samples.pop_front();
+    }
+    auto trend = _prev_trend;
+    if (_delay_samples.size() == kTrendlineWindowSize) {
+        //单向时延随时间变化的斜率，大于0说明链路在排队
+        trend = linearFitSlope(_delay_samples);
+    }
+    detect(trend, send_delta_ms, arrival_ms);
+}
+
+void GccEstimator::detect(double trend, double send_delta_ms, double arrival_ms) {
+    auto modified_trend = MIN(_num_deltas, (size_t)60) * trend * kTrendlineGain;
+    if (modified_trend > _threshold) {
+        if (_time_over_using < 0) {
+            _time_over_using = send_delta_ms / 2;
+        } else {
+            _time_over_using += send_delta_ms;
+        }
+        ++_overuse_counter;
+        if (_time_over_using > kOverusingTimeMs && _overuse_counter > 1 && trend >= _prev_trend) {
+            _time_over_using = 0;
+            _overuse_counter = 0;
+            _usage = BandwidthUsage::overusing;
+        }
+    } else if (modified_trend < -_threshold) {
+        _time_over_using = -1;
+        _overuse_counter = 0;
+        _usage = BandwidthUsage::underusing;
+    } else {
+        _time_over_using = -1;
+        _overuse_counter = 0;
+        _usage = BandwidthUsage::normal;
+    }
+    _prev_trend = trend;
+    updateThreshold(modified_trend, arrival_ms);
+}
+
+void GccEstimator::updateThreshold(double modified_trend, double arrival_ms) {
+    if (_last_threshold_update_ms < 0) {
+        _last_threshold_update_ms = arrival_ms;
+    }
+    auto abs_trend = fabs(modified_trend);
+    if (abs_trend > _threshold + 15) {
+        //突发的大时延变化不参与阈值调整
+        _last_threshold_update_ms = arrival_ms;
+        return;
+    }
+    auto k = abs_trend < _threshold ? kThresholdDown : kThresholdUp;
+    auto time_delta_ms = MIN(arrival_ms - _last_threshold_update_ms, 100.0);
+    _threshold += k * (abs_trend - _threshold) * time_delta_ms;
+    _threshold = MIN(MAX(_threshold, 6.0), 600.0);
+    _last_threshold_update_ms = arrival_ms;
+}
+
+uint32_t GccEstimator::getAckedBitrate() const {
+    if (_acked.size() < 2) {
+        return 0;
+    }
+    auto span_us = _acked.back().first - _acked.front().first;
+    if (span_us < kAckedWindowUs / 2) {
+        //统计时长不足
+        return 0;
+    }
+    return (uint32_t)(_acked_bytes * 8 * 1000000 / span_us);
+}
+
+void GccEstimator::updateLinkCapacity(uint32_t acked_bitrate) {
+    //过载时的到达码率即为链路容量的一个样本
+    if (!_link_capacity) {
+        _link_capacity = acked_bitrate;
+        _link_capacity_dev = acked_bitrate * 0.1;
+        return;
+    }
+    _link_capacity_dev = 0.95 * _link_capacity_dev + 0.05 * fabs(acked_bitrate - _link_capacity);
+    _link_capacity = 0.95 * _link_capacity + 0.05 * acked_bitrate;
+}
+
+void GccEstimator::updateDelayBitrate(uint64_t now_us) {
+    static auto &s_overuse = Metrics::Instance().getCounter("zlm_webrtc_gcc_overuse_total", "", "Times the delay based estimator detected overuse");
+
+    auto acked_bitrate = getAckedBitrate();
+    switch (_usage) {
+        case BandwidthUsage::overusing: {
+            if (_rate_state != RateState::decrease && acked_bitrate) {
+                s_overuse.add();
+                updateLinkCapacity(acked_bitrate);
+                _delay_bitrate = MIN(_delay_bitrate, (uint32_t)(kDecreaseFactor * acked_bitrate));
+                _rate_state = RateState::decrease;
+                _last_decrease_us = now_us;
+            }
+            break;
+        }
+        case BandwidthUsage::underusing: {
+            //队列正在排空，保持码率
+            _rate_state = RateState::hold;
+            break;
+        }
+        default: {
+            _rate_state = RateState::increase;
+            break;
+        }
+    }
+
+    if (_rate_state == RateState::increase && _last_rate_update_us) {
+        auto elapsed_ms = MIN((now_us - _last_rate_update_us) / 1000.0, 1000.0);
+        if (_link_capacity && acked_bitrate > _link_capacity + 3 * _link_capacity_dev) {
+            //到达码率已经远超之前估计的链路容量，链路可能已经变化，重新探测
+            _link_capacity = 0;
+        }
+        double increase;
+        if (_link_capacity) {
+            //接近链路容量，每个响应时间增加一个包
+            auto avg_packet_bits = _acked.empty() ? 1200 * 8 : _acked_bytes * 8.0 / _acked.size();
+            increase = MAX(avg_packet_bits * 1000 / kResponseTimeMs, 4000.0) * elapsed_ms / 1000;
+        } else {
+            //远离链路容量，每秒增加8%
+            increase = MAX(_delay_bitrate * (pow(1.08, elapsed_ms / 1000) - 1), 1000.0 * elapsed_ms / 1000);
+        }
+        auto bitrate = _delay_bitrate + (uint32_t)increase;
+        if (acked_bitrate) {
+            //不超过实际到达码率太多，防止发送数据不足时码率无限增长；但也不因发送数据不足而降低码率
+            bitrate = MIN(bitrate, MAX(_delay_bitrate, (uint32_t)(1.5 * acked_bitrate) + 10000));
+        }
+        _delay_bitrate = bitrate;
+    } else if (_rate_state == RateState::decrease && now_us - _last_decrease_us > 1000 * kResponseTimeMs) {
+        //降码率后保持一个响应时间再恢复增长
+        _rate_state = RateState::hold;
+    }
+    _delay_bitrate = MIN(MAX(_delay_bitrate, _min_bitrate), _max_bitrate);
+    _last_rate_update_us = now_us;
+}
+
+void GccEstimator::updateLossBitrate(size_t lost, size_t total, uint64_t now_us) {
+    _loss_lost += lost;
+    _loss_total += total;
+    if (_loss_total < 20) {
+        //样本太少
+        return;
+    }
+    _loss_rate = (float)_loss_lost / _loss_total;
+    _loss_lost = _loss_total = 0;
+
+    if (_loss_rate < 0.02f) {
+        if (now_us - _last_loss_increase_us >= 1000 * 1000) {
+            _last_loss_increase_us = now_us;
+            //最多增加到基于时延的码率，防止长期无丢包时无限增长，出现丢包后迟迟降不下来
+            _loss_bitrate = (uint32_t)MIN(_loss_bitrate * 1.08 + 1000, (double)MAX(_loss_bitrate, _delay_bitrate));
+        }
+    } else if (_loss_rate > 0.1f) {
+        if (now_us - _last_loss_decrease_us >= 300 * 1000) {
+            _last_loss_decrease_us = now_us;
+            _loss_bitrate = (uint32_t)(_loss_bitrate * (1 - 0.5 * _loss_rate));
+        }
+    }
+    _loss_bitrate = MIN(MAX(_loss_bitrate, _min_bitrate), _max_bitrate);
+}
+
+void GccEstimator::updateTarget() {
+    static auto &s_target = Metrics::Instance().getHistogram("zlm_webrtc_gcc_target_bitrate_bps", "", "Target bitrate estimated for webrtc players on each feedback",
+                                                            { 100000, 300000, 500000, 1000000, 2000000, 4000000, 8000000 });
+    _target_bitrate = MIN(_delay_bitrate, _loss_bitrate);
+    s_target.observe(_target_bitrate);
+}
+
+string GccEstimator::dumpString() const {
+    _StrPrinter printer;
+    printer << "target:" << _target_bitrate << ", delay based:" << _delay_bitrate << ", loss based:" << _loss_bitrate
+            << ", acked:" << getAckedBitrate() << ", loss rate:" << _loss_rate << ", usage:" << (int)_usage
+            << ", threshold:" << _threshold;
+    return std::move(printer);
+}
+
+}// namespace mediakit
@@ -0,0 +1,166 @@
+﻿/*
+ * Copyright (c) 2016 The ZLMediaKit project authors. All Rights Reserved.
+ *
+ * This file is part of ZLMediaKit(https://github.com/xia-chu/ZLMediaKit).
+ *
+ * Use of this source code is governed by MIT license that can be found in the
+ * LICENSE file in the root of the source tree. All contributing project authors
+ * may be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef ZLMEDIAKIT_GCCESTIMATOR_H
+#define ZLMEDIAKIT_GCCESTIMATOR_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <string>
+
+namespace mediakit {
+
+class FCI_TWCC;
+
+/**
+ * 发送端带宽估计(google congestion control)，根据对端回复的transport-cc反馈估算可用带宽
+ * 由三部分组成:
+ *  基于时延: 按5ms发送间隔把包分组，计算相邻两组的单向时延变化，用趋势线(线性回归)滤波后与自适应阈值比较，判断过载/欠载；
+ *            再由AIMD控制码率，正常时乘性(每秒8%)或接近链路容量时加性增加，过载时降至实际到达码率的85%；
+ *  基于丢包: 丢包率低于2%时每秒增加8%，高于10%时按丢包率降低；
+ *  取两者较小值，并限制在rtc.gccMinBitRate与rtc.gccMaxBitRate之间。
+ * 参考 https://datatracker.ietf.org/doc/html/draft-ietf-rmcat-gcc-02
+ */
+class GccEstimator {
+public:
+    enum class BandwidthUsage : int {
+        normal = 0,
+        underusing,
+        overusing,
+    };
+
+    GccEstimator();
+    ~GccEstimator() = default;
+
+    /**
+     * 发送rtp时调用，记录发送时间与大小
+     * @param size rtp大小
+     * @param now_us 当前时间，单位微秒
+     * @return 分配给该包的transport-cc ext seq
+     */
+    uint16_t onSendRtp(size_t size, uint64_t now_us);
+
+    /**
+     * 收到transport-cc反馈
+     * @param fci twcc fci
+     * @param fci_size fci长度
+     * @param now_us 当前时间，单位微秒
+     */
+    void onTwccFeedback(const FCI_TWCC &fci, size_t fci_size, uint64_t now_us);
+
+    /**
+     * 目标码率，单位bit/s
+     */
+    uint32_t getTargetBitrate() const { return _target_bitrate; }
+
+    /**
+     * 对端实际收到的码率，单位bit/s，统计数据不足时为0
+     */
+    uint32_t getAckedBitrate() const;
+
+    /**
+     * 最近统计周期的丢包率，范围0~1
+     */
+    float getLossRate() const { return _loss_rate; }
+
+    BandwidthUsage getBandwidthUsage() const { return _usage; }
+
+    std::string dumpString() const;
+
+private:
+    class PacketResult {
+    public:
+        uint64_t send_us;
+        uint64_t arrival_us;
+        size_t size;
+    };
+
+    void onPacketResults(const std::vector<PacketResult> &results, uint64_t now_us);
+    void updateTrendline(double delay_delta_ms, double send_delta_ms, double arrival_ms);
+    void detect(double trend, double send_delta_ms, double arrival_ms);
+    void updateThreshold(double modified_trend, double arrival_ms);
+    void updateDelayBitrate(uint64_t now_us);
+    void updateLossBitrate(size_t lost, size_t total, uint64_t now_us);
+    void updateLinkCapacity(uint32_t acked_bitrate);
+    void updateTarget();
+
+private:
+    //发送记录，下标为transport-cc ext seq与_history_seq的差值
+    class SentPacket {
+    public:
+        uint64_t send_us;
+        size_t size;
+    };
+    uint16_t _next_seq = 0;
+    uint16_t _history_seq = 0;
+    std::deque<SentPacket> _history;
+    //已处理反馈的最大seq，防止重复反馈
+    bool _feedback_started = false;
+    uint16_t _feedback_seq = 0;
+
+    //按发送时间分组(5ms内发送的包为一组)
+    class PacketGroup {
+    public:
+        bool valid = false;
+        uint64_t first_send_us = 0;
+        uint64_t last_send_us = 0;
+        uint64_t arrival_us = 0;
+    };
+    PacketGroup _cur_group;
+    PacketGroup _prev_group;
+
+    //趋势线滤波
+    size_t _num_deltas = 0;
+    double _accumulated_delay = 0;
+    double _smoothed_delay = 0;
+    double _first_arrival_ms = -1;
+    std::deque<std::pair<double/*arrival ms*/, double/*smoothed delay*/> > _delay_samples;
+    double _prev_trend = 0;
+
+    //过载检测
+    double _threshold = 12.5;
+    double _last_threshold_update_ms = -1;
+    double _time_over_using = -1;
+    int _overuse_counter = 0;
+    BandwidthUsage _usage = BandwidthUsage::normal;
+
+    //AIMD码率控制
+    enum class RateState : int {
+        hold = 0,
+        increase,
+        decrease,
+    };
+    RateState _rate_state = RateState::increase;
+    uint32_t _delay_bitrate;
+    uint64_t _last_rate_update_us = 0;
+    uint64_t _last_decrease_us = 0;
+    double _link_capacity = 0;
+    double _link_capacity_dev = 0;
+
+    //到达码率统计
+    std::deque<std::pair<uint64_t/*arrival us*/, size_t/*size*/> > _acked;
+    size_t _acked_bytes = 0;
+
+    //基于丢包的码率控制
+    uint32_t _loss_bitrate;
+    size_t _loss_lost = 0;
+    size_t _loss_total = 0;
+    float _loss_rate = 0;
+    uint64_t _last_loss_increase_us = 0;
+    uint64_t _last_loss_decrease_us = 0;
+
+    uint32_t _min_bitrate;
+    uint32_t _max_bitrate;
+    uint32_t _target_bitrate;
+};
+
+}// namespace mediakit
+#endif //ZLMEDIAKIT_GCCESTIMATOR_H
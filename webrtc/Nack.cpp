@@ -9,6 +9,7 @@
  */
 
 #include "Nack.h"
+#include "Common/Metrics.h"
 
 //using namespace std;
 using namespace toolkit;
@@ -158,6 +159,8 @@ void NackContext::setOnNack(onNack cb) {
 }
 
 void NackContext::doNack(const FCI_NACK &nack, bool record_nack) {
+    static auto &s_nack_sent = Metrics::Instance().getCounter("zlm_webrtc_nack_sent_total", "", "RTCP NACK feedback sent to webrtc pushers");
+    s_nack_sent.add();
     if (record_nack) {
         recordNack(nack);
     }
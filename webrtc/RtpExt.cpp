@@ -329,6 +329,70 @@ uint16_t RtpExt::getTransportCCSeq() const {
     return ret;
 }
 
+void RtpExt::setTransportCCSeq(uint16_t seq) {
+    CHECK(_type == RtpExtType::transport_cc && size() >= 2);
+    auto ptr = (uint8_t *) _data;
+    ptr[0] = seq >> 8;
+    ptr[1] = seq & 0xFF;
+}
+
+bool RtpExt::appendTransportCC(RtpHeader *header, size_t &len, uint8_t ext_id, uint16_t seq) {
+    auto ext_ptr = &header->payload + header->getCsrcSize();
+    auto end = (uint8_t *) header + len;
+    if (!header->ext) {
+        //没有扩展头，新建扩展头(4字节)并写入transport-cc扩展(4字节)
+        memmove(ext_ptr + 8, ext_ptr, end - ext_ptr);
+        if (ext_id < (uint8_t) RtpExtType::reserved) {
+            ext_ptr[0] = kOneByteHeader >> 8;
+            ext_ptr[1] = kOneByteHeader & 0xFF;
+            ext_ptr[4] = ext_id << 4 | 1;
+            ext_ptr[5] = seq >> 8;
+            ext_ptr[6] = seq & 0xFF;
+            ext_ptr[7] = 0;
+        } else {
+            //id超过14只能使用two-byte扩展头
+            ext_ptr[0] = kTwoByteHeader >> 8;
+            ext_ptr[1] = kTwoByteHeader & 0xFF;
+            ext_ptr[4] = ext_id;
+            ext_ptr[5] = 2;
+            ext_ptr[6] = seq >> 8;
+            ext_ptr[7] = seq & 0xFF;
+        }
+        //扩展头长度为1个32位字
+        ext_ptr[2] = 0;
+        ext_ptr[3] = 1;
+        header->ext = 1;
+        len += 8;
+        return true;
+    }
+
+    uint8_t item[4];
+    auto reserved = header->getExtReserved();
+    if (reserved == kOneByteHeader && ext_id < (uint8_t) RtpExtType::reserved) {
+        item[0] = ext_id << 4 | 1;
+        item[1] = seq >> 8;
+        item[2] = seq & 0xFF;
+        item[3] = 0;
+    } else if ((reserved & 0xFFF0) == kTwoByteHeader) {
+        item[0] = ext_id;
+        item[1] = 2;
+        item[2] = seq >> 8;
+        item[3] = seq & 0xFF;
+    } else {
+        //不识别的扩展头格式
+        return false;
+    }
+    //在扩展头末尾追加4个字节，并修改扩展头长度
+    auto ext_words = header->getExtSize() / 4 + 1;
+    auto append_ptr = header->getExtData() + header->getExtSize();
+    memmove(append_ptr + 4, append_ptr, end - append_ptr);
+    memcpy(append_ptr, item, sizeof(item));
+    ext_ptr[2] = ext_words >> 8;
+    ext_ptr[3] = ext_words & 0xFF;
+    len += 4;
+    return true;
+}
+
 //https://tools.ietf.org/html/draft-ietf-avtext-sdes-hdr-ext-07
 //    0                   1                   2                   3
 //    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
@@ -54,6 +54,16 @@ public:
     static const std::string& getExtUrl(RtpExtType type);
     static const char *getExtName(RtpExtType type);
 
+    /**
+     * 在rtp扩展头末尾追加transport-cc扩展，没有扩展头时新建，调用者须保证buf有8个字节的剩余空间
+     * @param header rtp头
+     * @param len rtp长度，追加成功后增加
+     * @param ext_id 客户端sdp声明的transport-cc扩展id
+     * @param seq transport-cc ext seq
+     * @return 是否追加成功
+     */
+    static bool appendTransportCC(RtpHeader *header, size_t &len, uint8_t ext_id, uint16_t seq);
+
     void setType(RtpExtType type);
     RtpExtType getType() const;
     std::string dumpString() const;
@@ -61,6 +71,7 @@ public:
     uint8_t getAudioLevel(bool *vad) const;
     uint32_t getAbsSendTime() const;
     uint16_t getTransportCCSeq() const;
+    void setTransportCCSeq(uint16_t seq);
     std::string getSdesMid() const;
     std::string getRtpStreamId() const;
     std::string getRepairedRtpStreamId() const;
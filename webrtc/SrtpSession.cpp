@@ -235,6 +235,27 @@ bool SrtpSession::EncryptRtp(uint8_t *data, int *len) {
     return true;
 }
 
+size_t SrtpSession::EncryptRtpList(uint8_t **data, int *len, size_t count) {
+    MS_TRACE();
+    size_t ret = 0;
+    srtp_err_status_t last_err = srtp_err_status_ok;
+    for (size_t i = 0; i < count; ++i) {
+        srtp_err_status_t err = srtp_protect(this->session, static_cast<void *>(data[i]), len + i);
+        if (DepLibSRTP::IsError(err)) {
+            last_err = err;
+            len[i] = 0;
+            continue;
+        }
+        ++ret;
+    }
+
+    if (ret != count) {
+        // 整批只打印一次日志，避免大量丢包时日志拖慢发送
+        WarnL << "srtp_protect() failed:" << DepLibSRTP::GetErrorString(last_err) << ", count:" << count - ret << "/" << count;
+    }
+    return ret;
+}
+
 bool SrtpSession::DecryptSrtp(uint8_t *data, int *len) {
     MS_TRACE();
 
@@ -48,6 +48,9 @@ public:
 
 public:
     bool EncryptRtp(uint8_t *data, int *len);
+    // 批量加密一组rtp(通常为同一帧)，data与len一一对应，len为输入输出参数，加密失败的包len置为0
+    // 不分配内存，返回加密成功的个数
+    size_t EncryptRtpList(uint8_t **data, int *len, size_t count);
     bool DecryptSrtp(uint8_t *data, int *len);
     bool EncryptRtcp(uint8_t *data, int *len);
     bool DecryptSrtcp(uint8_t *data, int *len);
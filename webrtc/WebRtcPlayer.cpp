@@ -10,10 +10,24 @@
 
 #include "WebRtcPlayer.h"
 #include "Common/config.h"
+#include "Common/Metrics.h"
 
+using namespace std;
 
 namespace mediakit {
 
+namespace Rtc {
+#define RTC_FIELD "rtc."
+//源码率超过带宽估计的目标码率多少倍时，丢弃视频直到下一个关键帧，并向推流端请求关键帧；为0时关闭
+const string kGccSkipRatio = RTC_FIELD "gccSkipRatio";
+static onceToken token([]() {
+    mINI::Instance()[kGccSkipRatio] = 2;
+});
+}
+
+//从关键帧恢复发送后，至少发送这么久才会再次跳帧，单位毫秒
+static constexpr uint64_t kMinResumeMS = 2000;
+
 WebRtcPlayer::Ptr WebRtcPlayer::create(const EventPoller::Ptr &poller,
                                        const RtspMediaSource::Ptr &src,
                                        const MediaInfo &info,
@@ -32,7 +46,13 @@ WebRtcPlayer::WebRtcPlayer(const EventPoller::Ptr &poller,
                            bool perferred_tcp) : WebRtcTransportImp(poller,perferred_tcp) {
     _media_info = info;
     _play_src = src;
+    _weak_src = src;
     CHECK(_play_src);
+    for (auto &track : SdpParser(_play_src->getSdp()).getAvailableTrack()) {
+        if (track->_type == TrackVideo) {
+            _video_codec = getCodecId(track->_codec);
+        }
+    }
 }
 
 void WebRtcPlayer::onStartWebRTC() {
@@ -49,11 +69,8 @@ void WebRtcPlayer::onStartWebRTC() {
             if (!strong_self) {
                 return;
             }
-            size_t i = 0;
-            pkt->for_each([&](const RtpPacket::Ptr &rtp) {
-                // TraceL << getIdentifier() << " send " << rtp->dump() << " i:"<<i;
-                strong_self->onSendRtp(rtp, ++i == pkt->size());
-            });
+            // 整帧批量加密发送
+            strong_self->sendRtpList(pkt);
         });
         _reader->setDetachCB([weak_self]() {
             if (auto strong_self = weak_self.lock()) {
@@ -65,6 +82,70 @@ void WebRtcPlayer::onStartWebRTC() {
     _play_src = nullptr;
 }
 
+void WebRtcPlayer::sendRtpList(const RtspMediaSource::RingDataType &pkt) {
+    GET_CONFIG(float, skip_ratio, Rtc::kGccSkipRatio);
+    auto target_bitrate = getTargetBitrate();
+    if (skip_ratio <= 0 || !target_bitrate || !FrameDropper::canSkipToKey(_video_codec)) {
+        // 未开启跳帧、对端不支持transport-cc或者视频编码(vp8/vp9/av1等)无法判断关键帧
+        sendRtpList_l(*pkt);
+        return;
+    }
+
+    pkt->for_each([&](const RtpPacket::Ptr &rtp) { _src_speed += rtp->size(); });
+    auto src_bitrate = (uint64_t)_src_speed.getSpeed() * 8;
+    if (!_skip_to_key && _resume_ticker.elapsedTime() > kMinResumeMS && src_bitrate > target_bitrate * skip_ratio) {
+        // 带宽远低于源码率，继续发送只会让对端延时越来越大直至卡死，改为丢弃视频直到下一个关键帧
+        static auto &s_skip = Metrics::Instance().getCounter("zlm_viewer_skip_to_key_total", "schema=\"webrtc\"", "Times a congested viewer skipped to the next key frame");
+        s_skip.add();
+        _skip_to_key = true;
+        WarnL << "rtc播放器(" << _media_info.shortUrl() << ")带宽不足，跳至下一个关键帧, 源码率:" << src_bitrate
+              << ", 目标码率:" << target_bitrate;
+        if (auto src = _weak_src.lock()) {
+            src->requestKeyFrame();
+        }
+    }
+    if (!_skip_to_key) {
+        sendRtpList_l(*pkt);
+        return;
+    }
+
+    static auto &s_drop_packets = Metrics::Instance().getCounter("zlm_viewer_drop_packets_total", "schema=\"webrtc\",reason=\"skip_to_key\"", "Packets dropped for congested viewers");
+    static auto &s_drop_bytes = Metrics::Instance().getCounter("zlm_viewer_drop_bytes_total", "schema=\"webrtc\",reason=\"skip_to_key\"", "Bytes dropped for congested viewers");
+    _send_list.clear();
+    pkt->for_each([&](const RtpPacket::Ptr &rtp) {
+        if (rtp->type == TrackVideo && _skip_to_key) {
+            if (FrameDropper::getRtpKind(_video_codec, rtp->getPayload(), rtp->getPayloadSize()) != FrameDropper::kind_key_start) {
+                // 音频照常发送，视频丢弃
+                s_drop_packets.add();
+                s_drop_bytes.add(rtp->size());
+                _seq_rewriter.onDrop(rtp);
+                return;
+            }
+            // 关键帧到达，恢复发送
+            _skip_to_key = false;
+            _resume_ticker.resetTime();
+        }
+        _send_list.emplace_back(_seq_rewriter.rewrite(rtp));
+    });
+    if (!_send_list.empty()) {
+        onSendRtpList(_send_list);
+        _send_list.clear();
+    }
+}
+
+void WebRtcPlayer::sendRtpList_l(const List<RtpPacket::Ptr> &rtps) {
+    if (!_seq_rewriter.hasOffset()) {
+        // 从未跳帧，直接发送环形缓存中的包
+        onSendRtpList(rtps);
+        return;
+    }
+    // 跳帧后seq有偏移，后续的包都需要重写seq
+    _send_list.clear();
+    rtps.for_each([&](const RtpPacket::Ptr &rtp) { _send_list.emplace_back(_seq_rewriter.rewrite(rtp)); });
+    onSendRtpList(_send_list);
+    _send_list.clear();
+}
+
 void WebRtcPlayer::onDestory() {
     WebRtcTransportImp::onDestory();
 
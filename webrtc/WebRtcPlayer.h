@@ -13,6 +13,7 @@
 
 #include "WebRtcTransport.h"
 #include "Rtsp/RtspMediaSource.h"
+#include "Common/FrameDropper.h"
 
 namespace mediakit {
 
@@ -31,6 +32,10 @@ protected:
 
 private:
     WebRtcPlayer(const EventPoller::Ptr &poller, const RtspMediaSource::Ptr &src, const MediaInfo &info, bool perferred_tcp);
+    // 根据带宽估计结果决定是否跳帧，然后批量发送
+    void sendRtpList(const RtspMediaSource::RingDataType &pkt);
+    // 发送一组rtp包，跳帧后重写seq
+    void sendRtpList_l(const toolkit::List<RtpPacket::Ptr> &rtps);
 
 private:
     //媒体相关元数据
@@ -39,6 +44,20 @@ private:
     RtspMediaSource::Ptr _play_src;
     //播放rtsp源的reader对象
     RtspMediaSource::RingType::RingReader::Ptr _reader;
+    //播放的rtsp源弱引用，跳帧时用于请求关键帧
+    std::weak_ptr<RtspMediaSource> _weak_src;
+    //视频编码，跳帧时用于判断关键帧
+    CodecId _video_codec = CodecInvalid;
+    //带宽不足，正在丢弃视频直到下一个关键帧
+    bool _skip_to_key = false;
+    //源的码率统计(丢帧前)
+    toolkit::BytesSpeed _src_speed;
+    //上次从关键帧恢复发送后的时间
+    toolkit::Ticker _resume_ticker;
+    //跳帧时复用的发送列表
+    toolkit::List<RtpPacket::Ptr> _send_list;
+    //跳帧后重写seq，防止对端对主动丢弃的包发起nack
+    RtpSeqRewriter _seq_rewriter;
 };
 
 }// namespace mediakit
@@ -156,6 +156,17 @@ float WebRtcPusher::getLossRate(MediaSource &sender,TrackType type){
     return WebRtcTransportImp::getLossRate(type);
 }
 
+bool WebRtcPusher::requestKeyFrame(MediaSource &sender) {
+    // 播放器可能在其他线程，切换到本对象线程发送pli
+    std::weak_ptr<WebRtcPusher> weak_self = std::static_pointer_cast<WebRtcPusher>(shared_from_this());
+    getPoller()->async([weak_self]() {
+        if (auto strong_self = weak_self.lock()) {
+            strong_self->sendKeyFrameRequest();
+        }
+    }, false);
+    return true;
+}
+
 void WebRtcPusher::OnDtlsTransportClosed(const RTC::DtlsTransport *dtlsTransport) {
    //主动关闭推流，那么不等待重推
     _push_src = nullptr;
@@ -49,6 +49,8 @@ protected:
     toolkit::EventPoller::Ptr getOwnerPoller(MediaSource &sender) override;
     // 获取丢包率
     float getLossRate(MediaSource &sender,TrackType type) override;
+    // 请求关键帧
+    bool requestKeyFrame(MediaSource &sender) override;
 
 private:
     WebRtcPusher(const EventPoller::Ptr &poller, const RtspMediaSourceImp::Ptr &src,
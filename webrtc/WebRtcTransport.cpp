@@ -8,6 +8,7 @@
  * may be found in the AUTHORS file in the root of the source tree.
  */
 
+#include <set>
 #include <iostream>
 #include "Common/config.h"
 #include "RtpExt.h"
@@ -16,6 +17,7 @@
 #include "Rtcp/RtcpContext.h"
 #include "Rtsp/RtpReceiver.h"
 #include "WebRtcTransport.h"
+#include "Common/Metrics.h"
 
 #include "WebRtcEchoTest.h"
 #include "WebRtcPlayer.h"
@@ -381,8 +383,8 @@ void WebRtcTransport::inputSockData(char *buf, int len, RTC::TransportTuple *tup
 void WebRtcTransport::sendRtpPacket(const char *buf, int len, bool flush, void *ctx) {
     if (_srtp_session_send) {
         auto pkt = _packet_pool.obtain2();
-        // 预留rtx加入的两个字节
-        pkt->setCapacity((size_t)len + SRTP_MAX_TRAILER_LEN + 2);
+        // 预留rtx加入的两个字节与transport-cc扩展的8个字节
+        pkt->setCapacity((size_t)len + SRTP_MAX_TRAILER_LEN + 2 + 8);
         pkt->assign(buf, len);
         // 回调发送的明文Rtp数据
         onBeforeEncryptRtp(pkt->data(), len, ctx);
@@ -397,6 +399,46 @@ void WebRtcTransport::sendRtpPacket(const char *buf, int len, bool flush, void *
     }
 }
 
+void WebRtcTransport::sendRtpPacketList(const RtpBatchItem *items, size_t count) {
+    if (!_srtp_session_send || !count) {
+        return;
+    }
+    _batch_pkts.clear();
+    _batch_data.clear();
+    _batch_len.clear();
+    for (size_t i = 0; i < count; ++i) {
+        auto &item = items[i];
+        auto pkt = _packet_pool.obtain2();
+        // 预留rtx加入的两个字节与transport-cc扩展的8个字节
+        pkt->setCapacity((size_t)item.len + SRTP_MAX_TRAILER_LEN + 2 + 8);
+        pkt->assign(item.buf, item.len);
+        int len = item.len;
+        // 回调发送的明文Rtp数据
+        onBeforeEncryptRtp(pkt->data(), len, item.ctx);
+        if (dumpRtp1) TraceL << getIdentifier() <<  " sendRtp " << ((const RtpHeader*)item.buf)->dump(item.len);
+        _batch_data.emplace_back(reinterpret_cast<uint8_t *>(pkt->data()));
+        _batch_len.emplace_back(len);
+        _batch_pkts.emplace_back(std::move(pkt));
+    }
+
+    // 整批加密
+    _srtp_session_send->EncryptRtpList(_batch_data.data(), _batch_len.data(), count);
+
+    // 找到最后一个加密成功的包，在其发送后flush
+    size_t last = count;
+    while (last > 0 && _batch_len[last - 1] <= 0) {
+        --last;
+    }
+    for (size_t i = 0; i < last; ++i) {
+        if (_batch_len[i] <= 0) {
+            continue;
+        }
+        _batch_pkts[i]->setSize(_batch_len[i]);
+        onSendSockData(std::move(_batch_pkts[i]), i + 1 == last);
+    }
+    _batch_pkts.clear();
+}
+
 void WebRtcTransport::sendRtcpPacket(const char *buf, int len, bool flush, void *ctx) {
     if (dumpRtcp) TraceL << getIdentifier() <<  " sendRtcp " << ((const RtcpHeader*)buf)->dump(len);
     if (_srtp_session_send) {
@@ -469,6 +511,9 @@ void WebRtcTransportImp::onCreate(){
     }, getPoller());
 
     _twcc_ctx.setOnSendTwccCB([this](uint32_t ssrc, string fci) { onSendTwcc(ssrc, fci); });
+    if (PacketPacerBase::enabled()) {
+        _pacer = std::make_shared<PacketPacer<RtpPacket::Ptr>>(getPoller(), "webrtc", [this](const List<RtpPacket::Ptr> &rtps) { doSendRtpList(rtps); });
+    }
 }
 
 void WebRtcTransportImp::onDestory() {
@@ -495,6 +540,11 @@ void WebRtcTransportImp::setSession(Session::Ptr session) {
         InfoL << "rtc network changed: " << _selected_session->get_peer_ip() << ":" << _selected_session->get_peer_port()
               << " -> " << session->get_peer_ip() << ":" << session->get_peer_port() << ", id:" << getIdentifier();
     }
+    _send_batch.setIdentifier(getIdentifier() + "@" + session->get_peer_ip() + ":" + std::to_string(session->get_peer_port()));
+    // ice-tcp时同样批量发送，但不是sendmmsg，分开统计
+    _send_batch.setTransport(session->getSock()->sockType() == SockNum::Sock_TCP ? "tcp" : "udp");
+    // 非flush的包只加入发送队列，由onSendSockData在flush时一次性发送，只需在切换会话时设置一次
+    session->setSendFlushFlag(false);
     _selected_session = std::move(session);
     unrefSelf();
 }
@@ -506,6 +556,8 @@ void WebRtcTransportImp::onSendSockData(Buffer::Ptr buf, bool flush, RTC::Transp
     }
 
     // 一次性发送一帧的rtp数据，提高网络io性能
+    // 非flush的包只加入发送队列(见setSession)，flush时一次性发送(udp时为sendmmsg)，flush边界与PacketCache的合并写一致
+    // 只优化了发送侧，接收侧(recvmmsg、GSO以及推流数据的批量处理)仍逐包处理
     if (_selected_session->getSock()->sockType() == SockNum::Sock_TCP) {
         // 增加tcp两字节头
         auto len = buf->size();
@@ -515,9 +567,11 @@ void WebRtcTransportImp::onSendSockData(Buffer::Ptr buf, bool flush, RTC::Transp
         _selected_session->SockSender::send(tcp_len, 2);
     }
     _selected_session->send(std::move(buf));
+    _send_batch.onPacket();
 
     if (flush) {
         _selected_session->flushAll();
+        _send_batch.onFlush();
     }
 }
 
@@ -558,6 +612,14 @@ void WebRtcTransportImp::onStartWebRTC() {
         track->plan_rtp = &m_answer.plan[0];
         track->plan_rtx = m_answer.getRelatedRtxPlan(track->plan_rtp->pt);
         track->rtcp_context_send = std::make_shared<RtcpContextForSend>();
+        if (_answer_sdp->supportRtcpFb(SdpConst::kTWCCRtcpFb, m_answer.type)) {
+            // 对端支持transport-cc反馈，发送rtp时携带transport-cc扩展，用于发送端带宽估计
+            for (auto &ext : m_answer.extmap) {
+                if (RtpExt::getExtType(ext.ext) == RtpExtType::transport_cc) {
+                    track->twcc_ext_id = ext.id;
+                }
+            }
+        }
 
         // rtp track type --> MediaTrack
         if (m_answer.direction == RtpDirection::sendonly || m_answer.direction == RtpDirection::sendrecv) {
@@ -824,6 +886,24 @@ float WebRtcTransportImp::getLossRate(TrackType type) {
     return -1;
 }
 
+void WebRtcTransportImp::sendKeyFrameRequest() {
+    if (_pli_ticker.elapsedTime() < 500) {
+        // 防止多个播放器同时请求时频繁发送pli
+        return;
+    }
+    _pli_ticker.resetTime();
+    std::set<MediaTrack *> tracks;
+    for (auto &pr : _ssrc_to_track) {
+        auto &track = pr.second;
+        if (!track->media || track->media->type != TrackVideo || !tracks.emplace(track.get()).second) {
+            continue;
+        }
+        for (auto &chn : track->rtp_channel) {
+            sendRtcpPli(chn.second->getSSRC());
+        }
+    }
+}
+
 void WebRtcTransportImp::onRtcp(const char *buf, size_t len) {
     _bytes_usage += len;
     auto rtcps = RtcpHeader::loadFromBytes((char *)buf, len);
@@ -890,6 +970,12 @@ void WebRtcTransportImp::onRtcp(const char *buf, size_t len) {
             }
             // RTPFB
             switch ((RTPFBType)rtcp->count) {
+            case RTPFBType::RTCP_RTPFB_TWCC: {
+                // 对端汇报rtp到达情况，用于发送端带宽估计
+                RtcpFB *fb = (RtcpFB *)rtcp;
+                onRecvTwcc(fb->getFci<FCI_TWCC>(), fb->getFciSize());
+                break;
+            }
             case RTPFBType::RTCP_RTPFB_NACK: {
                 RtcpFB *fb = (RtcpFB *)rtcp;
                 auto it = _ssrc_to_track.find(fb->ssrc_media);
@@ -897,10 +983,14 @@ void WebRtcTransportImp::onRtcp(const char *buf, size_t len) {
                     WarnL << "未识别的 rtcp包:" << rtcp->dumpString();
                     return;
                 }
+                static auto &s_nack_received = Metrics::Instance().getCounter("zlm_webrtc_nack_received_total", "", "RTCP NACK feedback received from webrtc peers");
+                static auto &s_rtx_sent = Metrics::Instance().getCounter("zlm_webrtc_rtx_sent_total", "", "RTP packets retransmitted to webrtc peers");
+                s_nack_received.add();
                 auto &track = it->second;
                 auto &fci = fb->getFci<FCI_NACK>();
                 track->nack_list.forEach(fci, [&](const RtpPacket::Ptr &rtp) {
                     // rtp重传
+                    s_rtx_sent.add();
                     onSendRtp(rtp, true, true);
                 });
                 break;
@@ -1050,6 +1140,37 @@ void WebRtcTransportImp::onSendTwcc(uint32_t ssrc, const string &twcc_fci) {
     sendRtcpPacket((char *)rtcp.get(), rtcp->getSize(), true);
 }
 
+void WebRtcTransportImp::onRecvTwcc(const FCI_TWCC &fci, size_t fci_size) {
+    if (dumpRtcp) TraceL << getIdentifier() << " recv twcc " << fci.dumpString(fci_size);
+    _twcc_feedback = true;
+    _gcc.onTwccFeedback(fci, fci_size, getCurrentMicrosecond());
+    if (_pacer) {
+        // 按带宽估计结果平滑发送
+        _pacer->setTargetBitrate(_gcc.getTargetBitrate());
+    }
+    if (dumpRtcp) TraceL << getIdentifier() << " bandwidth estimate " << _gcc.dumpString();
+}
+
+uint32_t WebRtcTransportImp::getTargetBitrate() const {
+    return _twcc_feedback ? _gcc.getTargetBitrate() : 0;
+}
+
+void WebRtcTransportImp::addTransportCC(MediaTrack &track, RtpHeader *header, int &len, RtpExt &twcc_ext) {
+    if (!track.twcc_ext_id) {
+        return;
+    }
+    auto seq = _gcc.onSendRtp(len, getCurrentMicrosecond());
+    if (twcc_ext) {
+        // rtp已经携带transport-cc扩展(例如转发webrtc推流)，覆盖为本链路的序号
+        twcc_ext.setTransportCCSeq(seq);
+        return;
+    }
+    size_t size = len;
+    if (RtpExt::appendTransportCC(header, size, track.twcc_ext_id, seq)) {
+        len = size;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////
 
 void WebRtcTransportImp::onSortedRtp(MediaTrack &track, const string &rid, RtpPacket::Ptr rtp) {
@@ -1076,12 +1197,53 @@ WebRtcTransportImp::onSendRtp -> WebRtcTransport::sendRtpPacket
 */
 void WebRtcTransportImp::onSendRtp(const RtpPacket::Ptr &rtp, bool flush, bool rtx) {
     if (dumpRtp2) TraceL << getIdentifier() << " " << (rtx?"onSendRtx ":"onSendRtp ") << rtp->dump() << " flush:" << flush;
+    int len = rtp->size() - RtpPacket::kRtpTcpHeaderSize;
+    auto track = onBeforeSendRtp(rtp, len, rtx);
+    if (!track) {
+        return;
+    }
+    if (_pacer) {
+        // nack重传不排队，但是要消耗令牌，防止重传叠加在关键帧突发上
+        _pacer->onSendDirect(len);
+    }
+    std::pair<bool/*rtx*/, MediaTrack *> ctx{rtx, track};
+    sendRtpPacket(rtp->data() + RtpPacket::kRtpTcpHeaderSize, len, flush, &ctx);
+    _bytes_usage += len;
+}
+
+void WebRtcTransportImp::onSendRtpList(const List<RtpPacket::Ptr> &rtps) {
+    if (_pacer) {
+        _pacer->inputList(rtps);
+        return;
+    }
+    doSendRtpList(rtps);
+}
+
+void WebRtcTransportImp::doSendRtpList(const List<RtpPacket::Ptr> &rtps) {
+    _batch_items.clear();
+    _batch_ctx.clear();
+    // 预先分配，防止扩容导致已保存的ctx指针失效
+    _batch_ctx.reserve(rtps.size());
+    rtps.for_each([&](const RtpPacket::Ptr &rtp) {
+        if (dumpRtp2) TraceL << getIdentifier() << " onSendRtp " << rtp->dump();
+        int len = rtp->size() - RtpPacket::kRtpTcpHeaderSize;
+        auto track = onBeforeSendRtp(rtp, len, false);
+        if (!track) {
+            return;
+        }
+        _batch_ctx.emplace_back(false, track);
+        _batch_items.emplace_back(RtpBatchItem{rtp->data() + RtpPacket::kRtpTcpHeaderSize, len, &_batch_ctx.back()});
+        _bytes_usage += len;
+    });
+    sendRtpPacketList(_batch_items.data(), _batch_items.size());
+}
+
+MediaTrack *WebRtcTransportImp::onBeforeSendRtp(const RtpPacket::Ptr &rtp, int len, bool rtx) {
     auto &track = _type_to_track[rtp->type];
     if (!track) {
         // 忽略，对方不支持该编码类型
-        return;
+        return nullptr;
     }
-    int len = rtp->size() - RtpPacket::kRtpTcpHeaderSize;
     if (!rtx) {
         //统计rtp发送情况，好做sr汇报
         track->rtcp_context_send->onRtp(rtp->getSeq(), rtp->getStamp(), rtp->ntp_stamp, rtp->sample_rate, len);
@@ -1089,16 +1251,14 @@ void WebRtcTransportImp::onSendRtp(const RtpPacket::Ptr &rtp, bool flush, bool r
 #if 0
         //此处模拟发送丢包
         if (rtp->type == TrackVideo && rtp->getSeq() % 100 == 0) {
-            return;
+            return nullptr;
         }
 #endif
     } else {
         // 发送rtx重传包
         // TraceL << "send rtx rtp:" << rtp->getSeq();
     }
-    std::pair<bool/*rtx*/, MediaTrack *> ctx{rtx, track.get()};
-    sendRtpPacket(rtp->data() + RtpPacket::kRtpTcpHeaderSize, len, flush, &ctx);
-    _bytes_usage += len;
+    return track.get();
 }
 
 void WebRtcTransportImp::onBeforeEncryptRtp(const char *buf, int &len, void *ctx) {
@@ -1109,12 +1269,15 @@ void WebRtcTransportImp::onBeforeEncryptRtp(const char *buf, int &len, void *ctx
 
     if (!pr->first || !track->plan_rtx) {
         // 普通的rtp,或者不支持rtx, 修改目标pt和ssrc
-        track->rtp_ext_ctx->changeRtpExtId(header, false);
+        auto twcc_ext = track->rtp_ext_ctx->changeRtpExtId(header, false, nullptr, RtpExtType::transport_cc);
         header->pt = track->plan_rtp->pt;
         header->ssrc = htonl(track->answer_ssrc_rtp);
+        addTransportCC(*track, header, len, twcc_ext);
     } else {
         // 重传的rtp, rtx
-        track->rtp_ext_ctx->changeRtpExtId(header, false);
+        auto twcc_ext = track->rtp_ext_ctx->changeRtpExtId(header, false, nullptr, RtpExtType::transport_cc);
+        // 先追加transport-cc扩展，再在负载前插入osn
+        addTransportCC(*track, header, len, twcc_ext);
         header->pt = track->plan_rtx->pt;
         if (track->answer_ssrc_rtx) {
             // 有rtx单独的ssrc,有些情况下，浏览器支持rtx，但是未指定rtx单独的ssrc
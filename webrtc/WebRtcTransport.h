@@ -23,6 +23,9 @@
 #include "Network/Session.h"
 #include "Nack.h"
 #include "TwccContext.h"
+#include "GccEstimator.h"
+#include "Common/SendBatchStatistic.h"
+#include "Common/PacketPacer.h"
 #include "SctpAssociation.hpp"
 
 namespace mediakit {
@@ -113,6 +116,20 @@ public:
     void sendRtpPacket(const char *buf, int len, bool flush, void *ctx = nullptr);
     void sendRtcpPacket(const char *buf, int len, bool flush, void *ctx = nullptr);
 
+    class RtpBatchItem {
+    public:
+        const char *buf;
+        int len;
+        void *ctx;
+    };
+
+    /**
+     * 批量发送rtp，整批一次性加密后再发送，并且只在最后flush一次
+     * @param items rtp列表，ctx会透传给onBeforeEncryptRtp
+     * @param count rtp个数
+     */
+    void sendRtpPacketList(const RtpBatchItem *items, size_t count);
+
     const EventPoller::Ptr& getPoller() const;
 
 protected:
@@ -197,6 +214,10 @@ private:
     Ticker _ticker;
     // 循环池
     ResourcePool<BufferRaw> _packet_pool;
+    // 批量加密时复用的缓存，避免每次发送分配内存
+    std::vector<BufferRaw::Ptr> _batch_pkts;
+    std::vector<uint8_t *> _batch_data;
+    std::vector<int> _batch_len;
 
 #ifdef ENABLE_SCTP
     RTC::SctpAssociationImp::Ptr _sctp;
@@ -220,6 +241,8 @@ public:
 
     //for send rtp
     NackList nack_list;
+    //客户端声明的transport-cc扩展id，为0时发送rtp不携带transport-cc扩展
+    uint8_t twcc_ext_id = 0;
     std::shared_ptr<RtcpContext> rtcp_context_send;
 
     //for recv rtp
@@ -268,6 +291,10 @@ public:
 
     // 发送rtp数据包，带rtcp和nack功能
     void onSendRtp(const RtpPacket::Ptr &rtp, bool flush, bool rtx = false);
+    // 批量发送一组rtp(通常为环形缓存中的一帧)，开启pacer时经平滑后再整批加密，最后flush一次
+    void onSendRtpList(const toolkit::List<RtpPacket::Ptr> &rtps);
+    // 根据对端transport-cc反馈估算的发送目标码率(bit/s)，对端不支持transport-cc时返回0
+    uint32_t getTargetBitrate() const;
 protected:
     // rtp包经排序和nack后的数据回调
     virtual void onRecvRtp(MediaTrack &track, const std::string &rid, RtpPacket::Ptr rtp) = 0;
@@ -292,12 +319,20 @@ protected:
 
     void updateTicker();
     float getLossRate(TrackType type);
+    // 向推流端发送pli请求关键帧
+    void sendKeyFrameRequest();
     void onRtcpBye() override;
 
 private:
+    // 发送rtp前更新rtcp与nack上下文，返回nullptr代表对方不支持该track
+    MediaTrack *onBeforeSendRtp(const RtpPacket::Ptr &rtp, int len, bool rtx);
+    // 整批加密发送rtp，不经过pacer
+    void doSendRtpList(const toolkit::List<RtpPacket::Ptr> &rtps);
     void onSortedRtp(MediaTrack &track, const std::string &rid, RtpPacket::Ptr rtp);
     void onSendNack(MediaTrack &track, const FCI_NACK &nack, uint32_t ssrc);
     void onSendTwcc(uint32_t ssrc, const std::string &twcc_fci);
+    void onRecvTwcc(const FCI_TWCC &fci, size_t fci_size);
+    void addTransportCC(MediaTrack &track, RtpHeader *header, int &len, RtpExt &twcc_ext);
 
     void registerSelf();
     void unregisterSelf();
@@ -325,10 +360,21 @@ private:
 
     //twcc rtcp发送上下文对象
     TwccContext _twcc_ctx;
+    //是否收到过transport-cc反馈
+    bool _twcc_feedback = false;
+    //发送端带宽估计
+    GccEstimator _gcc;
+    //udp批量发送统计
+    SendBatchStatistic _send_batch { "webrtc" };
+    //发送平滑，关闭时为空
+    PacketPacer<RtpPacket::Ptr>::Ptr _pacer;
 
     //根据发送rtp的track类型获取相关信息
     MediaTrack::Ptr _type_to_track[2];
     uint16_t _rtx_seq[2] = {0, 0};
+    //批量发送rtp时复用的缓存
+    std::vector<RtpBatchItem> _batch_items;
+    std::vector<std::pair<bool/*rtx*/, MediaTrack *>> _batch_ctx;
 
     //根据rtcp的ssrc获取相关信息，收发rtp和rtx的ssrc都会记录
     std::unordered_map<uint32_t/*ssrc*/, MediaTrack::Ptr> _ssrc_to_track;